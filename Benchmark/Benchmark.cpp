@@ -0,0 +1,404 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#include "stdafx.h"
+#include "KeyedCollection.h"
+#include "../TrimImage/FlatMap.h"
+#include "../TrimImage/CHelper.h"
+#include <vector>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// this console program times the lookups TrimImage makes once per file
+// against the code they replaced, over a made up tree of scans the size
+// of a large job. KeyedCollection.h is the map of owned pointers that
+// CFlatMap replaced, and COldPath the _tsplitpath helpers that 
+// CHelper::SplitPath replaced, kept here only to be measured against
+
+/////////////////////////////////////////////////////////////////////////////
+// number of pathnames in the made up tree
+static const int m_nFiles = 200000;
+
+/////////////////////////////////////////////////////////////////////////////
+// number of times each test walks the pathnames
+static const int m_nPasses = 5;
+
+/////////////////////////////////////////////////////////////////////////////
+// start of the current measurement
+static LARGE_INTEGER m_liStart;
+
+/////////////////////////////////////////////////////////////////////////////
+// start a measurement
+void StartTimer()
+{
+	::QueryPerformanceCounter( &m_liStart );
+
+} // StartTimer
+
+/////////////////////////////////////////////////////////////////////////////
+// milliseconds since the measurement started
+double StopTimer()
+{
+	LARGE_INTEGER frequency, stop;
+	::QueryPerformanceFrequency( &frequency );
+	::QueryPerformanceCounter( &stop );
+
+	const double value =
+		1000.0 * double( stop.QuadPart - m_liStart.QuadPart ) /
+		double( frequency.QuadPart );
+	return value;
+
+} // StopTimer
+
+/////////////////////////////////////////////////////////////////////////////
+// display one line of results, the old time against the new one. The
+// counts are displayed so the optimizer cannot drop the work and so the
+// two sides can be seen to agree
+void Report
+(
+	LPCTSTR pcszTest, double dOld, double dNew, int nOld, int nNew
+)
+{
+	_tprintf
+	(
+		_T( "%-24s %10.2f ms %10.2f ms %6.2fx  (%d / %d)\n" ),
+		pcszTest, dOld, dNew, dNew > 0 ? dOld / dNew : 0.0, nOld, nNew
+	);
+
+} // Report
+
+/////////////////////////////////////////////////////////////////////////////
+// the pathname helpers CHelper had before SplitPath, each of which copies
+// the pathname and splits all of it into four buffers to return one piece
+class COldPath
+{
+public:
+	// parse the filename from a pathname
+	static CString GetFileName( LPCTSTR pcszPath )
+	{
+		CString csPath( pcszPath );
+		TCHAR* pBuf = csPath.GetBuffer( csPath.GetLength() + 1 );
+		TCHAR szDrive[ _MAX_DRIVE ];
+		TCHAR szDir[ _MAX_DIR ];
+		TCHAR szFile[ _MAX_FNAME ];
+		TCHAR szExt[ _MAX_EXT ];
+
+		_tsplitpath( pBuf, szDrive, szDir, szFile, szExt );
+		csPath.ReleaseBuffer();
+		return szFile;
+	}
+
+	// parse the extension from a pathname
+	static CString GetExtension( LPCTSTR pcszPath )
+	{
+		CString csPath( pcszPath );
+		TCHAR* pBuf = csPath.GetBuffer( csPath.GetLength() + 1 );
+		TCHAR szDrive[ _MAX_DRIVE ];
+		TCHAR szDir[ _MAX_DIR ];
+		TCHAR szFile[ _MAX_FNAME ];
+		TCHAR szExt[ _MAX_EXT ];
+
+		_tsplitpath( pBuf, szDrive, szDir, szFile, szExt );
+		csPath.ReleaseBuffer();
+		return szExt;
+	}
+
+	// parse the directory from a pathname
+	static CString GetDirectory( LPCTSTR pcszPath )
+	{
+		CString csPath( pcszPath );
+		TCHAR* pBuf = csPath.GetBuffer( csPath.GetLength() + 1 );
+		TCHAR szDrive[ _MAX_DRIVE ];
+		TCHAR szDir[ _MAX_DIR ];
+		TCHAR szFile[ _MAX_FNAME ];
+		TCHAR szExt[ _MAX_EXT ];
+
+		_tsplitpath( pBuf, szDrive, szDir, szFile, szExt );
+		csPath.ReleaseBuffer();
+		return szDir;
+	}
+
+	// parse the drive from a pathname
+	static CString GetDrive( LPCTSTR pcszPath )
+	{
+		CString csPath( pcszPath );
+		TCHAR* pBuf = csPath.GetBuffer( csPath.GetLength() + 1 );
+		TCHAR szDrive[ _MAX_DRIVE ];
+		TCHAR szDir[ _MAX_DIR ];
+		TCHAR szFile[ _MAX_FNAME ];
+		TCHAR szExt[ _MAX_EXT ];
+
+		_tsplitpath( pBuf, szDrive, szDir, szFile, szExt );
+		csPath.ReleaseBuffer();
+		return szDrive;
+	}
+
+	// parse folder from a pathname (drive and directory)
+	static CString GetFolder( LPCTSTR pcszPath )
+	{
+		CString csDrive = GetDrive( pcszPath );
+		CString csDir = GetDirectory( pcszPath );
+		return csDrive + csDir;
+	}
+
+	// parse data name from a pathname (filename and extension)
+	static CString GetDataName( LPCTSTR pcszPath )
+	{
+		CString csFile = GetFileName( pcszPath );
+		CString csExt = GetExtension( pcszPath );
+		return csFile + csExt;
+	}
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// pathnames of a made up tree of scans, boxes of folders of pages with the
+// mix of extensions a scanning job turns up
+vector<CString> BuildPaths()
+{
+	static const LPCTSTR Extensions[] =
+	{
+		_T( ".jpg" ), _T( ".jpg" ), _T( ".jpg" ), _T( ".tif" ),
+		_T( ".png" ), _T( ".jpeg" ), _T( ".bmp" ), _T( ".txt" )
+	};
+	const int nExtensions = _countof( Extensions );
+
+	vector<CString> value;
+	value.reserve( m_nFiles );
+	CString csPath;
+	for ( int nFile = 0; nFile < m_nFiles; nFile++ )
+	{
+		csPath.Format
+		(
+			_T( "D:\\Scans\\Box %04d\\Folder %03d\\Page %06d%s" ),
+			nFile / 5000, ( nFile / 100 ) % 50, nFile,
+			Extensions[ nFile % nExtensions ]
+		);
+		value.push_back( csPath );
+	}
+
+	return value;
+
+} // BuildPaths
+
+/////////////////////////////////////////////////////////////////////////////
+// the extension of each pathname, the key TrimImage looks up per file
+vector<CString> BuildExtensions( const vector<CString>& arrPaths )
+{
+	vector<CString> value;
+	value.reserve( arrPaths.size() );
+	for ( const CString& csPath : arrPaths )
+	{
+		value.push_back( csPath.Mid( csPath.ReverseFind( _T( '.' ) ) ) );
+	}
+
+	return value;
+
+} // BuildExtensions
+
+/////////////////////////////////////////////////////////////////////////////
+// look up the mime type of each extension in the table of eleven supported
+// ones, the old way through Exists[] and then find() the way
+// CExtension::SetFileExtension did, and the new way in a single probe of
+// a frozen flat map
+void BenchmarkExtensions( const vector<CString>& arrExtensions )
+{
+	static const LPCTSTR Lookup[][ 2 ] =
+	{
+		{ _T( ".bmp" ), _T( "image/bmp" ) },
+		{ _T( ".dib" ), _T( "image/bmp" ) },
+		{ _T( ".rle" ), _T( "image/bmp" ) },
+		{ _T( ".gif" ), _T( "image/gif" ) },
+		{ _T( ".jpeg" ), _T( "image/jpeg" ) },
+		{ _T( ".jpg" ), _T( "image/jpeg" ) },
+		{ _T( ".jpe" ), _T( "image/jpeg" ) },
+		{ _T( ".jfif" ), _T( "image/jpeg" ) },
+		{ _T( ".png" ), _T( "image/png" ) },
+		{ _T( ".tiff" ), _T( "image/tiff" ) },
+		{ _T( ".tif" ), _T( "image/tiff" ) }
+	};
+	const int nPairs = _countof( Lookup );
+
+	CKeyedCollection<CString, CString> mapOld;
+	CFlatMap<CString, CString> mapNew;
+	for ( int nPair = 0; nPair < nPairs; nPair++ )
+	{
+		const CString csKey( Lookup[ nPair ][ 0 ] );
+		const CString csValue( Lookup[ nPair ][ 1 ] );
+		mapOld.add( csKey, new CString( csValue ) );
+		mapNew.add( csKey, csValue );
+	}
+	mapNew.freeze();
+
+	int nOld = 0;
+	StartTimer();
+	for ( int nPass = 0; nPass < m_nPasses; nPass++ )
+	{
+		for ( const CString& csExtension : arrExtensions )
+		{
+			if ( mapOld.Exists[ csExtension ] )
+			{
+				nOld += mapOld.find( csExtension )->GetLength();
+			}
+		}
+	}
+	const double dOld = StopTimer();
+
+	int nNew = 0;
+	StartTimer();
+	for ( int nPass = 0; nPass < m_nPasses; nPass++ )
+	{
+		for ( const CString& csExtension : arrExtensions )
+		{
+			const CString* pValue = mapNew.find( csExtension );
+			if ( pValue != nullptr )
+			{
+				nNew += pValue->GetLength();
+			}
+		}
+	}
+	const double dNew = StopTimer();
+
+	Report( _T( "Extension lookups" ), dOld, dNew, nOld, nNew );
+
+} // BenchmarkExtensions
+
+/////////////////////////////////////////////////////////////////////////////
+// build a map keyed by every pathname of the tree and look each one up
+// again, the way a table of files seen (the crop plan or the files handed
+// over while watching) grows with the size of a job
+void BenchmarkPaths( const vector<CString>& arrPaths )
+{
+	CKeyedCollection<CString, int> mapOld;
+	int nOld = 0;
+	StartTimer();
+	for ( const CString& csPath : arrPaths )
+	{
+		mapOld.add( csPath, new int( nOld++ ) );
+	}
+	const double dOldBuild = StopTimer();
+
+	CFlatMap<CString, int> mapNew;
+	int nNew = 0;
+	StartTimer();
+	for ( const CString& csPath : arrPaths )
+	{
+		mapNew.add( csPath, nNew++ );
+	}
+	const double dNewBuild = StopTimer();
+
+	Report( _T( "Pathname map build" ), dOldBuild, dNewBuild, nOld, nNew );
+	mapNew.freeze();
+
+	nOld = 0;
+	StartTimer();
+	for ( int nPass = 0; nPass < m_nPasses; nPass++ )
+	{
+		for ( const CString& csPath : arrPaths )
+		{
+			if ( mapOld.Exists[ csPath ] )
+			{
+				nOld += *mapOld.find( csPath ) & 1;
+			}
+		}
+	}
+	const double dOld = StopTimer();
+
+	nNew = 0;
+	StartTimer();
+	for ( int nPass = 0; nPass < m_nPasses; nPass++ )
+	{
+		for ( const CString& csPath : arrPaths )
+		{
+			const int* pValue = mapNew.find( csPath );
+			if ( pValue != nullptr )
+			{
+				nNew += *pValue & 1;
+			}
+		}
+	}
+	const double dNew = StopTimer();
+
+	Report( _T( "Pathname lookups" ), dOld, dNew, nOld, nNew );
+
+} // BenchmarkPaths
+
+/////////////////////////////////////////////////////////////////////////////
+// take each pathname apart the way ProcessImage and Save do per file, for
+// the folder, the data name and the extension. The old helpers split the
+// pathname five times into new strings, where SplitPath splits it once
+// into slices of the pathname
+void BenchmarkSplitPath( const vector<CString>& arrPaths )
+{
+	int nOld = 0;
+	StartTimer();
+	for ( int nPass = 0; nPass < m_nPasses; nPass++ )
+	{
+		for ( const CString& csPath : arrPaths )
+		{
+			const CString csFolder = COldPath::GetFolder( csPath );
+			const CString csDataName = COldPath::GetDataName( csPath );
+			const CString csExtension = COldPath::GetExtension( csPath );
+			nOld += 
+				csFolder.GetLength() + csDataName.GetLength() + 
+				csExtension.GetLength();
+		}
+	}
+	const double dOld = StopTimer();
+
+	int nNew = 0;
+	StartTimer();
+	for ( int nPass = 0; nPass < m_nPasses; nPass++ )
+	{
+		for ( const CString& csPath : arrPaths )
+		{
+			const CHelper::PATH_PARTS parts = CHelper::SplitPath( csPath );
+			nNew += 
+				parts.m_Drive.Length + parts.m_Directory.Length +
+				parts.m_FileName.Length + parts.m_Extension.Length +
+				parts.m_Extension.Length;
+		}
+	}
+	const double dNew = StopTimer();
+
+	Report( _T( "Pathname splits" ), dOld, dNew, nOld, nNew );
+
+} // BenchmarkSplitPath
+
+/////////////////////////////////////////////////////////////////////////////
+// This is a console application that times the per file lookups and
+// pathname splits of TrimImage, old against new. Build and run it in the Release
+// configuration; the Debug timings mean little
+int _tmain( int argc, TCHAR* argv[], TCHAR* envp[] )
+{
+	HMODULE hModule = ::GetModuleHandle( NULL );
+	if ( hModule == NULL )
+	{
+		_tprintf( _T( "Fatal Error: GetModuleHandle failed\n" ) );
+		return 1;
+	}
+
+	// initialize MFC and error on failure
+	if ( !AfxWinInit( hModule, NULL, ::GetCommandLine(), 0 ) )
+	{
+		_tprintf( _T( "Fatal Error: MFC initialization failed\n " ) );
+		return 2;
+	}
+
+	const vector<CString> arrPaths = BuildPaths();
+	const vector<CString> arrExtensions = BuildExtensions( arrPaths );
+
+	_tprintf
+	(
+		_T( "%d pathnames, %d passes\n%-24s %13s %13s %7s\n" ),
+		m_nFiles, m_nPasses, _T( "Test" ), _T( "Old" ), _T( "New" ),
+		_T( "Speedup" )
+	);
+
+	BenchmarkExtensions( arrExtensions );
+	BenchmarkPaths( arrPaths );
+	BenchmarkSplitPath( arrPaths );
+
+	return 0;
+
+} // _tmain
@@ -0,0 +1,5 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#include "stdafx.h"
+
@@ -0,0 +1,799 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+#include "Inflate.h"
+#include <vector>
+#include <algorithm>
+#include <new>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// this class reads the files out of a tar or zip archive one at a time,
+// front to back, so a batch that arrives as an archive can be processed
+// without extracting it to disk first. The archive is read through a
+// large buffer with the big entries read straight into their own memory.
+// Tar entries may use pax or GNU long names, and zip entries may be
+// stored or deflated (zip64 included), where the central directory is
+// read first and the entries are then read in the order they sit in the
+// file. Folders, links and encrypted entries are passed over, as are
+// entries whose declared sizes run past the end of the archive or past
+// MAX_ENTRY, or whose data does not match its CRC-32
+class CArchiveReader
+{
+// public definitions
+public:
+	// the kind of archive
+	typedef enum
+	{
+		ARCHIVE_NONE,
+		ARCHIVE_TAR,
+		ARCHIVE_ZIP
+
+	} ARCHIVE_TYPE;
+
+// protected definitions
+protected:
+	// an entry of the zip central directory
+	typedef struct tagZipEntry
+	{
+		// name of the entry
+		CString m_csName;
+
+		// where the local header of the entry starts
+		ULONGLONG m_ullOffset;
+
+		// bytes of compressed data
+		ULONGLONG m_ullCompressed;
+
+		// bytes once it is decompressed
+		ULONGLONG m_ullSize;
+
+		// compression method (0 is stored and 8 is deflated)
+		WORD m_wMethod;
+
+		// general purpose flags (bit 0 is encrypted)
+		WORD m_wFlags;
+
+		// CRC-32 of the decompressed data
+		DWORD m_dwCrc;
+
+	} ZIP_ENTRY;
+
+	// bytes read from the archive at once
+	static const size_t BUFFER = 4 << 20;
+
+	// size of a tar block
+	static const UINT BLOCK = 512;
+
+	// the largest entry read into memory, which no image comes near
+	static const ULONGLONG MAX_ENTRY = 1ULL << 30;
+
+	// the largest pax header or GNU long name
+	static const ULONGLONG MAX_HEADER = 1 << 20;
+
+// protected data
+protected:
+	// the archive
+	HANDLE m_hFile;
+
+	// size of the archive
+	ULONGLONG m_ullFileSize;
+
+	// where the file pointer of the archive is
+	ULONGLONG m_ullFilePointer;
+
+	// bytes read from the archive ahead of the entries, which end at the
+	// file pointer
+	vector<BYTE> m_arrBuffer;
+
+	// the next byte of the buffer
+	size_t m_nStart;
+
+	// number of bytes in the buffer
+	size_t m_nEnd;
+
+	// the kind of archive
+	ARCHIVE_TYPE m_type;
+
+	// entries of a zip archive in the order they sit in the file
+	vector<ZIP_ENTRY> m_arrZipEntries;
+
+	// the next entry of a zip archive
+	size_t m_nZipEntry;
+
+	// compressed data of a zip entry
+	vector<BYTE> m_arrCompressed;
+
+	// number of entries passed over because they could not be read
+	ULONGLONG m_ullSkipped;
+
+// public properties
+public:
+	// the kind of archive
+	inline ARCHIVE_TYPE GetType()
+	{
+		return m_type;
+	}
+	// the kind of archive
+	__declspec( property( get = GetType ) )
+		ARCHIVE_TYPE Type;
+
+	// number of entries passed over because they could not be read
+	inline ULONGLONG GetSkipped()
+	{
+		return m_ullSkipped;
+	}
+	// number of entries passed over because they could not be read
+	__declspec( property( get = GetSkipped ) )
+		ULONGLONG Skipped;
+
+// protected methods
+protected:
+	// the offset of the next byte to be read
+	inline ULONGLONG GetPosition()
+	{
+		return m_ullFilePointer - m_nEnd + m_nStart;
+	}
+
+	// read the given number of bytes, large reads skip the buffer
+	// returns false if the archive ends first
+	bool Read( BYTE* pData, size_t nSize )
+	{
+		const size_t nBuffered = min( m_nEnd - m_nStart, nSize );
+		memcpy( pData, m_arrBuffer.data() + m_nStart, nBuffered );
+		m_nStart += nBuffered;
+		pData += nBuffered;
+		nSize -= nBuffered;
+		if ( nSize == 0 )
+		{
+			return true;
+		}
+
+		// the buffer is empty now
+		m_nStart = 0;
+		m_nEnd = 0;
+		if ( nSize >= BUFFER / 2 )
+		{
+			while ( nSize > 0 )
+			{
+				const DWORD dwChunk = DWORD( min( nSize, size_t( 16 << 20 ) ) );
+				DWORD dwRead = 0;
+				if
+				(
+					!::ReadFile( m_hFile, pData, dwChunk, &dwRead, NULL ) ||
+					dwRead == 0
+				)
+				{
+					return false;
+				}
+				m_ullFilePointer += dwRead;
+				pData += dwRead;
+				nSize -= dwRead;
+			}
+			return true;
+		}
+
+		DWORD dwRead = 0;
+		if ( !::ReadFile( m_hFile, &m_arrBuffer[ 0 ], DWORD( BUFFER ), &dwRead, NULL ) )
+		{
+			return false;
+		}
+		m_ullFilePointer += dwRead;
+		m_nEnd = dwRead;
+		if ( m_nEnd < nSize )
+		{
+			return false;
+		}
+
+		memcpy( pData, &m_arrBuffer[ 0 ], nSize );
+		m_nStart = nSize;
+		return true;
+	}
+
+	// bytes of the archive after the next one to be read
+	inline ULONGLONG GetRemaining()
+	{
+		const ULONGLONG ullPosition = GetPosition();
+		return ullPosition < m_ullFileSize ? m_ullFileSize - ullPosition : 0;
+	}
+
+	// size the memory of an entry
+	// returns false if there is not enough memory
+	static bool Allocate( vector<BYTE>& data, size_t nSize )
+	{
+		try
+		{
+			data.resize( nSize );
+		}
+		catch ( const bad_alloc& )
+		{
+			data.clear();
+			data.shrink_to_fit();
+			return false;
+		}
+		return true;
+	}
+
+	// move to the given offset, which stays inside the buffer if it can
+	bool Seek( ULONGLONG ullOffset )
+	{
+		const ULONGLONG ullBuffer = m_ullFilePointer - m_nEnd;
+		if ( ullOffset >= ullBuffer && ullOffset <= m_ullFilePointer )
+		{
+			m_nStart = size_t( ullOffset - ullBuffer );
+			return true;
+		}
+
+		LARGE_INTEGER position;
+		position.QuadPart = LONGLONG( ullOffset );
+		if ( !::SetFilePointerEx( m_hFile, position, NULL, FILE_BEGIN ) )
+		{
+			return false;
+		}
+		m_ullFilePointer = ullOffset;
+		m_nStart = 0;
+		m_nEnd = 0;
+		return true;
+	}
+
+	// a little endian number of the given number of bytes
+	static inline ULONGLONG GetNumber( const BYTE* pData, int nBytes )
+	{
+		ULONGLONG value = 0;
+		for ( int nByte = nBytes - 1; nByte >= 0; nByte-- )
+		{
+			value = ( value << 8 ) | pData[ nByte ];
+		}
+		return value;
+	}
+
+	// a number of a tar header in octal, or in base 256 when the first
+	// byte has its top bit set
+	static ULONGLONG GetTarNumber( const BYTE* pField, int nWidth )
+	{
+		ULONGLONG value = 0;
+		if ( pField[ 0 ] & 0x80 )
+		{
+			value = pField[ 0 ] & 0x7F;
+			for ( int nByte = 1; nByte < nWidth; nByte++ )
+			{
+				value = ( value << 8 ) | pField[ nByte ];
+			}
+			return value;
+		}
+
+		for ( int nByte = 0; nByte < nWidth; nByte++ )
+		{
+			const BYTE ch = pField[ nByte ];
+			if ( ch >= '0' && ch <= '7' )
+			{
+				value = ( value << 3 ) | ( ch - '0' );
+			}
+			else if ( ch != ' ' || value != 0 )
+			{
+				break;
+			}
+		}
+		return value;
+	}
+
+	// a name given in UTF-8 that may not be null terminated
+	static CString GetName( const BYTE* pName, size_t nLength )
+	{
+		size_t nEnd = 0;
+		while ( nEnd < nLength && pName[ nEnd ] != 0 )
+		{
+			nEnd++;
+		}
+		const CStringA csName( (LPCSTR)pName, int( nEnd ) );
+		return CString( CA2W( csName, CP_UTF8 ) );
+	}
+
+	// is the header block the one of a tar archive
+	static bool IsTarHeader( const BYTE* pHeader )
+	{
+		UINT uiSum = 0;
+		for ( UINT uiByte = 0; uiByte < BLOCK; uiByte++ )
+		{
+			uiSum += uiByte >= 148 && uiByte < 156 ? ' ' : pHeader[ uiByte ];
+		}
+		return uiSum == UINT( GetTarNumber( pHeader + 148, 8 ) );
+	}
+
+	// the next file of a tar archive
+	bool NextTar( CString& csName, vector<BYTE>& data )
+	{
+		CString csLongName;
+		BYTE arrHeader[ BLOCK ];
+		do
+		{
+			if ( !Read( arrHeader, BLOCK ) )
+			{
+				return false;
+			}
+
+			// the archive ends with empty blocks
+			if ( arrHeader[ 0 ] == 0 || !IsTarHeader( arrHeader ) )
+			{
+				return false;
+			}
+
+			// an entry cannot be larger than the rest of the archive, and
+			// the entries after a damaged size cannot be found, but the 
+			// padding of the last entry may be missing
+			const ULONGLONG ullSize = GetTarNumber( arrHeader + 124, 12 );
+			const BYTE type = arrHeader[ 156 ];
+			if ( ullSize > GetRemaining() )
+			{
+				m_ullSkipped++;
+				return false;
+			}
+			const ULONGLONG ullPadded =
+				min( ( ullSize + BLOCK - 1 ) / BLOCK * BLOCK, GetRemaining() );
+
+			// a pax header holds records of "length key=value\n", and a
+			// GNU long name is the name itself
+			if ( type == 'x' || type == 'L' )
+			{
+				vector<BYTE> arrRecords;
+				if
+				(
+					ullSize > MAX_HEADER ||
+					!Allocate( arrRecords, size_t( ullPadded ) + 1 )
+				)
+				{
+					m_ullSkipped++;
+					csLongName.Empty();
+					if ( !Seek( GetPosition() + ullPadded ) )
+					{
+						return false;
+					}
+					continue;
+				}
+				if ( ullPadded > 0 && !Read( &arrRecords[ 0 ], size_t( ullPadded ) ) )
+				{
+					return false;
+				}
+				if ( type == 'L' )
+				{
+					csLongName = GetName( &arrRecords[ 0 ], size_t( ullSize ) );
+					continue;
+				}
+
+				size_t nRecord = 0;
+				while ( nRecord < ullSize )
+				{
+					const size_t nLength = size_t( atoi( (LPCSTR)&arrRecords[ nRecord ] ) );
+					if ( nLength == 0 || nRecord + nLength > ullSize )
+					{
+						break;
+					}
+					const CStringA csRecord
+					(
+						(LPCSTR)&arrRecords[ nRecord ], int( nLength - 1 )
+					);
+					const int nKey = csRecord.Find( " path=" );
+					if ( nKey != -1 )
+					{
+						const CStringA csPath = csRecord.Mid( nKey + 6 );
+						csLongName = CString( CA2W( csPath, CP_UTF8 ) );
+					}
+					nRecord += nLength;
+				}
+				continue;
+			}
+
+			// only regular files are wanted
+			if ( type != '0' && type != 0 && type != '7' )
+			{
+				if ( !Seek( GetPosition() + ullPadded ) )
+				{
+					return false;
+				}
+				csLongName.Empty();
+				continue;
+			}
+
+			csName = csLongName;
+			if ( csName.IsEmpty() )
+			{
+				csName = GetName( arrHeader, 100 );
+				if ( memcmp( arrHeader + 257, "ustar", 5 ) == 0 && arrHeader[ 345 ] != 0 )
+				{
+					csName = GetName( arrHeader + 345, 155 ) + _T( "/" ) + csName;
+				}
+			}
+
+			if ( ullSize > MAX_ENTRY || !Allocate( data, size_t( ullSize ) ) )
+			{
+				m_ullSkipped++;
+				csLongName.Empty();
+				if ( !Seek( GetPosition() + ullPadded ) )
+				{
+					return false;
+				}
+				continue;
+			}
+			if ( ullSize > 0 && !Read( &data[ 0 ], size_t( ullSize ) ) )
+			{
+				return false;
+			}
+			return Seek( GetPosition() + ullPadded - ullSize );
+
+		} while ( true );
+	}
+
+	// read the central directory of a zip archive
+	// returns false if it cannot be found or read
+	bool ReadZipDirectory()
+	{
+		// the end of central directory record is in the last 64K or so
+		const size_t nTail = size_t( min( m_ullFileSize, ULONGLONG( 65536 + 22 ) ) );
+		vector<BYTE> arrTail( nTail );
+		if
+		(
+			nTail < 22 ||
+			!Seek( m_ullFileSize - nTail ) || !Read( &arrTail[ 0 ], nTail )
+		)
+		{
+			return false;
+		}
+
+		size_t nEnd = nTail;
+		for ( size_t nByte = nTail - 22 + 1; nByte-- > 0; )
+		{
+			if ( memcmp( &arrTail[ nByte ], "PK\x05\x06", 4 ) == 0 )
+			{
+				nEnd = nByte;
+				break;
+			}
+		}
+		if ( nEnd == nTail )
+		{
+			return false;
+		}
+
+		ULONGLONG ullEntries = GetNumber( &arrTail[ nEnd + 10 ], 2 );
+		ULONGLONG ullDirectorySize = GetNumber( &arrTail[ nEnd + 12 ], 4 );
+		ULONGLONG ullDirectory = GetNumber( &arrTail[ nEnd + 16 ], 4 );
+
+		// a zip64 archive points to its own end record just before
+		if
+		(
+			nEnd >= 20 &&
+			memcmp( &arrTail[ nEnd - 20 ], "PK\x06\x07", 4 ) == 0
+		)
+		{
+			BYTE arrRecord[ 56 ];
+			if
+			(
+				!Seek( GetNumber( &arrTail[ nEnd - 20 + 8 ], 8 ) ) ||
+				!Read( arrRecord, sizeof( arrRecord ) ) ||
+				memcmp( arrRecord, "PK\x06\x06", 4 ) != 0
+			)
+			{
+				return false;
+			}
+			ullEntries = GetNumber( arrRecord + 32, 8 );
+			ullDirectorySize = GetNumber( arrRecord + 40, 8 );
+			ullDirectory = GetNumber( arrRecord + 48, 8 );
+		}
+
+		if ( ullDirectory + ullDirectorySize > m_ullFileSize )
+		{
+			return false;
+		}
+
+		vector<BYTE> arrDirectory( size_t( ullDirectorySize ) + 1 );
+		if
+		(
+			ullDirectorySize > 0 &&
+			( !Seek( ullDirectory ) || !Read( &arrDirectory[ 0 ], size_t( ullDirectorySize ) ) )
+		)
+		{
+			return false;
+		}
+
+		m_arrZipEntries.clear();
+		m_arrZipEntries.reserve( size_t( ullEntries ) );
+		size_t nEntry = 0;
+		while
+		(
+			nEntry + 46 <= ullDirectorySize &&
+			memcmp( &arrDirectory[ nEntry ], "PK\x01\x02", 4 ) == 0
+		)
+		{
+			const BYTE* pEntry = &arrDirectory[ nEntry ];
+			const size_t nName = size_t( GetNumber( pEntry + 28, 2 ) );
+			const size_t nExtra = size_t( GetNumber( pEntry + 30, 2 ) );
+			const size_t nComment = size_t( GetNumber( pEntry + 32, 2 ) );
+			if ( nEntry + 46 + nName + nExtra > ullDirectorySize )
+			{
+				break;
+			}
+
+			ZIP_ENTRY entry;
+			entry.m_wFlags = WORD( GetNumber( pEntry + 8, 2 ) );
+			entry.m_wMethod = WORD( GetNumber( pEntry + 10, 2 ) );
+			entry.m_dwCrc = DWORD( GetNumber( pEntry + 16, 4 ) );
+			entry.m_ullCompressed = GetNumber( pEntry + 20, 4 );
+			entry.m_ullSize = GetNumber( pEntry + 24, 4 );
+			entry.m_ullOffset = GetNumber( pEntry + 42, 4 );
+
+			// names are UTF-8 when bit 11 is set and the DOS code page
+			// otherwise
+			const CStringA csName( (LPCSTR)pEntry + 46, int( nName ) );
+			entry.m_csName = CString
+			(
+				CA2W( csName, ( entry.m_wFlags & 0x800 ) ? CP_UTF8 : CP_OEMCP )
+			);
+
+			// the zip64 extra field holds the sizes and offset that did not
+			// fit, in that order
+			const BYTE* pExtra = pEntry + 46 + nName;
+			size_t nField = 0;
+			while ( nField + 4 <= nExtra )
+			{
+				const WORD wID = WORD( GetNumber( pExtra + nField, 2 ) );
+				const size_t nSize = size_t( GetNumber( pExtra + nField + 2, 2 ) );
+				if ( wID == 0x0001 )
+				{
+					const BYTE* pValue = pExtra + nField + 4;
+					const BYTE* pEndValue = pValue + nSize;
+					if ( entry.m_ullSize == 0xFFFFFFFF && pValue + 8 <= pEndValue )
+					{
+						entry.m_ullSize = GetNumber( pValue, 8 );
+						pValue += 8;
+					}
+					if ( entry.m_ullCompressed == 0xFFFFFFFF && pValue + 8 <= pEndValue )
+					{
+						entry.m_ullCompressed = GetNumber( pValue, 8 );
+						pValue += 8;
+					}
+					if ( entry.m_ullOffset == 0xFFFFFFFF && pValue + 8 <= pEndValue )
+					{
+						entry.m_ullOffset = GetNumber( pValue, 8 );
+					}
+				}
+				nField += 4 + nSize;
+			}
+
+			// folders are only names ending with a slash
+			if ( entry.m_csName.Right( 1 ) != _T( "/" ) )
+			{
+				m_arrZipEntries.push_back( entry );
+			}
+
+			nEntry += 46 + nName + nExtra + nComment;
+		}
+
+		// reading the entries in the order they sit in the file keeps the
+		// reads going forward
+		sort
+		(
+			m_arrZipEntries.begin(), m_arrZipEntries.end(),
+			[]( const ZIP_ENTRY& left, const ZIP_ENTRY& right )
+			{
+				return left.m_ullOffset < right.m_ullOffset;
+			}
+		);
+		m_nZipEntry = 0;
+		return Seek( 0 );
+	}
+
+	// the next file of a zip archive
+	bool NextZip( CString& csName, vector<BYTE>& data )
+	{
+		while ( m_nZipEntry < m_arrZipEntries.size() )
+		{
+			const ZIP_ENTRY& entry = m_arrZipEntries[ m_nZipEntry++ ];
+
+			// the local header repeats the name and may have an extra
+			// field of a different length than the central directory
+			BYTE arrHeader[ 30 ];
+			if
+			(
+				!Seek( entry.m_ullOffset ) ||
+				!Read( arrHeader, sizeof( arrHeader ) ) ||
+				memcmp( arrHeader, "PK\x03\x04", 4 ) != 0
+			)
+			{
+				m_ullSkipped++;
+				continue;
+			}
+
+			const ULONGLONG ullData =
+				entry.m_ullOffset + 30 +
+				GetNumber( arrHeader + 26, 2 ) + GetNumber( arrHeader + 28, 2 );
+			// the declared sizes are checked against the archive and the
+			// limit before any memory is sized by them, and a stored entry
+			// is as large as its data
+			const bool bReadable =
+				( entry.m_wFlags & 1 ) == 0 &&
+				( entry.m_wMethod == 0 || entry.m_wMethod == 8 ) &&
+				ullData <= m_ullFileSize &&
+				entry.m_ullCompressed <= m_ullFileSize - ullData &&
+				entry.m_ullCompressed <= MAX_ENTRY &&
+				entry.m_ullSize <= MAX_ENTRY &&
+				( entry.m_wMethod != 0 || entry.m_ullSize == entry.m_ullCompressed );
+			if ( !bReadable || !Seek( ullData ) )
+			{
+				m_ullSkipped++;
+				continue;
+			}
+
+			csName = entry.m_csName;
+			if ( entry.m_wMethod == 0 )
+			{
+				if ( !Allocate( data, size_t( entry.m_ullCompressed ) ) )
+				{
+					m_ullSkipped++;
+					continue;
+				}
+				if ( !data.empty() && !Read( &data[ 0 ], data.size() ) )
+				{
+					return false;
+				}
+				if ( CInflate::Crc32( data.data(), data.size() ) != entry.m_dwCrc )
+				{
+					m_ullSkipped++;
+					continue;
+				}
+				return true;
+			}
+
+			if ( !Allocate( m_arrCompressed, size_t( entry.m_ullCompressed ) ) )
+			{
+				m_ullSkipped++;
+				continue;
+			}
+			if
+			(
+				!m_arrCompressed.empty() &&
+				!Read( &m_arrCompressed[ 0 ], m_arrCompressed.size() )
+			)
+			{
+				return false;
+			}
+
+			CInflate inflate;
+			if
+			(
+				!inflate.Decompress
+				(
+					m_arrCompressed.data(), m_arrCompressed.size(), data,
+					size_t( entry.m_ullSize ), entry.m_dwCrc
+				)
+			)
+			{
+				m_ullSkipped++;
+				continue;
+			}
+			return true;
+		}
+		return false;
+	}
+
+// public methods
+public:
+	// is the pathname that of an archive this class reads
+	static bool IsArchive( const CString& csPath )
+	{
+		const CString csExt = csPath.Right( 4 ).MakeLower();
+		return csExt == _T( ".tar" ) || csExt == _T( ".zip" );
+	}
+
+	// open the archive and work out what kind it is
+	// returns false if it cannot be opened or is not an archive
+	bool Open( const CString& csPath )
+	{
+		Close();
+		m_hFile = ::CreateFile
+		(
+			csPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL
+		);
+		if ( m_hFile == INVALID_HANDLE_VALUE )
+		{
+			return false;
+		}
+
+		LARGE_INTEGER size;
+		if ( !::GetFileSizeEx( m_hFile, &size ) )
+		{
+			Close();
+			return false;
+		}
+		m_ullFileSize = ULONGLONG( size.QuadPart );
+		m_arrBuffer.resize( BUFFER );
+
+		// a zip archive starts with a local header (or is empty) and a tar
+		// archive with a header block whose checksum adds up
+		BYTE arrHeader[ BLOCK ] = { 0 };
+		const size_t nHeader = size_t( min( m_ullFileSize, ULONGLONG( BLOCK ) ) );
+		if ( nHeader < 4 || !Read( arrHeader, nHeader ) || !Seek( 0 ) )
+		{
+			Close();
+			return false;
+		}
+
+		if
+		(
+			memcmp( arrHeader, "PK\x03\x04", 4 ) == 0 ||
+			memcmp( arrHeader, "PK\x05\x06", 4 ) == 0
+		)
+		{
+			m_type = ARCHIVE_ZIP;
+			if ( !ReadZipDirectory() )
+			{
+				Close();
+				return false;
+			}
+		}
+		else if ( nHeader == BLOCK && IsTarHeader( arrHeader ) )
+		{
+			m_type = ARCHIVE_TAR;
+		}
+		else
+		{
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	// read the next file of the archive into the given memory
+	// returns false at the end of the archive (or if it is damaged)
+	bool Next( CString& csName, vector<BYTE>& data )
+	{
+		switch ( m_type )
+		{
+			case ARCHIVE_TAR:
+				return NextTar( csName, data );
+			case ARCHIVE_ZIP:
+				return NextZip( csName, data );
+			default:
+				return false;
+		}
+	}
+
+	// close the archive
+	void Close()
+	{
+		if ( m_hFile != INVALID_HANDLE_VALUE )
+		{
+			::CloseHandle( m_hFile );
+			m_hFile = INVALID_HANDLE_VALUE;
+		}
+		m_type = ARCHIVE_NONE;
+		m_ullFileSize = 0;
+		m_ullFilePointer = 0;
+		m_nStart = 0;
+		m_nEnd = 0;
+		m_arrZipEntries.clear();
+		m_nZipEntry = 0;
+	}
+
+// public construction / destruction
+public:
+	// constructor
+	CArchiveReader()
+	{
+		m_hFile = INVALID_HANDLE_VALUE;
+		m_ullFileSize = 0;
+		m_ullFilePointer = 0;
+		m_nStart = 0;
+		m_nEnd = 0;
+		m_type = ARCHIVE_NONE;
+		m_nZipEntry = 0;
+		m_ullSkipped = 0;
+	}
+	// destructor
+	virtual ~CArchiveReader()
+	{
+		Close();
+	}
+};
@@ -0,0 +1,259 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+#include <vector>
+#include <cmath>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// this class normalizes the levels of a trimmed scan. A histogram of each
+// color channel is gathered from the pixels, the darkest and brightest
+// values (less a small percentage clipped at each end) are stretched to
+// black and white with an optional gamma, and the result is written
+// through a lookup table per channel. The pixels are blue, green, red and
+// alpha channels of 8 bits (0 to 255) or of 16 bits, where GDI+ keeps 16
+// bit channels in linear light (0 to 8192) so the table also converts them
+// to sRGB. Stretching the 16 bit channels before they are reduced to 8
+// bits leaves no gaps in the histogram of the result
+class CAutoLevels
+{
+// protected data
+protected:
+	// percentage of the pixels clipped at each end of each channel
+	// (negative is no normalization)
+	double m_dClip;
+
+	// gamma applied after the stretch (1 is none)
+	double m_dGamma;
+
+// public properties
+public:
+	// percentage of the pixels clipped at each end of each channel
+	inline double GetClip()
+	{
+		return m_dClip;
+	}
+	// percentage of the pixels clipped at each end of each channel
+	inline void SetClip( double value )
+	{
+		m_dClip = min( value, 49.0 );
+	}
+	// percentage of the pixels clipped at each end of each channel
+	__declspec( property( get = GetClip, put = SetClip ) )
+		double Clip;
+
+	// gamma applied after the stretch (1 is none)
+	inline double GetGamma()
+	{
+		return m_dGamma;
+	}
+	// gamma applied after the stretch (1 is none)
+	inline void SetGamma( double value )
+	{
+		m_dGamma = value > 0.0 ? value : 1.0;
+	}
+	// gamma applied after the stretch (1 is none)
+	__declspec( property( get = GetGamma, put = SetGamma ) )
+		double Gamma;
+
+	// are the levels being normalized at all
+	inline bool GetIsEnabled()
+	{
+		return m_dClip >= 0.0;
+	}
+	// are the levels being normalized at all
+	__declspec( property( get = GetIsEnabled ) )
+		bool IsEnabled;
+
+// protected methods
+protected:
+	// the first value of the histogram where more than the given number
+	// of pixels have been counted from the dark end, or from the bright
+	// end when bFromTop is set
+	static UINT FindLevel
+	(
+		const vector<UINT>& arrHistogram, ULONGLONG ullClip, bool bFromTop
+	)
+	{
+		const UINT uiValues = UINT( arrHistogram.size() );
+		ULONGLONG ullCount = 0;
+		for ( UINT uiStep = 0; uiStep < uiValues; uiStep++ )
+		{
+			const UINT uiValue = bFromTop ? uiValues - 1 - uiStep : uiStep;
+			ullCount += arrHistogram[ uiValue ];
+			if ( ullCount > ullClip )
+			{
+				return uiValue;
+			}
+		}
+		return bFromTop ? uiValues - 1 : 0;
+	}
+
+	// the sRGB encoding of a linear value from 0 to 1
+	static double EncodeSRGB( double dLinear )
+	{
+		if ( dLinear <= 0.0031308 )
+		{
+			return 12.92 * dLinear;
+		}
+		return 1.055 * pow( dLinear, 1.0 / 2.4 ) - 0.055;
+	}
+
+	// fill the table stretching the values from uiLow to uiHigh over 0
+	// to 255 with the gamma, converting linear light to sRGB if asked
+	void BuildTable
+	(
+		UINT uiLow, UINT uiHigh, bool bLinear, vector<BYTE>& arrTable
+	) const
+	{
+		const UINT uiValues = UINT( arrTable.size() );
+		if ( uiHigh <= uiLow )
+		{
+			uiLow = 0;
+			uiHigh = uiValues - 1;
+		}
+
+		const double dRange = double( uiHigh - uiLow );
+		for ( UINT uiValue = 0; uiValue < uiValues; uiValue++ )
+		{
+			double dLevel =
+				( double( uiValue ) - double( uiLow ) ) / dRange;
+			dLevel = min( max( dLevel, 0.0 ), 1.0 );
+			if ( m_dGamma != 1.0 )
+			{
+				dLevel = pow( dLevel, 1.0 / m_dGamma );
+			}
+			if ( bLinear )
+			{
+				dLevel = EncodeSRGB( dLevel );
+			}
+			arrTable[ uiValue ] = BYTE( dLevel * 255.0 + 0.5 );
+		}
+	}
+
+// public methods
+public:
+	// normalize the levels of the source pixels (8 or 16 bits a channel,
+	// blue, green, red and alpha) into the 32 bits per pixel target, which
+	// may be the same memory as an 8 bit source. uiMaximum is the largest
+	// value of a channel and bLinear says the channels are linear light
+	template <typename T>
+	void Apply
+	(
+		const T* pSource, INT nSourceStride, BYTE* pTarget, INT nTargetStride,
+		UINT uiWidth, UINT uiHeight, UINT uiMaximum, bool bLinear
+	) const
+	{
+		// two histograms of each channel, one for the even pixels and one
+		// for the odd, so the counts of neighboring pixels (which are
+		// often the same value) do not wait on each other
+		const size_t nValues = size_t( uiMaximum ) + 1;
+		vector<UINT> arrEven[ 3 ];
+		vector<UINT> arrOdd[ 3 ];
+		for ( int nChannel = 0; nChannel < 3; nChannel++ )
+		{
+			arrEven[ nChannel ].assign( nValues, 0 );
+			arrOdd[ nChannel ].assign( nValues, 0 );
+		}
+
+		for ( UINT uiRow = 0; uiRow < uiHeight; uiRow++ )
+		{
+			const T* pRow = (const T*)
+			(
+				(const BYTE*)pSource + ptrdiff_t( uiRow ) * nSourceStride
+			);
+			UINT uiPixel = 0;
+			for ( ; uiPixel + 2 <= uiWidth; uiPixel += 2 )
+			{
+				const T* pPixel = pRow + size_t( uiPixel ) * 4;
+				for ( int nChannel = 0; nChannel < 3; nChannel++ )
+				{
+					arrEven[ nChannel ][ min( UINT( pPixel[ nChannel ] ), uiMaximum ) ]++;
+					arrOdd[ nChannel ][ min( UINT( pPixel[ 4 + nChannel ] ), uiMaximum ) ]++;
+				}
+			}
+			if ( uiPixel < uiWidth )
+			{
+				const T* pPixel = pRow + size_t( uiPixel ) * 4;
+				for ( int nChannel = 0; nChannel < 3; nChannel++ )
+				{
+					arrEven[ nChannel ][ min( UINT( pPixel[ nChannel ] ), uiMaximum ) ]++;
+				}
+			}
+		}
+
+		// the table of each channel from the ends of its histogram
+		const ULONGLONG ullClip =
+			ULONGLONG( double( uiWidth ) * uiHeight * m_dClip / 100.0 );
+		vector<BYTE> arrTables[ 4 ];
+		for ( int nChannel = 0; nChannel < 3; nChannel++ )
+		{
+			vector<UINT>& arrHistogram = arrEven[ nChannel ];
+			for ( size_t nValue = 0; nValue < nValues; nValue++ )
+			{
+				arrHistogram[ nValue ] += arrOdd[ nChannel ][ nValue ];
+			}
+
+			arrTables[ nChannel ].resize( nValues );
+			BuildTable
+			(
+				FindLevel( arrHistogram, ullClip, false ),
+				FindLevel( arrHistogram, ullClip, true ),
+				bLinear, arrTables[ nChannel ]
+			);
+		}
+
+		// alpha is only scaled to 8 bits
+		arrTables[ 3 ].resize( nValues );
+		for ( size_t nValue = 0; nValue < nValues; nValue++ )
+		{
+			arrTables[ 3 ][ nValue ] =
+				BYTE( ( nValue * 255 + uiMaximum / 2 ) / uiMaximum );
+		}
+
+		const BYTE* pBlue = &arrTables[ 0 ][ 0 ];
+		const BYTE* pGreen = &arrTables[ 1 ][ 0 ];
+		const BYTE* pRed = &arrTables[ 2 ][ 0 ];
+		const BYTE* pAlpha = &arrTables[ 3 ][ 0 ];
+		for ( UINT uiRow = 0; uiRow < uiHeight; uiRow++ )
+		{
+			const T* pPixel = (const T*)
+			(
+				(const BYTE*)pSource + ptrdiff_t( uiRow ) * nSourceStride
+			);
+			BYTE* pOutput = pTarget + ptrdiff_t( uiRow ) * nTargetStride;
+			for ( UINT uiPixel = 0; uiPixel < uiWidth; uiPixel++ )
+			{
+				// the four channels are read before any is written, since
+				// an 8 bit source may be the target
+				const UINT uiBlue = min( UINT( pPixel[ 0 ] ), uiMaximum );
+				const UINT uiGreen = min( UINT( pPixel[ 1 ] ), uiMaximum );
+				const UINT uiRed = min( UINT( pPixel[ 2 ] ), uiMaximum );
+				const UINT uiAlpha = min( UINT( pPixel[ 3 ] ), uiMaximum );
+				*(UINT*)pOutput =
+					UINT( pBlue[ uiBlue ] ) |
+					( UINT( pGreen[ uiGreen ] ) << 8 ) |
+					( UINT( pRed[ uiRed ] ) << 16 ) |
+					( UINT( pAlpha[ uiAlpha ] ) << 24 );
+				pPixel += 4;
+				pOutput += 4;
+			}
+		}
+	}
+
+// public construction / destruction
+public:
+	// constructor
+	CAutoLevels()
+	{
+		m_dClip = -1.0;
+		m_dGamma = 1.0;
+	}
+	// destructor
+	virtual ~CAutoLevels()
+	{
+	}
+};
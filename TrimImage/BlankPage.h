@@ -0,0 +1,213 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+#include <emmintrin.h>
+#include <cmath>
+
+/////////////////////////////////////////////////////////////////////////////
+// this class decides if a trimmed scan (32 bits per pixel) is a blank page,
+// like the back sides of a duplex batch, so it can be left out before the
+// expensive encode. The brightness of every pixel is worked out four
+// pixels at a time, counting the pixels dark enough to be ink along with
+// the mean and deviation of the brightness, and a page with less ink than
+// the threshold is blank
+class CBlankPage
+{
+// protected data
+protected:
+	// most ink a blank page may have, as a percentage of its pixels
+	// (negative is no detection)
+	double m_dThreshold;
+
+	// brightness (0 to 255) below which a pixel is ink
+	UINT m_uiInkLevel;
+
+	// percentage of the pixels of the last page that are ink
+	double m_dInk;
+
+	// mean brightness of the last page
+	double m_dMean;
+
+	// standard deviation of the brightness of the last page
+	double m_dDeviation;
+
+// public properties
+public:
+	// most ink a blank page may have, as a percentage of its pixels
+	inline double GetThreshold()
+	{
+		return m_dThreshold;
+	}
+	// most ink a blank page may have, as a percentage of its pixels
+	inline void SetThreshold( double value )
+	{
+		m_dThreshold = value;
+	}
+	// most ink a blank page may have, as a percentage of its pixels
+	__declspec( property( get = GetThreshold, put = SetThreshold ) )
+		double Threshold;
+
+	// brightness (0 to 255) below which a pixel is ink
+	inline UINT GetInkLevel()
+	{
+		return m_uiInkLevel;
+	}
+	// brightness (0 to 255) below which a pixel is ink
+	inline void SetInkLevel( UINT value )
+	{
+		m_uiInkLevel = min( value, 256u );
+	}
+	// brightness (0 to 255) below which a pixel is ink
+	__declspec( property( get = GetInkLevel, put = SetInkLevel ) )
+		UINT InkLevel;
+
+	// are pages being tested at all
+	inline bool GetIsEnabled()
+	{
+		return m_dThreshold >= 0.0;
+	}
+	// are pages being tested at all
+	__declspec( property( get = GetIsEnabled ) )
+		bool IsEnabled;
+
+	// percentage of the pixels of the last page that are ink
+	inline double GetInk()
+	{
+		return m_dInk;
+	}
+	// percentage of the pixels of the last page that are ink
+	__declspec( property( get = GetInk ) )
+		double Ink;
+
+	// mean brightness of the last page
+	inline double GetMean()
+	{
+		return m_dMean;
+	}
+	// mean brightness of the last page
+	__declspec( property( get = GetMean ) )
+		double Mean;
+
+	// standard deviation of the brightness of the last page
+	inline double GetDeviation()
+	{
+		return m_dDeviation;
+	}
+	// standard deviation of the brightness of the last page
+	__declspec( property( get = GetDeviation ) )
+		double Deviation;
+
+// public methods
+public:
+	// gather the statistics of the page and decide if it is blank
+	bool IsBlank( const BYTE* pPixels, UINT uiWidth, UINT uiHeight, INT nStride )
+	{
+		m_dInk = 0.0;
+		m_dMean = 0.0;
+		m_dDeviation = 0.0;
+		if ( uiWidth == 0 || uiHeight == 0 )
+		{
+			return false;
+		}
+
+		// weights of blue, green and red in 256ths (alpha is ignored)
+		const __m128i weights = _mm_setr_epi16( 29, 150, 77, 0, 29, 150, 77, 0 );
+		const __m128i level = _mm_set1_epi32( int( m_uiInkLevel ) );
+		const __m128i zero = _mm_setzero_si128();
+
+		ULONGLONG ullInk = 0;
+		ULONGLONG ullSum = 0;
+		ULONGLONG ullSquares = 0;
+		const UINT uiGroups = uiWidth / 4;
+		for ( UINT uiRow = 0; uiRow < uiHeight; uiRow++ )
+		{
+			const BYTE* pRow = pPixels + ptrdiff_t( uiRow ) * nStride;
+
+			// the lanes of a row cannot overflow 32 bits for rows of up
+			// to 65535 pixels
+			__m128i ink = _mm_setzero_si128();
+			__m128i sum = _mm_setzero_si128();
+			__m128i squares = _mm_setzero_si128();
+			for ( UINT uiGroup = 0; uiGroup < uiGroups; uiGroup++ )
+			{
+				const __m128i pixels =
+					_mm_loadu_si128( (const __m128i*)( pRow + uiGroup * 16 ) );
+
+				// each pixel's weighted channels end up in two lanes,
+				// which are added into the first of them
+				__m128i low = _mm_madd_epi16
+				(
+					_mm_unpacklo_epi8( pixels, zero ), weights
+				);
+				__m128i high = _mm_madd_epi16
+				(
+					_mm_unpackhi_epi8( pixels, zero ), weights
+				);
+				low = _mm_add_epi32( low, _mm_srli_epi64( low, 32 ) );
+				high = _mm_add_epi32( high, _mm_srli_epi64( high, 32 ) );
+				__m128i brightness = _mm_unpacklo_epi64
+				(
+					_mm_shuffle_epi32( low, _MM_SHUFFLE( 3, 1, 2, 0 ) ),
+					_mm_shuffle_epi32( high, _MM_SHUFFLE( 3, 1, 2, 0 ) )
+				);
+				brightness = _mm_srli_epi32( brightness, 8 );
+
+				// the comparison is all ones (minus one) for ink
+				ink = _mm_sub_epi32( ink, _mm_cmplt_epi32( brightness, level ) );
+				sum = _mm_add_epi32( sum, brightness );
+				squares = _mm_add_epi32
+				(
+					squares, _mm_madd_epi16( brightness, brightness )
+				);
+			}
+
+			UINT arrInk[ 4 ], arrSum[ 4 ], arrSquares[ 4 ];
+			_mm_storeu_si128( (__m128i*)arrInk, ink );
+			_mm_storeu_si128( (__m128i*)arrSum, sum );
+			_mm_storeu_si128( (__m128i*)arrSquares, squares );
+			for ( int nLane = 0; nLane < 4; nLane++ )
+			{
+				ullInk += arrInk[ nLane ];
+				ullSum += arrSum[ nLane ];
+				ullSquares += arrSquares[ nLane ];
+			}
+
+			// the pixels left over at the end of the row
+			for ( UINT uiPixel = uiGroups * 4; uiPixel < uiWidth; uiPixel++ )
+			{
+				const BYTE* pPixel = pRow + uiPixel * 4;
+				const UINT uiBrightness =
+					( pPixel[ 0 ] * 29 + pPixel[ 1 ] * 150 + pPixel[ 2 ] * 77 ) >> 8;
+				ullInk += uiBrightness < m_uiInkLevel ? 1 : 0;
+				ullSum += uiBrightness;
+				ullSquares += uiBrightness * uiBrightness;
+			}
+		}
+
+		const double dPixels = double( uiWidth ) * uiHeight;
+		m_dInk = 100.0 * ullInk / dPixels;
+		m_dMean = ullSum / dPixels;
+		m_dDeviation = sqrt( max( ullSquares / dPixels - m_dMean * m_dMean, 0.0 ) );
+
+		const bool value = IsEnabled && m_dInk <= m_dThreshold;
+		return value;
+	}
+
+// public construction / destruction
+public:
+	// constructor
+	CBlankPage()
+	{
+		m_dThreshold = -1.0;
+		m_uiInkLevel = 128;
+		m_dInk = 0.0;
+		m_dMean = 0.0;
+		m_dDeviation = 0.0;
+	}
+	// destructor
+	virtual ~CBlankPage()
+	{
+	}
+};
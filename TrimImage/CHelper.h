@@ -3,6 +3,7 @@
 /////////////////////////////////////////////////////////////////////////////
 #pragma once
 #include "stdafx.h"
+#include "StringSlice.h"
 #include <vector>
 
 using namespace std;
@@ -98,86 +99,117 @@ public:
 		return value;
 	}
 
+	/////////////////////////////////////////////////////////////////////////////
+	// the pieces of a pathname as slices of the pathname itself
+	typedef struct tagPathParts
+	{
+		// drive letter and colon (empty if none)
+		CStringSlice m_Drive;
+
+		// directory including the trailing separator (empty if none)
+		CStringSlice m_Directory;
+
+		// filename without the extension
+		CStringSlice m_FileName;
+
+		// extension including the period (empty if none)
+		CStringSlice m_Extension;
+
+	} PATH_PARTS;
+
+	/////////////////////////////////////////////////////////////////////////////
+	// split a pathname into its drive, directory, filename and extension the
+	// way _tsplitpath does, in one pass over the pathname and without 
+	// copying it. Both backslashes and forward slashes separate folders, so 
+	// POSIX pathnames split as well. The slices point into the pathname, 
+	// which must outlive them
+	static PATH_PARTS SplitPath( const CStringSlice& path )
+	{
+		PATH_PARTS value;
+		const int nLength = path.Length;
+
+		// a drive is a single letter followed by a colon
+		int nDrive = 0;
+		if ( nLength >= 2 && path[ 1 ] == _T( ':' ) && _istalpha( path[ 0 ] ) )
+		{
+			nDrive = 2;
+		}
+
+		// the directory ends with the last separator and the extension 
+		// starts with the last period after it
+		int nName = nDrive;
+		int nPeriod = -1;
+		for ( int nIndex = nDrive; nIndex < nLength; nIndex++ )
+		{
+			const TCHAR ch = path[ nIndex ];
+			if ( ch == _T( '\\' ) || ch == _T( '/' ) )
+			{
+				nName = nIndex + 1;
+				nPeriod = -1;
+			}
+			else if ( ch == _T( '.' ) )
+			{
+				nPeriod = nIndex;
+			}
+		}
+		if ( nPeriod == -1 )
+		{
+			nPeriod = nLength;
+		}
+
+		value.m_Drive = path.Left( nDrive );
+		value.m_Directory = path.Mid( nDrive, nName - nDrive );
+		value.m_FileName = path.Mid( nName, nPeriod - nName );
+		value.m_Extension = path.Mid( nPeriod );
+		return value;
+	}
+
 	/////////////////////////////////////////////////////////////////////////////
 	// parse the filename from a pathname
 	static inline CString GetFileName( LPCTSTR pcszPath )
 	{
-		CString csPath( pcszPath );
-		TCHAR* pBuf = csPath.GetBuffer( csPath.GetLength() + 1 );
-		TCHAR szDrive[ _MAX_DRIVE ];
-		TCHAR szDir[ _MAX_DIR ];
-		TCHAR szFile[ _MAX_FNAME ];
-		TCHAR szExt[ _MAX_EXT ];
-
-		_tsplitpath( pBuf, szDrive, szDir, szFile, szExt );
-		csPath.ReleaseBuffer();
-		return szFile;
+		return SplitPath( pcszPath ).m_FileName.ToString();
 	}
 
 	/////////////////////////////////////////////////////////////////////////////
 	// parse the extension from a pathname
 	static inline CString GetExtension( LPCTSTR pcszPath )
 	{
-		CString csPath( pcszPath );
-		TCHAR* pBuf = csPath.GetBuffer( csPath.GetLength() + 1 );
-		TCHAR szDrive[ _MAX_DRIVE ];
-		TCHAR szDir[ _MAX_DIR ];
-		TCHAR szFile[ _MAX_FNAME ];
-		TCHAR szExt[ _MAX_EXT ];
-
-		_tsplitpath( pBuf, szDrive, szDir, szFile, szExt );
-		csPath.ReleaseBuffer();
-		return szExt;
+		return SplitPath( pcszPath ).m_Extension.ToString();
 	}
 
 	/////////////////////////////////////////////////////////////////////////////
 	// parse the directory from a pathname
 	static inline CString GetDirectory( LPCTSTR pcszPath )
 	{
-		CString csPath( pcszPath );
-		TCHAR* pBuf = csPath.GetBuffer( csPath.GetLength() + 1 );
-		TCHAR szDrive[ _MAX_DRIVE ];
-		TCHAR szDir[ _MAX_DIR ];
-		TCHAR szFile[ _MAX_FNAME ];
-		TCHAR szExt[ _MAX_EXT ];
-
-		_tsplitpath( pBuf, szDrive, szDir, szFile, szExt );
-		csPath.ReleaseBuffer();
-		return szDir;
+		return SplitPath( pcszPath ).m_Directory.ToString();
 	}
 
 	/////////////////////////////////////////////////////////////////////////////
 	// parse the drive from a pathname
 	static inline CString GetDrive( LPCTSTR pcszPath )
 	{
-		CString csPath( pcszPath );
-		TCHAR* pBuf = csPath.GetBuffer( csPath.GetLength() + 1 );
-		TCHAR szDrive[ _MAX_DRIVE ];
-		TCHAR szDir[ _MAX_DIR ];
-		TCHAR szFile[ _MAX_FNAME ];
-		TCHAR szExt[ _MAX_EXT ];
-
-		_tsplitpath( pBuf, szDrive, szDir, szFile, szExt );
-		csPath.ReleaseBuffer();
-		return szDrive;
+		return SplitPath( pcszPath ).m_Drive.ToString();
 	}
 
 	/////////////////////////////////////////////////////////////////////////////
 	// parse folder from a pathname (drive and directory)
 	static inline CString GetFolder( LPCTSTR pcszPath )
 	{
-		CString csDrive = GetDrive( pcszPath );
-		CString csDir = GetDirectory( pcszPath );
-		return csDrive + csDir;
+		const PATH_PARTS parts = SplitPath( pcszPath );
+		return CString( pcszPath, parts.m_Drive.Length + parts.m_Directory.Length );
 	}
 
 	/////////////////////////////////////////////////////////////////////////////
 	// parse data name from a pathname (filename and extension)
 	static inline CString GetDataName( LPCTSTR pcszPath )
 	{
-		CString csFile = GetFileName( pcszPath );
-		CString csExt = GetExtension( pcszPath );
-		return csFile + csExt;
+		const PATH_PARTS parts = SplitPath( pcszPath );
+		return CString
+		( 
+			parts.m_FileName.Text, 
+			parts.m_FileName.Length + parts.m_Extension.Length 
+		);
 	}
 
 	/////////////////////////////////////////////////////////////////////////////
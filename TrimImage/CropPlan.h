@@ -0,0 +1,338 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+#include "FlatMap.h"
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// this class turns the trimming parameters of the command line (margins
+// and aspect ratio) into the crop of an image. The parameters are read
+// once, and the crop worked out for a stored width, height and EXIF
+// orientation is remembered, so a batch of scans that share dimensions
+// works the crop out once instead of once per image. The crops remembered
+// are the dimension classes of the batch, which are counted as the images
+// go by for a summary at the end
+class CCropPlan
+{
+// public definitions
+public:
+	// the crop of a class of images
+	typedef struct tagCrop
+	{
+		// the class in the order the classes were first seen
+		int m_nClass;
+
+		// number of images of the class
+		ULONGLONG m_ullImages;
+
+		// EXIF orientation of the class
+		UINT m_uiOrientation;
+
+		// margins of the stored pixels
+		UINT m_uiTop;
+		UINT m_uiBottom;
+		UINT m_uiLeft;
+		UINT m_uiRight;
+
+		// dimensions of the stored pixels
+		UINT m_uiOriginalWidth;
+		UINT m_uiOriginalHeight;
+
+		// dimensions of the stored pixels after the crop
+		UINT m_uiNewWidth;
+		UINT m_uiNewHeight;
+
+		// did the aspect ratio change the margins
+		bool m_bAspect;
+
+	} CROP;
+
+// protected data
+protected:
+	// margins of the displayed image from the command line
+	UINT m_uiTop;
+	UINT m_uiBottom;
+	UINT m_uiLeft;
+	UINT m_uiRight;
+
+	// the two sides of the aspect ratio from the command line, either
+	// order is accepted (zero is no aspect ratio)
+	UINT m_uiAspectLong;
+	UINT m_uiAspectShort;
+
+	// the crops worked out so far keyed by the stored dimensions and the
+	// orientation
+	CFlatMap<ULONGLONG, CROP> m_mapCrops;
+
+	// protects the crops, which the worker threads share
+	mutex m_mutex;
+
+// public properties
+public:
+	// was an aspect ratio given
+	inline bool GetIsAspect()
+	{
+		return m_uiAspectShort > 0;
+	}
+	// was an aspect ratio given
+	__declspec( property( get = GetIsAspect ) )
+		bool IsAspect;
+
+	// number of dimension classes seen so far
+	inline int GetClasses()
+	{
+		lock_guard<mutex> lock( m_mutex );
+		return m_mapCrops.Count;
+	}
+	// number of dimension classes seen so far
+	__declspec( property( get = GetClasses ) )
+		int Classes;
+
+// protected methods
+protected:
+	// the key of a class of images
+	static inline ULONGLONG GetKey
+	(
+		UINT uiWidth, UINT uiHeight, UINT uiOrientation
+	)
+	{
+		const ULONGLONG value =
+			( ULONGLONG( uiWidth & 0xFFFFFFF ) << 36 ) |
+			( ULONGLONG( uiHeight & 0xFFFFFFF ) << 8 ) |
+			ULONGLONG( uiOrientation & 0xFF );
+		return value;
+	}
+
+	// are the stored rows the displayed columns (EXIF orientations 5
+	// through 8)
+	static inline bool IsTransposed( UINT uiOrientation )
+	{
+		return uiOrientation >= 5 && uiOrientation <= 8;
+	}
+
+	// work out the crop of an image with the given stored dimensions and
+	// orientation. The margins and aspect ratio are given as the image is
+	// displayed, so they are applied to the displayed dimensions and then
+	// mapped back onto the stored pixels, which lets the crop leave the
+	// orientation tag to rotate the result
+	void Compute
+	(
+		UINT uiWidth, UINT uiHeight, UINT uiOrientation, CROP& crop
+	) const
+	{
+		const bool bTransposed = IsTransposed( uiOrientation );
+		const UINT uiDisplayedWidth = bTransposed ? uiHeight : uiWidth;
+		const UINT uiDisplayedHeight = bTransposed ? uiWidth : uiHeight;
+
+		UINT uiTop = m_uiTop;
+		UINT uiBottom = m_uiBottom;
+		UINT uiLeft = m_uiLeft;
+		UINT uiRight = m_uiRight;
+		UINT uiNewWidth = uiDisplayedWidth - uiLeft - uiRight;
+		UINT uiNewHeight = uiDisplayedHeight - uiTop - uiBottom;
+
+		// 3:2 remains 3:2 in landscape mode and becomes 2:3 in portrait
+		// mode
+		bool bAspect = m_uiAspectShort > 0 && uiDisplayedHeight > 0;
+		float fRequestedRatio = 0.0f;
+		float fOriginalRatio = 0.0f;
+		if ( bAspect )
+		{
+			fRequestedRatio = uiDisplayedWidth > uiDisplayedHeight ?
+				float( m_uiAspectLong ) / float( m_uiAspectShort ) :
+				float( m_uiAspectShort ) / float( m_uiAspectLong );
+			fOriginalRatio =
+				float( uiDisplayedWidth ) / float( uiDisplayedHeight );
+			if ( fabs( fRequestedRatio - fOriginalRatio ) < 0.0001f )
+			{
+				bAspect = false;
+			}
+		}
+
+		if ( bAspect )
+		{
+			if ( fRequestedRatio > fOriginalRatio )
+			{
+				// h = w / r
+				uiNewHeight = UINT( float( uiDisplayedWidth ) / fRequestedRatio );
+				uiTop = ( uiDisplayedHeight - uiNewHeight ) / 2;
+				uiBottom = uiTop;
+			}
+			else
+			{
+				// w = r * h
+				uiNewWidth = UINT( float( uiDisplayedHeight ) * fRequestedRatio );
+				uiLeft = ( uiDisplayedWidth - uiNewWidth ) / 2;
+				uiRight = uiLeft;
+			}
+		}
+
+		// each case names the displayed edge the stored edges end up on
+		crop.m_uiTop = uiTop;
+		crop.m_uiBottom = uiBottom;
+		crop.m_uiLeft = uiLeft;
+		crop.m_uiRight = uiRight;
+		switch ( uiOrientation )
+		{
+			case 2: // mirrored left to right
+				crop.m_uiLeft = uiRight;
+				crop.m_uiRight = uiLeft;
+				break;
+			case 3: // rotated 180 degrees
+				crop.m_uiTop = uiBottom;
+				crop.m_uiBottom = uiTop;
+				crop.m_uiLeft = uiRight;
+				crop.m_uiRight = uiLeft;
+				break;
+			case 4: // mirrored top to bottom
+				crop.m_uiTop = uiBottom;
+				crop.m_uiBottom = uiTop;
+				break;
+			case 5: // stored top is displayed left, stored left is displayed top
+				crop.m_uiTop = uiLeft;
+				crop.m_uiBottom = uiRight;
+				crop.m_uiLeft = uiTop;
+				crop.m_uiRight = uiBottom;
+				break;
+			case 6: // stored top is displayed right, stored left is displayed top
+				crop.m_uiTop = uiRight;
+				crop.m_uiBottom = uiLeft;
+				crop.m_uiLeft = uiTop;
+				crop.m_uiRight = uiBottom;
+				break;
+			case 7: // stored top is displayed right, stored left is displayed bottom
+				crop.m_uiTop = uiRight;
+				crop.m_uiBottom = uiLeft;
+				crop.m_uiLeft = uiBottom;
+				crop.m_uiRight = uiTop;
+				break;
+			case 8: // stored top is displayed left, stored left is displayed bottom
+				crop.m_uiTop = uiLeft;
+				crop.m_uiBottom = uiRight;
+				crop.m_uiLeft = uiBottom;
+				crop.m_uiRight = uiTop;
+				break;
+			default:
+				break;
+		}
+
+		crop.m_uiOrientation = uiOrientation;
+		crop.m_uiOriginalWidth = uiWidth;
+		crop.m_uiOriginalHeight = uiHeight;
+		crop.m_uiNewWidth = bTransposed ? uiNewHeight : uiNewWidth;
+		crop.m_uiNewHeight = bTransposed ? uiNewWidth : uiNewHeight;
+		crop.m_bAspect = bAspect;
+	}
+
+// public methods
+public:
+	// read the trimming parameters, the aspect ratio is given as
+	// width:height
+	// returns false if the aspect ratio cannot be read
+	bool Prepare
+	(
+		UINT uiTop, UINT uiBottom, UINT uiLeft, UINT uiRight,
+		const CString& csAspect
+	)
+	{
+		lock_guard<mutex> lock( m_mutex );
+		m_uiTop = uiTop;
+		m_uiBottom = uiBottom;
+		m_uiLeft = uiLeft;
+		m_uiRight = uiRight;
+		m_uiAspectLong = 0;
+		m_uiAspectShort = 0;
+		m_mapCrops.clear();
+
+		if ( csAspect.IsEmpty() )
+		{
+			return true;
+		}
+
+		int nStart = 0;
+		const CString csWidth = csAspect.Tokenize( _T( ":" ), nStart );
+		const CString csHeight = csAspect.Tokenize( _T( ":" ), nStart );
+		const UINT uiWidth = _tstol( csWidth );
+		const UINT uiHeight = _tstol( csHeight );
+		if ( uiWidth == 0 || uiHeight == 0 )
+		{
+			return false;
+		}
+
+		m_uiAspectLong = max( uiWidth, uiHeight );
+		m_uiAspectShort = min( uiWidth, uiHeight );
+		return true;
+	}
+
+	// the crop of an image with the given stored dimensions and
+	// orientation, which is only worked out the first time the class is
+	// seen, and count the image in its class
+	CROP GetCrop( UINT uiWidth, UINT uiHeight, UINT uiOrientation )
+	{
+		lock_guard<mutex> lock( m_mutex );
+		bool bAdded = false;
+		CROP* pCrop = m_mapCrops.insert
+		(
+			GetKey( uiWidth, uiHeight, uiOrientation ), bAdded
+		);
+		if ( bAdded )
+		{
+			Compute( uiWidth, uiHeight, uiOrientation, *pCrop );
+			pCrop->m_nClass = m_mapCrops.Count - 1;
+		}
+		pCrop->m_ullImages++;
+		return *pCrop;
+	}
+
+	// the classes seen so far with the most common first
+	vector<CROP> GetSummary()
+	{
+		vector<CROP> value;
+		{
+			lock_guard<mutex> lock( m_mutex );
+			value.reserve( m_mapCrops.Count );
+			for ( const auto& slot : m_mapCrops )
+			{
+				value.push_back( slot.m_value );
+			}
+		}
+
+		sort
+		(
+			value.begin(), value.end(),
+			[]( const CROP& left, const CROP& right )
+			{
+				if ( left.m_ullImages != right.m_ullImages )
+				{
+					return left.m_ullImages > right.m_ullImages;
+				}
+				return left.m_nClass < right.m_nClass;
+			}
+		);
+		return value;
+	}
+
+// public construction / destruction
+public:
+	// constructor
+	CCropPlan()
+	{
+		m_uiTop = 0;
+		m_uiBottom = 0;
+		m_uiLeft = 0;
+		m_uiRight = 0;
+		m_uiAspectLong = 0;
+		m_uiAspectShort = 0;
+	}
+	// destructor
+	virtual ~CCropPlan()
+	{
+	}
+};
@@ -0,0 +1,311 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+#include <emmintrin.h>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// this class straightens crooked scans. The skew is estimated on a copy
+// of the page reduced to about a thousand pixels across: the dark cells
+// of the copy are projected onto the side of the page at each candidate
+// angle, and the angle where the lines of text pile up into the fewest,
+// fullest rows (the largest sum of squares of the profile) wins, searched
+// coarse to fine. The page is then rotated by that angle and trimmed in
+// the same pass with a bilinear filter using SSE2, so the trim margins
+// are measured on the straightened page
+class CDeskew
+{
+// protected definitions
+protected:
+	// a dark cell of the reduced copy
+	typedef struct tagInkCell
+	{
+		float m_fX;
+		float m_fY;
+
+	} INK_CELL;
+
+// protected data
+protected:
+	// largest skew searched for in degrees (zero is no deskew)
+	double m_dMaxAngle;
+
+	// smallest skew in degrees worth resampling the page for
+	double m_dMinAngle;
+
+// public properties
+public:
+	// largest skew searched for in degrees (zero is no deskew)
+	inline double GetMaxAngle()
+	{
+		return m_dMaxAngle;
+	}
+	// largest skew searched for in degrees (zero is no deskew)
+	inline void SetMaxAngle( double value )
+	{
+		m_dMaxAngle = min( fabs( value ), 45.0 );
+	}
+	// largest skew searched for in degrees (zero is no deskew)
+	__declspec( property( get = GetMaxAngle, put = SetMaxAngle ) )
+		double MaxAngle;
+
+	// smallest skew in degrees worth resampling the page for
+	inline double GetMinAngle()
+	{
+		return m_dMinAngle;
+	}
+	// smallest skew in degrees worth resampling the page for
+	__declspec( property( get = GetMinAngle ) )
+		double MinAngle;
+
+	// are pages being straightened at all
+	inline bool GetIsEnabled()
+	{
+		return m_dMaxAngle > 0.0;
+	}
+	// are pages being straightened at all
+	__declspec( property( get = GetIsEnabled ) )
+		bool IsEnabled;
+
+// protected methods
+protected:
+	// the brightness (0 to 255) of a pixel
+	static inline UINT Brightness( const BYTE* pPixel )
+	{
+		return ( pPixel[ 0 ] * 29 + pPixel[ 1 ] * 150 + pPixel[ 2 ] * 77 ) >> 8;
+	}
+
+	// the sum of squares of the projection profile of the dark cells at
+	// the given angle in degrees
+	static double Score
+	(
+		const vector<INK_CELL>& arrCells, double dAngle, UINT uiWidth,
+		UINT uiHeight, vector<UINT>& arrProfile
+	)
+	{
+		const float fSlope = float( tan( dAngle * 3.14159265358979 / 180.0 ) );
+		const float fOffset = fabs( fSlope ) * uiWidth + 1.0f;
+		arrProfile.assign( size_t( uiHeight + 2 * fOffset + 2 ), 0 );
+		for ( const INK_CELL& cell : arrCells )
+		{
+			const int nBin = int( cell.m_fY - cell.m_fX * fSlope + fOffset + 0.5f );
+			arrProfile[ nBin ]++;
+		}
+
+		double value = 0.0;
+		for ( UINT uiCount : arrProfile )
+		{
+			value += double( uiCount ) * uiCount;
+		}
+		return value;
+	}
+
+// public methods
+public:
+	// estimate the skew in degrees of the given part of the pixels (32
+	// bits per pixel), positive when the lines of the page run down to
+	// the right
+	double Estimate
+	(
+		const BYTE* pPixels, INT nStride, UINT uiLeft, UINT uiTop,
+		UINT uiWidth, UINT uiHeight
+	)
+	{
+		// reduce the page to about a thousand cells across by averaging
+		const UINT uiFactor = max( ( max( uiWidth, uiHeight ) + 1023 ) / 1024, 1u );
+		const UINT uiCellsAcross = uiWidth / uiFactor;
+		const UINT uiCellsDown = uiHeight / uiFactor;
+		if ( uiCellsAcross < 16 || uiCellsDown < 16 )
+		{
+			return 0.0;
+		}
+
+		vector<INK_CELL> arrCells;
+		vector<UINT> arrSums( uiCellsAcross );
+		const UINT uiDark = 160 * uiFactor * uiFactor;
+		for ( UINT uiCellRow = 0; uiCellRow < uiCellsDown; uiCellRow++ )
+		{
+			fill( arrSums.begin(), arrSums.end(), 0 );
+			for ( UINT uiLine = 0; uiLine < uiFactor; uiLine++ )
+			{
+				const BYTE* pRow = pPixels +
+					ptrdiff_t( uiTop + uiCellRow * uiFactor + uiLine ) * nStride +
+					ptrdiff_t( uiLeft ) * 4;
+				for ( UINT uiCell = 0; uiCell < uiCellsAcross; uiCell++ )
+				{
+					const BYTE* pPixel = pRow + ptrdiff_t( uiCell ) * uiFactor * 4;
+					UINT uiSum = 0;
+					for ( UINT uiPixel = 0; uiPixel < uiFactor; uiPixel++ )
+					{
+						uiSum += Brightness( pPixel + uiPixel * 4 );
+					}
+					arrSums[ uiCell ] += uiSum;
+				}
+			}
+
+			for ( UINT uiCell = 0; uiCell < uiCellsAcross; uiCell++ )
+			{
+				if ( arrSums[ uiCell ] < uiDark )
+				{
+					const INK_CELL cell = { float( uiCell ), float( uiCellRow ) };
+					arrCells.push_back( cell );
+				}
+			}
+		}
+
+		// too little on the page to measure, or a page that is mostly
+		// dark (a photograph) rather than lines of text
+		if
+		(
+			arrCells.size() < 64 ||
+			arrCells.size() > size_t( uiCellsAcross ) * uiCellsDown / 2
+		)
+		{
+			return 0.0;
+		}
+
+		// search the whole range coarsely, then around the best angle
+		// more finely each time
+		vector<UINT> arrProfile;
+		double dBest = 0.0;
+		double dBestScore =
+			Score( arrCells, 0.0, uiCellsAcross, uiCellsDown, arrProfile );
+		double dLow = -m_dMaxAngle;
+		double dHigh = m_dMaxAngle;
+		double dStep = max( m_dMaxAngle / 16.0, 0.05 );
+		while ( dStep >= 0.01 )
+		{
+			for ( double dAngle = dLow; dAngle <= dHigh + 1e-9; dAngle += dStep )
+			{
+				const double dScore =
+					Score( arrCells, dAngle, uiCellsAcross, uiCellsDown, arrProfile );
+				if ( dScore > dBestScore )
+				{
+					dBestScore = dScore;
+					dBest = dAngle;
+				}
+			}
+			dLow = max( dBest - dStep, -m_dMaxAngle );
+			dHigh = min( dBest + dStep, m_dMaxAngle );
+			dStep /= 5.0;
+		}
+
+		return dBest;
+	}
+
+	// fill the target with the part of the source inside the margins
+	// after the source has been rotated about the center of that part to
+	// take out the given skew, the corners rotated in from outside the
+	// page are white
+	static void Rotate
+	(
+		const BYTE* pSource, UINT uiWidth, UINT uiHeight, INT nStride,
+		UINT uiLeft, UINT uiTop, UINT uiNewWidth, UINT uiNewHeight,
+		double dAngle, BYTE* pTarget, INT nTargetStride
+	)
+	{
+		const double dRadians = dAngle * 3.14159265358979 / 180.0;
+		const float fCos = float( cos( dRadians ) );
+		const float fSin = float( sin( dRadians ) );
+		const float fCenterX = uiLeft + uiNewWidth / 2.0f;
+		const float fCenterY = uiTop + uiNewHeight / 2.0f;
+		const __m128i zero = _mm_setzero_si128();
+		const UINT uiWhite = 0xFFFFFFFF;
+
+		for ( UINT uiRow = 0; uiRow < uiNewHeight; uiRow++ )
+		{
+			// the source position of the first pixel of the row, which
+			// moves along the rotated row one pixel at a time
+			const float fDX = uiLeft + 0.5f - fCenterX;
+			const float fDY = uiTop + uiRow + 0.5f - fCenterY;
+			float fX = fCenterX + fDX * fCos - fDY * fSin - 0.5f;
+			float fY = fCenterY + fDX * fSin + fDY * fCos - 0.5f;
+
+			UINT* pTargetRow = (UINT*)( pTarget + ptrdiff_t( uiRow ) * nTargetStride );
+			for ( UINT uiPixel = 0; uiPixel < uiNewWidth; uiPixel++ )
+			{
+				const int nX = int( floor( fX ) );
+				const int nY = int( floor( fY ) );
+				const float fFractionX = fX - nX;
+				const float fFractionY = fY - nY;
+
+				// the four neighbors, white outside the page
+				UINT arrNeighbors[ 4 ] = { uiWhite, uiWhite, uiWhite, uiWhite };
+				for ( int nNeighbor = 0; nNeighbor < 4; nNeighbor++ )
+				{
+					const int nColumn = nX + ( nNeighbor & 1 );
+					const int nLine = nY + ( nNeighbor >> 1 );
+					if
+					(
+						nColumn >= 0 && nColumn < int( uiWidth ) &&
+						nLine >= 0 && nLine < int( uiHeight )
+					)
+					{
+						arrNeighbors[ nNeighbor ] = *(const UINT*)
+						(
+							pSource + ptrdiff_t( nLine ) * nStride +
+							ptrdiff_t( nColumn ) * 4
+						);
+					}
+				}
+
+				// widen the neighbors to floats and weigh them
+				const __m128i top = _mm_unpacklo_epi8
+				(
+					_mm_loadl_epi64( (const __m128i*)&arrNeighbors[ 0 ] ), zero
+				);
+				const __m128i bottom = _mm_unpacklo_epi8
+				(
+					_mm_loadl_epi64( (const __m128i*)&arrNeighbors[ 2 ] ), zero
+				);
+				const __m128 topLeft = _mm_cvtepi32_ps( _mm_unpacklo_epi16( top, zero ) );
+				const __m128 topRight = _mm_cvtepi32_ps( _mm_unpackhi_epi16( top, zero ) );
+				const __m128 bottomLeft = _mm_cvtepi32_ps( _mm_unpacklo_epi16( bottom, zero ) );
+				const __m128 bottomRight = _mm_cvtepi32_ps( _mm_unpackhi_epi16( bottom, zero ) );
+
+				const __m128 fractionX = _mm_set1_ps( fFractionX );
+				const __m128 fractionY = _mm_set1_ps( fFractionY );
+				const __m128 upper = _mm_add_ps
+				(
+					topLeft, _mm_mul_ps( _mm_sub_ps( topRight, topLeft ), fractionX )
+				);
+				const __m128 lower = _mm_add_ps
+				(
+					bottomLeft,
+					_mm_mul_ps( _mm_sub_ps( bottomRight, bottomLeft ), fractionX )
+				);
+				const __m128 result = _mm_add_ps
+				(
+					upper, _mm_mul_ps( _mm_sub_ps( lower, upper ), fractionY )
+				);
+
+				__m128i channels = _mm_cvtps_epi32( result );
+				channels = _mm_packs_epi32( channels, channels );
+				channels = _mm_packus_epi16( channels, channels );
+				pTargetRow[ uiPixel ] = UINT( _mm_cvtsi128_si32( channels ) );
+
+				fX += fCos;
+				fY += fSin;
+			}
+		}
+	}
+
+// public construction / destruction
+public:
+	// constructor
+	CDeskew()
+	{
+		m_dMaxAngle = 0.0;
+		m_dMinAngle = 0.05;
+	}
+	// destructor
+	virtual ~CDeskew()
+	{
+	}
+};
@@ -0,0 +1,344 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// this class crawls a folder tree with several threads at once using an
+// explicit queue of folders instead of recursion, and streams the files
+// it finds to the consumer as soon as they are discovered
+class CDirectoryWalker
+{
+// protected data
+protected:
+	// wild card pattern used for every folder search ("*.*" when the
+	// user did not give one)
+	CString m_csPattern;
+
+	// name of the output folders which are never searched
+	CString m_csCorrected;
+
+	// name of the folders blank pages are saved to, which are never
+	// searched (empty searches every folder)
+	CString m_csBlank;
+
+	// number of threads searching folders
+	int m_nThreads;
+
+	// folders waiting to be searched
+	deque<CString> m_arrFolders;
+
+	// files found but not yet handed to the consumer
+	deque<CString> m_arrFiles;
+
+	// number of folders currently being searched
+	int m_nActive;
+
+	// protects the queues and the active count
+	mutex m_mutex;
+
+	// signaled when a folder is queued or the search is complete
+	condition_variable m_cvFolders;
+
+	// signaled when a file is queued or the search is complete
+	condition_variable m_cvFiles;
+
+	// threads searching folders
+	vector<thread> m_arrThreads;
+
+// public properties
+public:
+	// wild card pattern used for every folder search
+	inline CString GetPattern()
+	{
+		return m_csPattern;
+	}
+	// wild card pattern used for every folder search
+	inline void SetPattern( CString value )
+	{
+		m_csPattern = value;
+	}
+	// wild card pattern used for every folder search
+	__declspec( property( get = GetPattern, put = SetPattern ) )
+		CString Pattern;
+
+	// name of the output folders which are never searched (empty searches
+	// every folder)
+	inline CString GetCorrected()
+	{
+		return m_csCorrected;
+	}
+	// name of the output folders which are never searched
+	inline void SetCorrected( CString value )
+	{
+		m_csCorrected = value;
+	}
+	// name of the output folders which are never searched
+	__declspec( property( get = GetCorrected, put = SetCorrected ) )
+		CString Corrected;
+
+	// name of the folders blank pages are saved to, which are never
+	// searched (empty searches every folder)
+	inline CString GetBlank()
+	{
+		return m_csBlank;
+	}
+	// name of the folders blank pages are saved to
+	inline void SetBlank( CString value )
+	{
+		m_csBlank = value;
+	}
+	// name of the folders blank pages are saved to
+	__declspec( property( get = GetBlank, put = SetBlank ) )
+		CString Blank;
+
+	// number of threads searching folders
+	inline int GetThreads()
+	{
+		return m_nThreads;
+	}
+	// number of threads searching folders
+	inline void SetThreads( int value )
+	{
+		m_nThreads = max( value, 1 );
+	}
+	// number of threads searching folders
+	__declspec( property( get = GetThreads, put = SetThreads ) )
+		int Threads;
+
+// protected methods
+protected:
+	// search a single folder, queueing the files and sub-folders that
+	// match the pattern
+	void SearchFolder( const CString& csFolder )
+	{
+		const int nCorrected = m_csCorrected.GetLength();
+		const CString csWildcard = csFolder + _T( "\\" ) + m_csPattern;
+
+		// collect the results locally so the lock is taken once per
+		// folder instead of once per entry
+		vector<CString> arrFolders;
+		vector<CString> arrFiles;
+
+		// the basic information level skips the short names and the
+		// large fetch flag asks for bigger batches of entries per call,
+		// which matters most on network storage
+		WIN32_FIND_DATA data;
+		HANDLE hFind = ::FindFirstFileEx
+		(
+			csWildcard, FindExInfoBasic, &data, FindExSearchNameMatch,
+			NULL, FIND_FIRST_EX_LARGE_FETCH
+		);
+		if ( hFind != INVALID_HANDLE_VALUE )
+		{
+			do
+			{
+				const LPCTSTR pszName = data.cFileName;
+
+				if ( data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY )
+				{
+					// skip "." and ".." folder names
+					if
+					(
+						pszName[ 0 ] == _T( '.' ) &&
+						(
+							pszName[ 1 ] == 0 ||
+							( pszName[ 1 ] == _T( '.' ) && pszName[ 2 ] == 0 )
+						)
+					)
+					{
+						continue;
+					}
+
+					// do not search the corrected folder
+					const int nName = (int)_tcslen( pszName );
+					if
+					(
+						nCorrected > 0 &&
+						nName >= nCorrected &&
+						0 == _tcscmp( pszName + nName - nCorrected, m_csCorrected )
+					)
+					{
+						continue;
+					}
+
+					// nor the folders the blank pages are saved to
+					if
+					(
+						!m_csBlank.IsEmpty() &&
+						0 == m_csBlank.CompareNoCase( pszName )
+					)
+					{
+						continue;
+					}
+
+					arrFolders.push_back( csFolder + _T( "\\" ) + pszName );
+
+				} else
+				{
+					arrFiles.push_back( csFolder + _T( "\\" ) + pszName );
+				}
+
+			} while ( ::FindNextFile( hFind, &data ) );
+
+			::FindClose( hFind );
+		}
+
+		lock_guard<mutex> lock( m_mutex );
+
+		if ( !arrFolders.empty() )
+		{
+			m_arrFolders.insert
+			(
+				m_arrFolders.end(), arrFolders.begin(), arrFolders.end()
+			);
+			m_cvFolders.notify_all();
+		}
+
+		if ( !arrFiles.empty() )
+		{
+			m_arrFiles.insert
+			(
+				m_arrFiles.end(), arrFiles.begin(), arrFiles.end()
+			);
+			// several consumers can take the files of one folder
+			if ( arrFiles.size() > 1 )
+			{
+				m_cvFiles.notify_all();
+
+			} else
+			{
+				m_cvFiles.notify_one();
+			}
+		}
+	}
+
+	// thread procedure that searches folders until the queue is empty
+	// and no other thread can add to it
+	void SearchThread()
+	{
+		unique_lock<mutex> lock( m_mutex );
+		do
+		{
+			m_cvFolders.wait
+			(
+				lock,
+				[ this ]
+				{
+					return !m_arrFolders.empty() || m_nActive == 0;
+				}
+			);
+
+			if ( m_arrFolders.empty() )
+			{
+				break;
+			}
+
+			const CString csFolder = m_arrFolders.front();
+			m_arrFolders.pop_front();
+			m_nActive++;
+
+			lock.unlock();
+			SearchFolder( csFolder );
+			lock.lock();
+
+			// the search is complete when nothing is queued and nothing
+			// is being searched that could queue more
+			m_nActive--;
+			if ( m_nActive == 0 && m_arrFolders.empty() )
+			{
+				m_cvFolders.notify_all();
+				m_cvFiles.notify_all();
+			}
+
+		} while ( true );
+	}
+
+// public methods
+public:
+	// start searching the tree below the given folder
+	void Start( LPCTSTR pcszFolder )
+	{
+		CString csFolder( pcszFolder );
+		csFolder.TrimRight( _T( "\\" ) );
+
+		m_arrFolders.clear();
+		m_arrFiles.clear();
+
+		// the queued root keeps the search from looking finished until
+		// the first thread picks it up
+		m_arrFolders.push_back( csFolder );
+		m_nActive = 0;
+
+		for ( int nThread = 0; nThread < m_nThreads; nThread++ )
+		{
+			m_arrThreads.push_back
+			(
+				thread( &CDirectoryWalker::SearchThread, this )
+			);
+		}
+	}
+
+	// get the next file found, waiting for the search if necessary
+	// returns false once the search is complete and every file has
+	// been handed out
+	bool GetNextFile( CString& csPath )
+	{
+		unique_lock<mutex> lock( m_mutex );
+		m_cvFiles.wait
+		(
+			lock,
+			[ this ]
+			{
+				return
+					!m_arrFiles.empty() ||
+					( m_nActive == 0 && m_arrFolders.empty() );
+			}
+		);
+
+		if ( m_arrFiles.empty() )
+		{
+			return false;
+		}
+
+		csPath = m_arrFiles.front();
+		m_arrFiles.pop_front();
+		return true;
+	}
+
+	// wait for the search threads to finish
+	void Wait()
+	{
+		for ( thread& worker : m_arrThreads )
+		{
+			worker.join();
+		}
+		m_arrThreads.clear();
+	}
+
+// public construction / destruction
+public:
+	// constructor
+	CDirectoryWalker()
+	{
+		m_csPattern = _T( "*.*" );
+		m_csCorrected = _T( "Corrected" );
+		// searching waits on the disk or the network far more than on
+		// the processor, so even small machines use a few threads
+		m_nThreads = max( (int)thread::hardware_concurrency(), 4 );
+		m_nActive = 0;
+	}
+	// destructor
+	virtual ~CDirectoryWalker()
+	{
+		Wait();
+	}
+};
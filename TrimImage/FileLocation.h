@@ -0,0 +1,138 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+#include <winioctl.h>
+
+/////////////////////////////////////////////////////////////////////////////
+// this class finds where a file starts on its volume, so files can be read
+// in the order they lie on the disk instead of the order of their names.
+// The first cluster comes from the file's retrieval pointers (NTFS and
+// FAT), and where those are not available (network shares, files small
+// enough to live in the MFT) the file index is used instead, since NTFS
+// hands out file records in roughly the order files are written
+class CFileLocation
+{
+// protected data
+protected:
+	// first logical cluster of the file on its volume
+	ULONGLONG m_ullCluster;
+
+	// index of the file on its volume
+	ULONGLONG m_ullFileIndex;
+
+	// was the first cluster found
+	bool m_bCluster;
+
+// public properties
+public:
+	// first logical cluster of the file on its volume
+	inline ULONGLONG GetCluster()
+	{
+		return m_ullCluster;
+	}
+	// first logical cluster of the file on its volume
+	__declspec( property( get = GetCluster ) )
+		ULONGLONG Cluster;
+
+	// index of the file on its volume
+	inline ULONGLONG GetFileIndex()
+	{
+		return m_ullFileIndex;
+	}
+	// index of the file on its volume
+	__declspec( property( get = GetFileIndex ) )
+		ULONGLONG FileIndex;
+
+	// was the first cluster found
+	inline bool GetHasCluster()
+	{
+		return m_bCluster;
+	}
+	// was the first cluster found
+	__declspec( property( get = GetHasCluster ) )
+		bool HasCluster;
+
+	// key to sort files by their place on the disk, where the files
+	// without a known cluster follow the others in file index order
+	inline ULONGLONG GetSortKey()
+	{
+		if ( m_bCluster )
+		{
+			return m_ullCluster;
+		}
+		return ( 1ull << 63 ) | m_ullFileIndex;
+	}
+	// key to sort files by their place on the disk
+	__declspec( property( get = GetSortKey ) )
+		ULONGLONG SortKey;
+
+// public methods
+public:
+	// find where the given file is on the disk
+	// returns false if the file cannot be opened
+	bool Read( LPCTSTR pcszPath )
+	{
+		m_ullCluster = 0;
+		m_ullFileIndex = 0;
+		m_bCluster = false;
+
+		// only the attributes are needed, which does not read the file
+		// or get in the way of anyone else using it
+		HANDLE hFile = ::CreateFile
+		(
+			pcszPath, FILE_READ_ATTRIBUTES,
+			FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL
+		);
+		if ( hFile == INVALID_HANDLE_VALUE )
+		{
+			return false;
+		}
+
+		BY_HANDLE_FILE_INFORMATION info;
+		if ( ::GetFileInformationByHandle( hFile, &info ) )
+		{
+			m_ullFileIndex =
+				( ULONGLONG( info.nFileIndexHigh ) << 32 ) | info.nFileIndexLow;
+		}
+
+		// only the first extent is wanted, so a buffer with room for
+		// one is enough and ERROR_MORE_DATA is not a failure
+		STARTING_VCN_INPUT_BUFFER input = { 0 };
+		RETRIEVAL_POINTERS_BUFFER output = { 0 };
+		DWORD dwBytes = 0;
+		const BOOL bOkay = ::DeviceIoControl
+		(
+			hFile, FSCTL_GET_RETRIEVAL_POINTERS, &input, sizeof( input ),
+			&output, sizeof( output ), &dwBytes, NULL
+		);
+		if
+		(
+			( bOkay || ::GetLastError() == ERROR_MORE_DATA ) &&
+			output.ExtentCount > 0 && output.Extents[ 0 ].Lcn.QuadPart >= 0
+		)
+		{
+			m_ullCluster = ULONGLONG( output.Extents[ 0 ].Lcn.QuadPart );
+			m_bCluster = true;
+		}
+
+		::CloseHandle( hFile );
+		return true;
+	}
+
+// public construction / destruction
+public:
+	// constructor
+	CFileLocation()
+	{
+		m_ullCluster = 0;
+		m_ullFileIndex = 0;
+		m_bCluster = false;
+	}
+	// destructor
+	virtual ~CFileLocation()
+	{
+	}
+};
@@ -0,0 +1,491 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+#include "StringSlice.h"
+#include <vector>
+#include <functional>
+#include <utility>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// how the flat map hashes and compares its keys. A key may be looked up by
+// any type the traits accept, so the default traits take only the key type
+template<class KEY>
+struct CFlatMapTraits
+{
+	// hash of a key
+	static size_t Hash( const KEY& key )
+	{
+		return hash<KEY>()( key );
+	}
+
+	// is the stored key the one looked up
+	static bool Equal( const KEY& stored, const KEY& key )
+	{
+		return stored == key;
+	}
+
+	// the key to store for the one looked up
+	static KEY ToKey( const KEY& key )
+	{
+		return key;
+	}
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// string keys are hashed from their characters, so they can be looked up
+// by a CString, a null terminated string or a slice of a longer string
+// without building a CString for the lookup
+template<>
+struct CFlatMapTraits<CString>
+{
+	// FNV-1a hash of the characters of a key
+	static size_t Hash( const CStringSlice& key )
+	{
+		ULONGLONG value = 14695981039346656037ULL;
+		const int nLength = key.Length;
+		for ( int nIndex = 0; nIndex < nLength; nIndex++ )
+		{
+			value ^= ULONGLONG( key[ nIndex ] );
+			value *= 1099511628211ULL;
+		}
+		return size_t( value );
+	}
+
+	// is the stored key the one looked up
+	static bool Equal( const CString& stored, const CStringSlice& key )
+	{
+		return CStringSlice( stored ) == key;
+	}
+
+	// the key to store for the one looked up
+	static CString ToKey( const CStringSlice& key )
+	{
+		return key.ToString();
+	}
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// this template class is a hash map of keys to values kept inline in one
+// array of slots (open addressing with linear probing), so a lookup walks
+// a few neighboring slots instead of the nodes of a tree and a value costs
+// no allocation of its own. Removed keys leave a marker behind so the
+// probes past them still work, and the array doubles once three quarters
+// of its slots are used. A map that is only read after it is built can be
+// frozen, after which any number of threads may read it without a lock
+template<class KEY, class TYPE, class TRAITS = CFlatMapTraits<KEY> >
+class CFlatMap
+{
+// public definitions
+public:
+	// a slot of the array
+	typedef struct tagSlot
+	{
+		// the key of the slot
+		KEY m_key;
+
+		// the value of the slot
+		TYPE m_value;
+
+		// hash of the key
+		size_t m_nHash;
+
+		// is the slot empty, in use or left behind by a removed key
+		BYTE m_state;
+
+	} SLOT;
+
+	// iterator over the slots in use
+	class const_iterator
+	{
+	// protected data
+	protected:
+		// the current slot
+		const SLOT* m_pSlot;
+
+		// one past the last slot
+		const SLOT* m_pEnd;
+
+	// protected methods
+	protected:
+		// move to the next slot in use (or the end)
+		void Skip()
+		{
+			while ( m_pSlot != m_pEnd && m_pSlot->m_state != FULL )
+			{
+				m_pSlot++;
+			}
+		}
+
+	// public methods
+	public:
+		// the slot in use
+		const SLOT& operator*() const
+		{
+			return *m_pSlot;
+		}
+		// the slot in use
+		const SLOT* operator->() const
+		{
+			return m_pSlot;
+		}
+		// next slot in use
+		const_iterator& operator++()
+		{
+			m_pSlot++;
+			Skip();
+			return *this;
+		}
+		// are the iterators at the same slot
+		bool operator==( const const_iterator& other ) const
+		{
+			return m_pSlot == other.m_pSlot;
+		}
+		// are the iterators at different slots
+		bool operator!=( const const_iterator& other ) const
+		{
+			return m_pSlot != other.m_pSlot;
+		}
+
+	// public construction / destruction
+	public:
+		// start at the given slot
+		const_iterator( const SLOT* pSlot, const SLOT* pEnd )
+		{
+			m_pSlot = pSlot;
+			m_pEnd = pEnd;
+			Skip();
+		}
+	};
+
+// protected definitions
+protected:
+	// state of a slot
+	enum
+	{
+		EMPTY = 0,
+		FULL = 1,
+		REMOVED = 2
+	};
+
+// protected data
+protected:
+	// the slots, a power of two of them
+	vector<SLOT> m_arrSlots;
+
+	// number of slots in use
+	int m_nCount;
+
+	// number of slots left behind by removed keys
+	int m_nRemoved;
+
+	// can the map no longer change
+	bool m_bFrozen;
+
+// protected methods
+protected:
+	// the slot holding the key or null
+	template<class LOOKUP>
+	const SLOT* Probe( const LOOKUP& key ) const
+	{
+		const size_t nSlots = m_arrSlots.size();
+		if ( m_nCount == 0 || nSlots == 0 )
+		{
+			return nullptr;
+		}
+
+		const size_t nHash = TRAITS::Hash( key );
+		const size_t nMask = nSlots - 1;
+		for ( size_t nSlot = nHash & nMask;; nSlot = ( nSlot + 1 ) & nMask )
+		{
+			const SLOT& slot = m_arrSlots[ nSlot ];
+			if ( slot.m_state == EMPTY )
+			{
+				return nullptr;
+			}
+			if
+			(
+				slot.m_state == FULL && slot.m_nHash == nHash &&
+				TRAITS::Equal( slot.m_key, key )
+			)
+			{
+				return &slot;
+			}
+		}
+	}
+
+	// move the slots in use into a new array of the given size, which
+	// also drops the slots left behind by removed keys
+	void Rehash( size_t nSlots )
+	{
+		vector<SLOT> arrOld( nSlots );
+		arrOld.swap( m_arrSlots );
+		m_nRemoved = 0;
+
+		const size_t nMask = nSlots - 1;
+		for ( SLOT& slot : arrOld )
+		{
+			if ( slot.m_state != FULL )
+			{
+				continue;
+			}
+			size_t nSlot = slot.m_nHash & nMask;
+			while ( m_arrSlots[ nSlot ].m_state != EMPTY )
+			{
+				nSlot = ( nSlot + 1 ) & nMask;
+			}
+			m_arrSlots[ nSlot ] = move( slot );
+		}
+	}
+
+// public properties
+public:
+	// number of Items
+	__declspec( property( get = count ) )
+		int Count;
+
+	// does the key exist in the map?
+	__declspec( property( get = exists ) )
+		bool Exists[];
+
+	// can the map no longer change
+	inline bool GetIsFrozen() const
+	{
+		return m_bFrozen;
+	}
+	// can the map no longer change
+	__declspec( property( get = GetIsFrozen ) )
+		bool IsFrozen;
+
+// public methods
+public:
+	// number of Items
+	inline int count() const
+	{
+		return m_nCount;
+	}
+
+	// first slot in use
+	const_iterator begin() const
+	{
+		const SLOT* pSlots = m_arrSlots.data();
+		return const_iterator( pSlots, pSlots + m_arrSlots.size() );
+	}
+
+	// one past the last slot
+	const_iterator end() const
+	{
+		const SLOT* pEnd = m_arrSlots.data() + m_arrSlots.size();
+		return const_iterator( pEnd, pEnd );
+	}
+
+	// clear all Items from the map
+	void clear()
+	{
+		ASSERT( !m_bFrozen );
+		if ( m_bFrozen )
+		{
+			return;
+		}
+		m_arrSlots.clear();
+		m_nCount = 0;
+		m_nRemoved = 0;
+	}
+
+	// make room for the given number of Items without growing again
+	void reserve( int nItems )
+	{
+		size_t nSlots = 8;
+		while ( nSlots * 3 < size_t( nItems ) * 4 )
+		{
+			nSlots *= 2;
+		}
+		if ( nSlots > m_arrSlots.size() && !m_bFrozen )
+		{
+			Rehash( nSlots );
+		}
+	}
+
+	// the map will not change again, so it may be read by any number of
+	// threads at once
+	void freeze()
+	{
+		m_bFrozen = true;
+	}
+
+	// does the key exist in the map?
+	bool exists( const KEY& key ) const
+	{
+		return Probe( key ) != nullptr;
+	}
+
+	// find a key in the map, which may be given as any type the traits
+	// can hash and compare, and return its value or null
+	template<class LOOKUP>
+	const TYPE* find( const LOOKUP& key ) const
+	{
+		const SLOT* pSlot = Probe( key );
+		return pSlot == nullptr ? nullptr : &pSlot->m_value;
+	}
+
+	// find a key in the map and return its value or null
+	template<class LOOKUP>
+	TYPE* find( const LOOKUP& key )
+	{
+		const SLOT* pSlot = Probe( key );
+		return pSlot == nullptr ? nullptr : const_cast<TYPE*>( &pSlot->m_value );
+	}
+
+	// find a key in the map, adding it with a default value if it is
+	// missing, in one walk of the slots. bAdded says which happened
+	// returns null if the map is frozen and the key is missing
+	template<class LOOKUP>
+	TYPE* insert( const LOOKUP& key, bool& bAdded )
+	{
+		bAdded = false;
+		if ( m_bFrozen )
+		{
+			return find( key );
+		}
+
+		// grow before the walk, so the slot found stays put
+		if ( size_t( m_nCount + m_nRemoved + 1 ) * 4 > m_arrSlots.size() * 3 )
+		{
+			const size_t nSlots = m_arrSlots.size();
+			Rehash
+			(
+				nSlots == 0 ? 8 :
+				size_t( m_nCount + 1 ) * 2 > nSlots ? nSlots * 2 : nSlots
+			);
+		}
+
+		const size_t nHash = TRAITS::Hash( key );
+		const size_t nMask = m_arrSlots.size() - 1;
+		SLOT* pRemoved = nullptr;
+		size_t nSlot = nHash & nMask;
+		for ( ;; nSlot = ( nSlot + 1 ) & nMask )
+		{
+			SLOT& slot = m_arrSlots[ nSlot ];
+			if ( slot.m_state == EMPTY )
+			{
+				break;
+			}
+			if ( slot.m_state == REMOVED )
+			{
+				if ( pRemoved == nullptr )
+				{
+					pRemoved = &slot;
+				}
+				continue;
+			}
+			if ( slot.m_nHash == nHash && TRAITS::Equal( slot.m_key, key ) )
+			{
+				return &slot.m_value;
+			}
+		}
+
+		// reuse the first slot left behind by a removed key on the way
+		SLOT* pSlot = &m_arrSlots[ nSlot ];
+		if ( pRemoved != nullptr )
+		{
+			pSlot = pRemoved;
+			m_nRemoved--;
+		}
+		pSlot->m_key = TRAITS::ToKey( key );
+		pSlot->m_value = TYPE();
+		pSlot->m_nHash = nHash;
+		pSlot->m_state = FULL;
+		m_nCount++;
+		bAdded = true;
+		return &pSlot->m_value;
+	}
+
+	// add a key to the map and return false if it already exists
+	bool add( const KEY& key, const TYPE& value )
+	{
+		bool bAdded = false;
+		TYPE* pValue = insert( key, bAdded );
+		if ( bAdded )
+		{
+			*pValue = value;
+		}
+		return bAdded;
+	}
+
+	// remove a key from the map
+	bool remove( const KEY& key )
+	{
+		ASSERT( !m_bFrozen );
+		SLOT* pSlot = const_cast<SLOT*>( Probe( key ) );
+		if ( pSlot == nullptr || m_bFrozen )
+		{
+			return false;
+		}
+
+		pSlot->m_key = KEY();
+		pSlot->m_value = TYPE();
+		pSlot->m_state = REMOVED;
+		m_nCount--;
+		m_nRemoved++;
+		return true;
+	}
+
+	// get deleted items returns a map of items that are missing from after
+	// that are in before
+	static bool GetDeletedItems
+	(
+		const CFlatMap<KEY, TYPE, TRAITS>& before,
+		const CFlatMap<KEY, TYPE, TRAITS>& after,
+		CFlatMap<KEY, TYPE, TRAITS>& deleted
+	)
+	{
+		for ( const SLOT& slot : before )
+		{
+			if ( !after.exists( slot.m_key ) )
+			{
+				deleted.add( slot.m_key, slot.m_value );
+			}
+		}
+
+		const bool value = deleted.Count > 0;
+		return value;
+	}
+
+	// get new items returns a map of items that are missing from before
+	// that are in after
+	static bool GetNewItems
+	(
+		const CFlatMap<KEY, TYPE, TRAITS>& before,
+		const CFlatMap<KEY, TYPE, TRAITS>& after,
+		CFlatMap<KEY, TYPE, TRAITS>& added
+	)
+	{
+		for ( const SLOT& slot : after )
+		{
+			if ( !before.exists( slot.m_key ) )
+			{
+				added.add( slot.m_key, slot.m_value );
+			}
+		}
+
+		const bool value = added.Count > 0;
+		return value;
+	}
+
+// public construction / destruction
+public:
+	// constructor
+	CFlatMap( void )
+	{
+		m_nCount = 0;
+		m_nRemoved = 0;
+		m_bFrozen = false;
+	}
+	// destructor
+	virtual ~CFlatMap( void )
+	{
+	}
+};
@@ -0,0 +1,240 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+#include <objidl.h>
+
+/////////////////////////////////////////////////////////////////////////////
+// this class builds an animated GIF out of single frame GIFs, since the
+// GDI+ GIF encoder cannot write more than one frame. Each frame is encoded
+// on its own (which can be done in parallel), and its color table and
+// compressed pixels are copied into the animation behind a graphic
+// control block carrying the frame's delay. Every frame covers the whole
+// canvas and is cleared before the next, so frames decoded already
+// composited come out the same as they went in
+class CGifMuxer
+{
+// protected data
+protected:
+	// the stream the animation is written to
+	CComPtr<IStream> m_pStream;
+
+	// number of frames written
+	UINT m_uiFrames;
+
+	// the stream could not be written
+	bool m_bFailed;
+
+// public properties
+public:
+	// number of frames written
+	inline UINT GetFrames()
+	{
+		return m_uiFrames;
+	}
+	// number of frames written
+	__declspec( property( get = GetFrames ) )
+		UINT Frames;
+
+// protected methods
+protected:
+	// write bytes to the stream
+	void Write( const void* pData, ULONG ulSize )
+	{
+		ULONG ulWritten = 0;
+		if
+		(
+			!m_bFailed &&
+			( FAILED( m_pStream->Write( pData, ulSize, &ulWritten ) ) ||
+			ulWritten != ulSize )
+		)
+		{
+			m_bFailed = true;
+		}
+	}
+
+	// write a little endian 16 bit value
+	void WriteWord( UINT uiValue )
+	{
+		const BYTE arrBytes[] = { BYTE( uiValue ), BYTE( uiValue >> 8 ) };
+		Write( arrBytes, 2 );
+	}
+
+	// skip a chain of data sub-blocks starting at the given position
+	// returns the position after the terminating block or zero if the
+	// data ends first
+	static size_t SkipSubBlocks( const BYTE* pData, size_t nSize, size_t nPos )
+	{
+		while ( nPos < nSize )
+		{
+			const BYTE length = pData[ nPos++ ];
+			if ( length == 0 )
+			{
+				return nPos;
+			}
+			nPos += length;
+		}
+		return 0;
+	}
+
+// public methods
+public:
+	// start the animation with the canvas size and the number of times
+	// it repeats (zero is forever)
+	void Begin( IStream* pStream, UINT uiWidth, UINT uiHeight, UINT uiLoops )
+	{
+		m_pStream = pStream;
+		m_uiFrames = 0;
+		m_bFailed = false;
+
+		// header and logical screen without a global color table, every
+		// frame brings its own
+		Write( "GIF89a", 6 );
+		WriteWord( uiWidth );
+		WriteWord( uiHeight );
+		const BYTE arrScreen[] = { 0x00, 0x00, 0x00 };
+		Write( arrScreen, sizeof( arrScreen ) );
+
+		// the Netscape extension holding the loop count
+		const BYTE arrLoop[] =
+		{
+			0x21, 0xFF, 0x0B,
+			'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0',
+			0x03, 0x01
+		};
+		Write( arrLoop, sizeof( arrLoop ) );
+		WriteWord( uiLoops );
+		const BYTE terminator = 0x00;
+		Write( &terminator, 1 );
+	}
+
+	// add a frame encoded as a single frame GIF, shown for the given
+	// hundredths of a second
+	// returns false if the frame is not a GIF that can be copied
+	bool AddFrame( const BYTE* pData, size_t nSize, UINT uiDelay )
+	{
+		if ( nSize < 13 || memcmp( pData, "GIF8", 4 ) != 0 )
+		{
+			return false;
+		}
+
+		// the global color table of the frame becomes its local table
+		const BYTE screen = pData[ 10 ];
+		size_t nPos = 13;
+		const BYTE* pTable = nullptr;
+		size_t nTable = 0;
+		BYTE tableBits = 0;
+		if ( screen & 0x80 )
+		{
+			tableBits = screen & 0x07;
+			nTable = size_t( 3 ) << ( tableBits + 1 );
+			pTable = pData + nPos;
+			nPos += nTable;
+		}
+
+		// keep the transparent color of the frame if it has one
+		bool bTransparent = false;
+		BYTE transparent = 0;
+
+		while ( nPos < nSize )
+		{
+			const BYTE block = pData[ nPos ];
+			if ( block == 0x21 && nPos + 1 < nSize )
+			{
+				// graphic control extension
+				if ( pData[ nPos + 1 ] == 0xF9 && nPos + 6 < nSize )
+				{
+					bTransparent = ( pData[ nPos + 3 ] & 0x01 ) != 0;
+					transparent = pData[ nPos + 6 ];
+				}
+
+				nPos = SkipSubBlocks( pData, nSize, nPos + 2 );
+				if ( nPos == 0 )
+				{
+					return false;
+				}
+				continue;
+			}
+
+			if ( block != 0x2C || nPos + 10 > nSize )
+			{
+				return false;
+			}
+
+			// graphic control extension clearing the frame after its
+			// delay, with the transparent color carried over
+			const BYTE arrControl[] =
+			{
+				0x21, 0xF9, 0x04,
+				BYTE( ( 2 << 2 ) | ( bTransparent ? 0x01 : 0x00 ) ),
+				BYTE( uiDelay ), BYTE( uiDelay >> 8 ),
+				transparent, 0x00
+			};
+			Write( arrControl, sizeof( arrControl ) );
+
+			// image descriptor, moving the color table into it unless the
+			// frame already has a local one
+			BYTE arrDescriptor[ 10 ];
+			memcpy( arrDescriptor, pData + nPos, sizeof( arrDescriptor ) );
+			nPos += sizeof( arrDescriptor );
+			if ( ( arrDescriptor[ 9 ] & 0x80 ) == 0 && pTable != nullptr )
+			{
+				arrDescriptor[ 9 ] = BYTE
+				(
+					( arrDescriptor[ 9 ] & 0x40 ) | 0x80 | tableBits
+				);
+			} else
+			{
+				pTable = nullptr;
+			}
+			Write( arrDescriptor, sizeof( arrDescriptor ) );
+			if ( pTable != nullptr )
+			{
+				Write( pTable, ULONG( nTable ) );
+			}
+
+			// the local color table (if any), the minimum code size and
+			// the compressed pixels are copied as they are
+			const size_t nStart = nPos;
+			if ( arrDescriptor[ 9 ] & 0x80 && pTable == nullptr )
+			{
+				nPos += size_t( 3 ) << ( ( arrDescriptor[ 9 ] & 0x07 ) + 1 );
+			}
+			nPos = SkipSubBlocks( pData, nSize, nPos + 1 );
+			if ( nPos == 0 )
+			{
+				return false;
+			}
+			Write( pData + nStart, ULONG( nPos - nStart ) );
+
+			m_uiFrames++;
+			return !m_bFailed;
+		}
+
+		return false;
+	}
+
+	// finish the animation
+	// returns false if anything could not be written
+	bool End()
+	{
+		const BYTE trailer = 0x3B;
+		Write( &trailer, 1 );
+		m_pStream.Release();
+		return !m_bFailed && m_uiFrames > 0;
+	}
+
+// public construction / destruction
+public:
+	// constructor
+	CGifMuxer()
+	{
+		m_uiFrames = 0;
+		m_bFailed = false;
+	}
+	// destructor
+	virtual ~CGifMuxer()
+	{
+	}
+};
@@ -0,0 +1,711 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+#include "PixelBufferPool.h"
+#include "GridOverlay.h"
+#include <emmintrin.h>
+#include <vector>
+#include <memory>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// this class applies an ordered chain of operations to the trimmed pixels
+// (32 bits per pixel) of an image, given on the command line as a comma
+// separated list like "crop,rotate90,resize:1600x0,grid". The operations
+// are fused so the pixels are gone over as few times as possible: the
+// rotations and flips (along with the EXIF orientation of the image) are
+// folded into a single turn, which is done while the resized pixels are
+// written out, and the resize filters each source row horizontally once
+// into a band of only as many rows as the vertical filter uses, which it
+// then filters vertically, so no whole image filtered one way is kept.
+// The grid is drawn straight into the finished pixels
+class CImageChain
+{
+// public definitions
+public:
+	// the filter used to resize
+	typedef enum
+	{
+		FILTER_LANCZOS,
+		FILTER_BOX
+
+	} FILTER;
+
+	// a rotation by a multiple of 90 degrees and / or a flip as a matrix
+	// taking the column and row of a pixel to its new column and row
+	typedef struct tagTurn
+	{
+		int m_nXX;
+		int m_nXY;
+		int m_nYX;
+		int m_nYY;
+
+	} TURN;
+
+	// the pixels the chain produced
+	typedef struct tagOutput
+	{
+		// the new pixels, or nullptr if the pixels given were changed
+		// where they are
+		unique_ptr<CPixelBuffer> m_pPixels;
+
+		// dimensions of the new pixels
+		UINT m_uiWidth;
+		UINT m_uiHeight;
+
+		// number of bytes in each row of the new pixels
+		INT m_nStride;
+
+		// resolution in dots per inch, scaled by the resize so the
+		// printed size does not change
+		float m_fHorizontalResolution;
+		float m_fVerticalResolution;
+
+	} OUTPUT;
+
+// protected definitions
+protected:
+	// the filter taps of every pixel along one axis of the resize
+	typedef struct tagAxis
+	{
+		// first source pixel of each destination pixel
+		vector<UINT> m_arrFirst;
+
+		// number of source pixels of each destination pixel
+		vector<UINT> m_arrCount;
+
+		// weights of the source pixels, m_uiTaps for each destination
+		vector<float> m_arrWeights;
+
+		// most source pixels any destination pixel uses
+		UINT m_uiTaps;
+
+	} AXIS;
+
+// protected data
+protected:
+	// number of operations in the chain
+	UINT m_uiOperations;
+
+	// the rotations and flips of the chain in order
+	TURN m_turn;
+
+	// is there a resize in the chain
+	bool m_bResize;
+
+	// requested dimensions of the resize (zero keeps the aspect ratio)
+	UINT m_uiResizeWidth;
+	UINT m_uiResizeHeight;
+
+	// do the rotations before the resize swap the width and height
+	bool m_bResizeSwap;
+
+	// the filter used to resize
+	FILTER m_filter;
+
+	// is a grid drawn on the result
+	bool m_bGrid;
+
+// public properties
+public:
+	// are there no operations to apply
+	inline bool GetIsEmpty()
+	{
+		return m_uiOperations == 0;
+	}
+	// are there no operations to apply
+	__declspec( property( get = GetIsEmpty ) )
+		bool IsEmpty;
+
+	// is a grid drawn on the result
+	inline bool GetGrid()
+	{
+		return m_bGrid;
+	}
+	// is a grid drawn on the result
+	__declspec( property( get = GetGrid ) )
+		bool Grid;
+
+// protected methods
+protected:
+	// the turn that does nothing
+	static TURN GetIdentity()
+	{
+		const TURN value = { 1, 0, 0, 1 };
+		return value;
+	}
+
+	// the turn doing the first and then the second
+	static TURN Compose( const TURN& first, const TURN& then )
+	{
+		TURN value;
+		value.m_nXX = then.m_nXX * first.m_nXX + then.m_nXY * first.m_nYX;
+		value.m_nXY = then.m_nXX * first.m_nXY + then.m_nXY * first.m_nYY;
+		value.m_nYX = then.m_nYX * first.m_nXX + then.m_nYY * first.m_nYX;
+		value.m_nYY = then.m_nYX * first.m_nXY + then.m_nYY * first.m_nYY;
+		return value;
+	}
+
+	// does the turn swap the width and the height
+	static bool IsTransposing( const TURN& turn )
+	{
+		return turn.m_nXX == 0;
+	}
+
+	// does the turn leave every pixel where it is
+	static bool IsIdentity( const TURN& turn )
+	{
+		return
+			turn.m_nXX == 1 && turn.m_nXY == 0 &&
+			turn.m_nYX == 0 && turn.m_nYY == 1;
+	}
+
+	// the turn displaying an image stored with the given EXIF orientation
+	static TURN GetOrientationTurn( UINT uiOrientation )
+	{
+		switch ( uiOrientation )
+		{
+			case 2: // mirrored left to right
+			{
+				const TURN value = { -1, 0, 0, 1 };
+				return value;
+			}
+			case 3: // rotated 180 degrees
+			{
+				const TURN value = { -1, 0, 0, -1 };
+				return value;
+			}
+			case 4: // mirrored top to bottom
+			{
+				const TURN value = { 1, 0, 0, -1 };
+				return value;
+			}
+			case 5: // rows and columns swapped
+			{
+				const TURN value = { 0, 1, 1, 0 };
+				return value;
+			}
+			case 6: // rotated 90 degrees clockwise to be displayed
+			{
+				const TURN value = { 0, -1, 1, 0 };
+				return value;
+			}
+			case 7: // rows and columns swapped the other way
+			{
+				const TURN value = { 0, -1, -1, 0 };
+				return value;
+			}
+			case 8: // rotated 90 degrees counter clockwise to be displayed
+			{
+				const TURN value = { 0, 1, -1, 0 };
+				return value;
+			}
+			default:
+				return GetIdentity();
+		}
+	}
+
+	// the value of the resize filter at the given distance in pixels
+	static float Kernel( FILTER filter, float fDistance )
+	{
+		if ( filter == FILTER_BOX )
+		{
+			return fDistance >= -0.5f && fDistance < 0.5f ? 1.0f : 0.0f;
+		}
+
+		// Lanczos with three lobes
+		const float fAbsolute = fabs( fDistance );
+		if ( fAbsolute < 1e-6f )
+		{
+			return 1.0f;
+		}
+		if ( fAbsolute >= 3.0f )
+		{
+			return 0.0f;
+		}
+		const float fPi = 3.14159265f * fAbsolute;
+		return 3.0f * sin( fPi ) * sin( fPi / 3.0f ) / ( fPi * fPi );
+	}
+
+	// the pixels either side of the center the filter reaches
+	static float Support( FILTER filter )
+	{
+		return filter == FILTER_BOX ? 0.5f : 3.0f;
+	}
+
+	// work out the taps and weights of every destination pixel along an
+	// axis of the given source and destination lengths
+	static void BuildAxis( UINT uiSource, UINT uiDestination, FILTER filter, AXIS& axis )
+	{
+		const float fScale = float( uiSource ) / float( uiDestination );
+
+		// shrinking widens the filter so every source pixel is used
+		const float fStretch = max( fScale, 1.0f );
+		const float fSupport = Support( filter ) * fStretch;
+
+		axis.m_uiTaps = UINT( ceil( fSupport ) ) * 2 + 2;
+		axis.m_arrFirst.resize( uiDestination );
+		axis.m_arrCount.resize( uiDestination );
+		axis.m_arrWeights.assign( size_t( uiDestination ) * axis.m_uiTaps, 0.0f );
+
+		for ( UINT uiPixel = 0; uiPixel < uiDestination; uiPixel++ )
+		{
+			const float fCenter = ( uiPixel + 0.5f ) * fScale;
+			const int nFirst = max( int( floor( fCenter - fSupport ) ), 0 );
+			const int nLast =
+				min( int( ceil( fCenter + fSupport ) ), int( uiSource ) - 1 );
+
+			float* pWeights = &axis.m_arrWeights[ size_t( uiPixel ) * axis.m_uiTaps ];
+			float fTotal = 0.0f;
+			UINT uiCount = 0;
+			for
+			(
+				int nSource = nFirst;
+				nSource <= nLast && uiCount < axis.m_uiTaps;
+				nSource++
+			)
+			{
+				const float fWeight =
+					Kernel( filter, ( nSource + 0.5f - fCenter ) / fStretch );
+				pWeights[ uiCount++ ] = fWeight;
+				fTotal += fWeight;
+			}
+
+			// the weights add up to one so flat areas stay the same
+			if ( fabs( fTotal ) < 1e-6f )
+			{
+				axis.m_arrFirst[ uiPixel ] =
+					min( UINT( fCenter ), uiSource - 1 );
+				axis.m_arrCount[ uiPixel ] = 1;
+				pWeights[ 0 ] = 1.0f;
+				continue;
+			}
+			for ( UINT uiTap = 0; uiTap < uiCount; uiTap++ )
+			{
+				pWeights[ uiTap ] /= fTotal;
+			}
+			axis.m_arrFirst[ uiPixel ] = UINT( nFirst );
+			axis.m_arrCount[ uiPixel ] = uiCount;
+		}
+	}
+
+	// where the first pixel of a row of the source ends up after the turn,
+	// in bytes from the start of the destination
+	static ptrdiff_t GetTurnedOffset
+	(
+		const TURN& turn, UINT uiRow, UINT uiWidth, UINT uiHeight, INT nStride
+	)
+	{
+		const int nColumn =
+			turn.m_nXY * int( uiRow ) +
+			( turn.m_nXX < 0 ? int( uiWidth ) - 1 : 0 ) +
+			( turn.m_nXY < 0 ? int( uiHeight ) - 1 : 0 );
+		const int nRow =
+			turn.m_nYY * int( uiRow ) +
+			( turn.m_nYX < 0 ? int( uiWidth ) - 1 : 0 ) +
+			( turn.m_nYY < 0 ? int( uiHeight ) - 1 : 0 );
+		return ptrdiff_t( nRow ) * nStride + ptrdiff_t( nColumn ) * 4;
+	}
+
+	// bytes between neighboring pixels of a source row after the turn
+	static ptrdiff_t GetTurnedStep( const TURN& turn, INT nStride )
+	{
+		return ptrdiff_t( turn.m_nYX ) * nStride + ptrdiff_t( turn.m_nXX ) * 4;
+	}
+
+	// filter a row of the source horizontally into four floats a pixel
+	static void FilterRow( const UINT* pSource, const AXIS& axis, float* pTarget )
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const UINT uiWidth = UINT( axis.m_arrFirst.size() );
+		for ( UINT uiPixel = 0; uiPixel < uiWidth; uiPixel++ )
+		{
+			const UINT* pTaps = pSource + axis.m_arrFirst[ uiPixel ];
+			const float* pWeights =
+				&axis.m_arrWeights[ size_t( uiPixel ) * axis.m_uiTaps ];
+			const UINT uiCount = axis.m_arrCount[ uiPixel ];
+
+			__m128 sum = _mm_setzero_ps();
+			for ( UINT uiTap = 0; uiTap < uiCount; uiTap++ )
+			{
+				// widen the four channels of the pixel to floats
+				__m128i pixel = _mm_cvtsi32_si128( int( pTaps[ uiTap ] ) );
+				pixel = _mm_unpacklo_epi8( pixel, zero );
+				pixel = _mm_unpacklo_epi16( pixel, zero );
+				sum = _mm_add_ps
+				(
+					sum,
+					_mm_mul_ps
+					(
+						_mm_cvtepi32_ps( pixel ), _mm_set1_ps( pWeights[ uiTap ] )
+					)
+				);
+			}
+			_mm_storeu_ps( pTarget + size_t( uiPixel ) * 4, sum );
+		}
+	}
+
+	// resize the source into the destination while turning it, a band of
+	// horizontally filtered rows is kept for the vertical filter, each
+	// source row being filtered once
+	void Resample
+	(
+		const BYTE* pSource, UINT uiWidth, UINT uiHeight, INT nStride,
+		UINT uiNewWidth, UINT uiNewHeight, const TURN& turn,
+		BYTE* pTarget, INT nTargetStride
+	) const
+	{
+		AXIS horizontal;
+		AXIS vertical;
+		BuildAxis( uiWidth, uiNewWidth, m_filter, horizontal );
+		BuildAxis( uiHeight, uiNewHeight, m_filter, vertical );
+
+		// the band holds as many filtered rows as a destination row uses
+		const UINT uiBand = vertical.m_uiTaps;
+		vector<float> arrBand( size_t( uiBand ) * uiNewWidth * 4 );
+		vector<int> arrBandRow( uiBand, -1 );
+		vector<const float*> arrRows( uiBand );
+
+		const ptrdiff_t nStep = GetTurnedStep( turn, nTargetStride );
+		for ( UINT uiRow = 0; uiRow < uiNewHeight; uiRow++ )
+		{
+			const UINT uiFirst = vertical.m_arrFirst[ uiRow ];
+			const UINT uiCount = vertical.m_arrCount[ uiRow ];
+			const float* pWeights =
+				&vertical.m_arrWeights[ size_t( uiRow ) * vertical.m_uiTaps ];
+
+			// the rows used move down with the destination row, so the
+			// rows not filtered yet replace the ones no longer needed
+			for ( UINT uiTap = 0; uiTap < uiCount; uiTap++ )
+			{
+				const UINT uiSource = uiFirst + uiTap;
+				const UINT uiSlot = uiSource % uiBand;
+				float* pRow = &arrBand[ size_t( uiSlot ) * uiNewWidth * 4 ];
+				if ( arrBandRow[ uiSlot ] != int( uiSource ) )
+				{
+					FilterRow
+					(
+						(const UINT*)( pSource + ptrdiff_t( uiSource ) * nStride ),
+						horizontal, pRow
+					);
+					arrBandRow[ uiSlot ] = int( uiSource );
+				}
+				arrRows[ uiTap ] = pRow;
+			}
+
+			BYTE* pPixel = pTarget + GetTurnedOffset
+			(
+				turn, uiRow, uiNewWidth, uiNewHeight, nTargetStride
+			);
+			for ( UINT uiPixel = 0; uiPixel < uiNewWidth; uiPixel++ )
+			{
+				__m128 sum = _mm_setzero_ps();
+				for ( UINT uiTap = 0; uiTap < uiCount; uiTap++ )
+				{
+					sum = _mm_add_ps
+					(
+						sum,
+						_mm_mul_ps
+						(
+							_mm_loadu_ps( arrRows[ uiTap ] + size_t( uiPixel ) * 4 ),
+							_mm_set1_ps( pWeights[ uiTap ] )
+						)
+					);
+				}
+
+				// round and clamp the channels back into bytes
+				__m128i channels = _mm_cvtps_epi32( sum );
+				channels = _mm_packs_epi32( channels, channels );
+				channels = _mm_packus_epi16( channels, channels );
+				*(UINT*)pPixel = UINT( _mm_cvtsi128_si32( channels ) );
+				pPixel += nStep;
+			}
+		}
+	}
+
+	// turn the source into the destination without resizing it
+	static void Turn
+	(
+		const BYTE* pSource, UINT uiWidth, UINT uiHeight, INT nStride,
+		const TURN& turn, BYTE* pTarget, INT nTargetStride
+	)
+	{
+		const ptrdiff_t nStep = GetTurnedStep( turn, nTargetStride );
+		for ( UINT uiRow = 0; uiRow < uiHeight; uiRow++ )
+		{
+			const UINT* pRow = (const UINT*)( pSource + ptrdiff_t( uiRow ) * nStride );
+			BYTE* pPixel = pTarget + GetTurnedOffset
+			(
+				turn, uiRow, uiWidth, uiHeight, nTargetStride
+			);
+			for ( UINT uiPixel = 0; uiPixel < uiWidth; uiPixel++ )
+			{
+				*(UINT*)pPixel = pRow[ uiPixel ];
+				pPixel += nStep;
+			}
+		}
+	}
+
+	// read an operation of the chain
+	// returns false if the operation is not known
+	bool ParseOperation( const CString& csOperation )
+	{
+		TURN turn = GetIdentity();
+		if ( csOperation == _T( "crop" ) )
+		{
+			// the margins are always trimmed first
+			return m_uiOperations == 0;
+
+		} else if ( csOperation == _T( "rotate90" ) )
+		{
+			const TURN value = { 0, -1, 1, 0 };
+			turn = value;
+
+		} else if ( csOperation == _T( "rotate180" ) )
+		{
+			const TURN value = { -1, 0, 0, -1 };
+			turn = value;
+
+		} else if ( csOperation == _T( "rotate270" ) )
+		{
+			const TURN value = { 0, 1, -1, 0 };
+			turn = value;
+
+		} else if ( csOperation == _T( "fliph" ) )
+		{
+			const TURN value = { -1, 0, 0, 1 };
+			turn = value;
+
+		} else if ( csOperation == _T( "flipv" ) )
+		{
+			const TURN value = { 1, 0, 0, -1 };
+			turn = value;
+
+		} else if ( csOperation == _T( "grid" ) )
+		{
+			m_bGrid = true;
+			m_uiOperations++;
+			return true;
+
+		} else if ( csOperation.Left( 7 ) == _T( "resize:" ) && !m_bResize )
+		{
+			// resize:widthxheight[:lanczos|box]
+			int nStart = 7;
+			const CString csSize = csOperation.Tokenize( _T( ":" ), nStart );
+			const CString csFilter = csOperation.Tokenize( _T( ":" ), nStart );
+			const int nSeparator = csSize.Find( _T( 'x' ) );
+			if ( nSeparator == -1 )
+			{
+				return false;
+			}
+			m_uiResizeWidth = UINT( max( _tstol( csSize.Left( nSeparator ) ), 0L ) );
+			m_uiResizeHeight = UINT( max( _tstol( csSize.Mid( nSeparator + 1 ) ), 0L ) );
+			if ( m_uiResizeWidth == 0 && m_uiResizeHeight == 0 )
+			{
+				return false;
+			}
+
+			if ( csFilter == _T( "box" ) )
+			{
+				m_filter = FILTER_BOX;
+
+			} else if ( csFilter.IsEmpty() || csFilter == _T( "lanczos" ) )
+			{
+				m_filter = FILTER_LANCZOS;
+
+			} else
+			{
+				return false;
+			}
+
+			// the size is that of the image at this point of the chain
+			m_bResizeSwap = IsTransposing( m_turn );
+			m_bResize = true;
+			m_uiOperations++;
+			return true;
+
+		} else
+		{
+			return false;
+		}
+
+		m_turn = Compose( m_turn, turn );
+		m_uiOperations++;
+		return true;
+	}
+
+// public methods
+public:
+	// read the chain in the form of a comma separated list of operations
+	// returns false if any of the operations is not valid
+	bool Parse( const CString& csChain )
+	{
+		m_uiOperations = 0;
+		m_turn = GetIdentity();
+		m_bResize = false;
+		m_bResizeSwap = false;
+		m_bGrid = false;
+
+		int nStart = 0;
+		CString csOperation = csChain.Tokenize( _T( "," ), nStart );
+		while ( !csOperation.IsEmpty() )
+		{
+			csOperation.Trim();
+			if ( !ParseOperation( csOperation ) )
+			{
+				return false;
+			}
+			csOperation = csChain.Tokenize( _T( "," ), nStart );
+		}
+
+		return true;
+	}
+
+	// the dimensions of the result for trimmed pixels of the given
+	// dimensions and EXIF orientation, along with the dimensions of the
+	// resize before it is turned
+	void GetOutputSize
+	(
+		UINT uiWidth, UINT uiHeight, UINT uiOrientation,
+		UINT& uiNewWidth, UINT& uiNewHeight,
+		UINT& uiOutputWidth, UINT& uiOutputHeight
+	)
+	{
+		const TURN orientation = GetOrientationTurn( uiOrientation );
+		const TURN turn = Compose( orientation, m_turn );
+
+		uiNewWidth = uiWidth;
+		uiNewHeight = uiHeight;
+		if ( m_bResize )
+		{
+			// the dimensions of the image at the resize
+			const bool bSwap = IsTransposing( orientation ) != m_bResizeSwap;
+			const UINT uiFrameWidth = bSwap ? uiHeight : uiWidth;
+			const UINT uiFrameHeight = bSwap ? uiWidth : uiHeight;
+
+			UINT uiResizeWidth = m_uiResizeWidth;
+			UINT uiResizeHeight = m_uiResizeHeight;
+			if ( uiResizeWidth == 0 )
+			{
+				uiResizeWidth = UINT
+				(
+					double( uiFrameWidth ) * uiResizeHeight / uiFrameHeight + 0.5
+				);
+			} else if ( uiResizeHeight == 0 )
+			{
+				uiResizeHeight = UINT
+				(
+					double( uiFrameHeight ) * uiResizeWidth / uiFrameWidth + 0.5
+				);
+			}
+
+			uiNewWidth = max( bSwap ? uiResizeHeight : uiResizeWidth, 1u );
+			uiNewHeight = max( bSwap ? uiResizeWidth : uiResizeHeight, 1u );
+		}
+
+		const bool bTransposed = IsTransposing( turn );
+		uiOutputWidth = bTransposed ? uiNewHeight : uiNewWidth;
+		uiOutputHeight = bTransposed ? uiNewWidth : uiNewHeight;
+	}
+
+	// apply the chain to the trimmed pixels of an image with the given
+	// EXIF orientation, which is applied to the pixels as well so the
+	// result is upright, and the given grid is drawn if the chain has one
+	// returns false if the memory for the result is not available
+	bool Apply
+	(
+		BYTE* pPixels, UINT uiWidth, UINT uiHeight, INT nStride,
+		UINT uiOrientation, float fHorizontalResolution,
+		float fVerticalResolution, CPixelBufferPool& pool, 
+		CGridOverlay& grid, OUTPUT& output
+	)
+	{
+		const TURN turn = Compose( GetOrientationTurn( uiOrientation ), m_turn );
+
+		UINT uiNewWidth = uiWidth;
+		UINT uiNewHeight = uiHeight;
+		GetOutputSize
+		(
+			uiWidth, uiHeight, uiOrientation, uiNewWidth, uiNewHeight,
+			output.m_uiWidth, output.m_uiHeight
+		);
+
+		// keep the printed size of the image the same
+		const float fHorizontal =
+			fHorizontalResolution * uiNewWidth / float( uiWidth );
+		const float fVertical =
+			fVerticalResolution * uiNewHeight / float( uiHeight );
+		const bool bTransposed = IsTransposing( turn );
+		output.m_fHorizontalResolution = bTransposed ? fVertical : fHorizontal;
+		output.m_fVerticalResolution = bTransposed ? fHorizontal : fVertical;
+
+		// with nothing to move the grid is drawn on the pixels given
+		const bool bResize = uiNewWidth != uiWidth || uiNewHeight != uiHeight;
+		if ( !bResize && IsIdentity( turn ) )
+		{
+			output.m_pPixels.reset();
+			output.m_nStride = nStride;
+			if ( m_bGrid )
+			{
+				grid.Draw( pPixels, uiWidth, uiHeight, nStride );
+			}
+			return true;
+		}
+
+		output.m_nStride = INT( ( output.m_uiWidth * 4 + 63 ) & ~63u );
+		output.m_pPixels.reset
+		(
+			new CPixelBuffer
+			(
+				pool, size_t( output.m_nStride ) * output.m_uiHeight
+			)
+		);
+		BYTE* pTarget = output.m_pPixels->Data;
+		if ( pTarget == nullptr )
+		{
+			return false;
+		}
+
+		if ( bResize )
+		{
+			Resample
+			(
+				pPixels, uiWidth, uiHeight, nStride, uiNewWidth, uiNewHeight,
+				turn, pTarget, output.m_nStride
+			);
+		} else
+		{
+			Turn( pPixels, uiWidth, uiHeight, nStride, turn, pTarget, output.m_nStride );
+		}
+
+		if ( m_bGrid )
+		{
+			grid.Draw( pTarget, output.m_uiWidth, output.m_uiHeight, output.m_nStride );
+		}
+		return true;
+	}
+
+// public construction / destruction
+public:
+	// constructor
+	CImageChain()
+	{
+		m_uiOperations = 0;
+		m_turn = GetIdentity();
+		m_bResize = false;
+		m_uiResizeWidth = 0;
+		m_uiResizeHeight = 0;
+		m_bResizeSwap = false;
+		m_filter = FILTER_LANCZOS;
+		m_bGrid = false;
+	}
+	// destructor
+	virtual ~CImageChain()
+	{
+	}
+};
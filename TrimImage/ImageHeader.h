@@ -0,0 +1,432 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+#include "MappedFile.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// this class reads the dimensions and pixel depth of an image from the
+// header of its file without decoding it, which is cheap enough to do for
+// every file before deciding when and where to decode it. JPEG, PNG, GIF,
+// BMP and TIFF headers are understood
+class CImageHeader
+{
+// protected data
+protected:
+	// width of the image in pixels
+	UINT m_uiWidth;
+
+	// height of the image in pixels
+	UINT m_uiHeight;
+
+	// bits per pixel of the stored image
+	UINT m_uiBitsPerPixel;
+
+	// number of bytes in the file
+	ULONGLONG m_ullFileSize;
+
+// public properties
+public:
+	// width of the image in pixels
+	inline UINT GetWidth()
+	{
+		return m_uiWidth;
+	}
+	// width of the image in pixels
+	__declspec( property( get = GetWidth ) )
+		UINT Width;
+
+	// height of the image in pixels
+	inline UINT GetHeight()
+	{
+		return m_uiHeight;
+	}
+	// height of the image in pixels
+	__declspec( property( get = GetHeight ) )
+		UINT Height;
+
+	// bits per pixel of the stored image
+	inline UINT GetBitsPerPixel()
+	{
+		return m_uiBitsPerPixel;
+	}
+	// bits per pixel of the stored image
+	__declspec( property( get = GetBitsPerPixel ) )
+		UINT BitsPerPixel;
+
+	// number of bytes in the file
+	inline ULONGLONG GetFileSize()
+	{
+		return m_ullFileSize;
+	}
+	// number of bytes in the file
+	__declspec( property( get = GetFileSize ) )
+		ULONGLONG FileSize;
+
+// protected methods
+protected:
+	// read a big endian 16 bit value
+	static inline UINT GetWordBE( const BYTE* p )
+	{
+		return ( UINT( p[ 0 ] ) << 8 ) | p[ 1 ];
+	}
+
+	// read a big endian 32 bit value
+	static inline UINT GetLongBE( const BYTE* p )
+	{
+		return
+			( UINT( p[ 0 ] ) << 24 ) | ( UINT( p[ 1 ] ) << 16 ) |
+			( UINT( p[ 2 ] ) << 8 ) | p[ 3 ];
+	}
+
+	// read a little endian 16 bit value
+	static inline UINT GetWordLE( const BYTE* p )
+	{
+		return ( UINT( p[ 1 ] ) << 8 ) | p[ 0 ];
+	}
+
+	// read a little endian 32 bit value
+	static inline UINT GetLongLE( const BYTE* p )
+	{
+		return
+			( UINT( p[ 3 ] ) << 24 ) | ( UINT( p[ 2 ] ) << 16 ) |
+			( UINT( p[ 1 ] ) << 8 ) | p[ 0 ];
+	}
+
+	// walk the JPEG markers up to the start of frame
+	bool ProbeJpeg( const BYTE* pData, size_t nSize )
+	{
+		size_t nPos = 2;
+		while ( nPos + 4 <= nSize )
+		{
+			if ( pData[ nPos ] != 0xFF )
+			{
+				return false;
+			}
+
+			const BYTE marker = pData[ nPos + 1 ];
+
+			// fill bytes and markers without a length
+			if
+			(
+				marker == 0xFF || marker == 0x01 ||
+				( marker >= 0xD0 && marker <= 0xD8 )
+			)
+			{
+				nPos += marker == 0xFF ? 1 : 2;
+				continue;
+			}
+
+			// start of scan or end of image without a frame header
+			if ( marker == 0xDA || marker == 0xD9 )
+			{
+				return false;
+			}
+
+			const UINT uiLength = GetWordBE( pData + nPos + 2 );
+
+			// every start of frame marker except DHT, JPG and DAC
+			if
+			(
+				marker >= 0xC0 && marker <= 0xCF &&
+				marker != 0xC4 && marker != 0xC8 && marker != 0xCC
+			)
+			{
+				if ( nPos + 10 > nSize )
+				{
+					return false;
+				}
+
+				const BYTE* pFrame = pData + nPos + 4;
+				m_uiHeight = GetWordBE( pFrame + 1 );
+				m_uiWidth = GetWordBE( pFrame + 3 );
+				m_uiBitsPerPixel = UINT( pFrame[ 0 ] ) * pFrame[ 5 ];
+				return true;
+			}
+
+			nPos += 2 + uiLength;
+		}
+
+		return false;
+	}
+
+	// read the PNG image header chunk
+	bool ProbePng( const BYTE* pData, size_t nSize )
+	{
+		if ( nSize < 26 || memcmp( pData + 12, "IHDR", 4 ) != 0 )
+		{
+			return false;
+		}
+
+		m_uiWidth = GetLongBE( pData + 16 );
+		m_uiHeight = GetLongBE( pData + 20 );
+
+		// the number of channels follows from the color type
+		UINT uiChannels = 1;
+		switch ( pData[ 25 ] )
+		{
+			case 2: uiChannels = 3; break;
+			case 4: uiChannels = 2; break;
+			case 6: uiChannels = 4; break;
+		}
+		m_uiBitsPerPixel = UINT( pData[ 24 ] ) * uiChannels;
+		return true;
+	}
+
+	// read the GIF logical screen descriptor
+	bool ProbeGif( const BYTE* pData, size_t nSize )
+	{
+		if ( nSize < 10 )
+		{
+			return false;
+		}
+
+		m_uiWidth = GetWordLE( pData + 6 );
+		m_uiHeight = GetWordLE( pData + 8 );
+		m_uiBitsPerPixel = 8;
+		return true;
+	}
+
+	// read the BMP information header
+	bool ProbeBmp( const BYTE* pData, size_t nSize )
+	{
+		if ( nSize < 26 )
+		{
+			return false;
+		}
+
+		// the old OS/2 core header has 16 bit dimensions
+		const UINT uiHeader = GetLongLE( pData + 14 );
+		if ( uiHeader == 12 )
+		{
+			m_uiWidth = GetWordLE( pData + 18 );
+			m_uiHeight = GetWordLE( pData + 20 );
+			m_uiBitsPerPixel = GetWordLE( pData + 24 );
+			return true;
+		}
+
+		if ( nSize < 30 )
+		{
+			return false;
+		}
+
+		// a negative height is a top down bitmap
+		m_uiWidth = GetLongLE( pData + 18 );
+		m_uiHeight = UINT( abs( int( GetLongLE( pData + 22 ) ) ) );
+		m_uiBitsPerPixel = GetWordLE( pData + 28 );
+		return true;
+	}
+
+	// read the first image file directory of a TIFF
+	bool ProbeTiff( const BYTE* pData, size_t nSize )
+	{
+		if ( nSize < 8 )
+		{
+			return false;
+		}
+
+		const bool bIntel = pData[ 0 ] == 'I';
+		auto Word = [ bIntel ]( const BYTE* p )
+		{
+			return bIntel ? GetWordLE( p ) : GetWordBE( p );
+		};
+		auto Long = [ bIntel ]( const BYTE* p )
+		{
+			return bIntel ? GetLongLE( p ) : GetLongBE( p );
+		};
+
+		const size_t nIFD = Long( pData + 4 );
+		if ( nIFD + 2 > nSize )
+		{
+			return false;
+		}
+
+		UINT uiBitsPerSample = 1;
+		UINT uiSamplesPerPixel = 1;
+
+		const UINT uiEntries = Word( pData + nIFD );
+		for ( UINT uiEntry = 0; uiEntry < uiEntries; uiEntry++ )
+		{
+			const BYTE* pEntry = pData + nIFD + 2 + uiEntry * 12;
+			if ( pEntry + 12 > pData + nSize )
+			{
+				break;
+			}
+
+			// short values sit in the first half of the value field
+			const UINT uiTag = Word( pEntry );
+			const UINT uiType = Word( pEntry + 2 );
+			const UINT uiValue =
+				uiType == 3 ? Word( pEntry + 8 ) : Long( pEntry + 8 );
+
+			switch ( uiTag )
+			{
+				case 256: // ImageWidth
+					m_uiWidth = uiValue;
+					break;
+				case 257: // ImageLength
+					m_uiHeight = uiValue;
+					break;
+				case 258: // BitsPerSample (the same for every sample)
+				{
+					const UINT uiCount = Long( pEntry + 4 );
+					if ( uiCount <= 2 || uiType != 3 )
+					{
+						uiBitsPerSample = uiValue;
+
+					} else if ( uiValue + 2 <= nSize )
+					{
+						uiBitsPerSample = Word( pData + uiValue );
+					}
+					break;
+				}
+				case 277: // SamplesPerPixel
+					uiSamplesPerPixel = uiValue;
+					break;
+			}
+		}
+
+		m_uiBitsPerPixel = uiBitsPerSample * uiSamplesPerPixel;
+		return m_uiWidth != 0 && m_uiHeight != 0;
+	}
+
+	// read the header from a mapped view of the file, where a file cut 
+	// short or lost over the network raises an in page error, which fails
+	// the read instead of the process
+	// returns false if the view cannot be read or the format is not
+	// recognized
+	bool ProbeMapped( const BYTE* pData, size_t nSize )
+	{
+		__try
+		{
+			return Probe( pData, nSize );
+		}
+		__except 
+		( 
+			GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ?
+				EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH 
+		)
+		{
+			return false;
+		}
+	}
+
+// public methods
+public:
+	// the file extension of the format the data is in, found from the
+	// magic bytes at its start rather than a name
+	// returns an empty string if the format is not recognized
+	static CString GetExtension( const BYTE* pData, size_t nSize )
+	{
+		if ( nSize < 4 )
+		{
+			return _T( "" );
+		}
+
+		if ( pData[ 0 ] == 0xFF && pData[ 1 ] == 0xD8 )
+		{
+			return _T( ".jpg" );
+		}
+		if ( nSize >= 8 && memcmp( pData, "\x89PNG\r\n\x1A\n", 8 ) == 0 )
+		{
+			return _T( ".png" );
+		}
+		if ( memcmp( pData, "GIF8", 4 ) == 0 )
+		{
+			return _T( ".gif" );
+		}
+		if ( pData[ 0 ] == 'B' && pData[ 1 ] == 'M' )
+		{
+			return _T( ".bmp" );
+		}
+		if
+		(
+			memcmp( pData, "II*\0", 4 ) == 0 ||
+			memcmp( pData, "MM\0*", 4 ) == 0
+		)
+		{
+			return _T( ".tif" );
+		}
+
+		return _T( "" );
+	}
+
+	// read the header from the start of the file in memory
+	// returns false if the format is not recognized
+	bool Probe( const BYTE* pData, size_t nSize )
+	{
+		m_uiWidth = 0;
+		m_uiHeight = 0;
+		m_uiBitsPerPixel = 0;
+		m_ullFileSize = nSize;
+
+		if ( nSize < 4 )
+		{
+			return false;
+		}
+
+		if ( pData[ 0 ] == 0xFF && pData[ 1 ] == 0xD8 )
+		{
+			return ProbeJpeg( pData, nSize );
+		}
+		if ( nSize >= 8 && memcmp( pData, "\x89PNG\r\n\x1A\n", 8 ) == 0 )
+		{
+			return ProbePng( pData, nSize );
+		}
+		if ( memcmp( pData, "GIF8", 4 ) == 0 )
+		{
+			return ProbeGif( pData, nSize );
+		}
+		if ( pData[ 0 ] == 'B' && pData[ 1 ] == 'M' )
+		{
+			return ProbeBmp( pData, nSize );
+		}
+		if
+		(
+			memcmp( pData, "II*\0", 4 ) == 0 ||
+			memcmp( pData, "MM\0*", 4 ) == 0
+		)
+		{
+			return ProbeTiff( pData, nSize );
+		}
+
+		return false;
+	}
+
+	// read the header of the given file through a read only mapping,
+	// so only the pages holding the header are read from the disk
+	// returns false if the file cannot be read or the format is not
+	// recognized
+	bool Probe( LPCTSTR pcszPath )
+	{
+		CMappedFile file;
+		if ( !file.Open( pcszPath ) )
+		{
+			m_ullFileSize = 0;
+			return false;
+		}
+
+		const size_t nSize = (size_t)file.Size;
+		const bool value = ProbeMapped( file.Data, nSize );
+
+		// keep the real size if the file is larger than the address space
+		m_ullFileSize = file.Size;
+		return value;
+	}
+
+// public construction / destruction
+public:
+	// constructor
+	CImageHeader()
+	{
+		m_uiWidth = 0;
+		m_uiHeight = 0;
+		m_uiBitsPerPixel = 0;
+		m_ullFileSize = 0;
+	}
+	// destructor
+	virtual ~CImageHeader()
+	{
+	}
+};
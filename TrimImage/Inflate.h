@@ -0,0 +1,492 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+#include <vector>
+#include <new>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// this class decompresses raw deflate data (RFC 1951), which is how the
+// entries of a zip file are usually compressed. It decodes the Huffman
+// codes a bit at a time from their counts per length, which is small and
+// plenty fast next to decoding the images inside. The output is never
+// allowed past the size the archive declared, so a small entry cannot
+// expand into all of memory, and it must come to exactly that size with
+// the declared CRC-32
+class CInflate
+{
+// protected definitions
+protected:
+	// a Huffman code given by the number of codes of each length and
+	// the symbols in order of their codes
+	typedef struct tagHuffman
+	{
+		short m_arrCount[ 16 ];
+		short m_arrSymbol[ 288 ];
+
+	} HUFFMAN;
+
+// protected data
+protected:
+	// the compressed data
+	const BYTE* m_pInput;
+
+	// number of bytes of compressed data
+	size_t m_nInput;
+
+	// the next byte of compressed data
+	size_t m_nPosition;
+
+	// bits read but not used yet
+	UINT m_uiBits;
+
+	// number of bits read but not used yet
+	UINT m_uiBitCount;
+
+	// did the compressed data run out or make no sense
+	bool m_bFailed;
+
+	// the decompressed data
+	vector<BYTE>* m_pOutput;
+
+	// the most bytes the decompressed data may come to
+	size_t m_nLimit;
+
+// protected methods
+protected:
+	// the next given number of bits (up to 16)
+	UINT GetBits( UINT uiCount )
+	{
+		while ( m_uiBitCount < uiCount )
+		{
+			if ( m_nPosition >= m_nInput )
+			{
+				m_bFailed = true;
+				return 0;
+			}
+			m_uiBits |= UINT( m_pInput[ m_nPosition++ ] ) << m_uiBitCount;
+			m_uiBitCount += 8;
+		}
+
+		const UINT value = m_uiBits & ( ( 1u << uiCount ) - 1 );
+		m_uiBits >>= uiCount;
+		m_uiBitCount -= uiCount;
+		return value;
+	}
+
+	// build a code from the length of the code of each symbol
+	// returns false if the lengths are not a usable code
+	static bool Build( HUFFMAN& code, const short* pLengths, int nSymbols )
+	{
+		memset( code.m_arrCount, 0, sizeof( code.m_arrCount ) );
+		for ( int nSymbol = 0; nSymbol < nSymbols; nSymbol++ )
+		{
+			code.m_arrCount[ pLengths[ nSymbol ] ]++;
+		}
+		if ( code.m_arrCount[ 0 ] == nSymbols )
+		{
+			return true;
+		}
+
+		// more codes of a length than there is room for
+		int nLeft = 1;
+		for ( int nLength = 1; nLength < 16; nLength++ )
+		{
+			nLeft <<= 1;
+			nLeft -= code.m_arrCount[ nLength ];
+			if ( nLeft < 0 )
+			{
+				return false;
+			}
+		}
+
+		short arrOffsets[ 16 ];
+		arrOffsets[ 1 ] = 0;
+		for ( int nLength = 1; nLength < 15; nLength++ )
+		{
+			arrOffsets[ nLength + 1 ] =
+				arrOffsets[ nLength ] + code.m_arrCount[ nLength ];
+		}
+		for ( int nSymbol = 0; nSymbol < nSymbols; nSymbol++ )
+		{
+			if ( pLengths[ nSymbol ] != 0 )
+			{
+				code.m_arrSymbol[ arrOffsets[ pLengths[ nSymbol ] ]++ ] =
+					short( nSymbol );
+			}
+		}
+		return true;
+	}
+
+	// the next symbol of the given code or -1
+	int Decode( const HUFFMAN& code )
+	{
+		int nCode = 0;
+		int nFirst = 0;
+		int nIndex = 0;
+		for ( int nLength = 1; nLength < 16; nLength++ )
+		{
+			nCode |= int( GetBits( 1 ) );
+			const int nCount = code.m_arrCount[ nLength ];
+			if ( nCode - nCount < nFirst )
+			{
+				return code.m_arrSymbol[ nIndex + ( nCode - nFirst ) ];
+			}
+			nIndex += nCount;
+			nFirst += nCount;
+			nFirst <<= 1;
+			nCode <<= 1;
+		}
+		m_bFailed = true;
+		return -1;
+	}
+
+	// copy a block that is not compressed
+	bool Stored()
+	{
+		m_uiBits = 0;
+		m_uiBitCount = 0;
+		if ( m_nPosition + 4 > m_nInput )
+		{
+			return false;
+		}
+
+		const UINT uiLength =
+			m_pInput[ m_nPosition ] | ( m_pInput[ m_nPosition + 1 ] << 8 );
+		const UINT uiComplement =
+			m_pInput[ m_nPosition + 2 ] | ( m_pInput[ m_nPosition + 3 ] << 8 );
+		m_nPosition += 4;
+		if ( uiLength != ( ~uiComplement & 0xFFFF ) || m_nPosition + uiLength > m_nInput )
+		{
+			return false;
+		}
+
+		if ( m_pOutput->size() + uiLength > m_nLimit )
+		{
+			return false;
+		}
+		m_pOutput->insert
+		(
+			m_pOutput->end(), m_pInput + m_nPosition, m_pInput + m_nPosition + uiLength
+		);
+		m_nPosition += uiLength;
+		return true;
+	}
+
+	// decode the literals and copies of a compressed block
+	bool Codes( const HUFFMAN& lengths, const HUFFMAN& distances )
+	{
+		static const short arrLengthBase[ 29 ] =
+		{
+			3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+			35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+		};
+		static const short arrLengthExtra[ 29 ] =
+		{
+			0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+			3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+		};
+		static const short arrDistanceBase[ 30 ] =
+		{
+			1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+			257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+			8193, 12289, 16385, 24577
+		};
+		static const short arrDistanceExtra[ 30 ] =
+		{
+			0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+			7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+		};
+
+		vector<BYTE>& output = *m_pOutput;
+		do
+		{
+			int nSymbol = Decode( lengths );
+			if ( m_bFailed || nSymbol < 0 )
+			{
+				return false;
+			}
+			if ( nSymbol < 256 )
+			{
+				if ( output.size() >= m_nLimit )
+				{
+					return false;
+				}
+				output.push_back( BYTE( nSymbol ) );
+				continue;
+			}
+			if ( nSymbol == 256 )
+			{
+				return true;
+			}
+
+			nSymbol -= 257;
+			if ( nSymbol >= 29 )
+			{
+				return false;
+			}
+			const size_t nLength =
+				arrLengthBase[ nSymbol ] + GetBits( arrLengthExtra[ nSymbol ] );
+
+			nSymbol = Decode( distances );
+			if ( m_bFailed || nSymbol < 0 || nSymbol >= 30 )
+			{
+				return false;
+			}
+			const size_t nDistance =
+				arrDistanceBase[ nSymbol ] + GetBits( arrDistanceExtra[ nSymbol ] );
+			if
+			(
+				m_bFailed || nDistance > output.size() ||
+				output.size() + nLength > m_nLimit
+			)
+			{
+				return false;
+			}
+
+			// the copy may overlap what it is copying, so go a byte at a
+			// time
+			size_t nFrom = output.size() - nDistance;
+			for ( size_t nByte = 0; nByte < nLength; nByte++ )
+			{
+				output.push_back( output[ nFrom++ ] );
+			}
+
+		} while ( true );
+	}
+
+	// decode a block compressed with the fixed codes
+	bool Fixed()
+	{
+		static HUFFMAN lengths;
+		static HUFFMAN distances;
+		static const bool bBuilt = []
+		{
+			// literals 0 to 143 are 8 bits, 144 to 255 are 9, 256 to 279
+			// are 7 and the rest are 8, and all the distances are 5
+			short arrLengths[ 288 ];
+			for ( int nSymbol = 0; nSymbol < 288; nSymbol++ )
+			{
+				arrLengths[ nSymbol ] =
+					nSymbol < 144 ? 8 : nSymbol < 256 ? 9 : nSymbol < 280 ? 7 : 8;
+			}
+			Build( lengths, arrLengths, 288 );
+
+			for ( int nSymbol = 0; nSymbol < 30; nSymbol++ )
+			{
+				arrLengths[ nSymbol ] = 5;
+			}
+			Build( distances, arrLengths, 30 );
+			return true;
+		}();
+
+		return bBuilt && Codes( lengths, distances );
+	}
+
+	// decode a block compressed with codes given at its start
+	bool Dynamic()
+	{
+		static const short arrOrder[ 19 ] =
+		{
+			16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+		};
+
+		const int nLengthCodes = int( GetBits( 5 ) ) + 257;
+		const int nDistanceCodes = int( GetBits( 5 ) ) + 1;
+		const int nCodeCodes = int( GetBits( 4 ) ) + 4;
+		if ( m_bFailed || nLengthCodes > 286 || nDistanceCodes > 30 )
+		{
+			return false;
+		}
+
+		// the code the lengths of the other two codes are given in
+		short arrLengths[ 320 ] = { 0 };
+		for ( int nIndex = 0; nIndex < nCodeCodes; nIndex++ )
+		{
+			arrLengths[ arrOrder[ nIndex ] ] = short( GetBits( 3 ) );
+		}
+		HUFFMAN code;
+		if ( !Build( code, arrLengths, 19 ) )
+		{
+			return false;
+		}
+
+		// the lengths of the literal and length code followed by those of
+		// the distance code, with runs of lengths
+		const int nTotal = nLengthCodes + nDistanceCodes;
+		int nIndex = 0;
+		while ( nIndex < nTotal )
+		{
+			const int nSymbol = Decode( code );
+			if ( m_bFailed || nSymbol < 0 )
+			{
+				return false;
+			}
+			if ( nSymbol < 16 )
+			{
+				arrLengths[ nIndex++ ] = short( nSymbol );
+				continue;
+			}
+
+			short nLength = 0;
+			int nRepeat = 0;
+			if ( nSymbol == 16 )
+			{
+				if ( nIndex == 0 )
+				{
+					return false;
+				}
+				nLength = arrLengths[ nIndex - 1 ];
+				nRepeat = 3 + int( GetBits( 2 ) );
+
+			} else if ( nSymbol == 17 )
+			{
+				nRepeat = 3 + int( GetBits( 3 ) );
+
+			} else
+			{
+				nRepeat = 11 + int( GetBits( 7 ) );
+			}
+			if ( m_bFailed || nIndex + nRepeat > nTotal )
+			{
+				return false;
+			}
+			while ( nRepeat-- > 0 )
+			{
+				arrLengths[ nIndex++ ] = nLength;
+			}
+		}
+
+		// a block without an end code cannot end
+		if ( arrLengths[ 256 ] == 0 )
+		{
+			return false;
+		}
+
+		HUFFMAN lengths;
+		HUFFMAN distances;
+		if
+		(
+			!Build( lengths, arrLengths, nLengthCodes ) ||
+			!Build( distances, arrLengths + nLengthCodes, nDistanceCodes )
+		)
+		{
+			return false;
+		}
+
+		return Codes( lengths, distances );
+	}
+
+// public methods
+public:
+	// the CRC-32 of the data, as zip files record it for each entry
+	static DWORD Crc32( const BYTE* pData, size_t nSize )
+	{
+		static DWORD arrTable[ 256 ];
+		static const bool bBuilt = []
+		{
+			for ( DWORD dwByte = 0; dwByte < 256; dwByte++ )
+			{
+				DWORD dwValue = dwByte;
+				for ( int nBit = 0; nBit < 8; nBit++ )
+				{
+					dwValue = ( dwValue & 1 ) ?
+						0xEDB88320 ^ ( dwValue >> 1 ) : dwValue >> 1;
+				}
+				arrTable[ dwByte ] = dwValue;
+			}
+			return true;
+		}();
+
+		DWORD value = 0xFFFFFFFF;
+		for ( size_t nByte = 0; bBuilt && nByte < nSize; nByte++ )
+		{
+			value = arrTable[ ( value ^ pData[ nByte ] ) & 0xFF ] ^ ( value >> 8 );
+		}
+		return ~value;
+	}
+
+	// decompress the data into the output, which must come to exactly
+	// the given size and CRC-32. Decompressing stops as soon as the output
+	// would grow past that size
+	// returns false if the data is damaged or memory runs out
+	bool Decompress
+	(
+		const BYTE* pInput, size_t nInput, vector<BYTE>& output,
+		size_t nExpected, DWORD dwCrc
+	)
+	{
+		m_pInput = pInput;
+		m_nInput = nInput;
+		m_nPosition = 0;
+		m_uiBits = 0;
+		m_uiBitCount = 0;
+		m_bFailed = false;
+		m_pOutput = &output;
+		m_nLimit = nExpected;
+		output.clear();
+
+		// the output is reserved whole, so it never grows while decoding
+		try
+		{
+			output.reserve( nExpected );
+		}
+		catch ( const bad_alloc& )
+		{
+			return false;
+		}
+
+		bool bLast = false;
+		do
+		{
+			bLast = GetBits( 1 ) != 0;
+			const UINT uiType = GetBits( 2 );
+			bool bOkay = false;
+			switch ( uiType )
+			{
+				case 0:
+					bOkay = Stored();
+					break;
+				case 1:
+					bOkay = Fixed();
+					break;
+				case 2:
+					bOkay = Dynamic();
+					break;
+				default:
+					break;
+			}
+			if ( m_bFailed || !bOkay )
+			{
+				return false;
+			}
+
+		} while ( !bLast );
+
+		return
+			output.size() == nExpected &&
+			Crc32( output.data(), output.size() ) == dwCrc;
+	}
+
+// public construction / destruction
+public:
+	// constructor
+	CInflate()
+	{
+		m_pInput = nullptr;
+		m_nInput = 0;
+		m_nPosition = 0;
+		m_uiBits = 0;
+		m_uiBitCount = 0;
+		m_bFailed = false;
+		m_pOutput = nullptr;
+		m_nLimit = 0;
+	}
+	// destructor
+	virtual ~CInflate()
+	{
+	}
+};
@@ -0,0 +1,355 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+#include <deque>
+#include <list>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// this class runs the images through several worker threads at once while
+// keeping the memory they need within a budget. Before a job starts its
+// peak memory is estimated (from the image header) and the job is only
+// admitted if it fits in what is left of the budget, so a handful of huge
+// scans cannot land on the workers at the same time. Small jobs keep
+// flowing on the other workers while a big one waits, but once a waiting
+// job has been passed over often enough nothing else is admitted until it
+// has run, so the big job cannot be starved
+class CJobScheduler
+{
+// public definitions
+public:
+	// estimates the peak memory in bytes of processing the file
+	typedef function<ULONGLONG( const CString& csPath )> ESTIMATE_CALLBACK;
+
+	// processes the file
+	typedef function<void( const CString& csPath )> JOB_CALLBACK;
+
+// protected definitions
+protected:
+	// a job that has been estimated and is waiting for memory
+	typedef struct tagWaiting
+	{
+		// estimated peak memory of the job
+		ULONGLONG m_ullBytes;
+
+		// number of jobs admitted ahead of this one while it waited
+		int m_nPassedOver;
+
+	} WAITING;
+
+// protected data
+protected:
+	// files waiting for a worker
+	deque<CString> m_arrQueue;
+
+	// jobs waiting for memory in the order they started waiting
+	list<WAITING> m_listWaiting;
+
+	// the worker threads
+	vector<thread> m_arrWorkers;
+
+	// number of worker threads
+	int m_nThreads;
+
+	// the most memory the running jobs are allowed to need at once
+	ULONGLONG m_ullMaxMemory;
+
+	// estimated memory of the running jobs
+	ULONGLONG m_ullUsed;
+
+	// the most estimated memory of the jobs running at once
+	ULONGLONG m_ullPeak;
+
+	// number of jobs that had to wait for memory
+	ULONGLONG m_ullDelayed;
+
+	// number of jobs run
+	ULONGLONG m_ullJobs;
+
+	// the most files waiting for a worker before Queue blocks, which
+	// keeps the folder search from running far ahead of the workers
+	size_t m_nMaxQueued;
+
+	// times a waiting job can be passed over before it gets priority
+	int m_nMaxPassedOver;
+
+	// no more files will be queued
+	bool m_bClosing;
+
+	// estimates the memory of a job
+	ESTIMATE_CALLBACK m_onEstimate;
+
+	// processes a file
+	JOB_CALLBACK m_onJob;
+
+	// protects everything above
+	mutex m_mutex;
+
+	// signaled when a file is queued or the scheduler is closing
+	condition_variable m_cvQueued;
+
+	// signaled when room is made in the queue
+	condition_variable m_cvRoom;
+
+	// signaled when memory is given back
+	condition_variable m_cvMemory;
+
+// public properties
+public:
+	// number of worker threads
+	inline int GetThreads()
+	{
+		return m_nThreads;
+	}
+	// number of worker threads
+	inline void SetThreads( int value )
+	{
+		m_nThreads = max( value, 1 );
+	}
+	// number of worker threads
+	__declspec( property( get = GetThreads, put = SetThreads ) )
+		int Threads;
+
+	// the most memory the running jobs are allowed to need at once
+	inline ULONGLONG GetMaxMemory()
+	{
+		return m_ullMaxMemory;
+	}
+	// the most memory the running jobs are allowed to need at once
+	inline void SetMaxMemory( ULONGLONG value )
+	{
+		m_ullMaxMemory = value;
+	}
+	// the most memory the running jobs are allowed to need at once
+	__declspec( property( get = GetMaxMemory, put = SetMaxMemory ) )
+		ULONGLONG MaxMemory;
+
+	// the most files waiting for a worker before Queue blocks
+	inline size_t GetMaxQueued()
+	{
+		return m_nMaxQueued;
+	}
+	// the most files waiting for a worker before Queue blocks
+	inline void SetMaxQueued( size_t value )
+	{
+		m_nMaxQueued = max( value, size_t( 1 ) );
+	}
+	// the most files waiting for a worker before Queue blocks
+	__declspec( property( get = GetMaxQueued, put = SetMaxQueued ) )
+		size_t MaxQueued;
+
+	// the most estimated memory of the jobs running at once
+	inline ULONGLONG GetPeak()
+	{
+		return m_ullPeak;
+	}
+	// the most estimated memory of the jobs running at once
+	__declspec( property( get = GetPeak ) )
+		ULONGLONG Peak;
+
+	// number of jobs that had to wait for memory
+	inline ULONGLONG GetDelayed()
+	{
+		return m_ullDelayed;
+	}
+	// number of jobs that had to wait for memory
+	__declspec( property( get = GetDelayed ) )
+		ULONGLONG Delayed;
+
+	// number of jobs run
+	inline ULONGLONG GetJobs()
+	{
+		return m_ullJobs;
+	}
+	// number of jobs run
+	__declspec( property( get = GetJobs ) )
+		ULONGLONG Jobs;
+
+// protected methods
+protected:
+	// can the waiting job be admitted (the lock must be held)
+	bool CanAdmit( list<WAITING>::iterator posJob )
+	{
+		// a job that has been passed over too often blocks everyone
+		// behind it until it has run
+		for
+		(
+			list<WAITING>::iterator pos = m_listWaiting.begin();
+			pos != posJob; ++pos
+		)
+		{
+			if ( pos->m_nPassedOver >= m_nMaxPassedOver )
+			{
+				return false;
+			}
+		}
+
+		// a job bigger than the whole budget runs on its own
+		if ( m_ullUsed == 0 )
+		{
+			return true;
+		}
+
+		return
+			m_ullMaxMemory == 0 ||
+			m_ullUsed + posJob->m_ullBytes <= m_ullMaxMemory;
+	}
+
+	// wait until the estimated memory fits in the budget and take it
+	void Admit( ULONGLONG ullBytes )
+	{
+		unique_lock<mutex> lock( m_mutex );
+
+		WAITING waiting = { ullBytes, 0 };
+		list<WAITING>::iterator posJob =
+			m_listWaiting.insert( m_listWaiting.end(), waiting );
+
+		if ( !CanAdmit( posJob ) )
+		{
+			m_ullDelayed++;
+			m_cvMemory.wait( lock, [ & ] { return CanAdmit( posJob ); } );
+		}
+
+		// every job still waiting ahead of this one was passed over
+		for
+		(
+			list<WAITING>::iterator pos = m_listWaiting.begin();
+			pos != posJob; ++pos
+		)
+		{
+			pos->m_nPassedOver++;
+		}
+		m_listWaiting.erase( posJob );
+
+		m_ullUsed += ullBytes;
+		m_ullPeak = max( m_ullPeak, m_ullUsed );
+		m_ullJobs++;
+
+		// jobs held back by this one may fit now that it is out of the way
+		lock.unlock();
+		m_cvMemory.notify_all();
+	}
+
+	// give the memory of a finished job back to the budget
+	void Finish( ULONGLONG ullBytes )
+	{
+		{
+			lock_guard<mutex> lock( m_mutex );
+			m_ullUsed -= ullBytes;
+		}
+		m_cvMemory.notify_all();
+	}
+
+	// the worker threads take files off the queue until it is closed
+	// and empty
+	void Work()
+	{
+		CString csPath;
+		do
+		{
+			{
+				unique_lock<mutex> lock( m_mutex );
+				m_cvQueued.wait
+				(
+					lock, [ & ] { return !m_arrQueue.empty() || m_bClosing; }
+				);
+				if ( m_arrQueue.empty() )
+				{
+					break;
+				}
+
+				csPath = m_arrQueue.front();
+				m_arrQueue.pop_front();
+			}
+			m_cvRoom.notify_one();
+
+			// reading the header happens outside the lock so the workers
+			// estimate their jobs in parallel
+			const ULONGLONG ullBytes =
+				m_onEstimate ? m_onEstimate( csPath ) : 0;
+
+			Admit( ullBytes );
+			m_onJob( csPath );
+			Finish( ullBytes );
+
+		} while ( true );
+	}
+
+// public methods
+public:
+	// start the worker threads
+	void Start( JOB_CALLBACK onJob, ESTIMATE_CALLBACK onEstimate )
+	{
+		m_onJob = onJob;
+		m_onEstimate = onEstimate;
+		m_bClosing = false;
+
+		// a job can be passed over a few times for every worker before
+		// the workers are drained to make room for it
+		m_nMaxPassedOver = m_nThreads * 4;
+
+		for ( int nThread = 0; nThread < m_nThreads; nThread++ )
+		{
+			m_arrWorkers.push_back( thread( &CJobScheduler::Work, this ) );
+		}
+	}
+
+	// add a file to be processed, waiting if the queue is full
+	void Queue( const CString& csPath )
+	{
+		{
+			unique_lock<mutex> lock( m_mutex );
+			m_cvRoom.wait
+			(
+				lock, [ & ] { return m_arrQueue.size() < m_nMaxQueued; }
+			);
+			m_arrQueue.push_back( csPath );
+		}
+		m_cvQueued.notify_one();
+	}
+
+	// finish the queued files and stop the worker threads
+	void Close()
+	{
+		{
+			lock_guard<mutex> lock( m_mutex );
+			m_bClosing = true;
+		}
+		m_cvQueued.notify_all();
+
+		for ( thread& worker : m_arrWorkers )
+		{
+			worker.join();
+		}
+		m_arrWorkers.clear();
+	}
+
+// public construction / destruction
+public:
+	// constructor
+	CJobScheduler()
+	{
+		m_nThreads = max( int( thread::hardware_concurrency() ), 1 );
+		m_ullMaxMemory = 0;
+		m_ullUsed = 0;
+		m_ullPeak = 0;
+		m_ullDelayed = 0;
+		m_ullJobs = 0;
+		m_nMaxQueued = 64;
+		m_nMaxPassedOver = 4;
+		m_bClosing = false;
+	}
+	// destructor
+	virtual ~CJobScheduler()
+	{
+		Close();
+	}
+};
@@ -0,0 +1,969 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+#include <vector>
+#include <climits>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// this class rewrites the entropy coding of a baseline JPEG with Huffman
+// tables built for the image instead of the standard tables the encoder
+// uses, which is lossless since only the codes of the symbols change and
+// never the coefficients they describe. The scans are decoded twice, once
+// to count the symbols and once to write them with the new codes, so the
+// coefficients are never held in memory. Progressive and arithmetic coded
+// images are left as they are
+class CJpegOptimizer
+{
+// protected definitions
+protected:
+	// a Huffman table (DC tables are 0 to 3 and AC tables 4 to 7)
+	typedef struct tagHuffman
+	{
+		// number of codes of each length from 1 to 16
+		BYTE m_arrBits[ 17 ];
+
+		// the symbols in the order of their codes
+		BYTE m_arrValues[ 256 ];
+
+		// the code of each symbol
+		WORD m_arrCode[ 256 ];
+
+		// the length of the code of each symbol (zero is no code)
+		BYTE m_arrSize[ 256 ];
+
+		// was the table given
+		bool m_bDefined;
+
+	} HUFFMAN;
+
+	// a component of the frame
+	typedef struct tagComponent
+	{
+		int m_nID;
+		int m_nH;
+		int m_nV;
+
+	} COMPONENT;
+
+	// a scan of the image
+	typedef struct tagScan
+	{
+		// the components of the frame in the scan
+		int m_arrComponent[ 4 ];
+
+		// the tables of each component of the scan
+		int m_arrDC[ 4 ];
+		int m_arrAC[ 4 ];
+
+		// number of components in the scan
+		int m_nComponents;
+
+		// the restart interval in effect for the scan
+		UINT m_uiRestart;
+
+		// where the entropy coded data starts and ends
+		size_t m_nStart;
+		size_t m_nEnd;
+
+	} SCAN;
+
+	// a marker segment of the file
+	typedef struct tagSegment
+	{
+		// where the segment starts and its length with the marker
+		size_t m_nOffset;
+		size_t m_nLength;
+
+		// the marker of the segment
+		BYTE m_marker;
+
+		// the scan following the segment (-1 is none)
+		int m_nScan;
+
+	} SEGMENT;
+
+	// number of tables
+	static const int TABLES = 8;
+
+// protected data
+protected:
+	// the tables given in the file
+	HUFFMAN m_arrTables[ TABLES ];
+
+	// the tables built for the image
+	HUFFMAN m_arrOptimal[ TABLES ];
+
+	// number of times each symbol of each table is used
+	ULONG m_arrFrequency[ TABLES ][ 257 ];
+
+	// the components of the frame
+	vector<COMPONENT> m_arrComponents;
+
+	// the largest sampling factors of the components
+	int m_nMaxH;
+	int m_nMaxV;
+
+	// dimensions of the image
+	UINT m_uiWidth;
+	UINT m_uiHeight;
+
+	// the file
+	const BYTE* m_pData;
+	size_t m_nSize;
+
+	// the next byte of the scan being read
+	size_t m_nPosition;
+
+	// the end of the scan being read
+	size_t m_nEnd;
+
+	// bits read but not used yet
+	UINT m_uiBits;
+
+	// number of bits read but not used yet
+	int m_nBitCount;
+
+	// did the scan run out or make no sense
+	bool m_bFailed;
+
+	// the file being written (null while counting the symbols)
+	vector<BYTE>* m_pOutput;
+
+	// bits waiting to be written
+	UINT m_uiOutBits;
+
+	// number of bits waiting to be written
+	int m_nOutCount;
+
+// protected methods
+protected:
+	// a big endian word
+	static inline UINT GetWord( const BYTE* p )
+	{
+		return ( UINT( p[ 0 ] ) << 8 ) | p[ 1 ];
+	}
+
+	// the next bit of the scan, where a 0xFF byte is followed by a zero
+	// byte that is not part of the data
+	UINT GetBit()
+	{
+		if ( m_nBitCount == 0 )
+		{
+			if ( m_nPosition >= m_nEnd )
+			{
+				m_bFailed = true;
+				return 0;
+			}
+
+			const BYTE value = m_pData[ m_nPosition++ ];
+			if ( value == 0xFF )
+			{
+				// a marker in the middle of a block is a damaged scan
+				if ( m_nPosition >= m_nEnd || m_pData[ m_nPosition ] != 0 )
+				{
+					m_bFailed = true;
+					return 0;
+				}
+				m_nPosition++;
+			}
+			m_uiBits = value;
+			m_nBitCount = 8;
+		}
+
+		m_nBitCount--;
+		return ( m_uiBits >> m_nBitCount ) & 1;
+	}
+
+	// the next given number of bits of the scan
+	UINT GetBits( int nCount )
+	{
+		UINT value = 0;
+		while ( nCount-- > 0 )
+		{
+			value = ( value << 1 ) | GetBit();
+		}
+		return value;
+	}
+
+	// the next symbol of the given table or -1
+	int Decode( const HUFFMAN& table )
+	{
+		int nCode = 0;
+		int nFirst = 0;
+		int nIndex = 0;
+		for ( int nLength = 1; nLength <= 16; nLength++ )
+		{
+			nCode |= int( GetBit() );
+			const int nCount = table.m_arrBits[ nLength ];
+			if ( nCode - nFirst < nCount )
+			{
+				return table.m_arrValues[ nIndex + nCode - nFirst ];
+			}
+			nIndex += nCount;
+			nFirst += nCount;
+			nFirst <<= 1;
+			nCode <<= 1;
+		}
+		m_bFailed = true;
+		return -1;
+	}
+
+	// write the given number of bits, following every 0xFF byte with a
+	// zero byte
+	void PutBits( UINT uiCode, int nSize )
+	{
+		m_uiOutBits = ( m_uiOutBits << nSize ) | ( uiCode & ( ( 1u << nSize ) - 1 ) );
+		m_nOutCount += nSize;
+		while ( m_nOutCount >= 8 )
+		{
+			m_nOutCount -= 8;
+			const BYTE value = BYTE( m_uiOutBits >> m_nOutCount );
+			m_pOutput->push_back( value );
+			if ( value == 0xFF )
+			{
+				m_pOutput->push_back( 0 );
+			}
+		}
+		m_uiOutBits &= ( 1u << m_nOutCount ) - 1;
+	}
+
+	// fill the last byte with one bits
+	void FlushBits()
+	{
+		if ( m_nOutCount > 0 )
+		{
+			PutBits( 0xFF, 8 - m_nOutCount );
+		}
+		m_uiOutBits = 0;
+		m_nOutCount = 0;
+	}
+
+	// count a symbol, or write it with its new code followed by the
+	// given extra bits
+	void PutSymbol( int nTable, int nSymbol, UINT uiExtra, int nExtra )
+	{
+		if ( m_pOutput == nullptr )
+		{
+			m_arrFrequency[ nTable ][ nSymbol ]++;
+			return;
+		}
+
+		const HUFFMAN& table = m_arrOptimal[ nTable ];
+		if ( table.m_arrSize[ nSymbol ] == 0 )
+		{
+			m_bFailed = true;
+			return;
+		}
+		PutBits( table.m_arrCode[ nSymbol ], table.m_arrSize[ nSymbol ] );
+		if ( nExtra > 0 )
+		{
+			PutBits( uiExtra, nExtra );
+		}
+	}
+
+	// work out the code of each symbol from the number of codes of each
+	// length
+	static void BuildCodes( HUFFMAN& table )
+	{
+		memset( table.m_arrSize, 0, sizeof( table.m_arrSize ) );
+		UINT uiCode = 0;
+		int nIndex = 0;
+		for ( int nLength = 1; nLength <= 16; nLength++ )
+		{
+			for ( int nCount = 0; nCount < table.m_arrBits[ nLength ]; nCount++ )
+			{
+				const BYTE symbol = table.m_arrValues[ nIndex++ ];
+				table.m_arrCode[ symbol ] = WORD( uiCode++ );
+				table.m_arrSize[ symbol ] = BYTE( nLength );
+			}
+			uiCode <<= 1;
+		}
+	}
+
+	// build the table with the shortest codes for the given frequencies,
+	// no longer than 16 bits and without a code of all ones (annex K.2 of
+	// the JPEG standard)
+	// returns false if a code would be longer than the table can shorten
+	static bool BuildOptimal( const ULONG* pFrequency, HUFFMAN& table )
+	{
+		ULONGLONG arrFrequency[ 257 ];
+		int arrCodeSize[ 257 ];
+		int arrOthers[ 257 ];
+		for ( int nSymbol = 0; nSymbol < 257; nSymbol++ )
+		{
+			arrFrequency[ nSymbol ] = pFrequency[ nSymbol ];
+			arrCodeSize[ nSymbol ] = 0;
+			arrOthers[ nSymbol ] = -1;
+		}
+
+		// the reserved symbol keeps any code from being all ones, and a
+		// table no symbol uses still needs a code for the decoder
+		arrFrequency[ 256 ] = 1;
+		bool bUsed = false;
+		for ( int nSymbol = 0; nSymbol < 256; nSymbol++ )
+		{
+			bUsed = bUsed || arrFrequency[ nSymbol ] > 0;
+		}
+		if ( !bUsed )
+		{
+			arrFrequency[ 0 ] = 1;
+		}
+
+		do
+		{
+			// the two least frequent symbols (the higher one on a tie)
+			int nFirst = -1;
+			ULONGLONG ullFirst = ULLONG_MAX;
+			for ( int nSymbol = 0; nSymbol < 257; nSymbol++ )
+			{
+				if ( arrFrequency[ nSymbol ] > 0 && arrFrequency[ nSymbol ] <= ullFirst )
+				{
+					ullFirst = arrFrequency[ nSymbol ];
+					nFirst = nSymbol;
+				}
+			}
+			int nSecond = -1;
+			ULONGLONG ullSecond = ULLONG_MAX;
+			for ( int nSymbol = 0; nSymbol < 257; nSymbol++ )
+			{
+				if
+				(
+					arrFrequency[ nSymbol ] > 0 &&
+					arrFrequency[ nSymbol ] <= ullSecond &&
+					nSymbol != nFirst
+				)
+				{
+					ullSecond = arrFrequency[ nSymbol ];
+					nSecond = nSymbol;
+				}
+			}
+			if ( nSecond < 0 )
+			{
+				break;
+			}
+
+			// join the two branches, every symbol of both gets a bit longer
+			arrFrequency[ nFirst ] += arrFrequency[ nSecond ];
+			arrFrequency[ nSecond ] = 0;
+
+			arrCodeSize[ nFirst ]++;
+			while ( arrOthers[ nFirst ] >= 0 )
+			{
+				nFirst = arrOthers[ nFirst ];
+				arrCodeSize[ nFirst ]++;
+			}
+			arrOthers[ nFirst ] = nSecond;
+
+			arrCodeSize[ nSecond ]++;
+			while ( arrOthers[ nSecond ] >= 0 )
+			{
+				nSecond = arrOthers[ nSecond ];
+				arrCodeSize[ nSecond ]++;
+			}
+
+		} while ( true );
+
+		int arrBits[ 33 ] = { 0 };
+		for ( int nSymbol = 0; nSymbol < 257; nSymbol++ )
+		{
+			if ( arrCodeSize[ nSymbol ] > 32 )
+			{
+				return false;
+			}
+			if ( arrCodeSize[ nSymbol ] > 0 )
+			{
+				arrBits[ arrCodeSize[ nSymbol ] ]++;
+			}
+		}
+
+		// move the codes longer than 16 bits up the tree (annex K.3)
+		for ( int nLength = 32; nLength > 16; nLength-- )
+		{
+			while ( arrBits[ nLength ] > 0 )
+			{
+				int nShorter = nLength - 2;
+				while ( arrBits[ nShorter ] == 0 )
+				{
+					nShorter--;
+				}
+				arrBits[ nLength ] -= 2;
+				arrBits[ nLength - 1 ]++;
+				arrBits[ nShorter + 1 ] += 2;
+				arrBits[ nShorter ]--;
+			}
+		}
+
+		// the longest code belongs to the reserved symbol
+		int nLongest = 16;
+		while ( arrBits[ nLongest ] == 0 )
+		{
+			nLongest--;
+		}
+		arrBits[ nLongest ]--;
+
+		memset( &table, 0, sizeof( table ) );
+		for ( int nLength = 1; nLength <= 16; nLength++ )
+		{
+			table.m_arrBits[ nLength ] = BYTE( arrBits[ nLength ] );
+		}
+		int nIndex = 0;
+		for ( int nLength = 1; nLength <= 32; nLength++ )
+		{
+			for ( int nSymbol = 0; nSymbol < 256; nSymbol++ )
+			{
+				if ( arrCodeSize[ nSymbol ] == nLength )
+				{
+					table.m_arrValues[ nIndex++ ] = BYTE( nSymbol );
+				}
+			}
+		}
+		table.m_bDefined = true;
+		BuildCodes( table );
+		return true;
+	}
+
+	// read the tables of a DHT segment
+	bool ReadTables( const BYTE* pSegment, size_t nLength )
+	{
+		size_t nOffset = 0;
+		while ( nOffset < nLength )
+		{
+			const BYTE id = pSegment[ nOffset ];
+			const int nClass = id >> 4;
+			const int nTable = id & 0x0F;
+			if ( nClass > 1 || nTable > 3 || nOffset + 17 > nLength )
+			{
+				return false;
+			}
+
+			HUFFMAN& table = m_arrTables[ nClass * 4 + nTable ];
+			memset( &table, 0, sizeof( table ) );
+			int nCount = 0;
+			for ( int nLength = 1; nLength <= 16; nLength++ )
+			{
+				table.m_arrBits[ nLength ] = pSegment[ nOffset + nLength ];
+				nCount += table.m_arrBits[ nLength ];
+			}
+			nOffset += 17;
+			if ( nCount > 256 || nOffset + nCount > nLength )
+			{
+				return false;
+			}
+			memcpy( table.m_arrValues, pSegment + nOffset, nCount );
+			nOffset += nCount;
+			table.m_bDefined = true;
+		}
+		return true;
+	}
+
+	// read the components and tables of an SOS segment
+	bool ReadScan( const BYTE* pSegment, size_t nLength, SCAN& scan )
+	{
+		if ( nLength < 1 )
+		{
+			return false;
+		}
+		scan.m_nComponents = pSegment[ 0 ];
+		if
+		(
+			scan.m_nComponents < 1 || scan.m_nComponents > 4 ||
+			nLength < size_t( 1 + scan.m_nComponents * 2 + 3 )
+		)
+		{
+			return false;
+		}
+
+		for ( int nComponent = 0; nComponent < scan.m_nComponents; nComponent++ )
+		{
+			const BYTE* pComponent = pSegment + 1 + nComponent * 2;
+			scan.m_arrComponent[ nComponent ] = -1;
+			for ( size_t nFrame = 0; nFrame < m_arrComponents.size(); nFrame++ )
+			{
+				if ( m_arrComponents[ nFrame ].m_nID == pComponent[ 0 ] )
+				{
+					scan.m_arrComponent[ nComponent ] = int( nFrame );
+				}
+			}
+			scan.m_arrDC[ nComponent ] = pComponent[ 1 ] >> 4;
+			scan.m_arrAC[ nComponent ] = 4 + ( pComponent[ 1 ] & 0x0F );
+			if
+			(
+				scan.m_arrComponent[ nComponent ] < 0 ||
+				scan.m_arrDC[ nComponent ] > 3 || scan.m_arrAC[ nComponent ] > 7 ||
+				!m_arrTables[ scan.m_arrDC[ nComponent ] ].m_bDefined ||
+				!m_arrTables[ scan.m_arrAC[ nComponent ] ].m_bDefined
+			)
+			{
+				return false;
+			}
+		}
+
+		// a sequential scan covers every coefficient at full precision
+		const BYTE* pSpectral = pSegment + 1 + scan.m_nComponents * 2;
+		return pSpectral[ 0 ] == 0 && pSpectral[ 1 ] == 63 && pSpectral[ 2 ] == 0;
+	}
+
+	// read the symbols of a block, and count them or write them again
+	void CodeBlock( int nDC, int nAC )
+	{
+		const int nSize = Decode( m_arrTables[ nDC ] );
+		if ( m_bFailed || nSize > 15 )
+		{
+			m_bFailed = true;
+			return;
+		}
+		PutSymbol( nDC, nSize, GetBits( nSize ), nSize );
+
+		int nCoefficient = 1;
+		while ( nCoefficient < 64 && !m_bFailed )
+		{
+			const int nSymbol = Decode( m_arrTables[ nAC ] );
+			if ( m_bFailed )
+			{
+				return;
+			}
+			const int nRun = nSymbol >> 4;
+			const int nBits = nSymbol & 0x0F;
+			PutSymbol( nAC, nSymbol, GetBits( nBits ), nBits );
+
+			if ( nBits == 0 )
+			{
+				// the end of the block or a run of sixteen zeros
+				if ( nRun != 15 )
+				{
+					return;
+				}
+				nCoefficient += 16;
+
+			} else
+			{
+				nCoefficient += nRun + 1;
+			}
+
+			if ( nCoefficient > 64 )
+			{
+				m_bFailed = true;
+			}
+		}
+	}
+
+	// read the restart marker the coder starts again at, and write it
+	// again
+	bool Restart( UINT uiRestart )
+	{
+		m_nBitCount = 0;
+		while ( m_nPosition < m_nEnd && m_pData[ m_nPosition ] == 0xFF )
+		{
+			m_nPosition++;
+			if
+			(
+				m_nPosition < m_nEnd &&
+				m_pData[ m_nPosition ] >= 0xD0 && m_pData[ m_nPosition ] <= 0xD7
+			)
+			{
+				m_nPosition++;
+				if ( m_pOutput != nullptr )
+				{
+					FlushBits();
+					m_pOutput->push_back( 0xFF );
+					m_pOutput->push_back( BYTE( 0xD0 + ( uiRestart & 7 ) ) );
+				}
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// read every block of a scan, and count the symbols or write them
+	// again with the new codes
+	bool CodeScan( const SCAN& scan )
+	{
+		m_nPosition = scan.m_nStart;
+		m_nEnd = scan.m_nEnd;
+		m_uiBits = 0;
+		m_nBitCount = 0;
+		m_uiOutBits = 0;
+		m_nOutCount = 0;
+		m_bFailed = false;
+
+		// a scan of one component has a block per unit, and otherwise
+		// each unit has the blocks of every component of the scan
+		ULONGLONG ullUnits = 0;
+		if ( scan.m_nComponents == 1 )
+		{
+			const COMPONENT& component = m_arrComponents[ scan.m_arrComponent[ 0 ] ];
+			const ULONGLONG ullWidth =
+				( ULONGLONG( m_uiWidth ) * component.m_nH + m_nMaxH - 1 ) / m_nMaxH;
+			const ULONGLONG ullHeight =
+				( ULONGLONG( m_uiHeight ) * component.m_nV + m_nMaxV - 1 ) / m_nMaxV;
+			ullUnits = ( ( ullWidth + 7 ) / 8 ) * ( ( ullHeight + 7 ) / 8 );
+
+		} else
+		{
+			const ULONGLONG ullAcross = ( m_uiWidth + 8 * m_nMaxH - 1 ) / ( 8 * m_nMaxH );
+			const ULONGLONG ullDown = ( m_uiHeight + 8 * m_nMaxV - 1 ) / ( 8 * m_nMaxV );
+			ullUnits = ullAcross * ullDown;
+		}
+
+		UINT uiRestarts = 0;
+		for ( ULONGLONG ullUnit = 0; ullUnit < ullUnits && !m_bFailed; ullUnit++ )
+		{
+			if
+			(
+				scan.m_uiRestart > 0 && ullUnit > 0 &&
+				ullUnit % scan.m_uiRestart == 0 &&
+				!Restart( uiRestarts++ )
+			)
+			{
+				return false;
+			}
+
+			if ( scan.m_nComponents == 1 )
+			{
+				CodeBlock( scan.m_arrDC[ 0 ], scan.m_arrAC[ 0 ] );
+				continue;
+			}
+
+			for ( int nComponent = 0; nComponent < scan.m_nComponents; nComponent++ )
+			{
+				const COMPONENT& component =
+					m_arrComponents[ scan.m_arrComponent[ nComponent ] ];
+				const int nBlocks = component.m_nH * component.m_nV;
+				for ( int nBlock = 0; nBlock < nBlocks; nBlock++ )
+				{
+					CodeBlock( scan.m_arrDC[ nComponent ], scan.m_arrAC[ nComponent ] );
+				}
+			}
+		}
+
+		if ( m_pOutput != nullptr )
+		{
+			FlushBits();
+		}
+		return !m_bFailed;
+	}
+
+// public methods
+public:
+	// write the JPEG in memory again with Huffman tables built for it
+	// returns false if it is not a baseline JPEG or cannot be read
+	bool Optimize( const BYTE* pData, size_t nSize, vector<BYTE>& output )
+	{
+		memset( m_arrTables, 0, sizeof( m_arrTables ) );
+		memset( m_arrFrequency, 0, sizeof( m_arrFrequency ) );
+		m_arrComponents.clear();
+		m_nMaxH = 1;
+		m_nMaxV = 1;
+		m_uiWidth = 0;
+		m_uiHeight = 0;
+		m_pData = pData;
+		m_nSize = nSize;
+		m_pOutput = nullptr;
+
+		if ( nSize < 4 || pData[ 0 ] != 0xFF || pData[ 1 ] != 0xD8 )
+		{
+			return false;
+		}
+
+		// find the segments and scans
+		vector<SEGMENT> arrSegments;
+		vector<SCAN> arrScans;
+		UINT uiRestart = 0;
+		bool bFrame = false;
+		size_t nOffset = 2;
+		do
+		{
+			if ( nOffset + 2 > nSize || pData[ nOffset ] != 0xFF )
+			{
+				return false;
+			}
+			while ( nOffset + 1 < nSize && pData[ nOffset + 1 ] == 0xFF )
+			{
+				nOffset++;
+			}
+			if ( nOffset + 2 > nSize )
+			{
+				return false;
+			}
+
+			SEGMENT segment;
+			segment.m_nOffset = nOffset;
+			segment.m_marker = pData[ nOffset + 1 ];
+			segment.m_nScan = -1;
+
+			// the end of the image keeps anything following it
+			if ( segment.m_marker == 0xD9 )
+			{
+				segment.m_nLength = nSize - nOffset;
+				arrSegments.push_back( segment );
+				break;
+			}
+
+			if ( nOffset + 4 > nSize )
+			{
+				return false;
+			}
+			const size_t nLength = GetWord( pData + nOffset + 2 );
+			if ( nLength < 2 || nOffset + 2 + nLength > nSize )
+			{
+				return false;
+			}
+			segment.m_nLength = 2 + nLength;
+			const BYTE* pSegment = pData + nOffset + 4;
+			const size_t nContent = nLength - 2;
+
+			switch ( segment.m_marker )
+			{
+				// baseline and extended sequential Huffman frames
+				case 0xC0:
+				case 0xC1:
+				{
+					if ( bFrame || nContent < 6 || pSegment[ 0 ] != 8 )
+					{
+						return false;
+					}
+					m_uiHeight = GetWord( pSegment + 1 );
+					m_uiWidth = GetWord( pSegment + 3 );
+					const int nComponents = pSegment[ 5 ];
+					if
+					(
+						m_uiHeight == 0 || m_uiWidth == 0 || nComponents == 0 ||
+						nContent < size_t( 6 + nComponents * 3 )
+					)
+					{
+						return false;
+					}
+					for ( int nComponent = 0; nComponent < nComponents; nComponent++ )
+					{
+						const BYTE* pComponent = pSegment + 6 + nComponent * 3;
+						COMPONENT component;
+						component.m_nID = pComponent[ 0 ];
+						component.m_nH = pComponent[ 1 ] >> 4;
+						component.m_nV = pComponent[ 1 ] & 0x0F;
+						if
+						(
+							component.m_nH < 1 || component.m_nH > 4 ||
+							component.m_nV < 1 || component.m_nV > 4
+						)
+						{
+							return false;
+						}
+						m_nMaxH = max( m_nMaxH, component.m_nH );
+						m_nMaxV = max( m_nMaxV, component.m_nV );
+						m_arrComponents.push_back( component );
+					}
+					bFrame = true;
+					break;
+				}
+
+				// the tables are all written again before the first scan,
+				// so tables changed between scans cannot be kept
+				case 0xC4:
+					if ( !arrScans.empty() || !ReadTables( pSegment, nContent ) )
+					{
+						return false;
+					}
+					break;
+
+				// restart interval
+				case 0xDD:
+					if ( nContent < 2 )
+					{
+						return false;
+					}
+					uiRestart = GetWord( pSegment );
+					break;
+
+				// start of scan
+				case 0xDA:
+				{
+					SCAN scan;
+					if ( !bFrame || !ReadScan( pSegment, nContent, scan ) )
+					{
+						return false;
+					}
+					scan.m_uiRestart = uiRestart;
+					scan.m_nStart = nOffset + segment.m_nLength;
+
+					// the scan ends at the first marker that is not a
+					// restart marker
+					size_t nEnd = scan.m_nStart;
+					while ( nEnd + 1 < nSize )
+					{
+						if
+						(
+							pData[ nEnd ] == 0xFF &&
+							pData[ nEnd + 1 ] != 0 &&
+							pData[ nEnd + 1 ] != 0xFF &&
+							( pData[ nEnd + 1 ] < 0xD0 || pData[ nEnd + 1 ] > 0xD7 )
+						)
+						{
+							break;
+						}
+						nEnd++;
+					}
+					scan.m_nEnd = nEnd;
+
+					segment.m_nScan = int( arrScans.size() );
+					arrScans.push_back( scan );
+					arrSegments.push_back( segment );
+					nOffset = nEnd;
+
+					// fill bytes ahead of the marker are not part of it
+					while ( nOffset > scan.m_nStart && pData[ nOffset - 1 ] == 0xFF )
+					{
+						nOffset--;
+						arrScans.back().m_nEnd = nOffset;
+					}
+					continue;
+				}
+
+				default:
+					// progressive, lossless, hierarchical and arithmetic
+					// coded frames and the end of lines marker
+					if
+					(
+						( segment.m_marker >= 0xC2 && segment.m_marker <= 0xCF ) ||
+						segment.m_marker == 0xDC
+					)
+					{
+						return false;
+					}
+					break;
+			}
+
+			arrSegments.push_back( segment );
+			nOffset += segment.m_nLength;
+
+		} while ( true );
+
+		if ( arrScans.empty() )
+		{
+			return false;
+		}
+
+		// count the symbols of every table
+		for ( const SCAN& scan : arrScans )
+		{
+			if ( !CodeScan( scan ) )
+			{
+				return false;
+			}
+		}
+
+		// the tables the scans use
+		bool arrUsed[ TABLES ] = { false };
+		for ( const SCAN& scan : arrScans )
+		{
+			for ( int nComponent = 0; nComponent < scan.m_nComponents; nComponent++ )
+			{
+				arrUsed[ scan.m_arrDC[ nComponent ] ] = true;
+				arrUsed[ scan.m_arrAC[ nComponent ] ] = true;
+			}
+		}
+		size_t nTables = 2;
+		for ( int nTable = 0; nTable < TABLES; nTable++ )
+		{
+			if ( arrUsed[ nTable ] )
+			{
+				if ( !BuildOptimal( m_arrFrequency[ nTable ], m_arrOptimal[ nTable ] ) )
+				{
+					return false;
+				}
+				nTables += 17;
+				for ( int nLength = 1; nLength <= 16; nLength++ )
+				{
+					nTables += m_arrOptimal[ nTable ].m_arrBits[ nLength ];
+				}
+			}
+		}
+
+		// write the segments again with the new tables ahead of the first
+		// scan and each scan coded with them
+		output.clear();
+		output.reserve( nSize );
+		output.push_back( 0xFF );
+		output.push_back( 0xD8 );
+		m_pOutput = &output;
+		bool bTables = false;
+		for ( const SEGMENT& segment : arrSegments )
+		{
+			if ( segment.m_marker == 0xC4 )
+			{
+				continue;
+			}
+
+			if ( segment.m_nScan >= 0 && !bTables )
+			{
+				output.push_back( 0xFF );
+				output.push_back( 0xC4 );
+				output.push_back( BYTE( nTables >> 8 ) );
+				output.push_back( BYTE( nTables ) );
+				for ( int nTable = 0; nTable < TABLES; nTable++ )
+				{
+					if ( !arrUsed[ nTable ] )
+					{
+						continue;
+					}
+					const HUFFMAN& table = m_arrOptimal[ nTable ];
+					output.push_back( BYTE( ( nTable / 4 ) << 4 | ( nTable % 4 ) ) );
+					int nCount = 0;
+					for ( int nLength = 1; nLength <= 16; nLength++ )
+					{
+						output.push_back( table.m_arrBits[ nLength ] );
+						nCount += table.m_arrBits[ nLength ];
+					}
+					output.insert
+					(
+						output.end(), table.m_arrValues, table.m_arrValues + nCount
+					);
+				}
+				bTables = true;
+			}
+
+			output.insert
+			(
+				output.end(), pData + segment.m_nOffset,
+				pData + segment.m_nOffset + segment.m_nLength
+			);
+
+			if ( segment.m_nScan >= 0 && !CodeScan( arrScans[ segment.m_nScan ] ) )
+			{
+				m_pOutput = nullptr;
+				return false;
+			}
+		}
+
+		m_pOutput = nullptr;
+		return true;
+	}
+
+// public construction / destruction
+public:
+	// constructor
+	CJpegOptimizer()
+	{
+		m_nMaxH = 1;
+		m_nMaxV = 1;
+		m_uiWidth = 0;
+		m_uiHeight = 0;
+		m_pData = nullptr;
+		m_nSize = 0;
+		m_nPosition = 0;
+		m_nEnd = 0;
+		m_uiBits = 0;
+		m_nBitCount = 0;
+		m_bFailed = false;
+		m_pOutput = nullptr;
+		m_uiOutBits = 0;
+		m_nOutCount = 0;
+	}
+	// destructor
+	virtual ~CJpegOptimizer()
+	{
+	}
+};
@@ -0,0 +1,143 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// this class maps a file into memory read only, so the decoders can read
+// the file through the page cache without copying it into buffers of
+// their own
+class CMappedFile
+{
+// protected data
+protected:
+	// handle of the file
+	HANDLE m_hFile;
+
+	// handle of the file mapping
+	HANDLE m_hMapping;
+
+	// address of the mapped view
+	const BYTE* m_pData;
+
+	// number of bytes in the file
+	ULONGLONG m_ullSize;
+
+// public properties
+public:
+	// address of the mapped view or nullptr if nothing is mapped
+	inline const BYTE* GetData()
+	{
+		return m_pData;
+	}
+	// address of the mapped view or nullptr if nothing is mapped
+	__declspec( property( get = GetData ) )
+		const BYTE* Data;
+
+	// number of bytes in the file
+	inline ULONGLONG GetSize()
+	{
+		return m_ullSize;
+	}
+	// number of bytes in the file
+	__declspec( property( get = GetSize ) )
+		ULONGLONG Size;
+
+	// is a file mapped
+	inline bool GetIsOpen()
+	{
+		return m_pData != nullptr;
+	}
+	// is a file mapped
+	__declspec( property( get = GetIsOpen ) )
+		bool IsOpen;
+
+// public methods
+public:
+	// map the whole file into memory
+	// returns false if the file is empty or cannot be mapped (for
+	// instance when a 32 bit process runs out of address space)
+	bool Open( LPCTSTR pcszPath )
+	{
+		Close();
+
+		m_hFile = ::CreateFile
+		(
+			pcszPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL
+		);
+		if ( m_hFile == INVALID_HANDLE_VALUE )
+		{
+			m_hFile = NULL;
+			return false;
+		}
+
+		LARGE_INTEGER size;
+		if ( !::GetFileSizeEx( m_hFile, &size ) || size.QuadPart == 0 )
+		{
+			Close();
+			return false;
+		}
+
+		m_hMapping = ::CreateFileMapping
+		(
+			m_hFile, NULL, PAGE_READONLY, 0, 0, NULL
+		);
+		if ( m_hMapping == NULL )
+		{
+			Close();
+			return false;
+		}
+
+		m_pData = (const BYTE*)::MapViewOfFile
+		(
+			m_hMapping, FILE_MAP_READ, 0, 0, 0
+		);
+		if ( m_pData == nullptr )
+		{
+			Close();
+			return false;
+		}
+
+		m_ullSize = ULONGLONG( size.QuadPart );
+		return true;
+	}
+
+	// unmap the file
+	void Close()
+	{
+		if ( m_pData != nullptr )
+		{
+			::UnmapViewOfFile( m_pData );
+			m_pData = nullptr;
+		}
+		if ( m_hMapping != NULL )
+		{
+			::CloseHandle( m_hMapping );
+			m_hMapping = NULL;
+		}
+		if ( m_hFile != NULL )
+		{
+			::CloseHandle( m_hFile );
+			m_hFile = NULL;
+		}
+		m_ullSize = 0;
+	}
+
+// public construction / destruction
+public:
+	// constructor
+	CMappedFile()
+	{
+		m_hFile = NULL;
+		m_hMapping = NULL;
+		m_pData = nullptr;
+		m_ullSize = 0;
+	}
+	// destructor
+	virtual ~CMappedFile()
+	{
+		Close();
+	}
+};
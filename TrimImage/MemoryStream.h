@@ -0,0 +1,294 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+#include <objidl.h>
+
+/////////////////////////////////////////////////////////////////////////////
+// this class is a read only IStream over a block of memory owned by the
+// caller, such as a mapped view of a file or a buffer that was read ahead.
+// Unlike SHCreateMemStream the memory is not copied, so the memory must
+// stay valid until the last reference to the stream has been released.
+// A mapped file that is cut short or lost over the network raises an in
+// page error when it is read, which fails the read instead of the process
+class CMemoryStream : public IStream
+{
+// protected data
+protected:
+	// reference count
+	LONG m_lRefs;
+
+	// the memory being read
+	const BYTE* m_pData;
+
+	// number of bytes in the memory
+	ULONGLONG m_ullSize;
+
+	// current read position
+	ULONGLONG m_ullPosition;
+
+// protected methods
+protected:
+	// is the exception an in page error reading the mapped file
+	static int InPageFilter( DWORD dwCode )
+	{
+		return dwCode == EXCEPTION_IN_PAGE_ERROR ?
+			EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH;
+	}
+
+	// copy out of the memory
+	// returns false if the memory could not be read
+	static bool ReadMemory( void* pTo, const BYTE* pFrom, size_t nBytes )
+	{
+		__try
+		{
+			memcpy( pTo, pFrom, nBytes );
+		}
+		__except ( InPageFilter( GetExceptionCode() ) )
+		{
+			return false;
+		}
+		return true;
+	}
+
+	// write out of the memory to another stream
+	// returns STG_E_READFAULT if the memory could not be read
+	static HRESULT WriteMemory
+	(
+		IStream* pstm, const BYTE* pFrom, ULONG ulBytes, ULONG* pulWritten
+	)
+	{
+		__try
+		{
+			return pstm->Write( pFrom, ulBytes, pulWritten );
+		}
+		__except ( InPageFilter( GetExceptionCode() ) )
+		{
+			return STG_E_READFAULT;
+		}
+	}
+
+// public methods
+public:
+	// create a stream with one reference over the given memory
+	static IStream* Create( const BYTE* pData, ULONGLONG ullSize )
+	{
+		return new CMemoryStream( pData, ullSize );
+	}
+
+// IUnknown
+public:
+	STDMETHODIMP QueryInterface( REFIID riid, void** ppv )
+	{
+		if ( ppv == nullptr )
+		{
+			return E_POINTER;
+		}
+
+		if
+		(
+			riid == IID_IUnknown ||
+			riid == IID_ISequentialStream ||
+			riid == IID_IStream
+		)
+		{
+			*ppv = static_cast<IStream*>( this );
+			AddRef();
+			return S_OK;
+		}
+
+		*ppv = nullptr;
+		return E_NOINTERFACE;
+	}
+
+	STDMETHODIMP_( ULONG ) AddRef()
+	{
+		return ::InterlockedIncrement( &m_lRefs );
+	}
+
+	STDMETHODIMP_( ULONG ) Release()
+	{
+		const LONG value = ::InterlockedDecrement( &m_lRefs );
+		if ( value == 0 )
+		{
+			delete this;
+		}
+		return value;
+	}
+
+// ISequentialStream
+public:
+	STDMETHODIMP Read( void* pv, ULONG cb, ULONG* pcbRead )
+	{
+		const ULONGLONG ullLeft =
+			m_ullPosition < m_ullSize ? m_ullSize - m_ullPosition : 0;
+		const ULONG ulRead = (ULONG)min( ULONGLONG( cb ), ullLeft );
+
+		if ( pcbRead != nullptr )
+		{
+			*pcbRead = 0;
+		}
+		if ( !ReadMemory( pv, m_pData + m_ullPosition, ulRead ) )
+		{
+			return STG_E_READFAULT;
+		}
+		m_ullPosition += ulRead;
+
+		if ( pcbRead != nullptr )
+		{
+			*pcbRead = ulRead;
+		}
+
+		return ulRead == cb ? S_OK : S_FALSE;
+	}
+
+	STDMETHODIMP Write( const void*, ULONG, ULONG* )
+	{
+		return STG_E_ACCESSDENIED;
+	}
+
+// IStream
+public:
+	STDMETHODIMP Seek
+	(
+		LARGE_INTEGER dlibMove, DWORD dwOrigin,
+		ULARGE_INTEGER* plibNewPosition
+	)
+	{
+		LONGLONG llBase = 0;
+		switch ( dwOrigin )
+		{
+			case STREAM_SEEK_SET:
+				llBase = 0;
+				break;
+			case STREAM_SEEK_CUR:
+				llBase = LONGLONG( m_ullPosition );
+				break;
+			case STREAM_SEEK_END:
+				llBase = LONGLONG( m_ullSize );
+				break;
+			default:
+				return STG_E_INVALIDFUNCTION;
+		}
+
+		const LONGLONG llPosition = llBase + dlibMove.QuadPart;
+		if ( llPosition < 0 )
+		{
+			return STG_E_INVALIDFUNCTION;
+		}
+
+		m_ullPosition = ULONGLONG( llPosition );
+		if ( plibNewPosition != nullptr )
+		{
+			plibNewPosition->QuadPart = m_ullPosition;
+		}
+
+		return S_OK;
+	}
+
+	STDMETHODIMP SetSize( ULARGE_INTEGER )
+	{
+		return STG_E_ACCESSDENIED;
+	}
+
+	STDMETHODIMP CopyTo
+	(
+		IStream* pstm, ULARGE_INTEGER cb, ULARGE_INTEGER* pcbRead,
+		ULARGE_INTEGER* pcbWritten
+	)
+	{
+		const ULONGLONG ullLeft =
+			m_ullPosition < m_ullSize ? m_ullSize - m_ullPosition : 0;
+		ULONGLONG ullCopy = min( cb.QuadPart, ullLeft );
+
+		// write straight out of the memory without a staging buffer
+		ULONGLONG ullWritten = 0;
+		HRESULT hr = S_OK;
+		while ( ullCopy > 0 && SUCCEEDED( hr ) )
+		{
+			const ULONG ulChunk = (ULONG)min( ullCopy, 1ull << 30 );
+			ULONG ulWritten = 0;
+			hr = WriteMemory
+			(
+				pstm, m_pData + m_ullPosition, ulChunk, &ulWritten
+			);
+			m_ullPosition += ulChunk;
+			ullWritten += ulWritten;
+			ullCopy -= ulChunk;
+		}
+
+		if ( pcbRead != nullptr )
+		{
+			pcbRead->QuadPart = ullWritten;
+		}
+		if ( pcbWritten != nullptr )
+		{
+			pcbWritten->QuadPart = ullWritten;
+		}
+
+		return hr;
+	}
+
+	STDMETHODIMP Commit( DWORD )
+	{
+		return S_OK;
+	}
+
+	STDMETHODIMP Revert()
+	{
+		return S_OK;
+	}
+
+	STDMETHODIMP LockRegion( ULARGE_INTEGER, ULARGE_INTEGER, DWORD )
+	{
+		return STG_E_INVALIDFUNCTION;
+	}
+
+	STDMETHODIMP UnlockRegion( ULARGE_INTEGER, ULARGE_INTEGER, DWORD )
+	{
+		return STG_E_INVALIDFUNCTION;
+	}
+
+	STDMETHODIMP Stat( STATSTG* pstatstg, DWORD )
+	{
+		if ( pstatstg == nullptr )
+		{
+			return E_POINTER;
+		}
+
+		memset( pstatstg, 0, sizeof( STATSTG ) );
+		pstatstg->type = STGTY_STREAM;
+		pstatstg->cbSize.QuadPart = m_ullSize;
+		pstatstg->grfMode = STGM_READ;
+		return S_OK;
+	}
+
+	STDMETHODIMP Clone( IStream** ppstm )
+	{
+		if ( ppstm == nullptr )
+		{
+			return E_POINTER;
+		}
+
+		CMemoryStream* pClone = new CMemoryStream( m_pData, m_ullSize );
+		pClone->m_ullPosition = m_ullPosition;
+		*ppstm = pClone;
+		return S_OK;
+	}
+
+// protected construction / destruction
+protected:
+	// constructor
+	CMemoryStream( const BYTE* pData, ULONGLONG ullSize )
+	{
+		m_lRefs = 1;
+		m_pData = pData;
+		m_ullSize = ullSize;
+		m_ullPosition = 0;
+	}
+	// destructor
+	virtual ~CMemoryStream()
+	{
+	}
+};
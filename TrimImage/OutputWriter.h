@@ -0,0 +1,813 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+#include "TarArchive.h"
+#include "PipeStream.h"
+#include "JpegOptimizer.h"
+#include <deque>
+#include <set>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <shlobj.h>
+#include <shlwapi.h>
+#pragma comment(lib, "shlwapi.lib")
+#include <gdiplus.h>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// this class takes encoded images held in memory and writes them to disk
+// on a dedicated thread so the image processing never waits on the file
+// system. Each file is written under a temporary name and renamed once it
+// is complete, so a crash never leaves a partial image behind. When an
+// archive is opened the images go into it instead, named by their path
+// below the root of the tree, and no folders or files are created. When
+// a pipe is opened the images are written to it one after another. JPEG
+// images can have their entropy coding optimized by the thread saving
+// them before they are queued
+class COutputWriter
+{
+// public definitions
+public:
+	// callback receiving a message for a file that could not be written
+	typedef function<void( const CString& )> ERROR_CALLBACK;
+
+// protected definitions
+protected:
+	// an encoded image waiting to be written
+	typedef struct tagOutputFile
+	{
+		// final pathname of the file
+		CString m_csPath;
+
+		// memory stream holding the encoded image
+		CComPtr<IStream> m_pStream;
+
+		// number of bytes in the stream
+		ULONGLONG m_ullSize;
+
+	} OUTPUT_FILE;
+
+// protected data
+protected:
+	// folders known to exist
+	set<CString> m_setFolders;
+
+	// protects the folder cache
+	mutex m_mutexFolders;
+
+	// files waiting to be written
+	deque<OUTPUT_FILE> m_arrFiles;
+
+	// encoded bytes queued or being written
+	ULONGLONG m_ullPending;
+
+	// the most encoded bytes allowed to be queued at once
+	ULONGLONG m_ullMaxPending;
+
+	// a file is being written by the thread
+	bool m_bWriting;
+
+	// no more files will be queued
+	bool m_bClosing;
+
+	// number of files written
+	ULONGLONG m_ullWritten;
+
+	// number of files that failed to write
+	ULONGLONG m_ullFailed;
+
+	// protects the queue and the counters
+	mutex m_mutex;
+
+	// signaled when a file is queued or the writer is closing
+	condition_variable m_cvQueued;
+
+	// signaled when a file has been written
+	condition_variable m_cvWritten;
+
+	// thread writing the files
+	thread m_thread;
+
+	// reports files that could not be written
+	ERROR_CALLBACK m_onError;
+
+	// the archive the images are written to instead of files
+	CTarArchive m_Archive;
+
+	// the images are named in the archive by their path below this folder
+	CString m_csArchiveRoot;
+
+	// the pipe the images are written to instead of files (NULL writes
+	// files)
+	HANDLE m_hPipe;
+
+	// the encoders write straight into the pipe instead of memory
+	bool m_bPipeStream;
+
+	// did an image that failed leave part of itself in the pipe
+	bool m_bPipeTorn;
+
+	// rewrite the JPEG images with Huffman tables built for each one
+	bool m_bOptimizeJpeg;
+
+	// number of JPEG images optimized
+	ULONGLONG m_ullJpegFiles;
+
+	// bytes of the JPEG images before and after they were optimized
+	ULONGLONG m_ullJpegBefore;
+	ULONGLONG m_ullJpegAfter;
+
+// public properties
+public:
+	// the most encoded bytes allowed to be queued at once
+	inline ULONGLONG GetMaxPending()
+	{
+		return m_ullMaxPending;
+	}
+	// the most encoded bytes allowed to be queued at once
+	inline void SetMaxPending( ULONGLONG value )
+	{
+		m_ullMaxPending = value;
+	}
+	// the most encoded bytes allowed to be queued at once
+	__declspec( property( get = GetMaxPending, put = SetMaxPending ) )
+		ULONGLONG MaxPending;
+
+	// number of files written
+	inline ULONGLONG GetWritten()
+	{
+		return m_ullWritten;
+	}
+	// number of files written
+	__declspec( property( get = GetWritten ) )
+		ULONGLONG Written;
+
+	// number of files that failed to write
+	inline ULONGLONG GetFailed()
+	{
+		return m_ullFailed;
+	}
+	// number of files that failed to write
+	__declspec( property( get = GetFailed ) )
+		ULONGLONG Failed;
+
+	// are the images written to an archive instead of files
+	inline bool GetIsArchive()
+	{
+		return m_Archive.IsOpen;
+	}
+	// are the images written to an archive instead of files
+	__declspec( property( get = GetIsArchive ) )
+		bool IsArchive;
+
+	// number of archives written
+	inline UINT GetArchives()
+	{
+		return m_Archive.Archives;
+	}
+	// number of archives written
+	__declspec( property( get = GetArchives ) )
+		UINT Archives;
+
+	// bytes written to the archives
+	inline ULONGLONG GetArchiveBytes()
+	{
+		return m_Archive.Total;
+	}
+	// bytes written to the archives
+	__declspec( property( get = GetArchiveBytes ) )
+		ULONGLONG ArchiveBytes;
+
+	// are the images written to a pipe instead of files
+	inline bool GetIsPipe()
+	{
+		return m_hPipe != NULL;
+	}
+	// are the images written to a pipe instead of files
+	__declspec( property( get = GetIsPipe ) )
+		bool IsPipe;
+
+	// did an image that failed leave part of itself in the pipe
+	inline bool GetPipeTorn()
+	{
+		return m_bPipeTorn;
+	}
+	// did an image that failed leave part of itself in the pipe
+	__declspec( property( get = GetPipeTorn ) )
+		bool PipeTorn;
+
+	// rewrite the JPEG images with Huffman tables built for each one
+	inline bool GetOptimizeJpeg()
+	{
+		return m_bOptimizeJpeg;
+	}
+	// rewrite the JPEG images with Huffman tables built for each one
+	inline void SetOptimizeJpeg( bool value )
+	{
+		m_bOptimizeJpeg = value;
+	}
+	// rewrite the JPEG images with Huffman tables built for each one
+	__declspec( property( get = GetOptimizeJpeg, put = SetOptimizeJpeg ) )
+		bool OptimizeJpeg;
+
+	// number of JPEG images optimized
+	inline ULONGLONG GetJpegFiles()
+	{
+		return m_ullJpegFiles;
+	}
+	// number of JPEG images optimized
+	__declspec( property( get = GetJpegFiles ) )
+		ULONGLONG JpegFiles;
+
+	// bytes of the JPEG images before they were optimized
+	inline ULONGLONG GetJpegBefore()
+	{
+		return m_ullJpegBefore;
+	}
+	// bytes of the JPEG images before they were optimized
+	__declspec( property( get = GetJpegBefore ) )
+		ULONGLONG JpegBefore;
+
+	// bytes of the JPEG images after they were optimized
+	inline ULONGLONG GetJpegAfter()
+	{
+		return m_ullJpegAfter;
+	}
+	// bytes of the JPEG images after they were optimized
+	__declspec( property( get = GetJpegAfter ) )
+		ULONGLONG JpegAfter;
+
+// protected methods
+protected:
+	// the name of an image in the archive, which is its path below the 
+	// root of the tree with forward slashes between the folders
+	CString GetEntryName( const CString& csPath )
+	{
+		CString value = csPath;
+		const int nRoot = m_csArchiveRoot.GetLength();
+		if 
+		( 
+			nRoot > 0 && 
+			csPath.Left( nRoot ).CompareNoCase( m_csArchiveRoot ) == 0 
+		)
+		{
+			value = csPath.Mid( nRoot );
+		}
+		value.Replace( '\\', '/' );
+		value.TrimLeft( _T( "/" ) );
+		return value;
+	}
+
+	// add the stream to the archive
+	bool WriteEntry( OUTPUT_FILE& file )
+	{
+		HGLOBAL hGlobal = NULL;
+		if ( FAILED( ::GetHGlobalFromStream( file.m_pStream, &hGlobal ) ) )
+		{
+			return false;
+		}
+
+		const BYTE* pData = (const BYTE*)::GlobalLock( hGlobal );
+		if ( pData == nullptr )
+		{
+			return false;
+		}
+
+		const bool value = m_Archive.Add
+		(
+			GetEntryName( file.m_csPath ), pData, file.m_ullSize
+		);
+		::GlobalUnlock( hGlobal );
+		return value;
+	}
+
+	// rewrite a JPEG with Huffman tables built for it, giving back a new
+	// stream holding it if that makes it smaller (otherwise the stream is
+	// left empty and the original is kept)
+	// returns false if the data is not a JPEG that can be optimized
+	bool Optimize
+	(
+		const BYTE* pData, size_t nSize, CComPtr<IStream>& pOptimized
+	)
+	{
+		vector<BYTE> arrOptimized;
+		CJpegOptimizer optimizer;
+		if ( !optimizer.Optimize( pData, nSize, arrOptimized ) )
+		{
+			return false;
+		}
+
+		const bool bSmaller = arrOptimized.size() < nSize;
+		if
+		(
+			bSmaller &&
+			SUCCEEDED( ::CreateStreamOnHGlobal( NULL, TRUE, &pOptimized ) ) &&
+			FAILED
+			(
+				pOptimized->Write
+				(
+					arrOptimized.data(), ULONG( arrOptimized.size() ), NULL
+				)
+			)
+		)
+		{
+			pOptimized.Release();
+		}
+
+		lock_guard<mutex> lock( m_mutex );
+		m_ullJpegFiles++;
+		m_ullJpegBefore += nSize;
+		m_ullJpegAfter += pOptimized != nullptr ? arrOptimized.size() : nSize;
+		return true;
+	}
+
+	// write the given bytes to an open file or pipe
+	static bool WriteHandle( HANDLE hFile, const BYTE* pData, ULONGLONG ullSize )
+	{
+		bool value = pData != nullptr;
+
+		ULONGLONG ullOffset = 0;
+		while ( value && ullOffset < ullSize )
+		{
+			const DWORD dwChunk =
+				(DWORD)min( ullSize - ullOffset, 16ull << 20 );
+
+			DWORD dwWritten = 0;
+			value =
+				::WriteFile
+				(
+					hFile, pData + ullOffset, dwChunk, &dwWritten, NULL
+				) && dwWritten == dwChunk;
+
+			ullOffset += dwWritten;
+		}
+
+		return value;
+	}
+
+	// write the stream to the pipe
+	bool WritePipe( OUTPUT_FILE& file )
+	{
+		HGLOBAL hGlobal = NULL;
+		if ( FAILED( ::GetHGlobalFromStream( file.m_pStream, &hGlobal ) ) )
+		{
+			return false;
+		}
+
+		const BYTE* pData = (const BYTE*)::GlobalLock( hGlobal );
+		const bool value = WriteHandle( m_hPipe, pData, file.m_ullSize );
+		::GlobalUnlock( hGlobal );
+		return value;
+	}
+
+	// write the stream to a temporary file and rename it to the final
+	// pathname once every byte is on disk, so a crash leaves either the
+	// old file or the whole new one under the final name
+	bool WriteFile( OUTPUT_FILE& file )
+	{
+		HGLOBAL hGlobal = NULL;
+		if ( FAILED( ::GetHGlobalFromStream( file.m_pStream, &hGlobal ) ) )
+		{
+			return false;
+		}
+
+		const CString csTemp = file.m_csPath + _T( ".partial" );
+		HANDLE hFile = ::CreateFile
+		(
+			csTemp, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL
+		);
+		if ( hFile == INVALID_HANDLE_VALUE )
+		{
+			return false;
+		}
+
+		// the stream owns the memory, so write straight from it
+		const BYTE* pData = (const BYTE*)::GlobalLock( hGlobal );
+		bool value = WriteHandle( hFile, pData, file.m_ullSize );
+		::GlobalUnlock( hGlobal );
+
+		// closing the file leaves its bytes in the cache, so they are
+		// flushed to the disk before the rename can replace a good file
+		value = value && FALSE != ::FlushFileBuffers( hFile );
+		::CloseHandle( hFile );
+
+		if ( value )
+		{
+			value = FALSE != ::MoveFileEx
+			(
+				csTemp, file.m_csPath, 
+				MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH
+			);
+		}
+
+		if ( !value )
+		{
+			::DeleteFile( csTemp );
+		}
+
+		return value;
+	}
+
+	// thread procedure writing the queued files in order
+	void WriteThread()
+	{
+		unique_lock<mutex> lock( m_mutex );
+		do
+		{
+			m_cvQueued.wait
+			(
+				lock,
+				[ this ]
+				{
+					return !m_arrFiles.empty() || m_bClosing;
+				}
+			);
+
+			if ( m_arrFiles.empty() )
+			{
+				break;
+			}
+
+			OUTPUT_FILE file = m_arrFiles.front();
+			m_arrFiles.pop_front();
+			m_bWriting = true;
+
+			lock.unlock();
+			const bool bOkay = 
+				m_Archive.IsOpen ? WriteEntry( file ) : 
+				m_hPipe != NULL ? WritePipe( file ) : WriteFile( file );
+			if ( !bOkay && m_onError )
+			{
+				CString csOutput;
+				csOutput.Format
+				(
+					_T( "Image save failed:\n\t%s\n" ), file.m_csPath
+				);
+				m_onError( csOutput );
+			}
+
+			// release the memory before waking up anyone waiting on it
+			file.m_pStream.Release();
+			lock.lock();
+
+			m_bWriting = false;
+			m_ullPending -= file.m_ullSize;
+			if ( bOkay )
+			{
+				m_ullWritten++;
+
+			} else
+			{
+				m_ullFailed++;
+			}
+			m_cvWritten.notify_all();
+
+		} while ( true );
+	}
+
+// public methods
+public:
+	// start the thread writing the files
+	void Start( ERROR_CALLBACK onError )
+	{
+		m_onError = onError;
+		m_bClosing = false;
+		m_thread = thread( &COutputWriter::WriteThread, this );
+	}
+
+	// write the images into tar archives at the given pathname instead of
+	// files, named by their path below the given root, rolling over to a
+	// new archive before one grows past the given size (zero is no limit)
+	void OpenArchive
+	( 
+		const CString& csPath, ULONGLONG ullMaxSize, const CString& csRoot 
+	)
+	{
+		m_Archive.Open( csPath, ullMaxSize );
+		m_csArchiveRoot = csRoot;
+		m_csArchiveRoot.TrimRight( _T( "\\/" ) );
+	}
+
+	// write the images to the given pipe (like standard output) in the 
+	// order they are saved instead of files, where the encoders that only
+	// write forward can be given the pipe itself so the encoded image is
+	// never held in memory as a whole
+	void OpenPipe( HANDLE hPipe, bool bStream )
+	{
+		m_hPipe = hPipe;
+		m_bPipeStream = bStream;
+	}
+
+	// make sure the folder exists, only asking the file system the first
+	// time a folder is seen, folders inside an archive or a pipe need 
+	// nothing
+	// returns true if the folder is created or already exists
+	bool CreateFolder( const CString& csFolder )
+	{
+		if ( m_Archive.IsOpen || m_hPipe != NULL )
+		{
+			return true;
+		}
+
+		{
+			lock_guard<mutex> lock( m_mutexFolders );
+			if ( m_setFolders.find( csFolder ) != m_setFolders.end() )
+			{
+				return true;
+			}
+		}
+
+		const int nError = ::SHCreateDirectoryEx( NULL, csFolder, NULL );
+		if
+		(
+			nError != ERROR_SUCCESS &&
+			nError != ERROR_ALREADY_EXISTS &&
+			nError != ERROR_FILE_EXISTS
+		)
+		{
+			return false;
+		}
+
+		lock_guard<mutex> lock( m_mutexFolders );
+		m_setFolders.insert( csFolder );
+		return true;
+	}
+
+	// encode the image into memory and queue it to be written to the
+	// given pathname, waiting if too many bytes are already queued, or
+	// encode it straight into the pipe if the encoder can stream
+	// returns false if the image could not be encoded
+	bool Save
+	(
+		const CString& csPath, Gdiplus::Image* pImage, const CLSID& clsid,
+		const Gdiplus::EncoderParameters* pParameters
+	)
+	{
+		CComPtr<IStream> pStream;
+
+		// the encoder writes into the pipe as it goes, after anything
+		// queued ahead of it, unless the whole image is needed to optimize
+		// it
+		if ( m_hPipe != NULL && m_bPipeStream && !m_bOptimizeJpeg )
+		{
+			Flush();
+			CPipeStream* pPipe = CPipeStream::Create( m_hPipe );
+			pStream.Attach( pPipe );
+			const bool value =
+				pImage->Save( pStream, &clsid, pParameters ) == Gdiplus::Ok &&
+				SUCCEEDED( pStream->Commit( STGC_DEFAULT ) );
+
+			lock_guard<mutex> lock( m_mutex );
+			if ( value )
+			{
+				m_ullWritten++;
+
+			} else
+			{
+				// the bytes already in the pipe cannot be taken back
+				m_ullFailed++;
+				m_bPipeTorn = m_bPipeTorn || pPipe->Written > 0;
+			}
+			return value;
+		}
+
+		if ( FAILED( ::CreateStreamOnHGlobal( NULL, TRUE, &pStream ) ) )
+		{
+			return false;
+		}
+
+		const Gdiplus::Status status =
+			pImage->Save( pStream, &clsid, pParameters );
+		if ( status != Gdiplus::Ok )
+		{
+			return false;
+		}
+
+		// the encoder only writes the standard Huffman tables, so a JPEG
+		// is coded again with its own tables on this thread while the 
+		// other threads do the same with theirs
+		HGLOBAL hGlobal = NULL;
+		STATSTG stat;
+		if
+		(
+			m_bOptimizeJpeg &&
+			SUCCEEDED( ::GetHGlobalFromStream( pStream, &hGlobal ) ) &&
+			SUCCEEDED( pStream->Stat( &stat, STATFLAG_NONAME ) )
+		)
+		{
+			CComPtr<IStream> pOptimized;
+			const BYTE* pData = (const BYTE*)::GlobalLock( hGlobal );
+			if ( pData != nullptr )
+			{
+				Optimize( pData, size_t( stat.cbSize.QuadPart ), pOptimized );
+				::GlobalUnlock( hGlobal );
+			}
+			if ( pOptimized != nullptr )
+			{
+				pStream = pOptimized;
+			}
+		}
+
+		return SaveStream( csPath, pStream );
+	}
+
+	// queue a JPEG already in memory to be written to the given pathname
+	// with Huffman tables built for it, unless that does not make it any
+	// smaller, in which case nothing is written
+	// returns false if the data is not a JPEG that can be optimized
+	bool SaveOptimized( const CString& csPath, const vector<BYTE>& data )
+	{
+		CComPtr<IStream> pOptimized;
+		if ( data.empty() || !Optimize( data.data(), data.size(), pOptimized ) )
+		{
+			return false;
+		}
+
+		return pOptimized == nullptr || SaveStream( csPath, pOptimized );
+	}
+
+	// open the temporary file of the given pathname as a stream an encoder
+	// can write a large image into as it goes (like a document of many 
+	// pages), so the encoded image is never held in memory as a whole, 
+	// which CommitFile gives its final name
+	// returns false if the images are not written to files (an archive or
+	// a pipe needs the whole image first) or the file cannot be created
+	bool OpenFile( const CString& csPath, CComPtr<IStream>& pStream )
+	{
+		if ( m_Archive.IsOpen || m_hPipe != NULL )
+		{
+			return false;
+		}
+
+		const CString csTemp = csPath + _T( ".partial" );
+		return SUCCEEDED
+		(
+			::SHCreateStreamOnFileEx
+			(
+				csTemp, STGM_CREATE | STGM_READWRITE | STGM_SHARE_EXCLUSIVE,
+				FILE_ATTRIBUTE_NORMAL, TRUE, NULL, &pStream
+			)
+		);
+	}
+
+	// close the temporary file opened by OpenFile and, if the encoder 
+	// succeeded, flush it to the disk and give it its final name like the
+	// files written by the thread, otherwise delete it
+	// returns false if the image was not written
+	bool CommitFile( const CString& csPath, CComPtr<IStream>& pStream, bool bOkay )
+	{
+		// closing the stream closes the encoder's handle of the file
+		pStream.Release();
+		const CString csTemp = csPath + _T( ".partial" );
+		if ( !bOkay )
+		{
+			::DeleteFile( csTemp );
+			return false;
+		}
+
+		// the cached bytes of the file are flushed through a handle of 
+		// our own before the rename can replace a good file
+		HANDLE hFile = ::CreateFile
+		(
+			csTemp, GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 
+			FILE_ATTRIBUTE_NORMAL, NULL
+		);
+		bool value = hFile != INVALID_HANDLE_VALUE;
+		if ( value )
+		{
+			value = FALSE != ::FlushFileBuffers( hFile );
+			::CloseHandle( hFile );
+		}
+		if ( value )
+		{
+			value = FALSE != ::MoveFileEx
+			(
+				csTemp, csPath, 
+				MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH
+			);
+		}
+		if ( !value )
+		{
+			::DeleteFile( csTemp );
+		}
+
+		lock_guard<mutex> lock( m_mutex );
+		if ( value )
+		{
+			m_ullWritten++;
+
+		} else
+		{
+			m_ullFailed++;
+		}
+		return value;
+	}
+
+	// queue an image already encoded into a stream created by 
+	// CreateStreamOnHGlobal to be written to the given pathname, waiting
+	// if too many bytes are already queued
+	// returns false if the size of the stream cannot be read
+	bool SaveStream( const CString& csPath, IStream* pStream )
+	{
+		OUTPUT_FILE file;
+		file.m_csPath = csPath;
+		file.m_pStream = pStream;
+
+		// some encoders seek around while writing, so ask the stream for
+		// its size rather than trusting the current position
+		STATSTG stat;
+		if ( FAILED( file.m_pStream->Stat( &stat, STATFLAG_NONAME ) ) )
+		{
+			return false;
+		}
+		file.m_ullSize = stat.cbSize.QuadPart;
+
+		unique_lock<mutex> lock( m_mutex );
+
+		// an image larger than the limit is still allowed through by
+		// itself, otherwise it would never be written
+		m_cvWritten.wait
+		(
+			lock,
+			[ this, &file ]
+			{
+				return
+					m_ullPending == 0 ||
+					m_ullPending + file.m_ullSize <= m_ullMaxPending;
+			}
+		);
+
+		m_ullPending += file.m_ullSize;
+		m_arrFiles.push_back( file );
+		m_cvQueued.notify_one();
+
+		return true;
+	}
+
+	// wait for every queued file to be written
+	void Flush()
+	{
+		unique_lock<mutex> lock( m_mutex );
+		m_cvWritten.wait
+		(
+			lock,
+			[ this ]
+			{
+				return m_arrFiles.empty() && !m_bWriting;
+			}
+		);
+	}
+
+	// write the remaining files and stop the thread
+	void Close()
+	{
+		{
+			lock_guard<mutex> lock( m_mutex );
+			m_bClosing = true;
+			m_cvQueued.notify_all();
+		}
+
+		if ( m_thread.joinable() )
+		{
+			m_thread.join();
+		}
+
+		// the archive is only complete once it has its end blocks
+		if ( m_Archive.IsOpen && !m_Archive.Close() && m_onError )
+		{
+			m_onError( _T( "Archive write failed\n" ) );
+		}
+	}
+
+// public construction / destruction
+public:
+	// constructor
+	COutputWriter()
+	{
+		m_ullPending = 0;
+		m_ullMaxPending = 256ull << 20;
+		m_bWriting = false;
+		m_bClosing = false;
+		m_ullWritten = 0;
+		m_ullFailed = 0;
+		m_hPipe = NULL;
+		m_bPipeStream = false;
+		m_bPipeTorn = false;
+		m_bOptimizeJpeg = false;
+		m_ullJpegFiles = 0;
+		m_ullJpegBefore = 0;
+		m_ullJpegAfter = 0;
+	}
+	// destructor
+	virtual ~COutputWriter()
+	{
+		Close();
+	}
+};
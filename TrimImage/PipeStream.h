@@ -0,0 +1,296 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+#include <objidl.h>
+#include <vector>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// this class is a write only IStream over a pipe (like standard output),
+// so an encoder can hand its output on as it goes instead of the whole
+// image being held in memory first. A pipe cannot go back, so the most
+// recent bytes are held back in a window the encoder may still seek into
+// and patch, and Commit writes what is left. Seeking back past the window
+// fails the encode, but the bytes already written stay in the pipe, so
+// the reader is left with a cut off image (see Written) and has to be 
+// told the image failed some other way
+class CPipeStream : public IStream
+{
+// protected data
+protected:
+	// reference count
+	LONG m_lRefs;
+
+	// the pipe being written
+	HANDLE m_hPipe;
+
+	// the most bytes held back for the encoder to patch
+	size_t m_nWindow;
+
+	// bytes held back, which start where the written bytes end
+	vector<BYTE> m_arrHeld;
+
+	// number of bytes written to the pipe
+	ULONGLONG m_ullWritten;
+
+	// current write position
+	ULONGLONG m_ullPosition;
+
+	// did writing to the pipe fail
+	bool m_bFailed;
+
+// public properties
+public:
+	// number of bytes written to the pipe, which cannot be taken back
+	inline ULONGLONG GetWritten()
+	{
+		return m_ullWritten;
+	}
+	// number of bytes written to the pipe, which cannot be taken back
+	__declspec( property( get = GetWritten ) )
+		ULONGLONG Written;
+
+// protected methods
+protected:
+	// write the given number of bytes from the front of the window to the
+	// pipe
+	bool WritePipe( size_t nBytes )
+	{
+		size_t nOffset = 0;
+		while ( !m_bFailed && nOffset < nBytes )
+		{
+			const DWORD dwChunk = DWORD( min( nBytes - nOffset, size_t( 16 << 20 ) ) );
+			DWORD dwWritten = 0;
+			m_bFailed =
+				!::WriteFile
+				(
+					m_hPipe, &m_arrHeld[ nOffset ], dwChunk, &dwWritten, NULL
+				) || dwWritten != dwChunk;
+			nOffset += dwWritten;
+		}
+
+		m_arrHeld.erase( m_arrHeld.begin(), m_arrHeld.begin() + nOffset );
+		m_ullWritten += nOffset;
+		return !m_bFailed;
+	}
+
+// public methods
+public:
+	// create a stream with one reference over the given pipe holding back
+	// the given number of bytes
+	static CPipeStream* Create( HANDLE hPipe, size_t nWindow = 1 << 20 )
+	{
+		return new CPipeStream( hPipe, nWindow );
+	}
+
+// IUnknown
+public:
+	STDMETHODIMP QueryInterface( REFIID riid, void** ppv )
+	{
+		if ( ppv == nullptr )
+		{
+			return E_POINTER;
+		}
+
+		if
+		(
+			riid == IID_IUnknown ||
+			riid == IID_ISequentialStream ||
+			riid == IID_IStream
+		)
+		{
+			*ppv = static_cast<IStream*>( this );
+			AddRef();
+			return S_OK;
+		}
+
+		*ppv = nullptr;
+		return E_NOINTERFACE;
+	}
+
+	STDMETHODIMP_( ULONG ) AddRef()
+	{
+		return ::InterlockedIncrement( &m_lRefs );
+	}
+
+	STDMETHODIMP_( ULONG ) Release()
+	{
+		const LONG value = ::InterlockedDecrement( &m_lRefs );
+		if ( value == 0 )
+		{
+			delete this;
+		}
+		return value;
+	}
+
+// ISequentialStream
+public:
+	STDMETHODIMP Read( void*, ULONG, ULONG* )
+	{
+		return STG_E_ACCESSDENIED;
+	}
+
+	STDMETHODIMP Write( const void* pv, ULONG cb, ULONG* pcbWritten )
+	{
+		if ( pcbWritten != nullptr )
+		{
+			*pcbWritten = 0;
+		}
+		if ( m_bFailed || m_ullPosition < m_ullWritten )
+		{
+			return STG_E_WRITEFAULT;
+		}
+
+		const size_t nOffset = size_t( m_ullPosition - m_ullWritten );
+		if ( m_arrHeld.size() < nOffset + cb )
+		{
+			m_arrHeld.resize( nOffset + cb );
+		}
+		memcpy( &m_arrHeld[ nOffset ], pv, cb );
+		m_ullPosition += cb;
+
+		// the window is written out in large pieces once it has grown to
+		// twice its size, keeping the most recent bytes held back
+		const size_t nBehind = size_t( m_ullPosition - m_ullWritten );
+		if ( m_arrHeld.size() > m_nWindow * 2 && nBehind > m_nWindow )
+		{
+			if ( !WritePipe( nBehind - m_nWindow ) )
+			{
+				return STG_E_WRITEFAULT;
+			}
+		}
+
+		if ( pcbWritten != nullptr )
+		{
+			*pcbWritten = cb;
+		}
+		return S_OK;
+	}
+
+// IStream
+public:
+	STDMETHODIMP Seek
+	(
+		LARGE_INTEGER dlibMove, DWORD dwOrigin,
+		ULARGE_INTEGER* plibNewPosition
+	)
+	{
+		LONGLONG llBase = 0;
+		switch ( dwOrigin )
+		{
+			case STREAM_SEEK_SET:
+				llBase = 0;
+				break;
+			case STREAM_SEEK_CUR:
+				llBase = LONGLONG( m_ullPosition );
+				break;
+			case STREAM_SEEK_END:
+				llBase = LONGLONG( m_ullWritten + m_arrHeld.size() );
+				break;
+			default:
+				return STG_E_INVALIDFUNCTION;
+		}
+
+		// the bytes already in the pipe are gone
+		const LONGLONG llPosition = llBase + dlibMove.QuadPart;
+		if ( llPosition < LONGLONG( m_ullWritten ) )
+		{
+			return STG_E_INVALIDFUNCTION;
+		}
+
+		m_ullPosition = ULONGLONG( llPosition );
+		if ( plibNewPosition != nullptr )
+		{
+			plibNewPosition->QuadPart = m_ullPosition;
+		}
+
+		return S_OK;
+	}
+
+	STDMETHODIMP SetSize( ULARGE_INTEGER libNewSize )
+	{
+		if ( libNewSize.QuadPart < m_ullWritten )
+		{
+			return STG_E_INVALIDFUNCTION;
+		}
+
+		m_arrHeld.resize( size_t( libNewSize.QuadPart - m_ullWritten ) );
+		return S_OK;
+	}
+
+	STDMETHODIMP CopyTo
+	(
+		IStream*, ULARGE_INTEGER, ULARGE_INTEGER*, ULARGE_INTEGER*
+	)
+	{
+		return STG_E_ACCESSDENIED;
+	}
+
+	// write the bytes held back, after which the image is complete
+	STDMETHODIMP Commit( DWORD )
+	{
+		if ( !WritePipe( m_arrHeld.size() ) )
+		{
+			return STG_E_WRITEFAULT;
+		}
+		return S_OK;
+	}
+
+	STDMETHODIMP Revert()
+	{
+		return STG_E_INVALIDFUNCTION;
+	}
+
+	STDMETHODIMP LockRegion( ULARGE_INTEGER, ULARGE_INTEGER, DWORD )
+	{
+		return STG_E_INVALIDFUNCTION;
+	}
+
+	STDMETHODIMP UnlockRegion( ULARGE_INTEGER, ULARGE_INTEGER, DWORD )
+	{
+		return STG_E_INVALIDFUNCTION;
+	}
+
+	STDMETHODIMP Stat( STATSTG* pstatstg, DWORD )
+	{
+		if ( pstatstg == nullptr )
+		{
+			return E_POINTER;
+		}
+
+		memset( pstatstg, 0, sizeof( STATSTG ) );
+		pstatstg->type = STGTY_STREAM;
+		pstatstg->cbSize.QuadPart = m_ullWritten + m_arrHeld.size();
+		pstatstg->grfMode = STGM_WRITE;
+		return S_OK;
+	}
+
+	STDMETHODIMP Clone( IStream** ppstm )
+	{
+		if ( ppstm != nullptr )
+		{
+			*ppstm = nullptr;
+		}
+		return STG_E_INVALIDFUNCTION;
+	}
+
+// protected construction / destruction
+protected:
+	// constructor
+	CPipeStream( HANDLE hPipe, size_t nWindow )
+	{
+		m_lRefs = 1;
+		m_hPipe = hPipe;
+		m_nWindow = nWindow;
+		m_ullWritten = 0;
+		m_ullPosition = 0;
+		m_bFailed = false;
+	}
+	// destructor
+	virtual ~CPipeStream()
+	{
+	}
+};
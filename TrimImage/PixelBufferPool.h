@@ -0,0 +1,383 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+#include <map>
+#include <vector>
+#include <mutex>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// this class keeps the pixel buffers of finished images so the next image
+// of the same size can use them again. Scanner batches are thousands of
+// pages with identical dimensions, so after the first page almost every
+// request is served without going to the heap or faulting in new pages.
+// Buffers are 64 byte aligned and can optionally come from large pages
+class CPixelBufferPool
+{
+// protected definitions
+protected:
+	// map of size classes to buffers ready to be used again
+	typedef map<size_t, vector<BYTE*>> MAP_FREE;
+
+	// how a buffer was allocated
+	typedef struct tagBufferInfo
+	{
+		// size class of the buffer
+		size_t m_nSize;
+
+		// the buffer came from large pages
+		bool m_bLargePage;
+
+	} BUFFER_INFO;
+
+// protected data
+protected:
+	// buffers ready to be used again by size class
+	MAP_FREE m_mapFree;
+
+	// how every buffer the pool has allocated was allocated
+	map<BYTE*, BUFFER_INFO> m_mapBuffers;
+
+	// bytes allocated from the system, in use or not
+	ULONGLONG m_ullAllocated;
+
+	// bytes held in buffers that are not in use
+	ULONGLONG m_ullCached;
+
+	// the most bytes allowed to be held in buffers not in use
+	ULONGLONG m_ullMaxCached;
+
+	// the most bytes allocated at once
+	ULONGLONG m_ullPeak;
+
+	// number of requests served by a buffer used before
+	ULONGLONG m_ullHits;
+
+	// number of requests that had to allocate a new buffer
+	ULONGLONG m_ullMisses;
+
+	// size of a large page, or zero if large pages are not used
+	size_t m_nLargePage;
+
+	// protects everything above
+	mutex m_mutex;
+
+// public properties
+public:
+	// the most bytes allowed to be held in buffers not in use
+	inline ULONGLONG GetMaxCached()
+	{
+		return m_ullMaxCached;
+	}
+	// the most bytes allowed to be held in buffers not in use
+	inline void SetMaxCached( ULONGLONG value )
+	{
+		m_ullMaxCached = value;
+	}
+	// the most bytes allowed to be held in buffers not in use
+	__declspec( property( get = GetMaxCached, put = SetMaxCached ) )
+		ULONGLONG MaxCached;
+
+	// number of requests served by a buffer used before
+	inline ULONGLONG GetHits()
+	{
+		return m_ullHits;
+	}
+	// number of requests served by a buffer used before
+	__declspec( property( get = GetHits ) )
+		ULONGLONG Hits;
+
+	// number of requests that had to allocate a new buffer
+	inline ULONGLONG GetMisses()
+	{
+		return m_ullMisses;
+	}
+	// number of requests that had to allocate a new buffer
+	__declspec( property( get = GetMisses ) )
+		ULONGLONG Misses;
+
+	// the most bytes allocated at once
+	inline ULONGLONG GetPeak()
+	{
+		return m_ullPeak;
+	}
+	// the most bytes allocated at once
+	__declspec( property( get = GetPeak ) )
+		ULONGLONG Peak;
+
+	// are the buffers allocated from large pages
+	inline bool GetLargePages()
+	{
+		return m_nLargePage != 0;
+	}
+	// are the buffers allocated from large pages
+	__declspec( property( get = GetLargePages ) )
+		bool LargePages;
+
+// protected methods
+protected:
+	// round the size up to its size class, which wastes at most one
+	// eighth of the buffer while letting nearly equal sizes share buffers
+	size_t GetSizeClass( size_t nSize )
+	{
+		if ( m_nLargePage != 0 )
+		{
+			return ( nSize + m_nLargePage - 1 ) / m_nLargePage * m_nLargePage;
+		}
+
+		size_t nStep = 64;
+		while ( nStep * 16 < nSize )
+		{
+			nStep *= 2;
+		}
+		return ( nSize + nStep - 1 ) / nStep * nStep;
+	}
+
+	// get memory from the system
+	BYTE* Allocate( size_t nSize )
+	{
+		if ( m_nLargePage != 0 )
+		{
+			BYTE* value = (BYTE*)::VirtualAlloc
+			(
+				NULL, nSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+				PAGE_READWRITE
+			);
+			if ( value != nullptr )
+			{
+				return value;
+			}
+
+			// large pages run out as memory fragments, so fall back on
+			// normal pages for the rest of the run
+			m_nLargePage = 0;
+		}
+
+		return (BYTE*)_aligned_malloc( nSize, 64 );
+	}
+
+	// give memory back to the system
+	void Free( BYTE* pBuffer, bool bLargePage )
+	{
+		if ( bLargePage )
+		{
+			::VirtualFree( pBuffer, 0, MEM_RELEASE );
+
+		} else
+		{
+			_aligned_free( pBuffer );
+		}
+	}
+
+	// give cached buffers back to the system until the cache is within
+	// its limit (the lock must be held)
+	void Trim( ULONGLONG ullLimit )
+	{
+		MAP_FREE::iterator pos = m_mapFree.begin();
+		while ( m_ullCached > ullLimit && pos != m_mapFree.end() )
+		{
+			vector<BYTE*>& arrFree = pos->second;
+			while ( m_ullCached > ullLimit && !arrFree.empty() )
+			{
+				BYTE* pBuffer = arrFree.back();
+				arrFree.pop_back();
+
+				Free( pBuffer, m_mapBuffers[ pBuffer ].m_bLargePage );
+				m_mapBuffers.erase( pBuffer );
+
+				m_ullCached -= pos->first;
+				m_ullAllocated -= pos->first;
+			}
+			++pos;
+		}
+	}
+
+// public methods
+public:
+	// try to allocate the buffers from large pages, which needs the
+	// "Lock pages in memory" privilege
+	// returns true if large pages will be used
+	bool EnableLargePages()
+	{
+		const size_t nLargePage = ::GetLargePageMinimum();
+		if ( nLargePage == 0 )
+		{
+			return false;
+		}
+
+		HANDLE hToken = NULL;
+		if
+		(
+			!::OpenProcessToken
+			(
+				::GetCurrentProcess(),
+				TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken
+			)
+		)
+		{
+			return false;
+		}
+
+		TOKEN_PRIVILEGES privileges = { 0 };
+		privileges.PrivilegeCount = 1;
+		privileges.Privileges[ 0 ].Attributes = SE_PRIVILEGE_ENABLED;
+		bool value = FALSE != ::LookupPrivilegeValue
+		(
+			NULL, SE_LOCK_MEMORY_NAME, &privileges.Privileges[ 0 ].Luid
+		);
+
+		// AdjustTokenPrivileges succeeds even if the privilege was not
+		// granted, so the last error has to be checked as well
+		if ( value )
+		{
+			value =
+				::AdjustTokenPrivileges
+				(
+					hToken, FALSE, &privileges, 0, NULL, NULL
+				) && ::GetLastError() == ERROR_SUCCESS;
+		}
+		::CloseHandle( hToken );
+
+		if ( value )
+		{
+			lock_guard<mutex> lock( m_mutex );
+			m_nLargePage = nLargePage;
+		}
+
+		return value;
+	}
+
+	// get a buffer of at least the given size
+	// returns nullptr if the memory is not available
+	BYTE* Acquire( size_t nSize )
+	{
+		lock_guard<mutex> lock( m_mutex );
+
+		const size_t nClass = GetSizeClass( nSize );
+
+		MAP_FREE::iterator pos = m_mapFree.find( nClass );
+		if ( pos != m_mapFree.end() && !pos->second.empty() )
+		{
+			BYTE* value = pos->second.back();
+			pos->second.pop_back();
+			m_ullCached -= nClass;
+			m_ullHits++;
+			return value;
+		}
+
+		m_ullMisses++;
+
+		BYTE* value = Allocate( nClass );
+		if ( value == nullptr )
+		{
+			// make room by giving back what is not in use and try again
+			Trim( 0 );
+			value = Allocate( nClass );
+			if ( value == nullptr )
+			{
+				return nullptr;
+			}
+		}
+
+		// remember how the buffer was allocated since the pool falls
+		// back on normal pages when large pages run out
+		BUFFER_INFO& info = m_mapBuffers[ value ];
+		info.m_nSize = nClass;
+		info.m_bLargePage = m_nLargePage != 0;
+
+		m_ullAllocated += nClass;
+		m_ullPeak = max( m_ullPeak, m_ullAllocated );
+		return value;
+	}
+
+	// give a buffer back to be used again
+	void Release( BYTE* pBuffer )
+	{
+		if ( pBuffer == nullptr )
+		{
+			return;
+		}
+
+		lock_guard<mutex> lock( m_mutex );
+
+		const size_t nClass = m_mapBuffers[ pBuffer ].m_nSize;
+		m_mapFree[ nClass ].push_back( pBuffer );
+		m_ullCached += nClass;
+
+		Trim( m_ullMaxCached );
+	}
+
+	// give every buffer not in use back to the system
+	void Clear()
+	{
+		lock_guard<mutex> lock( m_mutex );
+		Trim( 0 );
+		m_mapFree.clear();
+	}
+
+// public construction / destruction
+public:
+	// constructor
+	CPixelBufferPool()
+	{
+		m_ullAllocated = 0;
+		m_ullCached = 0;
+		m_ullMaxCached = 512ull << 20;
+		m_ullPeak = 0;
+		m_ullHits = 0;
+		m_ullMisses = 0;
+		m_nLargePage = 0;
+	}
+	// destructor
+	virtual ~CPixelBufferPool()
+	{
+		Clear();
+	}
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// this class holds a buffer from the pool for the life of a scope and
+// gives it back when it goes out of scope
+class CPixelBuffer
+{
+// protected data
+protected:
+	// the pool the buffer came from
+	CPixelBufferPool& m_pool;
+
+	// the buffer
+	BYTE* m_pData;
+
+// public properties
+public:
+	// the buffer or nullptr if the memory was not available
+	inline BYTE* GetData()
+	{
+		return m_pData;
+	}
+	// the buffer or nullptr if the memory was not available
+	__declspec( property( get = GetData ) )
+		BYTE* Data;
+
+// public construction / destruction
+public:
+	// constructor
+	CPixelBuffer( CPixelBufferPool& pool, size_t nSize ) :
+		m_pool( pool )
+	{
+		m_pData = m_pool.Acquire( nSize );
+	}
+	// destructor
+	virtual ~CPixelBuffer()
+	{
+		m_pool.Release( m_pData );
+	}
+
+// not copyable since the buffer is owned by a single scope
+private:
+	CPixelBuffer( const CPixelBuffer& );
+	CPixelBuffer& operator=( const CPixelBuffer& );
+};
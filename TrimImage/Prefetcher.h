@@ -0,0 +1,444 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+#include <deque>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// this class reads the next few input files into memory on a separate
+// thread while the current file is being processed, so the decoder finds
+// the file in memory instead of waiting on a cold read from the disk or
+// the network. Files that only exist in memory (like the entries of an
+// archive) can be put in directly under the same memory budget
+class CPrefetcher
+{
+// protected data
+protected:
+	// number of upcoming files to read ahead (zero disables reading ahead)
+	int m_nDepth;
+
+	// the most bytes held in memory by files read ahead
+	ULONGLONG m_ullBudget;
+
+	// files waiting to be read
+	deque<CString> m_arrQueue;
+
+	// files that have been read and are waiting for the decoder
+	map<CString, vector<BYTE>> m_mapReady;
+
+	// the file being read by the thread
+	CString m_csReading;
+
+	// the decoder is waiting on the file being read, so it is read even
+	// if that puts the memory over budget
+	bool m_bUrgent;
+
+	// bytes held by files read ahead
+	ULONGLONG m_ullUsed;
+
+	// buffers returned by the decoder to be used again
+	vector<vector<BYTE>> m_arrFree;
+
+	// no more files will be queued
+	bool m_bClosing;
+
+	// number of files found in memory when the decoder asked for them
+	ULONGLONG m_ullHits;
+
+	// number of files the decoder had to read itself
+	ULONGLONG m_ullMisses;
+
+	// protects everything above
+	mutex m_mutex;
+
+	// signaled when a file is queued, memory is released or the
+	// prefetcher is closing
+	condition_variable m_cvQueued;
+
+	// signaled when a file has been read
+	condition_variable m_cvReady;
+
+	// thread reading the files
+	thread m_thread;
+
+// public properties
+public:
+	// number of upcoming files to read ahead
+	inline int GetDepth()
+	{
+		return m_nDepth;
+	}
+	// number of upcoming files to read ahead
+	inline void SetDepth( int value )
+	{
+		m_nDepth = max( value, 0 );
+	}
+	// number of upcoming files to read ahead
+	__declspec( property( get = GetDepth, put = SetDepth ) )
+		int Depth;
+
+	// the most bytes held in memory by files read ahead
+	inline ULONGLONG GetBudget()
+	{
+		return m_ullBudget;
+	}
+	// the most bytes held in memory by files read ahead
+	inline void SetBudget( ULONGLONG value )
+	{
+		m_ullBudget = value;
+	}
+	// the most bytes held in memory by files read ahead
+	__declspec( property( get = GetBudget, put = SetBudget ) )
+		ULONGLONG Budget;
+
+	// number of files found in memory when the decoder asked for them
+	inline ULONGLONG GetHits()
+	{
+		return m_ullHits;
+	}
+	// number of files found in memory when the decoder asked for them
+	__declspec( property( get = GetHits ) )
+		ULONGLONG Hits;
+
+	// number of files the decoder had to read itself
+	inline ULONGLONG GetMisses()
+	{
+		return m_ullMisses;
+	}
+	// number of files the decoder had to read itself
+	__declspec( property( get = GetMisses ) )
+		ULONGLONG Misses;
+
+// protected methods
+protected:
+	// read the whole file into the buffer
+	static bool ReadFile( const CString& csPath, vector<BYTE>& buffer )
+	{
+		HANDLE hFile = ::CreateFile
+		(
+			csPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL
+		);
+		if ( hFile == INVALID_HANDLE_VALUE )
+		{
+			return false;
+		}
+
+		LARGE_INTEGER size;
+		bool value =
+			::GetFileSizeEx( hFile, &size ) &&
+			size.QuadPart > 0 &&
+			size.QuadPart < MAXDWORD;
+
+		if ( value )
+		{
+			buffer.resize( size_t( size.QuadPart ) );
+
+			DWORD dwRead = 0;
+			value =
+				::ReadFile
+				(
+					hFile, &buffer[ 0 ], (DWORD)buffer.size(), &dwRead, NULL
+				) && dwRead == buffer.size();
+		}
+
+		::CloseHandle( hFile );
+		return value;
+	}
+
+	// get the size of the file without opening it
+	static ULONGLONG GetFileSize( const CString& csPath )
+	{
+		WIN32_FILE_ATTRIBUTE_DATA data;
+		if ( !::GetFileAttributesEx( csPath, GetFileExInfoStandard, &data ) )
+		{
+			return 0;
+		}
+
+		ULARGE_INTEGER size;
+		size.LowPart = data.nFileSizeLow;
+		size.HighPart = data.nFileSizeHigh;
+		return size.QuadPart;
+	}
+
+	// thread procedure reading the queued files in order while they fit
+	// into the memory budget
+	void ReadThread()
+	{
+		unique_lock<mutex> lock( m_mutex );
+		do
+		{
+			m_cvQueued.wait
+			(
+				lock,
+				[ this ]
+				{
+					return !m_arrQueue.empty() || m_bClosing;
+				}
+			);
+
+			if ( m_bClosing )
+			{
+				break;
+			}
+
+			m_csReading = m_arrQueue.front();
+			m_arrQueue.pop_front();
+
+			lock.unlock();
+			const ULONGLONG ullSize = GetFileSize( m_csReading );
+			lock.lock();
+
+			// wait for the decoder to use up some of the memory unless
+			// it is already waiting for this very file
+			m_cvQueued.wait
+			(
+				lock,
+				[ this, ullSize ]
+				{
+					return
+						m_bClosing || m_bUrgent || m_ullUsed == 0 ||
+						m_ullUsed + ullSize <= m_ullBudget;
+				}
+			);
+
+			if ( m_bClosing )
+			{
+				break;
+			}
+
+			// reuse a buffer returned by the decoder
+			vector<BYTE> buffer;
+			if ( !m_arrFree.empty() )
+			{
+				buffer.swap( m_arrFree.back() );
+				m_arrFree.pop_back();
+			}
+			m_ullUsed += ullSize;
+
+			lock.unlock();
+			const bool bOkay = ReadFile( m_csReading, buffer );
+			lock.lock();
+
+			// an unreadable file is left for the decoder to report
+			m_ullUsed -= ullSize;
+			if ( bOkay )
+			{
+				// a file queued again replaces what was read the first 
+				// time, which no longer counts against the budget
+				vector<BYTE>& ready = m_mapReady[ m_csReading ];
+				m_ullUsed -= ready.size();
+				m_ullUsed += buffer.size();
+				ready.swap( buffer );
+			}
+
+			m_csReading.Empty();
+			m_bUrgent = false;
+			m_cvReady.notify_all();
+
+		} while ( true );
+
+		m_csReading.Empty();
+		m_cvReady.notify_all();
+	}
+
+// public methods
+public:
+	// start the thread reading the files
+	void Start()
+	{
+		m_bClosing = false;
+		if ( m_nDepth > 0 )
+		{
+			m_thread = thread( &CPrefetcher::ReadThread, this );
+		}
+	}
+
+	// queue an upcoming file to be read ahead of the decoder
+	void Queue( const CString& csPath )
+	{
+		if ( m_nDepth == 0 )
+		{
+			return;
+		}
+
+		lock_guard<mutex> lock( m_mutex );
+		m_arrQueue.push_back( csPath );
+		m_cvQueued.notify_all();
+	}
+
+	// take the content of a file that was read ahead, waiting for it if
+	// it is being read right now
+	// returns false if the file was not read ahead and the decoder has
+	// to read it from the disk
+	bool Take( const CString& csPath, vector<BYTE>& buffer )
+	{
+		unique_lock<mutex> lock( m_mutex );
+
+		if ( m_csReading == csPath )
+		{
+			m_bUrgent = true;
+			m_cvQueued.notify_all();
+			m_cvReady.wait
+			(
+				lock,
+				[ this, &csPath ]
+				{
+					return m_csReading != csPath;
+				}
+			);
+		}
+
+		map<CString, vector<BYTE>>::iterator pos = m_mapReady.find( csPath );
+		if ( pos == m_mapReady.end() )
+		{
+			// do not read a file the decoder has already read itself
+			deque<CString>::iterator posQueue =
+				find( m_arrQueue.begin(), m_arrQueue.end(), csPath );
+			if ( posQueue != m_arrQueue.end() )
+			{
+				m_arrQueue.erase( posQueue );
+			}
+
+			m_ullMisses++;
+			return false;
+		}
+
+		buffer.swap( pos->second );
+		m_mapReady.erase( pos );
+		m_ullUsed -= buffer.size();
+		m_ullHits++;
+
+		// make room for the next file
+		m_cvQueued.notify_all();
+		return true;
+	}
+
+	// put the content of a file that is already in memory where the
+	// decoder will take it, waiting for the decoder to use up some of the
+	// memory first if it is over budget (the buffer is left empty). A
+	// pathname put again (like an entry repeated in a tar archive) waits
+	// for the decoder to take the first one, so each is decoded in turn
+	// returns false if the prefetcher is closing
+	bool Put( const CString& csPath, vector<BYTE>& buffer )
+	{
+		unique_lock<mutex> lock( m_mutex );
+
+		const ULONGLONG ullSize = buffer.size();
+		m_cvQueued.wait
+		(
+			lock,
+			[ this, ullSize, &csPath ]
+			{
+				if ( m_bClosing )
+				{
+					return true;
+				}
+				if ( m_mapReady.find( csPath ) != m_mapReady.end() )
+				{
+					return false;
+				}
+				return m_ullUsed == 0 || m_ullUsed + ullSize <= m_ullBudget;
+			}
+		);
+
+		if ( m_bClosing )
+		{
+			return false;
+		}
+
+		m_ullUsed += ullSize;
+		m_mapReady[ csPath ].swap( buffer );
+		buffer.clear();
+		m_cvReady.notify_all();
+		return true;
+	}
+
+	// look at the content of a file waiting for the decoder without
+	// taking it
+	// returns false if the file is not in memory
+	bool Peek
+	(
+		const CString& csPath, function<void( const vector<BYTE>& )> look
+	)
+	{
+		lock_guard<mutex> lock( m_mutex );
+
+		map<CString, vector<BYTE>>::const_iterator pos =
+			m_mapReady.find( csPath );
+		if ( pos == m_mapReady.end() )
+		{
+			return false;
+		}
+
+		look( pos->second );
+		return true;
+	}
+
+	// give a buffer back to be used for another file
+	void Release( vector<BYTE>& buffer )
+	{
+		lock_guard<mutex> lock( m_mutex );
+
+		// there is never more than one buffer per upcoming file in use
+		if ( (int)m_arrFree.size() < m_nDepth )
+		{
+			buffer.clear();
+			m_arrFree.push_back( vector<BYTE>() );
+			m_arrFree.back().swap( buffer );
+
+		} else
+		{
+			vector<BYTE>().swap( buffer );
+		}
+	}
+
+	// stop the thread and free the memory
+	void Close()
+	{
+		{
+			lock_guard<mutex> lock( m_mutex );
+			m_bClosing = true;
+			m_cvQueued.notify_all();
+		}
+
+		if ( m_thread.joinable() )
+		{
+			m_thread.join();
+		}
+
+		m_arrQueue.clear();
+		m_mapReady.clear();
+		m_arrFree.clear();
+		m_ullUsed = 0;
+	}
+
+// public construction / destruction
+public:
+	// constructor
+	CPrefetcher()
+	{
+		m_nDepth = 8;
+		m_ullBudget = 256ull << 20;
+		m_bUrgent = false;
+		m_ullUsed = 0;
+		m_bClosing = false;
+		m_ullHits = 0;
+		m_ullMisses = 0;
+	}
+	// destructor
+	virtual ~CPrefetcher()
+	{
+		Close();
+	}
+};
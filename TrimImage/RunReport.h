@@ -0,0 +1,248 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+#include <mutex>
+#include <set>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// this class writes a line for every image processed to a comma separated
+// report with the cost predicted from its header next to the time it
+// actually took, so the cost model used to order the work can be checked
+// against a real run. The worker threads add lines at the same time.
+// The reports of several shards of a tree can be merged into one
+class CRunReport
+{
+// protected data
+protected:
+	// the report file
+	CStdioFile m_file;
+
+	// is the report open
+	bool m_bOpen;
+
+	// sum of the predicted costs of the images reported
+	double m_dPredicted;
+
+	// sum of the milliseconds the images reported took
+	double m_dActual;
+
+	// number of images reported
+	ULONGLONG m_ullCount;
+
+	// paths of the images merged so far, which finds images processed
+	// by more than one shard
+	set<CString> m_setMerged;
+
+	// protects everything above
+	mutex m_mutex;
+
+// public properties
+public:
+	// is the report open
+	inline bool GetIsOpen()
+	{
+		return m_bOpen;
+	}
+	// is the report open
+	__declspec( property( get = GetIsOpen ) )
+		bool IsOpen;
+
+	// number of images reported
+	inline ULONGLONG GetCount()
+	{
+		return m_ullCount;
+	}
+	// number of images reported
+	__declspec( property( get = GetCount ) )
+		ULONGLONG Count;
+
+	// milliseconds per unit of predicted cost over the whole run, which
+	// turns the predicted costs into times
+	inline double GetRate()
+	{
+		if ( m_dPredicted <= 0.0 )
+		{
+			return 0.0;
+		}
+		return m_dActual / m_dPredicted;
+	}
+	// milliseconds per unit of predicted cost over the whole run
+	__declspec( property( get = GetRate ) )
+		double Rate;
+
+// public methods
+public:
+	// the first line of the report naming the columns
+	static CString GetHeading()
+	{
+		return _T( "path,width,height,bytes,predicted,milliseconds\n" );
+	}
+
+	// create the report and write its heading
+	// returns false if the file cannot be created
+	bool Open( LPCTSTR pcszPath )
+	{
+		lock_guard<mutex> lock( m_mutex );
+
+		CFileException ex;
+		m_bOpen = FALSE != m_file.Open
+		(
+			pcszPath,
+			CFile::modeCreate | CFile::modeWrite | CFile::shareDenyWrite |
+			CFile::typeText, &ex
+		);
+		if ( m_bOpen )
+		{
+			m_file.WriteString( GetHeading() );
+		}
+		return m_bOpen;
+	}
+
+	// add an image to the report
+	void Add
+	(
+		const CString& csPath, UINT uiWidth, UINT uiHeight,
+		ULONGLONG ullBytes, ULONGLONG ullPredicted, double dMilliseconds
+	)
+	{
+		lock_guard<mutex> lock( m_mutex );
+
+		m_dPredicted += double( ullPredicted );
+		m_dActual += dMilliseconds;
+		m_ullCount++;
+
+		if ( !m_bOpen )
+		{
+			return;
+		}
+
+		// paths with commas are quoted
+		CString csName( csPath );
+		if ( csName.Find( _T( ',' ) ) != -1 )
+		{
+			csName = _T( "\"" ) + csName + _T( "\"" );
+		}
+
+		CString csLine;
+		csLine.Format
+		(
+			_T( "%s,%u,%u,%I64u,%I64u,%.1f\n" ), csName, uiWidth, uiHeight,
+			ullBytes, ullPredicted, dMilliseconds
+		);
+		m_file.WriteString( csLine );
+	}
+
+	// append the lines of another report (of one shard of the tree) to
+	// this one, adding the paths found in an earlier report to the list 
+	// of duplicates
+	// returns false if the report cannot be read
+	bool Append( LPCTSTR pcszReport, vector<CString>& arrDuplicates )
+	{
+		CStdioFile file;
+		if 
+		( 
+			!file.Open
+			( 
+				pcszReport, 
+				CFile::modeRead | CFile::shareDenyWrite | CFile::typeText 
+			) 
+		)
+		{
+			return false;
+		}
+
+		lock_guard<mutex> lock( m_mutex );
+
+		CString csLine;
+		const CString csHeading = GetHeading().TrimRight();
+		while ( file.ReadString( csLine ) )
+		{
+			if ( csLine.IsEmpty() || csLine == csHeading )
+			{
+				continue;
+			}
+
+			// the path is quoted if it has commas in it
+			CString csPath;
+			int nColumns = 0;
+			if ( csLine[ 0 ] == _T( '"' ) )
+			{
+				const int nQuote = csLine.Find( _T( '"' ), 1 );
+				if ( nQuote == -1 )
+				{
+					continue;
+				}
+				csPath = csLine.Mid( 1, nQuote - 1 );
+				nColumns = nQuote + 2;
+
+			} else
+			{
+				const int nComma = csLine.Find( _T( ',' ) );
+				if ( nComma == -1 )
+				{
+					continue;
+				}
+				csPath = csLine.Left( nComma );
+				nColumns = nComma + 1;
+			}
+
+			if ( !m_setMerged.insert( csPath.MakeLower() ).second )
+			{
+				arrDuplicates.push_back( csPath );
+			}
+
+			UINT uiWidth = 0;
+			UINT uiHeight = 0;
+			ULONGLONG ullBytes = 0;
+			ULONGLONG ullPredicted = 0;
+			double dMilliseconds = 0.0;
+			_stscanf_s
+			(
+				csLine.Mid( nColumns ), _T( "%u,%u,%I64u,%I64u,%lf" ),
+				&uiWidth, &uiHeight, &ullBytes, &ullPredicted, &dMilliseconds
+			);
+
+			m_dPredicted += double( ullPredicted );
+			m_dActual += dMilliseconds;
+			m_ullCount++;
+
+			if ( m_bOpen )
+			{
+				m_file.WriteString( csLine + _T( "\n" ) );
+			}
+		}
+
+		return true;
+	}
+
+	// close the report
+	void Close()
+	{
+		lock_guard<mutex> lock( m_mutex );
+		if ( m_bOpen )
+		{
+			m_file.Close();
+			m_bOpen = false;
+		}
+	}
+
+// public construction / destruction
+public:
+	// constructor
+	CRunReport()
+	{
+		m_bOpen = false;
+		m_dPredicted = 0.0;
+		m_dActual = 0.0;
+		m_ullCount = 0;
+	}
+	// destructor
+	virtual ~CRunReport()
+	{
+		Close();
+	}
+};
@@ -0,0 +1,171 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// this class decides which files of a tree belong to one of several
+// processes splitting the tree between them. Each file is assigned by a
+// stable hash of its path relative to the root of the tree, so processes
+// on different machines (with the tree mapped to different drives or
+// shares) agree on the split without talking to each other, and every
+// file is processed by exactly one of them
+class CShard
+{
+// protected data
+protected:
+	// zero based index of this shard
+	UINT m_uiIndex;
+
+	// number of shards the tree is split into
+	UINT m_uiCount;
+
+	// root of the tree the relative paths are taken from
+	CString m_csRoot;
+
+// public properties
+public:
+	// zero based index of this shard
+	inline UINT GetIndex()
+	{
+		return m_uiIndex;
+	}
+	// zero based index of this shard
+	__declspec( property( get = GetIndex ) )
+		UINT Index;
+
+	// number of shards the tree is split into
+	inline UINT GetCount()
+	{
+		return m_uiCount;
+	}
+	// number of shards the tree is split into
+	__declspec( property( get = GetCount ) )
+		UINT Count;
+
+	// is the tree split at all
+	inline bool GetIsSharded()
+	{
+		return m_uiCount > 1;
+	}
+	// is the tree split at all
+	__declspec( property( get = GetIsSharded ) )
+		bool IsSharded;
+
+	// root of the tree the relative paths are taken from
+	inline CString GetRoot()
+	{
+		return m_csRoot;
+	}
+	// root of the tree the relative paths are taken from
+	inline void SetRoot( CString value )
+	{
+		m_csRoot = value;
+		m_csRoot.TrimRight( _T( "\\/" ) );
+	}
+	// root of the tree the relative paths are taken from
+	__declspec( property( get = GetRoot, put = SetRoot ) )
+		CString Root;
+
+// public methods
+public:
+	// 64 bit FNV-1a hash of the path with the separators and the case
+	// of the letters made the same, so the hash does not depend on how
+	// the path was typed
+	static ULONGLONG Hash( const CString& csPath )
+	{
+		ULONGLONG value = 14695981039346656037ull;
+
+		const int nLength = csPath.GetLength();
+		for ( int nChar = 0; nChar < nLength; nChar++ )
+		{
+			TCHAR ch = csPath[ nChar ];
+			if ( ch == _T( '/' ) )
+			{
+				ch = _T( '\\' );
+
+			} else if ( ch >= _T( 'A' ) && ch <= _T( 'Z' ) )
+			{
+				ch = ch - _T( 'A' ) + _T( 'a' );
+			}
+
+			// both bytes of the character are hashed so the result is
+			// the same on every machine regardless of the code page
+			const UINT uiChar = UINT( ch );
+			value = ( value ^ ( uiChar & 0xFF ) ) * 1099511628211ull;
+			value = ( value ^ ( ( uiChar >> 8 ) & 0xFF ) ) * 1099511628211ull;
+		}
+
+		return value;
+	}
+
+	// the path of the file relative to the root of the tree
+	CString GetRelativePath( const CString& csPath )
+	{
+		const int nRoot = m_csRoot.GetLength();
+		if
+		(
+			nRoot == 0 ||
+			csPath.GetLength() <= nRoot ||
+			csPath.Left( nRoot ).CompareNoCase( m_csRoot ) != 0
+		)
+		{
+			return csPath;
+		}
+
+		CString value = csPath.Mid( nRoot );
+		value.TrimLeft( _T( "\\/" ) );
+		return value;
+	}
+
+	// read the shard in the form of "index/count" with a zero based index
+	// returns false if the text is not a valid shard
+	bool Parse( const CString& csShard )
+	{
+		int nStart = 0;
+		const CString csIndex = csShard.Tokenize( _T( "/" ), nStart );
+		const CString csCount = csShard.Tokenize( _T( "/" ), nStart );
+		if ( csIndex.IsEmpty() || csCount.IsEmpty() )
+		{
+			return false;
+		}
+
+		const int nIndex = _tstol( csIndex );
+		const int nCount = _tstol( csCount );
+		if ( nCount < 1 || nIndex < 0 || nIndex >= nCount )
+		{
+			return false;
+		}
+
+		m_uiIndex = UINT( nIndex );
+		m_uiCount = UINT( nCount );
+		return true;
+	}
+
+	// does the file belong to this shard
+	bool Contains( const CString& csPath )
+	{
+		if ( m_uiCount <= 1 )
+		{
+			return true;
+		}
+
+		const ULONGLONG ullHash = Hash( GetRelativePath( csPath ) );
+		const bool value = ullHash % m_uiCount == m_uiIndex;
+		return value;
+	}
+
+// public construction / destruction
+public:
+	// constructor
+	CShard()
+	{
+		m_uiIndex = 0;
+		m_uiCount = 1;
+	}
+	// destructor
+	virtual ~CShard()
+	{
+	}
+};
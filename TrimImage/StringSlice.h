@@ -0,0 +1,195 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// this class is a piece of text that belongs to someone else: a pointer
+// to the first character and a length. Taking pieces of a string this way
+// allocates nothing, so lookups and path parsing can work on the caller's
+// buffer and only build a CString when one has to be kept. The text must
+// outlive the slice
+class CStringSlice
+{
+// protected data
+protected:
+	// first character of the slice
+	LPCTSTR m_pText;
+
+	// number of characters in the slice
+	int m_nLength;
+
+// public properties
+public:
+	// first character of the slice (not null terminated)
+	inline LPCTSTR GetText() const
+	{
+		return m_pText;
+	}
+	// first character of the slice (not null terminated)
+	__declspec( property( get = GetText ) )
+		LPCTSTR Text;
+
+	// number of characters in the slice
+	inline int GetLength() const
+	{
+		return m_nLength;
+	}
+	// number of characters in the slice
+	__declspec( property( get = GetLength ) )
+		int Length;
+
+	// does the slice have no characters
+	inline bool GetIsEmpty() const
+	{
+		return m_nLength == 0;
+	}
+	// does the slice have no characters
+	__declspec( property( get = GetIsEmpty ) )
+		bool IsEmpty;
+
+// public methods
+public:
+	// the character at the given position
+	inline TCHAR operator[]( int nIndex ) const
+	{
+		return m_pText[ nIndex ];
+	}
+
+	// the given number of characters from the left
+	CStringSlice Left( int nCount ) const
+	{
+		return CStringSlice( m_pText, max( min( nCount, m_nLength ), 0 ) );
+	}
+
+	// the characters from the given position to the end
+	CStringSlice Mid( int nFirst ) const
+	{
+		nFirst = max( min( nFirst, m_nLength ), 0 );
+		return CStringSlice( m_pText + nFirst, m_nLength - nFirst );
+	}
+
+	// the given number of characters from the given position
+	CStringSlice Mid( int nFirst, int nCount ) const
+	{
+		return Mid( nFirst ).Left( nCount );
+	}
+
+	// the given number of characters from the right
+	CStringSlice Right( int nCount ) const
+	{
+		nCount = max( min( nCount, m_nLength ), 0 );
+		return CStringSlice( m_pText + m_nLength - nCount, nCount );
+	}
+
+	// position of the first occurrence of the character or -1
+	int Find( TCHAR ch ) const
+	{
+		for ( int nIndex = 0; nIndex < m_nLength; nIndex++ )
+		{
+			if ( m_pText[ nIndex ] == ch )
+			{
+				return nIndex;
+			}
+		}
+		return -1;
+	}
+
+	// position of the last occurrence of the character or -1
+	int ReverseFind( TCHAR ch ) const
+	{
+		for ( int nIndex = m_nLength - 1; nIndex >= 0; nIndex-- )
+		{
+			if ( m_pText[ nIndex ] == ch )
+			{
+				return nIndex;
+			}
+		}
+		return -1;
+	}
+
+	// position of the last occurrence of any of the characters or -1
+	int ReverseFindOneOf( LPCTSTR pcszCharacters ) const
+	{
+		for ( int nIndex = m_nLength - 1; nIndex >= 0; nIndex-- )
+		{
+			if ( _tcschr( pcszCharacters, m_pText[ nIndex ] ) != nullptr )
+			{
+				return nIndex;
+			}
+		}
+		return -1;
+	}
+
+	// compare with another slice (case sensitive)
+	int Compare( const CStringSlice& other ) const
+	{
+		const int nLength = min( m_nLength, other.m_nLength );
+		const int value = _tcsncmp( m_pText, other.m_pText, nLength );
+		if ( value != 0 || m_nLength == other.m_nLength )
+		{
+			return value;
+		}
+		return m_nLength < other.m_nLength ? -1 : 1;
+	}
+
+	// compare with another slice ignoring the case of the letters
+	int CompareNoCase( const CStringSlice& other ) const
+	{
+		const int nLength = min( m_nLength, other.m_nLength );
+		const int value = _tcsnicmp( m_pText, other.m_pText, nLength );
+		if ( value != 0 || m_nLength == other.m_nLength )
+		{
+			return value;
+		}
+		return m_nLength < other.m_nLength ? -1 : 1;
+	}
+
+	// are the slices the same text (case sensitive)
+	inline bool operator==( const CStringSlice& other ) const
+	{
+		return
+			m_nLength == other.m_nLength &&
+			_tcsncmp( m_pText, other.m_pText, m_nLength ) == 0;
+	}
+
+	// are the slices different text (case sensitive)
+	inline bool operator!=( const CStringSlice& other ) const
+	{
+		return !( *this == other );
+	}
+
+	// a copy of the text that can be kept
+	CString ToString() const
+	{
+		return CString( m_pText, m_nLength );
+	}
+
+// public construction / destruction
+public:
+	// an empty slice
+	CStringSlice()
+	{
+		m_pText = _T( "" );
+		m_nLength = 0;
+	}
+	// the whole of a null terminated string
+	CStringSlice( LPCTSTR pcszText )
+	{
+		m_pText = pcszText != nullptr ? pcszText : _T( "" );
+		m_nLength = int( _tcslen( m_pText ) );
+	}
+	// the whole of a CString, which must outlive the slice
+	CStringSlice( const CString& csText )
+	{
+		m_pText = csText;
+		m_nLength = csText.GetLength();
+	}
+	// the given number of characters
+	CStringSlice( LPCTSTR pcszText, int nLength )
+	{
+		m_pText = pcszText;
+		m_nLength = nLength;
+	}
+};
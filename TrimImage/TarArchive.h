@@ -0,0 +1,450 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+#include <vector>
+#include <ctime>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// this class writes files into a tar archive (POSIX ustar, with a pax
+// header for names that do not fit the header or are not plain ASCII),
+// which lets a whole batch be written as one long sequential stream
+// instead of thousands of small files. The bytes are gathered in a large
+// buffer so the file system sees few large writes. When a size limit is
+// given the archives roll over, numbered name.0001.tar, name.0002.tar
+// and so on, before an entry would take one past the limit. Each archive
+// is written under a temporary name and renamed once it is complete
+class CTarArchive
+{
+// protected definitions
+protected:
+	// size of a tar block, headers and data are padded to a whole block
+	static const UINT BLOCK = 512;
+
+	// bytes gathered before they are written
+	static const size_t BUFFER = 4 << 20;
+
+// protected data
+protected:
+	// pathname of the archive as given
+	CString m_csPath;
+
+	// largest an archive may grow before the next one is started
+	// (zero is no limit)
+	ULONGLONG m_ullMaxSize;
+
+	// pathname of the archive being written
+	CString m_csCurrent;
+
+	// the archive being written
+	HANDLE m_hFile;
+
+	// bytes in the archive being written
+	ULONGLONG m_ullSize;
+
+	// number of archives started
+	UINT m_uiArchives;
+
+	// number of entries written to all of the archives
+	ULONGLONG m_ullEntries;
+
+	// bytes written to all of the archives
+	ULONGLONG m_ullTotal;
+
+	// bytes waiting to be written
+	vector<BYTE> m_arrBuffer;
+
+	// number of bytes in the buffer
+	size_t m_nBuffered;
+
+	// did a write fail
+	bool m_bFailed;
+
+// public properties
+public:
+	// is an archive open to be written
+	inline bool GetIsOpen()
+	{
+		return !m_csPath.IsEmpty();
+	}
+	// is an archive open to be written
+	__declspec( property( get = GetIsOpen ) )
+		bool IsOpen;
+
+	// number of archives started
+	inline UINT GetArchives()
+	{
+		return m_uiArchives;
+	}
+	// number of archives started
+	__declspec( property( get = GetArchives ) )
+		UINT Archives;
+
+	// number of entries written to all of the archives
+	inline ULONGLONG GetEntries()
+	{
+		return m_ullEntries;
+	}
+	// number of entries written to all of the archives
+	__declspec( property( get = GetEntries ) )
+		ULONGLONG Entries;
+
+	// bytes written to all of the archives
+	inline ULONGLONG GetTotal()
+	{
+		return m_ullTotal;
+	}
+	// bytes written to all of the archives
+	__declspec( property( get = GetTotal ) )
+		ULONGLONG Total;
+
+// protected methods
+protected:
+	// bytes the given number of bytes take up padded to whole blocks
+	static inline ULONGLONG Padded( ULONGLONG ullSize )
+	{
+		return ( ullSize + BLOCK - 1 ) / BLOCK * BLOCK;
+	}
+
+	// write a number into a header field in octal, or in base 256 (the
+	// GNU extension) when it is too large for the octal digits
+	static void SetNumber( char* pField, size_t nWidth, ULONGLONG ullValue )
+	{
+		const size_t nDigits = nWidth - 1;
+		if ( nDigits * 3 >= 64 || ( ullValue >> ( nDigits * 3 ) ) == 0 )
+		{
+			for ( size_t nDigit = nDigits; nDigit > 0; nDigit-- )
+			{
+				pField[ nDigit - 1 ] = char( '0' + ( ullValue & 7 ) );
+				ullValue >>= 3;
+			}
+			pField[ nDigits ] = '\0';
+			return;
+		}
+
+		memset( pField, 0, nWidth );
+		pField[ 0 ] = char( 0x80 );
+		for ( size_t nByte = nWidth; nByte > 1 && ullValue != 0; nByte-- )
+		{
+			pField[ nByte - 1 ] = char( ullValue & 0xFF );
+			ullValue >>= 8;
+		}
+	}
+
+	// fill a ustar header block
+	static void SetHeader
+	(
+		BYTE* pHeader, const CStringA& csName, ULONGLONG ullSize, char type
+	)
+	{
+		memset( pHeader, 0, BLOCK );
+		char* pBlock = (char*)pHeader;
+		memcpy( pBlock, csName, min( csName.GetLength(), 100 ) );
+		SetNumber( pBlock + 100, 8, type == '5' ? 0755 : 0644 );
+		SetNumber( pBlock + 108, 8, 0 );
+		SetNumber( pBlock + 116, 8, 0 );
+		SetNumber( pBlock + 124, 12, ullSize );
+		SetNumber( pBlock + 136, 12, ULONGLONG( _time64( nullptr ) ) );
+		pBlock[ 156 ] = type;
+		memcpy( pBlock + 257, "ustar", 6 );
+		memcpy( pBlock + 263, "00", 2 );
+
+		// the checksum is worked out with its own field as spaces
+		memset( pBlock + 148, ' ', 8 );
+		UINT uiSum = 0;
+		for ( UINT uiByte = 0; uiByte < BLOCK; uiByte++ )
+		{
+			uiSum += pHeader[ uiByte ];
+		}
+		SetNumber( pBlock + 148, 7, uiSum );
+		pBlock[ 155 ] = ' ';
+	}
+
+	// the pathname of the numbered archive
+	CString GetArchivePath( UINT uiArchive )
+	{
+		if ( m_ullMaxSize == 0 )
+		{
+			return m_csPath;
+		}
+
+		// the number goes in front of the extension
+		const int nFolder =
+			max( m_csPath.ReverseFind( '\\' ), m_csPath.ReverseFind( '/' ) );
+		int nExt = m_csPath.ReverseFind( '.' );
+		if ( nExt <= nFolder )
+		{
+			nExt = m_csPath.GetLength();
+		}
+
+		CString value;
+		value.Format
+		(
+			_T( "%s.%04u%s" ), m_csPath.Left( nExt ), uiArchive, m_csPath.Mid( nExt )
+		);
+		return value;
+	}
+
+	// write the buffered bytes to the archive
+	bool Flush()
+	{
+		size_t nOffset = 0;
+		while ( !m_bFailed && nOffset < m_nBuffered )
+		{
+			DWORD dwWritten = 0;
+			const DWORD dwChunk = DWORD( m_nBuffered - nOffset );
+			m_bFailed =
+				!::WriteFile
+				(
+					m_hFile, &m_arrBuffer[ nOffset ], dwChunk, &dwWritten, NULL
+				) || dwWritten != dwChunk;
+			nOffset += dwWritten;
+		}
+		m_nBuffered = 0;
+		return !m_bFailed;
+	}
+
+	// add bytes to the archive through the buffer, large pieces are
+	// written straight from the caller's memory
+	bool Write( const BYTE* pData, ULONGLONG ullSize )
+	{
+		m_ullSize += ullSize;
+		m_ullTotal += ullSize;
+		if ( m_nBuffered + ullSize <= BUFFER )
+		{
+			memcpy( &m_arrBuffer[ m_nBuffered ], pData, size_t( ullSize ) );
+			m_nBuffered += size_t( ullSize );
+			return m_nBuffered < BUFFER || Flush();
+		}
+
+		if ( !Flush() )
+		{
+			return false;
+		}
+
+		ULONGLONG ullOffset = 0;
+		while ( !m_bFailed && ullOffset < ullSize )
+		{
+			const DWORD dwChunk = DWORD( min( ullSize - ullOffset, 16ull << 20 ) );
+			DWORD dwWritten = 0;
+			m_bFailed =
+				!::WriteFile
+				(
+					m_hFile, pData + ullOffset, dwChunk, &dwWritten, NULL
+				) || dwWritten != dwChunk;
+			ullOffset += dwWritten;
+		}
+		return !m_bFailed;
+	}
+
+	// add zeros to the archive
+	bool WriteZeros( ULONGLONG ullSize )
+	{
+		static const BYTE arrZeros[ BLOCK * 2 ] = { 0 };
+		while ( ullSize > 0 )
+		{
+			const ULONGLONG ullChunk = min( ullSize, ULONGLONG( sizeof( arrZeros ) ) );
+			if ( !Write( arrZeros, ullChunk ) )
+			{
+				return false;
+			}
+			ullSize -= ullChunk;
+		}
+		return true;
+	}
+
+	// start the next archive
+	bool StartArchive()
+	{
+		m_csCurrent = GetArchivePath( m_uiArchives + 1 );
+		m_hFile = ::CreateFile
+		(
+			m_csCurrent + _T( ".partial" ), GENERIC_WRITE, 0, NULL,
+			CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+			NULL
+		);
+		if ( m_hFile == INVALID_HANDLE_VALUE )
+		{
+			return false;
+		}
+
+		m_uiArchives++;
+		m_ullSize = 0;
+		m_nBuffered = 0;
+		m_bFailed = false;
+		return true;
+	}
+
+	// end the archive being written with two empty blocks, flush it to
+	// the disk and give it its final name
+	bool FinishArchive()
+	{
+		if ( m_hFile == INVALID_HANDLE_VALUE )
+		{
+			return true;
+		}
+
+		WriteZeros( BLOCK * 2 );
+		Flush();
+		if ( !m_bFailed && !::FlushFileBuffers( m_hFile ) )
+		{
+			m_bFailed = true;
+		}
+		::CloseHandle( m_hFile );
+		m_hFile = INVALID_HANDLE_VALUE;
+
+		const CString csTemp = m_csCurrent + _T( ".partial" );
+		bool value = !m_bFailed;
+		if ( value )
+		{
+			value = FALSE != ::MoveFileEx
+			(
+				csTemp, m_csCurrent, 
+				MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH
+			);
+		}
+		if ( !value )
+		{
+			::DeleteFile( csTemp );
+		}
+		return value;
+	}
+
+// public methods
+public:
+	// get ready to write archives to the given pathname, rolling over to
+	// a new archive before one grows past the given size (zero is no
+	// limit), the first archive is created with the first entry
+	void Open( const CString& csPath, ULONGLONG ullMaxSize )
+	{
+		m_csPath = csPath;
+		m_ullMaxSize = ullMaxSize;
+		m_uiArchives = 0;
+		m_ullEntries = 0;
+		m_ullTotal = 0;
+		m_arrBuffer.resize( BUFFER );
+	}
+
+	// add a file to the archive under the given name, which uses forward
+	// slashes between its folders
+	// returns false if the archive could not be written
+	bool Add( const CString& csName, const BYTE* pData, ULONGLONG ullSize )
+	{
+		// names are kept in UTF-8, and those that do not fit the header
+		// as plain ASCII are given in a pax header before the entry
+		const CStringA csUtf8 = CW2A( CT2W( csName ), CP_UTF8 );
+		bool bAscii = csUtf8.GetLength() < 100;
+		for ( int nChar = 0; bAscii && nChar < csUtf8.GetLength(); nChar++ )
+		{
+			bAscii = BYTE( csUtf8[ nChar ] ) < 0x80;
+		}
+
+		CStringA csRecord;
+		CStringA csHeaderName = csUtf8;
+		if ( !bAscii )
+		{
+			// the length at the front of the record counts itself
+			const int nText = csUtf8.GetLength() + 7;
+			int nLength = nText;
+			CStringA csDigits;
+			do
+			{
+				csDigits.Format( "%d", nLength );
+				if ( nText + csDigits.GetLength() == nLength )
+				{
+					break;
+				}
+				nLength = nText + csDigits.GetLength();
+
+			} while ( true );
+			csRecord.Format( "%d path=%s\n", nLength, (LPCSTR)csUtf8 );
+
+			// the entry's own header gets the end of the name made safe
+			csHeaderName = csUtf8.Right( 99 );
+			for ( int nChar = 0; nChar < csHeaderName.GetLength(); nChar++ )
+			{
+				if ( BYTE( csHeaderName[ nChar ] ) >= 0x80 )
+				{
+					csHeaderName.SetAt( nChar, '_' );
+				}
+			}
+		}
+
+		const ULONGLONG ullEntry =
+			BLOCK + Padded( ullSize ) +
+			( csRecord.IsEmpty() ? 0 : BLOCK + Padded( csRecord.GetLength() ) );
+
+		// roll over to a new archive before this one grows past the limit,
+		// unless the entry is all the archive would hold
+		if
+		(
+			m_hFile != INVALID_HANDLE_VALUE && m_ullMaxSize > 0 &&
+			m_ullSize > 0 && m_ullSize + ullEntry + BLOCK * 2 > m_ullMaxSize
+		)
+		{
+			if ( !FinishArchive() )
+			{
+				return false;
+			}
+		}
+		if ( m_hFile == INVALID_HANDLE_VALUE && !StartArchive() )
+		{
+			return false;
+		}
+
+		BYTE arrHeader[ BLOCK ];
+		if ( !csRecord.IsEmpty() )
+		{
+			SetHeader( arrHeader, "././@PaxHeader", csRecord.GetLength(), 'x' );
+			Write( arrHeader, BLOCK );
+			Write( (const BYTE*)(LPCSTR)csRecord, csRecord.GetLength() );
+			WriteZeros( Padded( csRecord.GetLength() ) - csRecord.GetLength() );
+		}
+
+		SetHeader( arrHeader, csHeaderName, ullSize, '0' );
+		Write( arrHeader, BLOCK );
+		Write( pData, ullSize );
+		WriteZeros( Padded( ullSize ) - ullSize );
+		if ( m_bFailed )
+		{
+			return false;
+		}
+
+		m_ullEntries++;
+		return true;
+	}
+
+	// finish the archive being written
+	// returns false if it could not be written
+	bool Close()
+	{
+		const bool value = FinishArchive();
+		m_csPath.Empty();
+		m_arrBuffer.clear();
+		m_arrBuffer.shrink_to_fit();
+		return value;
+	}
+
+// public construction / destruction
+public:
+	// constructor
+	CTarArchive()
+	{
+		m_ullMaxSize = 0;
+		m_hFile = INVALID_HANDLE_VALUE;
+		m_ullSize = 0;
+		m_uiArchives = 0;
+		m_ullEntries = 0;
+		m_ullTotal = 0;
+		m_nBuffered = 0;
+		m_bFailed = false;
+	}
+	// destructor
+	virtual ~CTarArchive()
+	{
+		FinishArchive();
+	}
+};
@@ -14,13 +14,79 @@
 // The one and only application object
 CWinApp theApp;
 
+/////////////////////////////////////////////////////////////////////////////
+// the EXIF orientation of the image, which is 1 (displayed as stored) if 
+// the image does not have one
+UINT GetOrientation( Gdiplus::Image& image )
+{
+	UINT value = 1;
+	const UINT uiSize = image.GetPropertyItemSize( PropertyTagOrientation );
+	if ( uiSize == 0 )
+	{
+		return value;
+	}
+
+	vector<BYTE> arrItem( uiSize );
+	PropertyItem* pItem = (PropertyItem*)&arrItem[ 0 ];
+	if 
+	( 
+		Ok == image.GetPropertyItem( PropertyTagOrientation, uiSize, pItem ) &&
+		pItem->type == PropertyTagTypeShort && pItem->length >= sizeof( USHORT )
+	)
+	{
+		value = *(const USHORT*)pItem->value;
+	}
+	if ( value < 1 || value > 8 )
+	{
+		value = 1;
+	}
+	return value;
+} // GetOrientation
+
+/////////////////////////////////////////////////////////////////////////////
+// the pathname of the corrected image in the given sub-folder below the 
+// image ("Corrected" by default), creating the folder if it does not 
+// exist yet
+// returns an empty string if the folder cannot be created
+CString GetCorrectedPath
+( 
+	LPCTSTR lpszPathName, const CString& csCorrected = GetCorrectedFolder() 
+)
+{
+	// split the pathname once and only copy the pieces that are kept
+	const CHelper::PATH_PARTS parts = CHelper::SplitPath( lpszPathName );
+	const CString csFolder = 
+		CString( lpszPathName, parts.m_Drive.Length + parts.m_Directory.Length ) +
+		csCorrected;
+
+	// the writer remembers the folders it has created, so the file system
+	// is only asked once per folder
+	if ( !m_OutputWriter.CreateFolder( csFolder ) )
+	{
+		return _T( "" );
+	}
+
+	// filename plus extension, which follow each other in the pathname
+	const CString csData
+	( 
+		parts.m_FileName.Text, 
+		parts.m_FileName.Length + parts.m_Extension.Length 
+	);
+
+	// create a new path from the pieces
+	const CString value = csFolder + _T( "\\" ) + csData;
+	return value;
+} // GetCorrectedPath
+
 /////////////////////////////////////////////////////////////////////////////
 // Save the data inside pImage to the given filename but relocated to the 
 // sub-folder "Corrected"
-bool Save( LPCTSTR lpszPathName, Gdiplus::Bitmap* pImage )
+bool Save
+( 
+	LPCTSTR lpszPathName, Gdiplus::Bitmap* pImage, 
+	const CString& csFolder = GetCorrectedFolder() 
+)
 {
-	USES_CONVERSION;
-
 	// save and overwrite the selected image file with current page
 	int iValue =
 		Gdiplus::EncoderValue::EncoderValueVersionGif89 |
@@ -36,461 +102,2551 @@ bool Save( LPCTSTR lpszPathName, Gdiplus::Bitmap* pImage )
 
 	// writing to the same file will fail, so save to a corrected folder
 	// below the image being corrected
-	const CString csCorrected = GetCorrectedFolder();
-	const CString csFolder = CHelper::GetFolder( lpszPathName ) + csCorrected;
-	if ( !::PathFileExists( csFolder ) )
+	const CString csPath = GetCorrectedPath( lpszPathName, csFolder );
+	if ( csPath.IsEmpty() )
 	{
-		if ( !CreatePath( csFolder ) )
-		{
-			return false;
-		}
+		return false;
 	}
 
-	// filename plus extension
-	const CString csData = CHelper::GetDataName( lpszPathName );
-
-	// create a new path from the pieces
-	const CString csPath = csFolder + _T( "\\" ) + csData;
-
 	// use the extension member class to get the class ID of the file
 	CLSID clsid = m_Extension.ClassID;
 
-	// save the image to the corrected folder
-	Status status = pImage->Save( T2CW( csPath ), &clsid, &param );
-
-	// return true if the save worked
-	return status == Ok;
+	// encode the image into memory and let the writer thread put it in
+	// the corrected folder, failures to write are reported by the writer
+	return m_OutputWriter.Save( csPath, pImage, clsid, &param );
 } // Save
 
 /////////////////////////////////////////////////////////////////////////////
-// handle an aspect ratio change if requested by modifying the new image
-// dimensions
-bool HandleAspectRatio()
+// test to see if the extension is one we support (in any case)
+bool IsSupportedExtension( const CStringSlice& ext )
 {
-	bool value = false;
-
-	// calculate the new width
-	m_uiNewWidth = m_uiOriginalWidth - m_uiLeft - m_uiRight;
-
-	// calculate the new height
-	m_uiNewHeight = m_uiOriginalHeight - m_uiTop - m_uiBottom;
-
-	// did the user request a fixed aspect ratio?
-	bool bAspect = GetProcessAspect();
-
-	// factor in the requested aspect ratio if requested
-	const float fRequestedRatio = GetRequestedAspectRatio();
-
-	// aspect ratio of the original file
-	const float fOriginalRatio = GetOriginalAspectRatio();
+	// valid file extensions
+	static const LPCTSTR arrValidExt[] =
+	{
+		_T( ".jpg" ), _T( ".jpeg" ), _T( ".png" ), _T( ".gif" ), 
+		_T( ".bmp" ), _T( ".tif" ), _T( ".tiff" )
+	};
 
-	if ( bAspect )
+	// the extension is compared in place ignoring its case, so testing
+	// the files found in a tree makes no copies of their names
+	for ( LPCTSTR pcszValidExt : arrValidExt )
 	{
-		// test for valid ratio value
-		if ( CHelper::NearlyEqual( fRequestedRatio, 0.0f ) )
+		if ( ext.CompareNoCase( pcszValidExt ) == 0 )
 		{
-			bAspect = false;
-		} 
-		else if ( CHelper::NearlyEqual( fRequestedRatio, fOriginalRatio ) )
-		{
-			bAspect = false;
+			return true;
 		}
 	}
+	return false;
+} // IsSupportedExtension
 
-	if ( bAspect )
+/////////////////////////////////////////////////////////////////////////////
+// copy the trimmed rectangle of the source image into the given pixels 
+// in the given format, which lets the decoder write the result straight 
+// into memory we own instead of drawing into a bitmap that allocates its
+// own
+bool CropPixels
+( 
+	Gdiplus::Bitmap& source, Gdiplus::Rect& rectTrim, 
+	Gdiplus::PixelFormat format, BYTE* pPixels, INT nStride 
+)
+{
+	Gdiplus::BitmapData data;
+	data.Width = rectTrim.Width;
+	data.Height = rectTrim.Height;
+	data.Stride = nStride;
+	data.PixelFormat = format;
+	data.Scan0 = pPixels;
+	data.Reserved = 0;
+
+	const Status status = source.LockBits
+	(
+		&rectTrim, 
+		Gdiplus::ImageLockModeRead | Gdiplus::ImageLockModeUserInputBuf,
+		format, &data
+	);
+	if ( status != Ok )
 	{
-		value = true;
+		return false;
+	}
 
-		// update the height, top and bottom values
-		if ( fRequestedRatio > fOriginalRatio )
-		{
-			// calculate new height based on the aspect ratio
-			// r = w / h
-			// h = w / r
-			m_uiNewHeight = UINT( float( m_uiOriginalWidth ) / fRequestedRatio );
-			const UINT uiDelta = m_uiOriginalHeight - m_uiNewHeight;
-			m_uiTop = uiDelta / 2;
-			m_uiBottom = m_uiTop;
-		} 
-		else // update the width, left and right values
+	source.UnlockBits( &data );
+	return true;
+} // CropPixels
+
+/////////////////////////////////////////////////////////////////////////////
+// straighten the page and trim it in a single pass into the given pixels 
+// (32 bits per pixel), where the skew is measured inside the trim margins
+// returns false if the memory for the page is not available or the image
+// could not be read
+bool DeskewPixels
+( 
+	Gdiplus::Bitmap& source, BYTE* pPixels, INT nStride, double& dAngle 
+)
+{
+	dAngle = 0.0;
+
+	// the whole page is needed since the corners of the trimmed part 
+	// rotate in from outside of it
+	const INT nPageStride = GetStride( m_uiOriginalWidth );
+	CPixelBuffer page
+	( 
+		m_PixelPool, size_t( nPageStride ) * m_uiOriginalHeight 
+	);
+	Gdiplus::Rect rectPage( 0, 0, m_uiOriginalWidth, m_uiOriginalHeight );
+	if 
+	( 
+		page.Data == nullptr ||
+		!CropPixels
+		( 
+			source, rectPage, PixelFormat32bppARGB, page.Data, nPageStride 
+		)
+	)
+	{
+		return false;
+	}
+
+	dAngle = m_Deskew.Estimate
+	( 
+		page.Data, nPageStride, m_uiLeft, m_uiTop, m_uiNewWidth, m_uiNewHeight 
+	);
+
+	// a page that is straight enough is only trimmed
+	if ( fabs( dAngle ) < m_Deskew.MinAngle )
+	{
+		for ( UINT uiRow = 0; uiRow < m_uiNewHeight; uiRow++ )
 		{
-			// calculate new width based on the aspect ratio
-			// r = w / h
-			// w = r * h
-			m_uiNewWidth = UINT( float( m_uiOriginalHeight ) * fRequestedRatio );
-			const UINT uiDelta = m_uiOriginalWidth - m_uiNewWidth;
-			m_uiLeft = uiDelta / 2;
-			m_uiRight = m_uiLeft;
+			memcpy
+			( 
+				pPixels + ptrdiff_t( uiRow ) * nStride,
+				page.Data + ptrdiff_t( m_uiTop + uiRow ) * nPageStride + 
+					ptrdiff_t( m_uiLeft ) * 4,
+				size_t( m_uiNewWidth ) * 4
+			);
 		}
+		return true;
 	}
 
+	CDeskew::Rotate
+	(
+		page.Data, m_uiOriginalWidth, m_uiOriginalHeight, nPageStride,
+		m_uiLeft, m_uiTop, m_uiNewWidth, m_uiNewHeight, dAngle, 
+		pPixels, nStride
+	);
+	return true;
+} // DeskewPixels
+
+/////////////////////////////////////////////////////////////////////////////
+// does the pixel format have 16 bits per channel
+bool IsDeepPixelFormat( Gdiplus::PixelFormat format )
+{
+	const bool value = 
+		format == PixelFormat48bppRGB || 
+		format == PixelFormat64bppARGB || 
+		format == PixelFormat64bppPARGB;
 	return value;
-} // HandleAspectRatio
+} // IsDeepPixelFormat
 
 /////////////////////////////////////////////////////////////////////////////
-// modify the image to reflect the user command line parameter
-bool ProcessImage( CString& csPath, CStdioFile& fout )
+// trim an image with 16 bits per channel and normalize its levels before
+// it is reduced to the 8 bits per channel of the given pixels, so the
+// stretch does not leave gaps in the levels of the result
+// returns false if the memory is not available or the image could not be
+// read
+bool LevelDeepPixels
+( 
+	Gdiplus::Bitmap& source, Gdiplus::Rect& rectTrim, BYTE* pPixels, 
+	INT nStride 
+)
 {
-	bool value = false;
+	const INT nDeepStride = GetStride( rectTrim.Width, 64 );
+	CPixelBuffer deep( m_PixelPool, size_t( nDeepStride ) * rectTrim.Height );
+	if 
+	( 
+		deep.Data == nullptr ||
+		!CropPixels
+		( 
+			source, rectTrim, PixelFormat64bppARGB, deep.Data, nDeepStride 
+		)
+	)
+	{
+		return false;
+	}
 
-	// preserve the original values from the command line parameters
-	const UINT uiTop = m_uiTop;
-	const UINT uiBottom = m_uiBottom;
-	const UINT uiLeft = m_uiLeft;
-	const UINT uiRight = m_uiRight;
+	// GDI+ keeps 16 bit channels in linear light from 0 to 8192
+	m_Levels.Apply<USHORT>
+	( 
+		(const USHORT*)deep.Data, nDeepStride, pPixels, nStride, 
+		rectTrim.Width, rectTrim.Height, 8192, true 
+	);
+	return true;
+} // LevelDeepPixels
 
-	// valid file extensions
-	const CString csValidExt = _T( ".jpg;.jpeg;.png;.gif;.bmp;.tif;.tiff" );
+/////////////////////////////////////////////////////////////////////////////
+// copy the metadata of the source image to the target, fetching every 
+// property in a single block instead of allocating and copying them one 
+// at a time
+void CopyProperties( Gdiplus::Image& source, Gdiplus::Image& target )
+{
+	UINT uiPropertySize = 0;
+	UINT uiPropertyCount = 0;
+	source.GetPropertySize( &uiPropertySize, &uiPropertyCount );
+	if ( uiPropertyCount == 0 )
+	{
+		return;
+	}
 
-	// the file extension of the current file
-	const CString csExt = CHelper::GetExtension( csPath ).MakeLower();
+	PropertyItem* pItems = (PropertyItem*)malloc( uiPropertySize );
+	if 
+	( 
+		pItems != nullptr &&
+		Ok == source.GetAllPropertyItems
+		( 
+			uiPropertySize, uiPropertyCount, pItems 
+		)
+	)
+	{
+		// loop through the metadata properties of the original 
+		// image and copy them to the new image
+		for ( UINT i = 0; i < uiPropertyCount; ++i )
+		{
+			target.SetPropertyItem( &pItems[ i ] );
+		}
+	}
 
-	// the name of the current file without the extension
-	const CString csFile = CHelper::GetFileName( csPath );
+	// clean up
+	free( pItems );
+} // CopyProperties
 
-	// test to see if the extension is one we support
-	if ( -1 != csValidExt.Find( csExt ) )
+/////////////////////////////////////////////////////////////////////////////
+// apply the operations of the chain to the trimmed pixels and save the
+// result, which is upright so its orientation tag is reset
+bool SaveChained
+( 
+	LPCTSTR lpszPathName, Gdiplus::Image& OriginalImage, 
+	Gdiplus::Bitmap& trimmedBitmap, BYTE* pPixels, INT nStride 
+)
+{
+	CImageChain::OUTPUT output;
+	if 
+	( 
+		!m_Chain.Apply
+		( 
+			pPixels, m_uiNewWidth, m_uiNewHeight, nStride, m_uiOrientation,
+			m_fHorizontalResolution, m_fVerticalResolution, m_PixelPool, 
+			m_Grid, output 
+		) 
+	)
 	{
-		// set the extension property
-		m_Extension.FileExtension = csExt;
+		return false;
+	}
 
-		// let the user know the file being processed
-		fout.WriteString( csPath + _T( "\n" ) );
+	// the chain either changed the trimmed pixels where they are or 
+	// produced new ones
+	deque<Gdiplus::Bitmap> arrChained;
+	Gdiplus::Bitmap* pBitmap = &trimmedBitmap;
+	if ( output.m_pPixels != nullptr )
+	{
+		arrChained.emplace_back
+		( 
+			output.m_uiWidth, output.m_uiHeight, output.m_nStride, 
+			PixelFormat32bppARGB, output.m_pPixels->Data 
+		);
+		pBitmap = &arrChained.front();
+		CopyProperties( OriginalImage, *pBitmap );
+		pBitmap->SetResolution
+		( 
+			output.m_fHorizontalResolution, output.m_fVerticalResolution 
+		);
+	}
 
-		// image representing this file
-		Gdiplus::Image OriginalImage( T2CW( csPath ) );
+	if ( m_uiOrientation != 1 )
+	{
+		USHORT usOrientation = 1;
+		PropertyItem item;
+		item.id = PropertyTagOrientation;
+		item.type = PropertyTagTypeShort;
+		item.length = sizeof( usOrientation );
+		item.value = &usOrientation;
+		pBitmap->SetPropertyItem( &item );
+	}
 
-		// get the width of the image
-		m_uiOriginalWidth = OriginalImage.GetWidth();
+	return Save( lpszPathName, pBitmap );
+} // SaveChained
 
-		// get the height of the image
-		m_uiOriginalHeight = OriginalImage.GetHeight();
+/////////////////////////////////////////////////////////////////////////////
+// trim a page or frame of a multi-frame image by the given margins, which
+// are the same for every page. Indexed pixels (bi-level document scans 
+// and GIF palettes) stay indexed so they are not inflated to 32 bits per
+// pixel, unless the decoder cannot crop them as they are
+bool TrimFrame
+( 
+	Gdiplus::Bitmap& source, const CRect& rectMargins, TRIMMED_FRAME& frame 
+)
+{
+	const UINT uiWidth = source.GetWidth();
+	const UINT uiHeight = source.GetHeight();
+	if 
+	( 
+		uiWidth <= UINT( rectMargins.left + rectMargins.right ) ||
+		uiHeight <= UINT( rectMargins.top + rectMargins.bottom )
+	)
+	{
+		return false;
+	}
 
-		// remember the resolution (DPI) of the original image so the
-		// generated image can be set to the same resolution
-		m_fHorizontalResolution = OriginalImage.GetHorizontalResolution();
-		m_fVerticalResolution = OriginalImage.GetVerticalResolution();
+	frame.m_uiWidth = uiWidth - rectMargins.left - rectMargins.right;
+	frame.m_uiHeight = uiHeight - rectMargins.top - rectMargins.bottom;
+	frame.m_fHorizontalResolution = source.GetHorizontalResolution();
+	frame.m_fVerticalResolution = source.GetVerticalResolution();
 
-		// get the new width based on trimming parameters
-		m_uiNewWidth = m_uiOriginalWidth - m_uiLeft - m_uiRight;
+	Gdiplus::Rect rectTrim
+	( 
+		rectMargins.left, rectMargins.top, frame.m_uiWidth, frame.m_uiHeight 
+	);
 
-		// get the new width based on trimming parameters
-		m_uiNewHeight = m_uiOriginalHeight - m_uiLeft - m_uiRight;
+	const Gdiplus::PixelFormat format = source.GetPixelFormat();
+	const INT nPalette = source.GetPaletteSize();
+	if ( IsIndexedPixelFormat( format ) && nPalette > 0 )
+	{
+		frame.m_arrPalette.resize( nPalette );
+		ColorPalette* pPalette = (ColorPalette*)&frame.m_arrPalette[ 0 ];
+
+		frame.m_format = format;
+		frame.m_nStride = 
+			GetStride( frame.m_uiWidth, GetPixelFormatSize( format ) );
+		frame.m_pPixels.reset
+		( 
+			new CPixelBuffer
+			( 
+				m_PixelPool, size_t( frame.m_nStride ) * frame.m_uiHeight 
+			)
+		);
 
-		// if the user specified an aspect ratio, other parameters
-		// like top and bottom or left and right can be modified
-		const bool bAspect = HandleAspectRatio();
+		if 
+		( 
+			Ok == source.GetPalette( pPalette, nPalette ) &&
+			frame.m_pPixels->Data != nullptr &&
+			CropPixels
+			( 
+				source, rectTrim, format, frame.m_pPixels->Data, 
+				frame.m_nStride 
+			)
+		)
+		{
+			return true;
+		}
+	}
 
-		// let the user know what is going on
-		CString csOutput;
-		csOutput.Format
-		(
-			_T( "Org Dimensions: %d, %d\n" ),
-			m_uiOriginalHeight, m_uiOriginalWidth
-		);
-		fout.WriteString( csOutput );
+	frame.m_arrPalette.clear();
+	frame.m_format = PixelFormat32bppARGB;
+	frame.m_nStride = GetStride( frame.m_uiWidth );
+	frame.m_pPixels.reset
+	( 
+		new CPixelBuffer
+		( 
+			m_PixelPool, size_t( frame.m_nStride ) * frame.m_uiHeight 
+		)
+	);
 
-		csOutput.Format
-		(
-			_T( "New Dimensions: %d, %d\n" ),
-			m_uiNewHeight, m_uiNewWidth
+	const bool value =
+		frame.m_pPixels->Data != nullptr &&
+		CropPixels
+		( 
+			source, rectTrim, frame.m_format, frame.m_pPixels->Data, 
+			frame.m_nStride 
 		);
-		fout.WriteString( csOutput );
+	return value;
+} // TrimFrame
 
-		// Create a new bitmap with the trimmed dimensions
-		Gdiplus::Bitmap trimmedBitmap( m_uiNewWidth, m_uiNewHeight );
+/////////////////////////////////////////////////////////////////////////////
+// give a bitmap built on the pixels of a trimmed frame the palette and
+// resolution of the frame it came from
+void ApplyFrame( Gdiplus::Bitmap& bitmap, TRIMMED_FRAME& frame )
+{
+	if ( !frame.m_arrPalette.empty() )
+	{
+		bitmap.SetPalette( (ColorPalette*)&frame.m_arrPalette[ 0 ] );
+	}
+	bitmap.SetResolution
+	( 
+		frame.m_fHorizontalResolution, frame.m_fVerticalResolution 
+	);
+} // ApplyFrame
 
-		// create a graphics object to draw the new bitmap
-		Gdiplus::Graphics graphics( &trimmedBitmap );
+/////////////////////////////////////////////////////////////////////////////
+// the number of pages (TIFF) or frames (GIF) in the image and the frame
+// dimension to select them by
+UINT GetFrameCount( Gdiplus::Image& image, GUID& dimension )
+{
+	dimension = FrameDimensionPage;
+	if ( image.GetFrameDimensionsCount() == 0 )
+	{
+		return 1;
+	}
 
-		// draw the original image into the new image
-		graphics.DrawImage
-		(
-			&OriginalImage, Gdiplus::Rect( 0, 0, m_uiNewWidth, m_uiNewHeight ),
-			m_uiLeft, m_uiTop, m_uiNewWidth, m_uiNewHeight, Gdiplus::UnitPixel
-		);
+	image.GetFrameDimensionsList( &dimension, 1 );
+	const UINT value = image.GetFrameCount( &dimension );
+	return max( value, 1u );
+} // GetFrameCount
 
-		// Preserve all metadata
-		const UINT uiPropertyCount = OriginalImage.GetPropertyCount();
-		PROPID* propIDs = new PROPID[ uiPropertyCount ];
-		OriginalImage.GetPropertyIdList( uiPropertyCount, propIDs );
+/////////////////////////////////////////////////////////////////////////////
+// trim every page of a multi-page TIFF and encode them into one document.
+// A window of pages is decoded and trimmed in parallel, each thread with a
+// decoder of its own over the same memory since a decoder can only have 
+// one page selected, and the encoder then appends the window in order, so
+// only a window of pages is in memory however long the document is
+bool TrimDocument
+( 
+	Gdiplus::Bitmap& OriginalImage, const BYTE* pData, ULONGLONG ullSize,
+	UINT uiFrames, const CRect& rectMargins, IStream* pOutput 
+)
+{
+	CLSID clsid = m_Extension.ClassID;
+	const UINT uiWindow = 
+		min( uiFrames, max( thread::hardware_concurrency(), 1u ) );
 
-		// loop through the metadata properties of the original image and 
-		// copy them to the new image
-		for ( UINT i = 0; i < uiPropertyCount; ++i )
+	// without the file in memory there is only the one decoder
+	const UINT uiThreads = pData != nullptr ? uiWindow : 1;
+	vector<unique_ptr<Gdiplus::Bitmap>> arrDecoders( uiThreads );
+	auto GetDecoder = [ & ]( UINT uiThread ) -> Gdiplus::Bitmap*
+	{
+		if ( pData == nullptr )
 		{
-			UINT size = OriginalImage.GetPropertyItemSize( propIDs[ i ] );
-			PropertyItem* pItem = (PropertyItem*)malloc( size );
-			OriginalImage.GetPropertyItem( propIDs[ i ], size, pItem );
-			trimmedBitmap.SetPropertyItem( pItem );
-			free( pItem );
+			return &OriginalImage;
 		}
+		if ( arrDecoders[ uiThread ] == nullptr )
+		{
+			CComPtr<IStream> pStream;
+			pStream.Attach( CMemoryStream::Create( pData, ullSize ) );
+			arrDecoders[ uiThread ].reset
+			( 
+				Gdiplus::Bitmap::FromStream( pStream ) 
+			);
+		}
+		return arrDecoders[ uiThread ].get();
+	};
+
+	// the save flag and the compression of each page, bi-level pages 
+	// keep the fax compression of document scans
+	ULONG ulFlag = 0;
+	ULONG ulCompression = 0;
+	struct
+	{
+		Gdiplus::EncoderParameters m_params;
+		Gdiplus::EncoderParameter m_compression;
+
+	} params;
+	params.m_params.Count = 2;
+	params.m_params.Parameter[ 0 ].Guid = Gdiplus::EncoderSaveFlag;
+	params.m_params.Parameter[ 0 ].Type = EncoderParameterValueTypeLong;
+	params.m_params.Parameter[ 0 ].NumberOfValues = 1;
+	params.m_params.Parameter[ 0 ].Value = &ulFlag;
+	params.m_compression.Guid = Gdiplus::EncoderCompression;
+	params.m_compression.Type = EncoderParameterValueTypeLong;
+	params.m_compression.NumberOfValues = 1;
+	params.m_compression.Value = &ulCompression;
+
+	// the first page stays alive until the document is flushed since the
+	// encoder belongs to it
+	TRIMMED_FRAME first;
+	deque<Gdiplus::Bitmap> arrFirst;
+
+	vector<TRIMMED_FRAME> arrWindow( uiWindow );
+	for ( UINT uiStart = 0; uiStart < uiFrames; uiStart += uiWindow )
+	{
+		const UINT uiCount = min( uiWindow, uiFrames - uiStart );
+		vector<char> arrOkay( uiCount, 0 );
 
-		// clean up
-		delete[] propIDs;
+		auto Trim = [ & ]( UINT uiThread )
+		{
+			Gdiplus::Bitmap* pDecoder = GetDecoder( uiThread );
+			for 
+			( 
+				UINT uiFrame = uiThread; uiFrame < uiCount; 
+				uiFrame += uiThreads 
+			)
+			{
+				arrOkay[ uiFrame ] =
+					pDecoder != nullptr &&
+					Ok == pDecoder->SelectActiveFrame
+					( 
+						&FrameDimensionPage, uiStart + uiFrame 
+					) &&
+					TrimFrame( *pDecoder, rectMargins, arrWindow[ uiFrame ] );
+			}
+		};
 
-		// the following code is triggered if all of the parameters
-		// amount to no change and is used to draw a grid on the 
-		// output image for scanner testing purposes
-		const bool bDrawGrid = 
-			bAspect == false && 
-			m_uiTop == 0 && m_uiBottom == 0 && 
-			m_uiLeft == 0 && m_uiRight == 0;
+		vector<thread> arrThreads;
+		for ( UINT uiThread = 1; uiThread < min( uiThreads, uiCount ); uiThread++ )
+		{
+			arrThreads.push_back( thread( Trim, uiThread ) );
+		}
+		Trim( 0 );
+		for ( thread& worker : arrThreads )
+		{
+			worker.join();
+		}
 
-		// draw a grid with an origin at the upper left using 50 pixel spacing
-		if ( bDrawGrid )
+		// the encoder takes the pages in order
+		for ( UINT uiFrame = 0; uiFrame < uiCount; uiFrame++ )
 		{
-			// Draw the grid
-			Pen pen( Color( 255, 255, 255, 255 ) ); // white color pen
-			int centerX = m_uiOriginalWidth / 2;
-			int centerY = m_uiOriginalHeight / 2;
+			if ( !arrOkay[ uiFrame ] )
+			{
+				return false;
+			}
 
-			// Draw vertical lines
-			for ( int x = 0; x < (int)m_uiOriginalWidth; x += 50 )
+			TRIMMED_FRAME& frame = arrWindow[ uiFrame ];
+			ulCompression = frame.m_format == PixelFormat1bppIndexed ?
+				EncoderValueCompressionCCITT4 : EncoderValueCompressionLZW;
+
+			Status status = Ok;
+			if ( arrFirst.empty() )
+			{
+				first = move( frame );
+				arrFirst.emplace_back
+				(
+					first.m_uiWidth, first.m_uiHeight, first.m_nStride,
+					first.m_format, first.m_pPixels->Data
+				);
+				ApplyFrame( arrFirst.front(), first );
+
+				// the metadata belongs to the first page
+				OriginalImage.SelectActiveFrame( &FrameDimensionPage, 0 );
+				CopyProperties( OriginalImage, arrFirst.front() );
+
+				ulFlag = EncoderValueMultiFrame;
+				status = arrFirst.front().Save( pOutput, &clsid, &params.m_params );
+
+			} else
 			{
-				graphics.DrawLine( &pen, x, 0, x, (int)m_uiOriginalHeight );
+				Gdiplus::Bitmap page
+				(
+					frame.m_uiWidth, frame.m_uiHeight, frame.m_nStride,
+					frame.m_format, frame.m_pPixels->Data
+				);
+				ApplyFrame( page, frame );
+
+				ulFlag = EncoderValueFrameDimensionPage;
+				status = arrFirst.front().SaveAdd( &page, &params.m_params );
+
+				// the page has been encoded, so its memory can be used for
+				// the next window
+				frame.m_pPixels.reset();
 			}
 
-			// Draw horizontal lines
-			for ( int y = 0; y < (int)m_uiOriginalHeight; y += 50 )
+			if ( status != Ok )
 			{
-				graphics.DrawLine( &pen, 0, y, (int)m_uiOriginalWidth, y );
+				return false;
 			}
 		}
-
-		// save the image to the new path
-		value = Save( csPath, &trimmedBitmap );
 	}
 
-	// restore the original values of the command line parameters
-	m_uiTop = uiTop;
-	m_uiBottom = uiBottom;
-	m_uiLeft = uiLeft;
-	m_uiRight = uiRight;
-
-	return value;
-} // ProcessImage
+	ulFlag = EncoderValueFlush;
+	params.m_params.Count = 1;
+	return Ok == arrFirst.front().SaveAdd( &params.m_params );
+} // TrimDocument
 
 /////////////////////////////////////////////////////////////////////////////
-// crawl through the directory tree looking for supported image extensions
-void RecursePath( LPCTSTR path, CStdioFile& fout )
+// trim every frame of an animated GIF and write them back as an animation 
+// with the original delays and loop count. The frames depend on each 
+// other so they are decoded in order, but a window of them is encoded in
+// parallel, each frame on its own, and the muxer joins them
+bool TrimAnimation
+( 
+	Gdiplus::Bitmap& OriginalImage, UINT uiFrames, const CRect& rectMargins, 
+	IStream* pOutput 
+)
 {
-	USES_CONVERSION;
-
-	// the new folder under the image folder to contain the corrected images
-	const CString csCorrected = GetCorrectedFolder();
-	const int nCorrected = GetCorrectedFolderLength();
-
-	// get the folder which will trim any wild card data
-	CString csPathname = CHelper::GetFolder( path );
-
-	// wild cards are in use if the pathname does not equal the given path
-	const bool bWildCards = csPathname != path;
-	csPathname.TrimRight( _T( "\\" ) );
-	CString csData;
-
-	// build a string with wild-cards
-	CString strWildcard;
-	if ( bWildCards )
-	{
-		csData = CHelper::GetDataName( path );
-		strWildcard.Format( _T( "%s\\%s" ), csPathname, csData );
+	CLSID clsid = m_Extension.ClassID;
+	const UINT uiWindow = 
+		min( uiFrames, max( thread::hardware_concurrency(), 1u ) );
 
-	} else // no wild cards, just a folder
+	// the delay of each frame in hundredths of a second
+	vector<BYTE> arrDelays;
+	const UINT uiDelays = OriginalImage.GetPropertyItemSize( PropertyTagFrameDelay );
+	if ( uiDelays > 0 )
 	{
-		strWildcard.Format( _T( "%s\\*.*" ), csPathname );
+		arrDelays.resize( uiDelays );
+		OriginalImage.GetPropertyItem
+		( 
+			PropertyTagFrameDelay, uiDelays, (PropertyItem*)&arrDelays[ 0 ] 
+		);
 	}
-
-	// start trolling for files we are interested in
-	CFileFind finder;
-	BOOL bWorking = finder.FindFile( strWildcard );
-	while ( bWorking )
+	auto GetDelay = [ & ]( UINT uiFrame ) -> UINT
 	{
-		bWorking = finder.FindNextFile();
+		if ( arrDelays.empty() )
+		{
+			return 10;
+		}
+		const PropertyItem* pItem = (const PropertyItem*)&arrDelays[ 0 ];
+		if ( ( uiFrame + 1 ) * sizeof( LONG ) > pItem->length )
+		{
+			return 10;
+		}
+		return UINT( ( (const LONG*)pItem->value )[ uiFrame ] );
+	};
 
-		// skip "." and ".." folder names
-		if ( finder.IsDots() )
+	// the number of times the animation repeats (zero is forever)
+	UINT uiLoops = 0;
+	const UINT uiLoopSize = OriginalImage.GetPropertyItemSize( PropertyTagLoopCount );
+	if ( uiLoopSize > 0 )
+	{
+		vector<BYTE> arrLoop( uiLoopSize );
+		PropertyItem* pItem = (PropertyItem*)&arrLoop[ 0 ];
+		if ( Ok == OriginalImage.GetPropertyItem( PropertyTagLoopCount, uiLoopSize, pItem ) )
 		{
-			continue;
+			uiLoops = *(const USHORT*)pItem->value;
 		}
+	}
 
-		// if it's a directory, recursively search it
-		if ( finder.IsDirectory() )
+	CGifMuxer muxer;
+	muxer.Begin( pOutput, m_uiNewWidth, m_uiNewHeight, uiLoops );
+
+	vector<TRIMMED_FRAME> arrWindow( uiWindow );
+	for ( UINT uiStart = 0; uiStart < uiFrames; uiStart += uiWindow )
+	{
+		const UINT uiCount = min( uiWindow, uiFrames - uiStart );
+		for ( UINT uiFrame = 0; uiFrame < uiCount; uiFrame++ )
 		{
-			// do not recurse into the corrected folder
-			const CString str = 
-				finder.GetFilePath().TrimRight( _T( "\\" ) );
-			if ( str.Right( nCorrected ) == csCorrected )
+			if 
+			( 
+				Ok != OriginalImage.SelectActiveFrame
+				( 
+					&FrameDimensionTime, uiStart + uiFrame 
+				) ||
+				!TrimFrame( OriginalImage, rectMargins, arrWindow[ uiFrame ] )
+			)
 			{
-				continue;
+				return false;
 			}
+		}
 
-			// if wild cards are in use, build a path with the wild cards
-			if ( bWildCards )
+		auto Encode = [ & ]( UINT uiFrame )
+		{
+			TRIMMED_FRAME& frame = arrWindow[ uiFrame ];
+			Gdiplus::Bitmap bitmap
+			(
+				frame.m_uiWidth, frame.m_uiHeight, frame.m_nStride,
+				frame.m_format, frame.m_pPixels->Data
+			);
+			ApplyFrame( bitmap, frame );
+
+			frame.m_pEncoded.Release();
+			if 
+			( 
+				SUCCEEDED
+				( 
+					::CreateStreamOnHGlobal( NULL, TRUE, &frame.m_pEncoded ) 
+				) &&
+				Ok != bitmap.Save( frame.m_pEncoded, &clsid, NULL )
+			)
 			{
-				CString csPath;
-				csPath.Format( _T( "%s\\%s" ), str, csData );
+				frame.m_pEncoded.Release();
+			}
+		};
 
-				// recurse into the new directory with wild cards
-				RecursePath( csPath, fout );
+		vector<thread> arrThreads;
+		for ( UINT uiFrame = 1; uiFrame < uiCount; uiFrame++ )
+		{
+			arrThreads.push_back( thread( Encode, uiFrame ) );
+		}
+		Encode( 0 );
+		for ( thread& worker : arrThreads )
+		{
+			worker.join();
+		}
 
-			} else // recurse into the new directory
+		// the muxer takes the frames in order
+		for ( UINT uiFrame = 0; uiFrame < uiCount; uiFrame++ )
+		{
+			TRIMMED_FRAME& frame = arrWindow[ uiFrame ];
+			frame.m_pPixels.reset();
+
+			HGLOBAL hGlobal = NULL;
+			STATSTG stat;
+			if 
+			( 
+				frame.m_pEncoded == nullptr ||
+				FAILED( ::GetHGlobalFromStream( frame.m_pEncoded, &hGlobal ) ) ||
+				FAILED( frame.m_pEncoded->Stat( &stat, STATFLAG_NONAME ) )
+			)
 			{
-				RecursePath( str + _T( "\\" ), fout );
+				return false;
 			}
 
-		} else // write the properties if it is a valid extension
-		{
-			// the pathname of the current file
-			CString csPath = finder.GetFilePath();
-
-			// process the current file if it is a valid image
-			const bool bOkay = ProcessImage( csPath, fout );
-			if ( bOkay == false )
+			const BYTE* pEncoded = (const BYTE*)::GlobalLock( hGlobal );
+			const bool bOkay = 
+				pEncoded != nullptr &&
+				muxer.AddFrame
+				( 
+					pEncoded, size_t( stat.cbSize.QuadPart ), 
+					GetDelay( uiStart + uiFrame ) 
+				);
+			::GlobalUnlock( hGlobal );
+			frame.m_pEncoded.Release();
+
+			if ( !bOkay )
 			{
-				CString csOutput;
-				csOutput.Format( _T( "Image save failed:\n\t%s\n" ), csPath );
-				fout.WriteString( csOutput );
+				return false;
 			}
 		}
 	}
 
-	finder.Close();
+	return muxer.End();
+} // TrimAnimation
 
-} // RecursePath
+/////////////////////////////////////////////////////////////////////////////
+// trim every page of a multi-page TIFF or frame of an animated GIF by the
+// same margins and write them back to the corrected folder as one file
+bool TrimFrames
+( 
+	LPCTSTR lpszPathName, Gdiplus::Bitmap& OriginalImage, 
+	const BYTE* pData, ULONGLONG ullSize, const GUID& dimension, 
+	UINT uiFrames 
+)
+{
+	const CString csPath = GetCorrectedPath( lpszPathName );
+	if ( csPath.IsEmpty() )
+	{
+		return false;
+	}
+
+	// the pages are encoded straight into the file when the images are 
+	// written to files, so the memory does not grow with the number of 
+	// pages, but an archive or a pipe needs the whole file in memory first
+	CComPtr<IStream> pOutput;
+	const bool bFile = m_OutputWriter.OpenFile( csPath, pOutput );
+	if ( !bFile && FAILED( ::CreateStreamOnHGlobal( NULL, TRUE, &pOutput ) ) )
+	{
+		return false;
+	}
+
+	// the margins of the first page or frame apply to all of them
+	const CRect rectMargins( m_uiLeft, m_uiTop, m_uiRight, m_uiBottom );
+
+	const bool bOkay = dimension == FrameDimensionTime ?
+		TrimAnimation( OriginalImage, uiFrames, rectMargins, pOutput ) :
+		TrimDocument
+		( 
+			OriginalImage, pData, ullSize, uiFrames, rectMargins, pOutput 
+		);
+	if ( bFile )
+	{
+		return m_OutputWriter.CommitFile( csPath, pOutput, bOkay );
+	}
+	if ( !bOkay )
+	{
+		return false;
+	}
+
+	// the writer thread puts the file in the corrected folder, failures 
+	// to write are reported by the writer
+	return m_OutputWriter.SaveStream( csPath, pOutput );
+} // TrimFrames
 
 /////////////////////////////////////////////////////////////////////////////
-// set the current file extension which will automatically lookup the
-// related mime type and class ID and set their respective properties
-void CExtension::SetFileExtension( CString value )
+// modify the image to reflect the user command line parameter
+bool ProcessImage( CString& csPath, CStdioFile& fout )
 {
-	USES_CONVERSION;
+	bool value = false;
 
-	m_csFileExtension = value;
+	// the pieces of the pathname of the current file
+	const CHelper::PATH_PARTS parts = CHelper::SplitPath( csPath );
 
-	if ( m_mapExtensions.Exists[ value ] )
+	// the file extension of the current file
+	const CString csExt = parts.m_Extension.ToString().MakeLower();
+
+	// the name of the current file without the extension
+	const CString csFile = parts.m_FileName.ToString();
+
+	// content of the file if it was read ahead, which has to outlive the
+	// image decoded from it
+	vector<BYTE> arrData;
+
+	// test to see if the extension is one we support
+	if ( IsSupportedExtension( csExt ) )
 	{
-		MimeType = *m_mapExtensions.find( value );
+		// set the extension property
+		m_Extension.FileExtension = csExt;
 
-		// populate the mime type map the first time it is referenced
-		if ( m_mapMimeTypes.Count == 0 )
+		// let the user know the file being processed, the lines for each 
+		// file are written at once so the output of the worker threads 
+		// does not interleave
+		CString csLog = csPath + _T( "\n" );
+
+		// decode straight from memory if the file was read ahead, 
+		// otherwise from a read only mapping of the file, so neither 
+		// case copies the file into buffers of its own
+		CMappedFile mappedFile;
+		CComPtr<IStream> pStream;
+		const BYTE* pData = nullptr;
+		ULONGLONG ullSize = 0;
+		if ( m_Prefetcher.Take( csPath, arrData ) && !arrData.empty() )
 		{
-			UINT num = 0;
-			UINT size = 0;
+			pData = arrData.data();
+			ullSize = arrData.size();
 
-			// gets the number of available image encoders and 
-			// the total size of the array
-			Gdiplus::GetImageEncodersSize( &num, &size );
-			if ( size == 0 )
-			{
-				return;
-			}
+		} else if ( mappedFile.Open( csPath ) )
+		{
+			pData = mappedFile.Data;
+			ullSize = mappedFile.Size;
+		}
+		if ( pData != nullptr )
+		{
+			pStream.Attach( CMemoryStream::Create( pData, ullSize ) );
+		}
 
-			Gdiplus::ImageCodecInfo* pImageCodecInfo =
-				(Gdiplus::ImageCodecInfo*)malloc( size );
-			if ( pImageCodecInfo == nullptr )
-			{
-				return;
-			}
+		// image representing this file, falling back on GDI+ reading the 
+		// file if it could not be mapped
+		unique_ptr<Gdiplus::Bitmap> pOriginalImage
+		(
+			pStream != nullptr ?
+				Gdiplus::Bitmap::FromStream( pStream ) :
+				Gdiplus::Bitmap::FromFile( T2CW( csPath ) )
+		);
 
-			// Returns an array of ImageCodecInfo objects that contain 
-			// information about the image encoders built into GDI+.
-			Gdiplus::GetImageEncoders( num, size, pImageCodecInfo );
+		// a damaged or unsupported file does not decode at all, and the
+		// bitmap lets go of the memory before it is given back
+		if 
+		( 
+			pOriginalImage == nullptr || 
+			pOriginalImage->GetLastStatus() != Gdiplus::Ok 
+		)
+		{
+			pOriginalImage.reset();
+			pStream.Release();
+			fout.WriteString( csLog );
+			m_Prefetcher.Release( arrData );
+			return false;
+		}
+		Gdiplus::Bitmap& OriginalImage = *pOriginalImage;
+
+		// the margins and aspect ratio are given as the image is displayed,
+		// so a camera held upright has its stored width and height swapped
+		m_uiOrientation = GetOrientation( OriginalImage );
+
+		// remember the resolution (DPI) of the original image so the
+		// generated image can be set to the same resolution
+		m_fHorizontalResolution = OriginalImage.GetHorizontalResolution();
+		m_fVerticalResolution = OriginalImage.GetVerticalResolution();
+
+		// the crop of the stored pixels by the edges of the displayed 
+		// image (which leaves the orientation tag to rotate the result the
+		// same way the original was) only has to be worked out once for 
+		// all of the images with the same dimensions and orientation
+		const CCropPlan::CROP crop = m_CropPlan.GetCrop
+		(
+			OriginalImage.GetWidth(), OriginalImage.GetHeight(), m_uiOrientation
+		);
+		m_uiTop = crop.m_uiTop;
+		m_uiBottom = crop.m_uiBottom;
+		m_uiLeft = crop.m_uiLeft;
+		m_uiRight = crop.m_uiRight;
+		m_uiOriginalWidth = crop.m_uiOriginalWidth;
+		m_uiOriginalHeight = crop.m_uiOriginalHeight;
+		m_uiNewWidth = crop.m_uiNewWidth;
+		m_uiNewHeight = crop.m_uiNewHeight;
+		const bool bAspect = crop.m_bAspect;
+
+		// let the user know what is going on
+		CString csOutput;
+		csOutput.Format
+		(
+			_T( "Org Dimensions: %d, %d\n" ),
+			m_uiOriginalHeight, m_uiOriginalWidth
+		);
+		csLog += csOutput;
+
+		csOutput.Format
+		(
+			_T( "New Dimensions: %d, %d\n" ),
+			m_uiNewHeight, m_uiNewWidth
+		);
+		csLog += csOutput;
+
+		// the following is triggered if all of the parameters amount to 
+		// no change and is used to draw a grid on the output image and 
+		// measure the scan for scanner testing purposes
+		const bool bCalibrate = 
+			m_Grid.IsEnabled &&
+			bAspect == false && 
+			m_uiTop == 0 && m_uiBottom == 0 && 
+			m_uiLeft == 0 && m_uiRight == 0;
+		if 
+		( 
+			bCalibrate && 
+			m_fHorizontalResolution > 0.0f && m_fVerticalResolution > 0.0f 
+		)
+		{
+			const float fHeight = m_uiOriginalHeight / m_fVerticalResolution;
+			const float fWidth = m_uiOriginalWidth / m_fHorizontalResolution;
+			csOutput.Format
+			(
+				_T( "Physical Dimensions: %.3f, %.3f in (%.1f, %.1f mm) " )
+				_T( "at %.0f, %.0f dpi\n" ),
+				fHeight, fWidth, fHeight * 25.4f, fWidth * 25.4f,
+				m_fVerticalResolution, m_fHorizontalResolution
+			);
+			csLog += csOutput;
+		}
+
+		if ( m_uiOrientation != 1 )
+		{
+			csOutput.Format( _T( "Orientation: %u\n" ), m_uiOrientation );
+			csLog += csOutput;
+		}
+
+		if ( !m_Chain.IsEmpty )
+		{
+			UINT uiResizeWidth, uiResizeHeight, uiChainWidth, uiChainHeight;
+			m_Chain.GetOutputSize
+			( 
+				m_uiNewWidth, m_uiNewHeight, m_uiOrientation, 
+				uiResizeWidth, uiResizeHeight, uiChainWidth, uiChainHeight
+			);
+			csOutput.Format
+			(
+				_T( "Chain Dimensions: %d, %d\n" ),
+				uiChainHeight, uiChainWidth
+			);
+			csLog += csOutput;
+		}
+
+		// multi-page documents and animations have every page or frame
+		// trimmed and are written back as one file
+		GUID dimension;
+		const UINT uiFrames = GetFrameCount( OriginalImage, dimension );
+		if ( uiFrames > 1 )
+		{
+			csOutput.Format( _T( "Frames: %u\n" ), uiFrames );
+			csLog += csOutput;
+		}
+
+		if ( uiFrames > 1 )
+		{
+			fout.WriteString( csLog );
+			value = TrimFrames
+			( 
+				csPath, OriginalImage, pData, ullSize, dimension, uiFrames 
+			);
+
+		} else
+		{
+
+			// number of bytes in each row of the trimmed image
+			const INT nStride = GetStride( m_uiNewWidth );
+
+			// the pixels of the trimmed image come from the pool, so batches
+			// of identically sized scans keep using the same memory, which 
+			// must outlive the bitmap built on top of it
+			CPixelBuffer pixels( m_PixelPool, size_t( nStride ) * m_uiNewHeight );
+
+			// Create a new bitmap with the trimmed dimensions
+			Gdiplus::Bitmap trimmedBitmap
+			( 
+				m_uiNewWidth, m_uiNewHeight, nStride, PixelFormat32bppARGB, 
+				pixels.Data 
+			);
+
+			// have the decoder copy the trimmed rectangle of the original 
+			// image straight into the new image's pixels, or straighten the
+			// page and trim it in the same pass
+			Gdiplus::Rect rectTrim( m_uiLeft, m_uiTop, m_uiNewWidth, m_uiNewHeight );
+			// images with 16 bits per channel have their levels normalized 
+			// before they are reduced to 8 bits, which has to wait for the 
+			// blank page test since stretching the levels turns the noise 
+			// of blank paper into full contrast
+			const bool bDeepLevels = 
+				m_Levels.IsEnabled && !m_Deskew.IsEnabled &&
+				IsDeepPixelFormat( OriginalImage.GetPixelFormat() );
+			const bool bDeepLater = bDeepLevels && m_BlankPage.IsEnabled;
+			double dSkew = 0.0;
+			bool bTrimmed = false;
+			if ( pixels.Data == nullptr )
+			{
+				bTrimmed = false;
+
+			} else if ( m_Deskew.IsEnabled )
+			{
+				bTrimmed = 
+					DeskewPixels( OriginalImage, pixels.Data, nStride, dSkew );
+
+			} else if ( bDeepLevels && !bDeepLater )
+			{
+				bTrimmed = LevelDeepPixels
+				( 
+					OriginalImage, rectTrim, pixels.Data, nStride 
+				);
+
+			} else
+			{
+				bTrimmed = CropPixels
+				( 
+					OriginalImage, rectTrim, PixelFormat32bppARGB, 
+					pixels.Data, nStride 
+				);
+			}
+			if ( m_Deskew.IsEnabled )
+			{
+				csOutput.Format( _T( "Skew: %.2f degrees\n" ), dSkew );
+				csLog += csOutput;
+			}
+
+			// Preserve all metadata
+			if ( bTrimmed )
+			{
+				CopyProperties( OriginalImage, trimmedBitmap );
+			}
+
+			// blank pages (the back sides of duplex scans) are left out or
+			// put in a folder of their own before the expensive encode
+			bool bBlank = false;
+			if ( bTrimmed && m_BlankPage.IsEnabled )
+			{
+				CBlankPage page( m_BlankPage );
+				bBlank = page.IsBlank
+				( 
+					pixels.Data, m_uiNewWidth, m_uiNewHeight, nStride 
+				);
+				csOutput.Format
+				(
+					_T( "Ink: %.3f%%, Mean: %.1f, Deviation: %.1f%s\n" ),
+					page.Ink, page.Mean, page.Deviation,
+					bBlank ? _T( " (blank page)" ) : _T( "" )
+				);
+				csLog += csOutput;
+			}
+			fout.WriteString( csLog );
+
+			if ( bBlank )
+			{
+				m_ullBlankPages++;
+			}
+
+			// normalize the levels of the 16 bit channels once the blank 
+			// page test has seen the pixels as they were, unless the page 
+			// is blank and discarded anyway
+			const bool bDiscard = bBlank && m_csBlankFolder.IsEmpty();
+			if ( bTrimmed && bDeepLater && !bDiscard )
+			{
+				bTrimmed = LevelDeepPixels
+				( 
+					OriginalImage, rectTrim, pixels.Data, nStride 
+				);
+			}
+
+			// normalize the levels in place through a table per channel
+			if ( bTrimmed && m_Levels.IsEnabled && !bDeepLevels )
+			{
+				m_Levels.Apply<BYTE>
+				( 
+					pixels.Data, nStride, pixels.Data, nStride, m_uiNewWidth, 
+					m_uiNewHeight, 255, false 
+				);
+			}
+
+			// draw a grid with an origin at the upper left straight into 
+			// the pixels of the output image for scanner testing purposes,
+			// unless the chain draws it after its own operations
+			if ( bTrimmed && bCalibrate && !m_Chain.Grid )
+			{
+				m_Grid.Draw( pixels.Data, m_uiNewWidth, m_uiNewHeight, nStride );
+			}
+
+			// save the image to the new path, after the operations of the
+			// chain if there are any
+			if ( bBlank )
+			{
+				value = m_csBlankFolder.IsEmpty() ?
+					true : Save( csPath, &trimmedBitmap, m_csBlankFolder );
+
+			} else if ( bTrimmed && !m_Chain.IsEmpty )
+			{
+				value = SaveChained
+				( 
+					csPath, OriginalImage, trimmedBitmap, pixels.Data, nStride 
+				);
+
+			} else if ( bTrimmed )
+			{
+				value = Save( csPath, &trimmedBitmap );
+			}
+		}
+	}
+
+	// give the memory back to be used for the next file read ahead
+	m_Prefetcher.Release( arrData );
+
+	return value;
+} // ProcessImage
+
+/////////////////////////////////////////////////////////////////////////////
+// hand the file to this thread's child process, so a file that hangs or
+// crashes the decoder only costs the child, which is killed and replaced
+bool ProcessIsolated( CString& csPath, CStdioFile& fout )
+{
+	m_WorkerProcess.Command = m_csWorkerCommand;
+	m_WorkerProcess.Timeout = DWORD( m_nTimeout ) * 1000;
+
+	CString csLog;
+	const CWorkerProcess::RESULT result = 
+		m_WorkerProcess.Process( csPath, csLog );
+
+	CString csOutput;
+	switch ( result )
+	{
+		case CWorkerProcess::WORKER_TIMEOUT:
+			m_ullWorkersLost++;
+			csOutput.Format
+			( 
+				_T( "Worker killed after %d seconds:\n\t%s\n" ), 
+				m_nTimeout, csPath 
+			);
+			break;
+		case CWorkerProcess::WORKER_CRASHED:
+			m_ullWorkersLost++;
+			csOutput.Format( _T( "Worker crashed:\n\t%s\n" ), csPath );
+			break;
+		case CWorkerProcess::WORKER_NOT_STARTED:
+			csOutput.Format( _T( "Unable to start worker:\n\t%s\n" ), csPath );
+			break;
+	}
+
+	fout.WriteString( csLog + csOutput );
+	return result == CWorkerProcess::WORKER_OK;
+} // ProcessIsolated
+
+/////////////////////////////////////////////////////////////////////////////
+// process the files sent by the parent process on standard input one at 
+// a time, answering each with the lines logged and the result, until the
+// parent closes the pipe
+int RunWorker( CStdioFile& fout )
+{
+	HANDLE hInput = ::GetStdHandle( STD_INPUT_HANDLE );
+
+	CStringA csReceived;
+	char szRead[ 4096 ];
+	DWORD dwRead = 0;
+	while ( ::ReadFile( hInput, szRead, sizeof( szRead ), &dwRead, NULL ) && dwRead > 0 )
+	{
+		csReceived.Append( szRead, dwRead );
+
+		int nEnd;
+		while ( ( nEnd = csReceived.Find( '\n' ) ) != -1 )
+		{
+			CString csPath( CA2W( csReceived.Left( nEnd ), CP_UTF8 ) );
+			csReceived = csReceived.Mid( nEnd + 1 );
+
+			const ULONGLONG ullFailed = m_OutputWriter.Failed;
+			bool bOkay = ProcessImage( csPath, fout );
+
+			// the file is on the disk before the parent hears about it,
+			// so a crash after the answer cannot lose it, and a file the
+			// writer could not write fails the image
+			m_OutputWriter.Flush();
+			bOkay = bOkay && m_OutputWriter.Failed == ullFailed;
+
+			fout.WriteString
+			( 
+				CString( CWorkerProcess::ANSWER ) + 
+				( bOkay ? _T( "OK\n" ) : _T( "FAILED\n" ) )
+			);
+			fout.Flush();
+		}
+	}
+
+	return 0;
+} // RunWorker
+
+/////////////////////////////////////////////////////////////////////////////
+// read one image from standard input, find its format from the magic 
+// bytes at its start and write the trimmed image to standard output, so 
+// a pipeline needs no files of its own. The image is handed to the 
+// decoder in memory under a name of the format it was found to be in
+int RunPipe( CStdioFile& fout )
+{
+	HANDLE hInput = ::GetStdHandle( STD_INPUT_HANDLE );
+	HANDLE hOutput = ::GetStdHandle( STD_OUTPUT_HANDLE );
+
+	vector<BYTE> arrData;
+	const size_t nChunk = 1 << 20;
+	DWORD dwRead = 0;
+	do
+	{
+		const size_t nSize = arrData.size();
+		arrData.resize( nSize + nChunk );
+		dwRead = 0;
+		if ( !::ReadFile( hInput, &arrData[ nSize ], DWORD( nChunk ), &dwRead, NULL ) )
+		{
+			dwRead = 0;
+		}
+		arrData.resize( nSize + dwRead );
+
+	} while ( dwRead > 0 );
+
+	const CString csExt = 
+		CImageHeader::GetExtension( arrData.data(), arrData.size() );
+	if ( csExt.IsEmpty() )
+	{
+		fout.WriteString( _T( "Standard input is not a supported image.\n" ) );
+		return 6;
+	}
+	const CString csPath = _T( "stdin" ) + csExt;
+
+	AfxOleInit();
+	::CoInitialize( NULL );
+	InitGdiplus();
+
+	// the JPEG, PNG and GIF encoders write front to back, so they write 
+	// into standard output as they go, while the BMP and TIFF encoders go
+	// back to fill in their headers and are encoded into memory first
+	const bool bStream = 
+		csExt == _T( ".jpg" ) || csExt == _T( ".png" ) || csExt == _T( ".gif" );
+	m_OutputWriter.OpenPipe( hOutput, bStream );
+	m_OutputWriter.Start
+	(
+		[ &fout ]( const CString& csOutput )
+		{
+			fout.WriteString( csOutput );
+		}
+	);
+
+	// the decoder takes the image as if it had been read ahead
+	m_Prefetcher.Put( csPath, arrData );
+	CString csImage( csPath );
+	const bool bOkay = ProcessImage( csImage, fout );
+
+	m_OutputWriter.Close();
+	m_Prefetcher.Close();
+	m_PixelPool.Clear();
+	TerminateGdiplus();
+
+	if ( m_OutputWriter.PipeTorn )
+	{
+		fout.WriteString
+		( 
+			_T( "Image save failed after part of it was written, standard " )
+			_T( "output holds a cut off image:\n\tstdin\n" ) 
+		);
+		return 7;
+	}
+	if ( !bOkay || m_OutputWriter.Failed > 0 )
+	{
+		fout.WriteString( _T( "Image save failed:\n\tstdin\n" ) );
+		return 7;
+	}
+	return 0;
+} // RunPipe
+
+/////////////////////////////////////////////////////////////////////////////
+// process a single file and let the user know if it failed
+void ProcessFile( CString& csPath, CStdioFile& fout )
+{
+	// process the current file if it is a valid image, in a child process
+	// if the user asked for the decoder to be isolated
+	const bool bOkay = m_nIsolate > 0 ?
+		ProcessIsolated( csPath, fout ) : ProcessImage( csPath, fout );
+	if ( bOkay == false )
+	{
+		CString csOutput;
+		csOutput.Format( _T( "Image save failed:\n\t%s\n" ), csPath );
+		fout.WriteString( csOutput );
+	}
+} // ProcessFile
+
+/////////////////////////////////////////////////////////////////////////////
+// read the header of an input file, which for an entry of an archive is
+// only in memory waiting for the decoder
+bool ProbeInput( const CString& csPath, CImageHeader& header )
+{
+	if ( !m_bArchiveInput )
+	{
+		return header.Probe( csPath );
+	}
+
+	bool value = false;
+	m_Prefetcher.Peek
+	(
+		csPath,
+		[ &header, &value ]( const vector<BYTE>& data )
+		{
+			value = header.Probe( data.data(), data.size() );
+		}
+	);
+	return value;
+} // ProbeInput
+
+/////////////////////////////////////////////////////////////////////////////
+// process a file on a worker thread and add the predicted and actual cost
+// to the report if one was requested
+void ProcessJob( const CString& csFile, CStdioFile& fout )
+{
+	CString csPath( csFile );
+	if ( !m_RunReport.IsOpen )
+	{
+		ProcessFile( csPath, fout );
+		return;
+	}
+
+	// the header is read again rather than remembered since its pages
+	// are still in the cache from estimating the memory of the job
+	CImageHeader header;
+	ProbeInput( csPath, header );
+
+	LARGE_INTEGER frequency, start, stop;
+	::QueryPerformanceFrequency( &frequency );
+	::QueryPerformanceCounter( &start );
+
+	ProcessFile( csPath, fout );
+
+	::QueryPerformanceCounter( &stop );
+	const double dMilliseconds =
+		1000.0 * double( stop.QuadPart - start.QuadPart ) /
+		double( frequency.QuadPart );
+
+	// the path relative to the root of the tree lets the reports of 
+	// shards run on different machines be merged
+	m_RunReport.Add
+	(
+		m_Shard.GetRelativePath( csPath ), header.Width, header.Height, header.FileSize, 
+		EstimateCost( header ), dMilliseconds
+	);
+} // ProcessJob
+
+/////////////////////////////////////////////////////////////////////////////
+// estimate the peak memory needed to process the file from the dimensions 
+// and pixel depth in its header, which covers the decoded image, the 
+// trimmed copy and the encoded output waiting to be written
+ULONGLONG EstimateMemory( const CString& csPath )
+{
+	if ( !IsSupportedExtension( CHelper::SplitPath( csPath ).m_Extension ) )
+	{
+		return 0;
+	}
+
+	CImageHeader header;
+	if ( !ProbeInput( csPath, header ) )
+	{
+		// an unknown header is likely a compressed image, so assume it
+		// decodes to several times the size of its file
+		return header.FileSize * 8;
+	}
+
+	const ULONGLONG ullPixels = ULONGLONG( header.Width ) * header.Height;
+
+	// GDI+ decodes to 32 bits per pixel unless the image has 16 bits per 
+	// channel, which is kept at 64 bits per pixel
+	const ULONGLONG ullDecoded = 
+		ullPixels * ( header.BitsPerPixel > 32 ? 8 : 4 );
+
+	// the trimmed copy is never larger than the original at 32 bits
+	const ULONGLONG ullTrimmed = ullPixels * 4;
+
+	// the encoded output is rarely more than half of the trimmed pixels
+	const ULONGLONG ullEncoded = ullTrimmed / 2;
+
+	// straightening a page needs all of it at 32 bits as well
+	const ULONGLONG ullDeskew = m_Deskew.IsEnabled ? ullPixels * 4 : 0;
+
+	// the file itself is held in memory if it was read ahead
+	const ULONGLONG value = 
+		ullDecoded + ullTrimmed + ullEncoded + ullDeskew + header.FileSize;
+	return value;
+} // EstimateMemory
+
+/////////////////////////////////////////////////////////////////////////////
+// predict the cost of processing the image, which is dominated by decoding
+// and so grows with the number of pixels. An image whose header cannot be
+// read is assumed to be compressed to about a quarter byte per pixel
+ULONGLONG EstimateCost( CImageHeader& header )
+{
+	if ( header.Width == 0 || header.Height == 0 )
+	{
+		return header.FileSize * 4;
+	}
+
+	const ULONGLONG value = ULONGLONG( header.Width ) * header.Height;
+	return value;
+} // EstimateCost
+
+/////////////////////////////////////////////////////////////////////////////
+// fill in the sort key of every file using several threads since on a 
+// network share most of the time is spent waiting on the file system
+void GetSortKeys
+( 
+	vector<ORDERED_FILE>& arrFiles, 
+	function<ULONGLONG( const CString& csPath )> getKey 
+)
+{
+	atomic<size_t> nNext( 0 );
+	auto GetKeys = [ &arrFiles, &nNext, &getKey ]()
+	{
+		size_t nFile;
+		while ( ( nFile = nNext++ ) < arrFiles.size() )
+		{
+			arrFiles[ nFile ].m_ullKey = getKey( arrFiles[ nFile ].m_csPath );
+		}
+	};
+
+	vector<thread> arrThreads;
+	for ( int nThread = 1; nThread < m_Scheduler.Threads; nThread++ )
+	{
+		arrThreads.push_back( thread( GetKeys ) );
+	}
+	GetKeys();
+	for ( thread& worker : arrThreads )
+	{
+		worker.join();
+	}
+} // GetSortKeys
+
+/////////////////////////////////////////////////////////////////////////////
+// sort the files by their predicted cost with the largest first, so the
+// longest jobs start early and the workers finish at nearly the same time
+// instead of one worker ending the run on a huge image on its own
+void OrderLargestFirst( vector<ORDERED_FILE>& arrFiles )
+{
+	GetSortKeys
+	( 
+		arrFiles, 
+		[]( const CString& csPath )
+		{
+			CImageHeader header;
+			header.Probe( csPath );
+			return EstimateCost( header );
+		}
+	);
+
+	// equal costs keep the order they were found in
+	stable_sort
+	(
+		arrFiles.begin(), arrFiles.end(),
+		[]( const ORDERED_FILE& left, const ORDERED_FILE& right )
+		{
+			return left.m_ullKey > right.m_ullKey;
+		}
+	);
+} // OrderLargestFirst
+
+/////////////////////////////////////////////////////////////////////////////
+// sort the files by where they start on the disk, so on spinning disks
+// the prefetcher reads them in one sweep across the platters instead of 
+// seeking back and forth in the order of their names
+void OrderPhysical( vector<ORDERED_FILE>& arrFiles )
+{
+	GetSortKeys
+	( 
+		arrFiles, 
+		[]( const CString& csPath )
+		{
+			CFileLocation location;
+			location.Read( csPath );
+			return location.SortKey;
+		}
+	);
+
+	stable_sort
+	(
+		arrFiles.begin(), arrFiles.end(),
+		[]( const ORDERED_FILE& left, const ORDERED_FILE& right )
+		{
+			return left.m_ullKey < right.m_ullKey;
+		}
+	);
+} // OrderPhysical
+
+/////////////////////////////////////////////////////////////////////////////
+// hand a file to the worker threads and read it ahead of the decoder if 
+// it is an image, unless it belongs to another shard of the tree
+void QueueFile( const CString& csPath )
+{
+	if ( !m_Shard.Contains( csPath ) )
+	{
+		return;
+	}
+
+	if ( IsSupportedExtension( CHelper::SplitPath( csPath ).m_Extension ) )
+	{
+		m_Prefetcher.Queue( csPath );
+	}
+
+	// remember when the file was written for a rescan of the tree
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if
+	(
+		m_bWatch &&
+		::GetFileAttributesEx( csPath, GetFileExInfoStandard, &data )
+	)
+	{
+		ULARGE_INTEGER time;
+		time.LowPart = data.ftLastWriteTime.dwLowDateTime;
+		time.HighPart = data.ftLastWriteTime.dwHighDateTime;
+		m_mapHandedOver[ csPath ] = time.QuadPart;
+	}
+
+	m_Scheduler.Queue( csPath );
+} // QueueFile
+
+/////////////////////////////////////////////////////////////////////////////
+// has the image been corrected since it was last written, i.e. was it 
+// handed to the workers earlier in this run and not written since, or 
+// does its corrected image (or blank page) exist and is it newer than 
+// the image
+bool IsCorrected( const CString& csPath )
+{
+	WIN32_FILE_ATTRIBUTE_DATA source;
+	if ( !::GetFileAttributesEx( csPath, GetFileExInfoStandard, &source ) )
+	{
+		return false;
+	}
+
+	const map<CString, ULONGLONG>::const_iterator pos = 
+		m_mapHandedOver.find( csPath );
+	if ( pos != m_mapHandedOver.end() )
+	{
+		ULARGE_INTEGER time;
+		time.LowPart = source.ftLastWriteTime.dwLowDateTime;
+		time.HighPart = source.ftLastWriteTime.dwHighDateTime;
+		if ( pos->second == time.QuadPart )
+		{
+			return true;
+		}
+	}
+
+	// the output of an earlier run is beside the image
+	const CHelper::PATH_PARTS parts = CHelper::SplitPath( csPath );
+	const int nFolder = parts.m_Drive.Length + parts.m_Directory.Length;
+	const CString arrFolders[] = { GetCorrectedFolder(), m_csBlankFolder };
+	for ( const CString& csFolder : arrFolders )
+	{
+		if ( csFolder.IsEmpty() )
+		{
+			continue;
+		}
+
+		const CString csOutput =
+			csPath.Left( nFolder ) + csFolder + _T( "\\" ) + 
+			csPath.Mid( nFolder );
+		WIN32_FILE_ATTRIBUTE_DATA output;
+		if
+		(
+			::GetFileAttributesEx( csOutput, GetFileExInfoStandard, &output ) &&
+			::CompareFileTime( &output.ftLastWriteTime, &source.ftLastWriteTime ) > 0
+		)
+		{
+			return true;
+		}
+	}
+
+	return false;
+} // IsCorrected
+
+/////////////////////////////////////////////////////////////////////////////
+// crawl through the directory tree looking for supported image extensions
+// the folders are searched by several threads and each file is handed to 
+// the worker threads as soon as it is found instead of after the whole 
+// tree has been searched. Rescanning a tree that was already processed
+// can skip the images that were corrected since they were written
+void RecursePath( LPCTSTR path, bool bSkipCorrected = false )
+{
+	// get the folder which will trim any wild card data
+	const CString csPathname = CHelper::GetFolder( path );
+
+	// wild cards are in use if the pathname does not equal the given path
+	// and the same wild cards are applied to every folder in the tree
+	const bool bWildCards = csPathname != path;
+
+	CDirectoryWalker walker;
+	walker.Corrected = GetCorrectedFolder();
+	walker.Blank = m_csBlankFolder;
+	if ( m_nScanThreads > 0 )
+	{
+		walker.Threads = m_nScanThreads;
+	}
+	if ( bWildCards )
+	{
+		walker.Pattern = CHelper::GetDataName( path );
+	}
+
+	// start trolling for files we are interested in
+	walker.Start( csPathname );
+
+	CString csPath;
+
+	// ordering the files needs the whole tree before the first file can
+	// be handed to the workers
+	if ( !m_csOrder.IsEmpty() )
+	{
+		vector<ORDERED_FILE> arrFiles;
+		while ( walker.GetNextFile( csPath ) )
+		{
+			// only this shard's files are worth ordering
+			if
+			(
+				m_Shard.Contains( csPath ) &&
+				( !bSkipCorrected || !IsCorrected( csPath ) )
+			)
+			{
+				ORDERED_FILE file = { csPath, 0 };
+				arrFiles.push_back( file );
+			}
+		}
+		walker.Wait();
+
+		if ( m_csOrder == _T( "largest" ) )
+		{
+			OrderLargestFirst( arrFiles );
+
+		} else
+		{
+			OrderPhysical( arrFiles );
+		}
+
+		for ( const ORDERED_FILE& file : arrFiles )
+		{
+			QueueFile( file.m_csPath );
+		}
+		return;
+	}
+
+	// the scheduler's queue holds the files found but not processed yet, 
+	// which the prefetcher is reading into memory while the workers are 
+	// busy. Handing files over waits while it is full, but the search 
+	// threads keep going and only the names pile up in the walker
+	while ( walker.GetNextFile( csPath ) )
+	{
+		if ( !bSkipCorrected || !IsCorrected( csPath ) )
+		{
+			QueueFile( csPath );
+		}
+	}
+
+	walker.Wait();
+
+} // RecursePath
+
+/////////////////////////////////////////////////////////////////////////////
+// find a tar or zip file at the start of the pathname, and the wild cards
+// following it that pick the entries (all of them if there are none)
+// returns the pathname of the archive or an empty string if the pathname
+// does not run through an archive
+CString GetInputArchive( const CString& csPath, CString& csPattern )
+{
+	const int nLength = csPath.GetLength();
+	for ( int nEnd = 1; nEnd <= nLength; nEnd++ )
+	{
+		if
+		(
+			nEnd < nLength &&
+			csPath[ nEnd ] != _T( '\\' ) && csPath[ nEnd ] != _T( '/' )
+		)
+		{
+			continue;
+		}
+
+		const CString csArchive = csPath.Left( nEnd );
+		if
+		(
+			CArchiveReader::IsArchive( csArchive ) &&
+			::PathFileExists( csArchive ) &&
+			!::PathIsDirectory( csArchive )
+		)
+		{
+			csPattern = csPath.Mid( nEnd + 1 );
+			if ( csPattern.IsEmpty() )
+			{
+				csPattern = _T( "*.*" );
+			}
+			return csArchive;
+		}
+	}
+
+	return CString();
+} // GetInputArchive
+
+/////////////////////////////////////////////////////////////////////////////
+// read the images out of a tar or zip archive front to back and hand each
+// one to the worker threads already in memory, so the archive is never
+// extracted to the disk. The entries are named as if the archive had been
+// extracted into a folder of its own name beside it, which is the root
+// of the tree
+bool RecurseArchive
+(
+	const CString& csArchive, const CString& csPattern, CStdioFile& fout
+)
+{
+	CArchiveReader reader;
+	if ( !reader.Open( csArchive ) )
+	{
+		CString csOutput;
+		csOutput.Format( _T( "Archive cannot be read:\n\t%s\n" ), csArchive );
+		fout.WriteString( csOutput );
+		return false;
+	}
+
+	CString csName;
+	vector<BYTE> arrData;
+	while ( reader.Next( csName, arrData ) )
+	{
+		csName.Replace( _T( '/' ), _T( '\\' ) );
+		csName.TrimLeft( _T( '\\' ) );
+
+		// an entry is not allowed to climb out of the folder
+		const CString csFolders = _T( "\\" ) + csName + _T( "\\" );
+		if ( csName.IsEmpty() || csFolders.Find( _T( "\\..\\" ) ) != -1 )
+		{
+			continue;
+		}
+
+		// the wild cards apply to the name of the entry without its folders
+		// an empty entry is no image whatever its name
+		const CString csFile = csName.Mid( csName.ReverseFind( _T( '\\' ) ) + 1 );
+		if
+		(
+			arrData.empty() ||
+			!IsSupportedExtension( CHelper::SplitPath( csFile ).m_Extension ) ||
+			!::PathMatchSpec( csFile, csPattern )
+		)
+		{
+			continue;
+		}
+
+		const CString csPath = m_Shard.Root + _T( "\\" ) + csName;
+		if ( !m_Shard.Contains( csPath ) )
+		{
+			continue;
+		}
+
+		// the workers take the entry from memory, and reading the archive
+		// waits here while the entries handed over fill the memory budget
+		if ( !m_Prefetcher.Put( csPath, arrData ) )
+		{
+			break;
+		}
+		m_Scheduler.Queue( csPath );
+	}
+
+	if ( reader.Skipped > 0 )
+	{
+		CString csOutput;
+		csOutput.Format
+		(
+			_T( "Archive entries skipped (encrypted, damaged, too large or " )
+			_T( "compressed by an unknown method): %I64u\n" ), reader.Skipped
+		);
+		fout.WriteString( csOutput );
+	}
+
+	return true;
+} // RecurseArchive
+
+/////////////////////////////////////////////////////////////////////////////
+// watch the folder tree for files dropped into it and process each one 
+// as soon as its writer is done with it
+void WatchPath( LPCTSTR path, CStdioFile& fout )
+{
+	// get the folder which will trim any wild card data
+	const CString csFolder = CHelper::GetFolder( path );
+
+	// wild cards are in use if the folder does not equal the given path
+	const bool bWildCards = csFolder != path;
+	const CString csData = 
+		bWildCards ? CHelper::GetDataName( path ) : CString( _T( "*.*" ) );
+
+	m_WatchFolder.Folder = csFolder;
+	m_WatchFolder.Pattern = csData;
+	m_WatchFolder.Corrected = GetCorrectedFolder();
+	m_WatchFolder.Blank = m_csBlankFolder;
+
+	CString csOutput;
+	csOutput.Format
+	( 
+		_T( "Watching for new files (Ctrl+C to stop):\n\t%s\n" ), 
+		m_WatchFolder.Folder 
+	);
+	fout.WriteString( csOutput );
+
+	const bool bOkay = m_WatchFolder.Watch
+	(
+		// a file has landed and is no longer being written
+		[]( const CString& csFile )
+		{
+			QueueFile( csFile );
+		},
+		// a folder was moved into the tree, so crawl it like the
+		// initial scan would have. The whole tree is rescanned when the
+		// notifications overflowed, and the images already corrected
+		// since they were written are not done again
+		[ &csData ]( const CString& csSubFolder )
+		{
+			const bool bOverflow = 
+				csSubFolder.CompareNoCase( m_WatchFolder.Folder ) == 0;
+			RecursePath( csSubFolder + _T( "\\" ) + csData, bOverflow );
+		},
+		// a file stayed empty or kept changing for too long
+		[ &fout ]( const CString& csFile )
+		{
+			CString csMessage;
+			csMessage.Format
+			( 
+				_T( "File never finished being written, skipped:\n\t%s\n" ), 
+				csFile 
+			);
+			fout.WriteString( csMessage );
+		}
+	);
+
+	if ( !bOkay )
+	{
+		csOutput.Format
+		( 
+			_T( "Unable to watch folder:\n\t%s\n" ), 
+			m_WatchFolder.Folder 
+		);
+		fout.WriteString( csOutput );
+	}
+} // WatchPath
+
+/////////////////////////////////////////////////////////////////////////////
+// stop watching the folder when the user presses Ctrl+C or closes the 
+// console so the current file is finished and GDI+ is shut down cleanly
+BOOL WINAPI ConsoleHandler( DWORD dwCtrlType )
+{
+	if ( m_bWatch )
+	{
+		m_WatchFolder.Stop();
+		return TRUE;
+	}
+
+	return FALSE;
+} // ConsoleHandler
+
+/////////////////////////////////////////////////////////////////////////////
+// set the current file extension which will automatically lookup the
+// related mime type and class ID and set their respective properties
+void CExtension::SetFileExtension( const CString& value )
+{
+	USES_CONVERSION;
+
+	m_csFileExtension = value;
+
+	// one lookup in the shared table finds the mime type
+	const CString* pMimeType = GetExtensions().find( value );
+	if ( pMimeType != nullptr )
+	{
+		MimeType = *pMimeType;
+
+		// populate the mime type map the first time it is referenced
+		if ( m_mapMimeTypes.Count == 0 )
+		{
+			UINT num = 0;
+			UINT size = 0;
+
+			// gets the number of available image encoders and 
+			// the total size of the array
+			Gdiplus::GetImageEncodersSize( &num, &size );
+			if ( size == 0 )
+			{
+				return;
+			}
+
+			Gdiplus::ImageCodecInfo* pImageCodecInfo =
+				(Gdiplus::ImageCodecInfo*)malloc( size );
+			if ( pImageCodecInfo == nullptr )
+			{
+				return;
+			}
+
+			// Returns an array of ImageCodecInfo objects that contain 
+			// information about the image encoders built into GDI+.
+			Gdiplus::GetImageEncoders( num, size, pImageCodecInfo );
+
+			// populate the map of mime types the first time it is 
+			// needed
+			m_mapMimeTypes.reserve( int( num ) );
+			for ( UINT nIndex = 0; nIndex < num; ++nIndex )
+			{
+				CString csKey;
+				csKey = CW2A( pImageCodecInfo[ nIndex ].MimeType );
+				m_mapMimeTypes.add( csKey, pImageCodecInfo[ nIndex ].Clsid );
+			}
+
+			// clean up
+			free( pImageCodecInfo );
+		}
+
+		const CLSID* pClassID = m_mapMimeTypes.find( m_csMimeType );
+		ClassID = pClassID != nullptr ? *pClassID : CLSID_NULL;
+
+	} else
+	{
+		MimeType = _T( "" );
+	}
+} // CExtension::SetFileExtension
+
+/////////////////////////////////////////////////////////////////////////////
+// combine the reports written by the shards of a tree into one report and
+// check that every image was processed by only one shard, the reports may
+// be given with wild cards
+// returns zero if the reports were merged without duplicates
+int MergeReports
+( 
+	const CString& csOutput, const vector<CString>& arrReports, 
+	CStdioFile& fout 
+)
+{
+	CString csMessage;
+	CRunReport report;
+	if ( !report.Open( csOutput ) )
+	{
+		csMessage.Format( _T( "Unable to create report:\n\t%s\n" ), csOutput );
+		fout.WriteString( csMessage );
+		return 6;
+	}
+
+	vector<CString> arrDuplicates;
+	int nReports = 0;
+	for ( const CString& csReports : arrReports )
+	{
+		const CString csFolder = CHelper::GetFolder( csReports );
+
+		CFileFind find;
+		BOOL bWorking = find.FindFile( csReports );
+		if ( !bWorking )
+		{
+			csMessage.Format( _T( "No report found:\n\t%s\n" ), csReports );
+			fout.WriteString( csMessage );
+		}
+
+		while ( bWorking )
+		{
+			bWorking = find.FindNextFile();
+			if ( find.IsDirectory() )
+			{
+				continue;
+			}
+
+			// the output may match the wild cards of the input
+			const CString csReport = find.GetFilePath();
+			if ( csReport.CompareNoCase( csOutput ) == 0 )
+			{
+				continue;
+			}
+
+			if ( report.Append( csReport, arrDuplicates ) )
+			{
+				nReports++;
+
+			} else
+			{
+				csMessage.Format
+				( 
+					_T( "Unable to read report:\n\t%s\n" ), csReport 
+				);
+				fout.WriteString( csMessage );
+			}
+		}
+	}
+
+	for ( const CString& csDuplicate : arrDuplicates )
+	{
+		csMessage.Format
+		( 
+			_T( "Processed by more than one shard:\n\t%s\n" ), csDuplicate 
+		);
+		fout.WriteString( csMessage );
+	}
+
+	csMessage.Format
+	(
+		_T( "Merged %d reports: %I64u images, %I64u duplicates, " )
+		_T( "%.3f milliseconds per megapixel\n" ),
+		nReports, report.Count, ULONGLONG( arrDuplicates.size() ),
+		report.Rate * 1000000.0
+	);
+	fout.WriteString( csMessage );
+	report.Close();
+
+	return arrDuplicates.empty() ? 0 : 7;
+} // MergeReports
+
+/////////////////////////////////////////////////////////////////////////////
+// let the user know how much the JPEG images were made smaller
+void ReportJpegSavings( CStdioFile& fout )
+{
+	const ULONGLONG ullBefore = m_OutputWriter.JpegBefore;
+	const ULONGLONG ullSaved = ullBefore - m_OutputWriter.JpegAfter;
+
+	CString csMessage;
+	csMessage.Format
+	(
+		_T( "JPEG optimized: %I64u files, %I64u KB saved (%.1f%%)\n" ),
+		m_OutputWriter.JpegFiles, ullSaved >> 10,
+		ullBefore > 0 ? 100.0 * double( ullSaved ) / double( ullBefore ) : 0.0
+	);
+	fout.WriteString( csMessage );
+} // ReportJpegSavings
+
+/////////////////////////////////////////////////////////////////////////////
+// code every JPEG below the folder again with Huffman tables built for 
+// it, like an existing Corrected tree written before --optimize-jpeg, 
+// replacing each file that gets smaller. The files are optimized by 
+// several threads and written by the output writer, which flushes each 
+// new file to the disk before renaming it over the original, so a crash 
+// or power loss leaves either the original or the whole new file
+int OptimizeJpegTree( const CString& csFolder, CStdioFile& fout )
+{
+	if ( !::PathIsDirectory( csFolder ) )
+	{
+		CString csMessage;
+		csMessage.Format( _T( "Invalid pathname:\n\t%s\n" ), csFolder );
+		fout.WriteString( csMessage );
+		return 4;
+	}
+
+	m_OutputWriter.Start
+	(
+		[ &fout ]( const CString& csOutput )
+		{
+			fout.WriteString( csOutput );
+		}
+	);
+
+	// the Corrected folders are what is being optimized, so every folder
+	// is searched
+	CDirectoryWalker walker;
+	walker.Corrected = _T( "" );
+	if ( m_nScanThreads > 0 )
+	{
+		walker.Threads = m_nScanThreads;
+	}
+	walker.Start( csFolder );
+
+	atomic<ULONGLONG> ullSkipped( 0 );
+	auto Optimize = [ &walker, &ullSkipped ]()
+	{
+		CString csPath;
+		while ( walker.GetNextFile( csPath ) )
+		{
+			const CString csExt = 
+				CHelper::SplitPath( csPath ).m_Extension.ToString().MakeLower();
+			if ( csExt != _T( ".jpg" ) && csExt != _T( ".jpeg" ) )
+			{
+				continue;
+			}
+
+			// the file is copied out of its mapping, since the mapping 
+			// would keep the optimized file from replacing it, through a 
+			// stream so a file cut short fails the read instead of the 
+			// process
+			vector<BYTE> arrData;
+			{
+				CMappedFile file;
+				if ( file.Open( csPath ) && file.Size < MAXDWORD )
+				{
+					CComPtr<IStream> pStream;
+					pStream.Attach( CMemoryStream::Create( file.Data, file.Size ) );
+					arrData.resize( size_t( file.Size ) );
+					ULONG ulRead = 0;
+					if
+					(
+						pStream->Read
+						( 
+							arrData.data(), ULONG( arrData.size() ), &ulRead 
+						) != S_OK
+					)
+					{
+						arrData.clear();
+					}
+				}
+			}
+
+			// progressive images and files that are not JPEGs at all
+			if ( !m_OutputWriter.SaveOptimized( csPath, arrData ) )
+			{
+				ullSkipped++;
+			}
+		}
+	};
+
+	const int nThreads = m_nThreads > 0 ? 
+		m_nThreads : int( max( thread::hardware_concurrency(), 1u ) );
+	vector<thread> arrThreads;
+	for ( int nThread = 1; nThread < nThreads; nThread++ )
+	{
+		arrThreads.push_back( thread( Optimize ) );
+	}
+	Optimize();
+	for ( thread& worker : arrThreads )
+	{
+		worker.join();
+	}
+	walker.Wait();
+
+	m_OutputWriter.Close();
+
+	ReportJpegSavings( fout );
+	if ( ullSkipped > 0 )
+	{
+		CString csMessage;
+		csMessage.Format
+		( 
+			_T( "JPEG skipped (progressive or unreadable): %I64u\n" ), 
+			ullSkipped.load() 
+		);
+		fout.WriteString( csMessage );
+	}
+	return m_OutputWriter.Failed > 0 ? 7 : 0;
+} // OptimizeJpegTree
+
+/////////////////////////////////////////////////////////////////////////////
+// give the user some usage help if the parameters do not look right
+void Usage( CStdioFile& fOut )
+{
+	fOut.WriteString( _T( ".\n" ) );
+	fOut.WriteString
+	(
+		_T( "TrimImage, Copyright (c) 2024, " )
+		_T( "by W. T. Block.\n" )
+	);
+
+	fOut.WriteString
+	(
+		_T( ".\n" )
+		_T( "A Windows command line program to trim image(s) using\n" )
+		_T( "  the given the number of pixels to be trimmed from\n" )
+		_T( "  each of the sides (top, bottom, left, and right) or\n" )
+		_T( "  to change the aspect ratio (example a=3:2).\n" )
+		_T( ".\n" )
+	);
+
+	fOut.WriteString
+	(
+		_T( ".\n" )
+		_T( "Usage:\n" )
+		_T( ".\n" )
+		_T( ".  TrimImage pathname [t=top b=bottom l=left r=right a=aspect]\n" )
+		_T( ".    [--watch] [--scan-threads=count] [--write-buffer=MB]\n" )
+		_T( ".    [--prefetch=files] [--prefetch-budget=MB] [--large-pages]\n" )
+		_T( ".    [--threads=count] [--max-memory=MB]\n" )
+		_T( ".    [--order=largest|physical] [--report=file]\n" )
+		_T( ".    [--shard=index/count] [--isolate=count] [--timeout=seconds]\n" )
+		_T( ".    [--chain=operation,...] [grid=spacing gridcolor=color\n" )
+		_T( ".    gridwidth=width] [--blank=percent] [--blank-level=level]\n" )
+		_T( ".    [--blank-folder=folder] [--deskew[=degrees]]\n" )
+		_T( ".    [--levels[=percent]] [--gamma=value]\n" )
+		_T( ".    [--archive=file] [--archive-size=MB] [--optimize-jpeg]\n" )
+		_T( ".  TrimImage --merge=file report [report ...]\n" )
+		_T( ".  TrimImage --optimize-jpeg=folder [--threads=count]\n" )
+		_T( ".\n" )
+		_T( "Where:\n" )
+		_T( ".\n" )
+	);
+
+	fOut.WriteString
+	(
+		_T( ".  pathname is the root of the tree to be scanned, but\n" )
+		_T( ".  may contain wild cards like the following:\n" )
+		_T( ".    \"c:\\Picture\\DisneyWorldMary2\\*.JPG\"\n" )
+		_T( ".  will process all files with that pattern, or\n" )
+		_T( ".    \"c:\\Picture\\DisneyWorldMary2\\231.JPG\"\n" )
+		_T( ".  will process a single defined image file, or\n" )
+		_T( ".    \"c:\\Picture\\DisneyWorldMary2\\\"\n" )
+		_T( ".  will recurse the folder and its sub-folders.\n" )
+		_T( ".  (NOTE: using wild cards will prevent recursion\n" )
+		_T( ".    into sub-folders because the folders will likely\n" )
+		_T( ".    not fall into the same pattern and therefore\n" )
+		_T( ".    sub-folders will not be found by the search).\n" )
+		_T( ".  The pathname may also be a tar or zip file, which is\n" )
+		_T( ".  read front to back without extracting it, like:\n" )
+		_T( ".    \"c:\\Scans\\Batch7.zip\\*.tif\"\n" )
+		_T( ".  where the wild cards pick the entries of any folder\n" )
+		_T( ".  of the archive, and the images are written as if the\n" )
+		_T( ".  archive had been extracted into c:\\Scans\\Batch7.\n" )
+		_T( ".  (NOTE: --order does not apply to an archive and\n" )
+		_T( ".    --watch and --isolate cannot be used with one).\n" )
+		_T( ".  A pathname of - reads one image from standard input,\n" )
+		_T( ".  finding its format from its first bytes, and writes\n" )
+		_T( ".  the trimmed image to standard output with everything\n" )
+		_T( ".  else going to standard error, like:\n" )
+		_T( ".    TrimImage - t=50 b=50 < scan.jpg > trimmed.jpg\n" )
+	);
+
+	fOut.WriteString
+	(
+		_T( ".  all parameters are optional.\n" )
+		_T( ".  top is the number of pixels trimmed from the top.\n" )
+		_T( ".  bottom is the number of pixels trimmed from the bottom.\n" )
+		_T( ".  left is the number of pixels trimmed from the left.\n" )
+		_T( ".  right is the number of pixels trimmed from the right.\n" )
+		_T( ".  aspect is the aspect ratio in the form of 'width:height'\n" )
+		_T( ".  --watch keeps running after the tree has been processed\n" )
+		_T( ".    and processes new files as they are dropped into it\n" )
+		_T( ".    (for example by a scanner) once they are written.\n" )
+		_T( ".  count is the number of threads searching folders,\n" )
+		_T( ".    which defaults to the number of processors (at\n" )
+		_T( ".    least 4).\n" )
+		_T( ".  MB is the most memory used by images waiting to be\n" )
+		_T( ".    written to disk, which defaults to 256.\n" )
+		_T( ".  files is the number of upcoming files read into memory\n" )
+		_T( ".    ahead of the decoder, which defaults to 8 (0 is off).\n" )
+		_T( ".  --prefetch-budget is the most memory used by files\n" )
+		_T( ".    read ahead, which defaults to 256.\n" )
+		_T( ".  --large-pages allocates the pixel buffers from large\n" )
+		_T( ".    pages (needs the Lock pages in memory privilege).\n" )
+		_T( ".  --threads is the number of images processed at once,\n" )
+		_T( ".    which defaults to the number of processors.\n" )
+		_T( ".  --max-memory is the most memory the images being\n" )
+		_T( ".    processed at once may need, estimated from their\n" )
+		_T( ".    headers, which defaults to half of the physical\n" )
+		_T( ".    memory (0 is unlimited). An image that needs more\n" )
+		_T( ".    waits while smaller ones keep being processed.\n" )
+		_T( ".  --order=largest processes the images with the most\n" )
+		_T( ".    pixels first, so the run does not end with one\n" )
+		_T( ".    thread working on a huge image on its own (the\n" )
+		_T( ".    whole tree is searched before processing starts).\n" )
+		_T( ".  --order=physical processes the files in the order they\n" )
+		_T( ".    lie on the disk, which reads spinning disks in one\n" )
+		_T( ".    sweep instead of seeking between files, and reads\n" )
+		_T( ".    at least four files per thread ahead of them.\n" )
+		_T( ".  --report writes the predicted cost (in pixels) and\n" )
+		_T( ".    the milliseconds taken by every image to the given\n" )
+		_T( ".    comma separated file.\n" )
+		_T( ".  --shard splits the tree between count processes (on one\n" )
+		_T( ".    or more machines) where this process only handles the\n" )
+		_T( ".    files of the zero based index, chosen by a hash of the\n" )
+		_T( ".    path relative to pathname so every process agrees.\n" )
+		_T( ".  --merge combines the reports of the shards into the\n" )
+		_T( ".    given file and lists any image found in two reports.\n" )
+		_T( ".  --isolate processes the images in the given number of\n" )
+		_T( ".    child processes, so a file that crashes or hangs the\n" )
+		_T( ".    decoder does not stop the run. A child that takes\n" )
+		_T( ".    longer than --timeout (default 60) seconds on one\n" )
+		_T( ".    file or crashes is killed and replaced, and the file\n" )
+		_T( ".    is reported as failed.\n" )
+		_T( ".  --chain applies operations to the trimmed image in the\n" )
+		_T( ".    order given, done together in as few passes over the\n" )
+		_T( ".    pixels as possible: rotate90, rotate180, rotate270,\n" )
+		_T( ".    fliph, flipv, resize:WxH[:lanczos|box] (0 for W or H\n" )
+		_T( ".    keeps the aspect ratio) and grid (drawn on the result\n" )
+		_T( ".    as set by grid=). The result is turned upright\n" )
+		_T( ".    according to its EXIF orientation (single frame\n" )
+		_T( ".    images only). Example: --chain=crop,resize:1600x0\n" )
+		_T( ".  when there is nothing to trim a calibration grid is\n" )
+		_T( ".    drawn on the image and the size of the scan is shown\n" )
+		_T( ".    in inches and millimeters.\n" )
+		_T( ".  spacing is the pixels between the lines of the grid,\n" )
+		_T( ".    which defaults to 50 (0 is no grid).\n" )
+		_T( ".  color is the color of the lines as RRGGBB or AARRGGBB\n" )
+		_T( ".    in hexadecimal, which defaults to ffffff (white).\n" )
+		_T( ".  width is the width of the lines in pixels, which\n" )
+		_T( ".    defaults to 1.\n" )
+		_T( ".  --blank finds blank pages (like the back sides of\n" )
+		_T( ".    duplex scans), which have no more than the given\n" )
+		_T( ".    percentage of their pixels darker than level (0 to\n" )
+		_T( ".    255, default 128), and leaves them out instead of\n" )
+		_T( ".    saving them, or saves them to the given folder below\n" )
+		_T( ".    the image instead of Corrected (single frame images\n" )
+		_T( ".    only). Example: --blank=0.05 --blank-folder=Blank\n" )
+		_T( ".  --deskew straightens crooked scans by up to the given\n" )
+		_T( ".    degrees (default 3) while they are trimmed, with the\n" )
+		_T( ".    margins measured on the straightened page (single\n" )
+		_T( ".    frame images only).\n" )
+		_T( ".  --levels stretches each color channel of the trimmed\n" )
+		_T( ".    image to black and white, ignoring the given percent\n" )
+		_T( ".    (default 0.5) of the darkest and brightest pixels,\n" )
+		_T( ".    with --gamma (default 1) applied after the stretch\n" )
+		_T( ".    (single frame images only).\n" )
+		_T( ".  --archive writes the corrected images into the given\n" )
+		_T( ".    tar file instead of the Corrected folders, named by\n" )
+		_T( ".    their path below pathname, and --archive-size starts\n" )
+		_T( ".    a new numbered archive (file.0001.tar and so on)\n" )
+		_T( ".    before one grows past the given MB (not with\n" )
+		_T( ".    --isolate). Multi-page documents written into an\n" )
+		_T( ".    archive or to standard output are held in memory\n" )
+		_T( ".    whole until their last page is encoded.\n" )
+		_T( ".  --optimize-jpeg codes the corrected JPEG images again\n" )
+		_T( ".    with Huffman tables built for each image, which is\n" )
+		_T( ".    lossless and makes them smaller. Given a folder in\n" )
+		_T( ".    place of the pathname, every JPEG below it (like an\n" )
+		_T( ".    existing Corrected tree) is optimized in place.\n" )
+		_T( ".\n" )
+		_T( ".Examples: \n" )
+		_T( ".  TrimImage . a=3:2\n" )
+		_T( ".    will force the aspect ratio to become 3:2\n" )
+		_T( ".  TrimImage . t=40 l=5\n" )
+		_T( ".    will trim 40 pixels from the top of the image\n" )
+		_T( ".    and 5 pixels from the left of the image.\n" )
+		_T( ".\n" )
+		_T( ".NOTE: \n" )
+		_T( ".  Trimming parameters can all be set at once, but\n" )
+		_T( ".  changing the aspect ratio should be done alone.\n" )
+		_T( ".  Aspect ratio causes its own trimming changes\n" )
+		_T( ".  and mixing the operations is unpredictable.\n" )
+		_T( ".\n" )
+	);
+} // Usage
+
+/////////////////////////////////////////////////////////////////////////////
+// set the options to their defaults and read the options that follow the 
+// pathname on the command line
+// returns zero on success or the exit code of the error
+int ParseOptions( vector<CString>& arrArgs, CStdioFile& fOut )
+{
+	// initialize the command line parameters to their default values
+	m_uiTop = 0;
+	m_uiBottom = 0;
+	m_uiLeft = 0;
+	m_uiRight = 0;
+	m_bWatch = false;
+	m_nScanThreads = 0;
+	m_bLargePages = false;
+	m_nThreads = 0;
+	m_nIsolate = 0;
+	m_csArchive.Empty();
+	m_ullArchiveSize = 0;
+	m_nTimeout = 60;
+
+	// default to half of the physical memory for the images in flight
+	MEMORYSTATUSEX memory = { sizeof( MEMORYSTATUSEX ) };
+	if ( ::GlobalMemoryStatusEx( &memory ) )
+	{
+		m_Scheduler.MaxMemory = memory.ullTotalPhys / 2;
+	}
+
+	// initialize intermediate values
+	m_uiOriginalWidth = 1;
+	m_uiOriginalHeight = 1;
+	m_fHorizontalResolution = 600.0f;
+	m_fVerticalResolution = 600.0f;
+	m_uiNewWidth = 1;
+	m_uiNewHeight = 1;
+
+	// parse the command line arguments
+	CString csArg;
+	const size_t nArgs = arrArgs.size();
+	for ( size_t nArg = 2; nArg < nArgs; nArg++ )
+	{
+		csArg = arrArgs[ nArg ].MakeLower();
+		int nStart = 0;
+		CString csOp, csValue;
+		csOp = csArg.Tokenize( _T( "=" ), nStart );
+		if ( csOp.IsEmpty() )
+		{
+			continue;
+		}
+		csValue = csArg.Tokenize( _T( "=" ), nStart );
+		if ( csOp == _T( "t" ) )
+		{
+			m_uiTop = _tstol( csValue );
+
+		} else if ( csOp == _T( "b" ) )
+		{
+			m_uiBottom = _tstol( csValue );
+
+		} else if ( csOp == _T( "l" ) )
+		{
+			m_uiLeft = _tstol( csValue );
+
+		} else if ( csOp == _T( "r" ) )
+		{
+			m_uiRight = _tstol( csValue );
+
+		} else if ( csOp == _T( "a" ) )
+		{
+			m_csAspect = csValue;
+			if ( !m_CropPlan.Prepare( 0, 0, 0, 0, m_csAspect ) )
+			{
+				Usage( fOut );
+				return 5;
+			}
+
+		} else if ( csOp == _T( "--watch" ) )
+		{
+			m_bWatch = true;
+
+		} else if ( csOp == _T( "--scan-threads" ) )
+		{
+			m_nScanThreads = _tstol( csValue );
+
+		} else if ( csOp == _T( "--write-buffer" ) )
+		{
+			m_OutputWriter.MaxPending = ULONGLONG( _tstol( csValue ) ) << 20;
+
+		} else if ( csOp == _T( "--archive" ) && !csValue.IsEmpty() )
+		{
+			m_csArchive = csValue;
+
+		} else if ( csOp == _T( "--archive-size" ) )
+		{
+			m_ullArchiveSize = ULONGLONG( _tstoi64( csValue ) ) << 20;
+
+		} else if ( csOp == _T( "--prefetch" ) )
+		{
+			m_Prefetcher.Depth = _tstol( csValue );
+
+		} else if ( csOp == _T( "--prefetch-budget" ) )
+		{
+			m_Prefetcher.Budget = ULONGLONG( _tstol( csValue ) ) << 20;
+
+		} else if ( csOp == _T( "--large-pages" ) )
+		{
+			m_bLargePages = true;
+
+		} else if ( csOp == _T( "--optimize-jpeg" ) )
+		{
+			m_OutputWriter.OptimizeJpeg = true;
+
+		} else if ( csOp == _T( "--threads" ) )
+		{
+			m_nThreads = _tstol( csValue );
+
+		} else if ( csOp == _T( "--max-memory" ) )
+		{
+			m_Scheduler.MaxMemory = ULONGLONG( _tstol( csValue ) ) << 20;
+
+		} else if 
+		( 
+			csOp == _T( "--order" ) && 
+			( csValue == _T( "largest" ) || csValue == _T( "physical" ) )
+		)
+		{
+			m_csOrder = csValue;
+
+		} else if ( csOp == _T( "--shard" ) )
+		{
+			if ( !m_Shard.Parse( csValue ) )
+			{
+				Usage( fOut );
+				return 5;
+			}
+
+		} else if ( csOp == _T( "--report" ) && !csValue.IsEmpty() )
+		{
+			if ( !m_RunReport.Open( csValue ) )
+			{
+				CString csMessage;
+				csMessage.Format
+				( 
+					_T( "Unable to create report:\n\t%s\n" ), csValue 
+				);
+				fOut.WriteString( csMessage );
+				return 6;
+			}
+
+		} else if ( csOp == _T( "--isolate" ) )
+		{
+			m_nIsolate = _tstol( csValue );
+
+		} else if ( csOp == _T( "--timeout" ) )
+		{
+			m_nTimeout = max( _tstol( csValue ), 1 );
+
+		} else if ( csOp == _T( "grid" ) )
+		{
+			m_Grid.Spacing = UINT( max( _tstol( csValue ), 0L ) );
+
+		} else if ( csOp == _T( "gridcolor" ) )
+		{
+			if ( !m_Grid.ParseColor( csValue ) )
+			{
+				Usage( fOut );
+				return 5;
+			}
+
+		} else if ( csOp == _T( "gridwidth" ) )
+		{
+			m_Grid.Width = UINT( max( _tstol( csValue ), 1L ) );
+
+		} else if ( csOp == _T( "--blank" ) )
+		{
+			m_BlankPage.Threshold = max( _tstof( csValue ), 0.0 );
+
+		} else if ( csOp == _T( "--blank-level" ) )
+		{
+			m_BlankPage.InkLevel = UINT( max( _tstol( csValue ), 0L ) );
+
+		} else if ( csOp == _T( "--blank-folder" ) && !csValue.IsEmpty() )
+		{
+			m_csBlankFolder = csValue;
+
+		} else if ( csOp == _T( "--deskew" ) )
+		{
+			m_Deskew.MaxAngle = csValue.IsEmpty() ? 3.0 : _tstof( csValue );
+
+		} else if ( csOp == _T( "--levels" ) )
+		{
+			m_Levels.Clip = csValue.IsEmpty() ? 0.5 : max( _tstof( csValue ), 0.0 );
 
-			// populate the map of mime types the first time it is 
-			// needed
-			for ( UINT nIndex = 0; nIndex < num; ++nIndex )
+		} else if ( csOp == _T( "--gamma" ) )
+		{
+			m_Levels.Gamma = _tstof( csValue );
+
+		} else if ( csOp == _T( "--chain" ) )
+		{
+			if ( !m_Chain.Parse( csValue ) )
 			{
-				CString csKey;
-				csKey = CW2A( pImageCodecInfo[ nIndex ].MimeType );
-				CLSID classID = pImageCodecInfo[ nIndex ].Clsid;
-				m_mapMimeTypes.add( csKey, new CLSID( classID ) );
+				Usage( fOut );
+				return 5;
 			}
 
-			// clean up
-			free( pImageCodecInfo );
+		} else
+		{
+			Usage( fOut );
+			return 5;
 		}
 
-		ClassID = *m_mapMimeTypes.find( MimeType );
-
-	} else
-	{
-		MimeType = _T( "" );
 	}
-} // CExtension::SetFileExtension
+
+	// the trimming parameters are read once for the whole batch
+	m_CropPlan.Prepare( m_uiTop, m_uiBottom, m_uiLeft, m_uiRight, m_csAspect );
+
+	return 0;
+} // ParseOptions
 
 /////////////////////////////////////////////////////////////////////////////
-// give the user some usage help if the parameters do not look right
-void Usage( CStdioFile& fOut )
+// build the command line of the child processes handling the images when
+// --isolate is given, which pass on the options changing how an image is
+// processed but not those deciding which images are processed or how
+CString GetWorkerCommand( const vector<CString>& arrArgs )
 {
-	fOut.WriteString( _T( ".\n" ) );
-	fOut.WriteString
-	(
-		_T( "TrimImage, Copyright (c) 2024, " )
-		_T( "by W. T. Block.\n" )
-	);
-
-	fOut.WriteString
-	(
-		_T( ".\n" )
-		_T( "A Windows command line program to trim image(s) using\n" )
-		_T( "  the given the number of pixels to be trimmed from\n" )
-		_T( "  each of the sides (top, bottom, left, and right) or\n" )
-		_T( "  to change the aspect ratio (example a=3:2).\n" )
-		_T( ".\n" )
+	TCHAR szModule[ MAX_PATH ];
+	::GetModuleFileName( NULL, szModule, MAX_PATH );
+
+	// the children handle one image at a time and the parent reads them
+	CString value;
+	value.Format
+	( 
+		_T( "\"%s\" --worker --threads=1 --prefetch=0" ), szModule 
 	);
 
-	fOut.WriteString
-	(
-		_T( ".\n" )
-		_T( "Usage:\n" )
-		_T( ".\n" )
-		_T( ".  TrimImage pathname [t=top b=bottom l=left r=right a=aspect]\n" )
-		_T( ".\n" )
-		_T( "Where:\n" )
-		_T( ".\n" )
-	);
+	const size_t nArgs = arrArgs.size();
+	for ( size_t nArg = 2; nArg < nArgs; nArg++ )
+	{
+		CString csArg( arrArgs[ nArg ] );
+		csArg.MakeLower();
 
-	fOut.WriteString
-	(
-		_T( ".  pathname is the root of the tree to be scanned, but\n" )
-		_T( ".  may contain wild cards like the following:\n" )
-		_T( ".    \"c:\\Picture\\DisneyWorldMary2\\*.JPG\"\n" )
-		_T( ".  will process all files with that pattern, or\n" )
-		_T( ".    \"c:\\Picture\\DisneyWorldMary2\\231.JPG\"\n" )
-		_T( ".  will process a single defined image file, or\n" )
-		_T( ".    \"c:\\Picture\\DisneyWorldMary2\\\"\n" )
-		_T( ".  will recurse the folder and its sub-folders.\n" )
-		_T( ".  (NOTE: using wild cards will prevent recursion\n" )
-		_T( ".    into sub-folders because the folders will likely\n" )
-		_T( ".    not fall into the same pattern and therefore\n" )
-		_T( ".    sub-folders will not be found by the search).\n" )
-	);
+		int nStart = 0;
+		const CString csOp = csArg.Tokenize( _T( "=" ), nStart );
+		if
+		(
+			csOp == _T( "t" ) || csOp == _T( "b" ) || csOp == _T( "l" ) ||
+			csOp == _T( "r" ) || csOp == _T( "a" ) || csOp == _T( "--chain" ) ||
+			csOp == _T( "grid" ) || csOp == _T( "gridcolor" ) || 
+			csOp == _T( "gridwidth" ) || csOp == _T( "--blank" ) ||
+			csOp == _T( "--blank-level" ) || csOp == _T( "--blank-folder" ) ||
+			csOp == _T( "--deskew" ) || csOp == _T( "--levels" ) ||
+			csOp == _T( "--gamma" ) ||
+			csOp == _T( "--write-buffer" ) || csOp == _T( "--large-pages" ) ||
+			csOp == _T( "--optimize-jpeg" )
+		)
+		{
+			value += _T( " \"" ) + arrArgs[ nArg ] + _T( "\"" );
+		}
+	}
 
-	fOut.WriteString
-	(
-		_T( ".  all parameters are optional.\n" )
-		_T( ".  top is the number of pixels trimmed from the top.\n" )
-		_T( ".  bottom is the number of pixels trimmed from the bottom.\n" )
-		_T( ".  left is the number of pixels trimmed from the left.\n" )
-		_T( ".  right is the number of pixels trimmed from the right.\n" )
-		_T( ".  aspect is the aspect ratio in the form of 'width:height'\n" )
-		_T( ".\n" )
-		_T( ".Examples: \n" )
-		_T( ".  TrimImage . a=3:2\n" )
-		_T( ".    will force the aspect ratio to become 3:2\n" )
-		_T( ".  TrimImage . t=40 l=5\n" )
-		_T( ".    will trim 40 pixels from the top of the image\n" )
-		_T( ".    and 5 pixels from the left of the image.\n" )
-		_T( ".\n" )
-		_T( ".NOTE: \n" )
-		_T( ".  Trimming parameters can all be set at once, but\n" )
-		_T( ".  changing the aspect ratio should be done alone.\n" )
-		_T( ".  Aspect ratio causes its own trimming changes\n" )
-		_T( ".  and mixing the operations is unpredictable.\n" )
-		_T( ".\n" )
-	);
-} // Usage
+	return value;
+} // GetWorkerCommand
 
 /////////////////////////////////////////////////////////////////////////////
 // a console application that can crawl through the file
@@ -515,13 +2671,21 @@ int _tmain( int argc, TCHAR* argv[], TCHAR* envp[] )
 	vector<CString> arrArgs = CHelper::CorrectedCommandLine( argc, argv );
 	size_t nArgs = arrArgs.size();
 
-	CStdioFile fOut( stdout );
+	// a pathname of a dash reads the image from standard input and writes 
+	// it to standard output, so everything else goes to standard error
+	m_bPipe = nArgs > 1 && arrArgs[ 1 ] == _T( "-" );
+
+	CStdioFile fOut( m_bPipe ? stderr : stdout );
 	CString csMessage;
 
+	// a child process started by --isolate answers its parent on its 
+	// standard output, so it must not write anything else there
+	m_bWorker = nArgs > 1 && arrArgs[ 1 ] == _T( "--worker" );
+
 	// display the number of arguments if not 1 to help the user 
 	// understand what went wrong if there is an error in the
 	// command line syntax
-	if ( nArgs != 1 )
+	if ( nArgs != 1 && !m_bWorker )
 	{
 		fOut.WriteString( _T( ".\n" ) );
 		csMessage.Format( _T( "The number of parameters are %d\n.\n" ), nArgs - 1 );
@@ -535,14 +2699,92 @@ int _tmain( int argc, TCHAR* argv[], TCHAR* envp[] )
 		}
 	}
 
-	// five arguments if specifying year, month, and day
-	// two arguments if using the existing date taken
-	if ( nArgs < 3 || nArgs > 7 )
+	// optimize the JPEG images of a tree written earlier instead of 
+	// processing images, which takes no pathname
+	if ( nArgs > 1 && arrArgs[ 1 ].Left( 16 ).MakeLower() == _T( "--optimize-jpeg=" ) )
+	{
+		const int nError = ParseOptions( arrArgs, fOut );
+		if ( nError != 0 )
+		{
+			return nError;
+		}
+		return OptimizeJpegTree( arrArgs[ 1 ].Mid( 16 ), fOut );
+	}
+
+	// the pathname and at least one option are required, any
+	// unknown options are reported below
+	if ( nArgs < 3 )
 	{
 		Usage( fOut );
 		return 3;
 	}
 
+	// combine the reports of the shards of a tree instead of processing 
+	// images
+	if ( arrArgs[ 1 ].Left( 8 ).MakeLower() == _T( "--merge=" ) )
+	{
+		const vector<CString> arrReports( arrArgs.begin() + 2, arrArgs.end() );
+		return MergeReports( arrArgs[ 1 ].Mid( 8 ), arrReports, fOut );
+	}
+
+	// a child process only needs the options, its files come from the 
+	// pipe and what it logs goes back to the parent with each answer
+	if ( m_bWorker )
+	{
+		const int nError = ParseOptions( arrArgs, fOut );
+		if ( nError != 0 )
+		{
+			return nError;
+		}
+
+		AfxOleInit();
+		::CoInitialize( NULL );
+		InitGdiplus();
+
+		if ( m_bLargePages )
+		{
+			m_PixelPool.EnableLargePages();
+		}
+
+		m_OutputWriter.Start
+		(
+			[ &fOut ]( const CString& csOutput )
+			{
+				fOut.WriteString( csOutput );
+			}
+		);
+
+		const int value = RunWorker( fOut );
+
+		m_OutputWriter.Close();
+		m_PixelPool.Clear();
+		TerminateGdiplus();
+		return value;
+	}
+
+	// one image from standard input to standard output, which only needs
+	// the options
+	if ( m_bPipe )
+	{
+		const int nError = ParseOptions( arrArgs, fOut );
+		if ( nError != 0 )
+		{
+			return nError;
+		}
+
+		if ( m_nIsolate > 0 || !m_csArchive.IsEmpty() || m_bWatch )
+		{
+			fOut.WriteString
+			( 
+				_T( "--isolate, --archive and --watch cannot be used with " )
+				_T( "standard input.\n" ) 
+			);
+			return 5;
+		}
+
+		return RunPipe( fOut );
+	}
+
 	// display the executable path
 	//csMessage.Format( _T( "Executable pathname: %s\n" ), arrArgs[ 0 ] );
 	//fOut.WriteString( _T( ".\n" ) );
@@ -555,12 +2797,19 @@ int _tmain( int argc, TCHAR* argv[], TCHAR* envp[] )
 	// trim off any wild card data
 	const CString csFolder = CHelper::GetFolder( csPath );
 
-	// test for current folder character (a period)
-	bool bExists = csPath == _T( "." );
+	// a pathname running through a tar or zip file reads the images out
+	// of the archive, picked by any wild cards following it
+	CString csArchivePattern;
+	const CString csInputArchive = GetInputArchive( csPath, csArchivePattern );
+	m_bArchiveInput = !csInputArchive.IsEmpty();
+
+	// test for current folder character (a period), an archive has 
+	// already been found to exist
+	bool bExists = csPath == _T( "." ) || m_bArchiveInput;
 
 	// if it is a period, add a wild card of *.* to retrieve
 	// all folders and files
-	if ( bExists )
+	if ( csPath == _T( "." ) )
 	{
 		csPath = _T( ".\\*.*" );
 
@@ -590,61 +2839,57 @@ int _tmain( int argc, TCHAR* argv[], TCHAR* envp[] )
 		fOut.WriteString( csMessage );
 	}
 
-	// initialize the command line parameters to their default values
-	m_uiTop = 0;
-	m_uiBottom = 0;
-	m_uiLeft = 0;
-	m_uiRight = 0;
-
-	// initialize intermediate values
-	m_uiOriginalWidth = 1;
-	m_uiOriginalHeight = 1;
-	m_fHorizontalResolution = 600.0f;
-	m_fVerticalResolution = 600.0f;
-	m_uiNewWidth = 1;
-	m_uiNewHeight = 1;
-	m_uiAspectWidth = 1;
-	m_uiAspectHeight = 1;
+	// shards and reports name the files relative to the root of the tree,
+	// which for an archive is the folder it would be extracted into
+	m_Shard.Root = m_bArchiveInput ?
+		csInputArchive.Left( csInputArchive.GetLength() - 4 ) :
+		CHelper::GetFolder( csPath );
 
-	// parse the command line arguments
-	CString csArg;
-	for ( int nArg = 2; nArg < nArgs; nArg++ )
+	// read the options following the pathname
+	const int nError = ParseOptions( arrArgs, fOut );
+	if ( nError != 0 )
 	{
-		csArg = arrArgs[ nArg ].MakeLower();
-		int nStart = 0;
-		CString csOp, csValue;
-		csOp = csArg.Tokenize( _T( "=" ), nStart );
-		if ( csOp.IsEmpty() )
-		{
-			continue;
-		}
-		csValue = csArg.Tokenize( _T( "=" ), nStart );
-		if ( csOp == _T( "t" ) )
-		{
-			m_uiTop = _tstol( csValue );
-
-		} else if ( csOp == _T( "b" ) )
-		{
-			m_uiBottom = _tstol( csValue );
+		return nError;
+	}
 
-		} else if ( csOp == _T( "l" ) )
-		{
-			m_uiLeft = _tstol( csValue );
+	// the child processes read their own images, so they cannot be 
+	// handed the entries of an archive in memory
+	if ( m_nIsolate > 0 && m_bArchiveInput )
+	{
+		fOut.WriteString( _T( "An input archive cannot be used with --isolate.\n" ) );
+		return 5;
+	}
 
-		} else if ( csOp == _T( "r" ) )
-		{
-			m_uiRight = _tstol( csValue );
+	// nothing lands in an archive while it is being read, so there is 
+	// nothing to watch
+	if ( m_bWatch && m_bArchiveInput )
+	{
+		fOut.WriteString( _T( "An input archive cannot be used with --watch.\n" ) );
+		return 5;
+	}
 
-		} else if ( csOp == _T( "a" ) )
-		{
-			m_csAspect = csValue;
+	// the child processes write their own images, so they cannot share 
+	// the archive
+	if ( m_nIsolate > 0 && !m_csArchive.IsEmpty() )
+	{
+		fOut.WriteString( _T( "--archive cannot be used with --isolate.\n" ) );
+		return 5;
+	}
 
-		} else
-		{
-			Usage( fOut );
-			return 5;
-		}
+	// write the images into one archive (or a few rolling ones) with the
+	// folders of the tree as the names of the entries
+	if ( !m_csArchive.IsEmpty() )
+	{
+		m_OutputWriter.OpenArchive( m_csArchive, m_ullArchiveSize, m_Shard.Root );
+	}
 
+	// each worker thread hands its images to a child process of its own,
+	// which reads the files itself since it cannot see the parent's memory
+	if ( m_nIsolate > 0 )
+	{
+		m_csWorkerCommand = GetWorkerCommand( arrArgs );
+		m_nThreads = m_nIsolate;
+		m_Prefetcher.Depth = 0;
 	}
 
 	// start up COM
@@ -654,9 +2899,165 @@ int _tmain( int argc, TCHAR* argv[], TCHAR* envp[] )
 	// create a reference to GDI+
 	InitGdiplus();
 
+	// allocate the pixel buffers from large pages if the user asked for
+	// them and has the privilege to lock pages in memory
+	if ( m_bLargePages && !m_PixelPool.EnableLargePages() )
+	{
+		fOut.WriteString
+		( 
+			_T( "Large pages are not available, using normal pages.\n" ) 
+		);
+	}
+
+	// start the thread writing the corrected images to disk
+	m_OutputWriter.Start
+	(
+		[ &fOut ]( const CString& csOutput )
+		{
+			fOut.WriteString( csOutput );
+		}
+	);
+
+	if ( m_nThreads > 0 )
+	{
+		m_Scheduler.Threads = m_nThreads;
+	}
+
+	// reading in disk order only pays if the prefetcher stays ahead of 
+	// every worker, otherwise the workers read the files themselves and
+	// the disk is back to seeking between them
+	if ( m_csOrder == _T( "physical" ) && m_Prefetcher.Depth > 0 )
+	{
+		m_Prefetcher.Depth = max( m_Prefetcher.Depth, m_Scheduler.Threads * 4 );
+	}
+
+	// start the thread reading the input files ahead of the decoder
+	m_Prefetcher.Start();
+
+	// start the worker threads, which only need to look a little further
+	// ahead than the prefetcher is reading
+	m_Scheduler.MaxQueued = m_Scheduler.Threads + m_Prefetcher.Depth;
+	m_Scheduler.Start
+	(
+		// process the current file if it is a valid image
+		[ &fOut ]( const CString& csFile )
+		{
+			ProcessJob( csFile, fOut );
+		},
+		EstimateMemory
+	);
+
 	// crawl through directory tree defined by the command line
-	// parameter trolling for supported image files
-	RecursePath( csPath, fOut );
+	// parameter trolling for supported image files, or read them out of
+	// the archive in the order they were stored
+	if ( m_bArchiveInput )
+	{
+		RecurseArchive( csInputArchive, csArchivePattern, fOut );
+
+	} else
+	{
+		RecursePath( csPath );
+	}
+
+	// keep processing files as they land in the tree
+	if ( m_bWatch )
+	{
+		::SetConsoleCtrlHandler( ConsoleHandler, TRUE );
+		WatchPath( csPath, fOut );
+		::SetConsoleCtrlHandler( ConsoleHandler, FALSE );
+	}
+
+	// finish the images in flight and writing the corrected images
+	m_Scheduler.Close();
+	m_OutputWriter.Close();
+	m_Prefetcher.Close();
+
+	// let the user know how well the pixel buffers were reused
+	csMessage.Format
+	(
+		_T( "Pixel buffers: %I64u reused, %I64u allocated, %I64u MB peak\n" ),
+		m_PixelPool.Hits, m_PixelPool.Misses, m_PixelPool.Peak >> 20
+	);
+	fOut.WriteString( csMessage );
+	m_PixelPool.Clear();
+
+	// let the user know where the archives ended up
+	if ( !m_csArchive.IsEmpty() )
+	{
+		csMessage.Format
+		(
+			_T( "Archives: %u written, %I64u MB\n" ),
+			m_OutputWriter.Archives, m_OutputWriter.ArchiveBytes >> 20
+		);
+		fOut.WriteString( csMessage );
+	}
+
+	// let the user know how much smaller the JPEG images were made
+	if ( m_OutputWriter.OptimizeJpeg )
+	{
+		ReportJpegSavings( fOut );
+	}
+
+	// let the user know how many different dimensions the images came
+	// in, which is how many crops had to be worked out
+	const vector<CCropPlan::CROP> arrClasses = m_CropPlan.GetSummary();
+	csMessage.Format( _T( "Dimension classes: %u\n" ), UINT( arrClasses.size() ) );
+	fOut.WriteString( csMessage );
+	const size_t nShown = min( arrClasses.size(), size_t( 10 ) );
+	for ( size_t nClass = 0; nClass < nShown; nClass++ )
+	{
+		const CCropPlan::CROP& crop = arrClasses[ nClass ];
+		csMessage.Format
+		(
+			_T( "    %u x %u (orientation %u): %I64u images trimmed to %u x %u\n" ),
+			crop.m_uiOriginalWidth, crop.m_uiOriginalHeight, crop.m_uiOrientation,
+			crop.m_ullImages, crop.m_uiNewWidth, crop.m_uiNewHeight
+		);
+		fOut.WriteString( csMessage );
+	}
+
+	// let the user know how many blank pages were left out
+	if ( m_BlankPage.IsEnabled )
+	{
+		csMessage.Format
+		(
+			_T( "Blank pages: %I64u\n" ), m_ullBlankPages.load()
+		);
+		fOut.WriteString( csMessage );
+	}
+
+	// let the user know how many child processes were lost to bad files
+	if ( m_nIsolate > 0 )
+	{
+		csMessage.Format
+		(
+			_T( "Workers: %I64u killed or crashed\n" ), 
+			m_ullWorkersLost.load()
+		);
+		fOut.WriteString( csMessage );
+	}
+
+	// let the user know how often the memory budget held images back
+	csMessage.Format
+	(
+		_T( "Images: %I64u processed, %I64u waited for memory, " )
+		_T( "%I64u MB peak estimate\n" ),
+		m_Scheduler.Jobs, m_Scheduler.Delayed, m_Scheduler.Peak >> 20
+	);
+	fOut.WriteString( csMessage );
+
+	// let the user know how the predicted costs turned into time, which
+	// is what the report is for
+	if ( m_RunReport.IsOpen )
+	{
+		csMessage.Format
+		(
+			_T( "Report: %I64u images, %.3f milliseconds per megapixel\n" ),
+			m_RunReport.Count, m_RunReport.Rate * 1000000.0
+		);
+		fOut.WriteString( csMessage );
+		m_RunReport.Close();
+	}
 
 	// clean up references to GDI+
 	TerminateGdiplus();
@@ -4,10 +4,35 @@
 #pragma once
 
 #include "resource.h"
-#include "KeyedCollection.h"
+#include "FlatMap.h"
+#include "WatchFolder.h"
+#include "DirectoryWalker.h"
+#include "OutputWriter.h"
+#include "Prefetcher.h"
+#include "MappedFile.h"
+#include "MemoryStream.h"
+#include "PixelBufferPool.h"
+#include "ImageHeader.h"
+#include "JobScheduler.h"
+#include "RunReport.h"
+#include "FileLocation.h"
+#include "Shard.h"
+#include "WorkerProcess.h"
+#include "GifMuxer.h"
+#include "ImageChain.h"
+#include "GridOverlay.h"
+#include "BlankPage.h"
+#include "Deskew.h"
+#include "AutoLevels.h"
+#include "CropPlan.h"
+#include "ArchiveReader.h"
 #include <vector>
+#include <deque>
 #include <map>
 #include <memory>
+#include <atomic>
+#include <thread>
+#include <algorithm>
 #include <gdiplus.h>
 #pragma comment(lib, "gdiplus.lib")
 
@@ -46,11 +71,8 @@ protected:
 	// current class ID
 	CLSID m_ClassID;
 
-	// cross reference of file extensions to mime types
-	CKeyedCollection<CString, CString> m_mapExtensions;
-
 	// cross reference of mime types to class IDs
-	CKeyedCollection<CString, CLSID> m_mapMimeTypes;
+	CFlatMap<CString, CLSID> m_mapMimeTypes;
 
 	// public properties
 public:
@@ -60,7 +82,7 @@ public:
 		return m_csFileExtension;
 	}
 	// current file extension
-	void SetFileExtension( CString value );
+	void SetFileExtension( const CString& value );
 	// current file extension
 	__declspec( property( get = GetFileExtension, put = SetFileExtension ) )
 		CString FileExtension;
@@ -98,19 +120,20 @@ public:
 
 	// protected methods
 protected:
+	// cross reference of file extensions to mime types, which is built
+	// once and frozen so every worker thread's instance reads the same
+	// table without a lock
+	static const CFlatMap<CString, CString>& GetExtensions()
+	{
+		static const CFlatMap<CString, CString>& value = BuildExtensions();
+		return value;
+	}
 
-	// public virtual methods
-public:
-
-	// protected virtual methods
-protected:
-
-	// public construction
-public:
-	CExtension()
+	// build the cross reference of file extensions to mime types
+	static const CFlatMap<CString, CString>& BuildExtensions()
 	{
 		// extension conversion table
-		static EXTENSION_LOOKUP ExtensionLookup[] =
+		static const EXTENSION_LOOKUP ExtensionLookup[] =
 		{
 			{ _T( ".bmp" ), _T( "image/bmp" ) },
 			{ _T( ".dib" ), _T( "image/bmp" ) },
@@ -125,22 +148,32 @@ public:
 			{ _T( ".tif" ), _T( "image/tiff" ) }
 		};
 
-		// build a cross reference of file extensions to 
-		// mime types
+		static CFlatMap<CString, CString> mapExtensions;
 		const int nPairs = _countof( ExtensionLookup );
+		mapExtensions.reserve( nPairs );
 		for ( int nPair = 0; nPair < nPairs; nPair++ )
 		{
-			const CString csKey =
-				ExtensionLookup[ nPair ].m_csFileExtension;
-
-			CString* pValue = new CString
+			mapExtensions.add
 			(
+				ExtensionLookup[ nPair ].m_csFileExtension,
 				ExtensionLookup[ nPair ].m_csMimeType
 			);
-
-			// add the pair to the collection
-			m_mapExtensions.add( csKey, pValue );
 		}
+		mapExtensions.freeze();
+		return mapExtensions;
+	}
+
+	// public virtual methods
+public:
+
+	// protected virtual methods
+protected:
+
+	// public construction
+public:
+	CExtension()
+	{
+		m_ClassID = CLSID_NULL;
 	}
 };
 
@@ -150,184 +183,276 @@ ULONG_PTR m_gdiplusToken;
 
 /////////////////////////////////////////////////////////////////////////////
 // this class creates a fast look up of the mime type and class ID as 
-// defined by GDI+ for common file extensions
-CExtension m_Extension;
+// defined by GDI+ for common file extensions (one per worker thread since
+// setting the extension changes its state)
+thread_local CExtension m_Extension;
 
 /////////////////////////////////////////////////////////////////////////////
-// pixels to trim from the top command line parameter
-UINT m_uiTop;
+// writes the encoded images to disk on a separate thread
+COutputWriter m_OutputWriter;
 
 /////////////////////////////////////////////////////////////////////////////
-// pixels to trim from the bottom command line parameter
-UINT m_uiBottom;
+// reads the upcoming input files into memory ahead of the decoder
+CPrefetcher m_Prefetcher;
 
 /////////////////////////////////////////////////////////////////////////////
-// pixels to trim from the left command line parameter
-UINT m_uiLeft;
+// pixel buffers reused from one image to the next
+CPixelBufferPool m_PixelPool;
 
 /////////////////////////////////////////////////////////////////////////////
-// pixels to trim from the right command line parameter
-UINT m_uiRight;
+// runs the images on several worker threads within a memory budget
+CJobScheduler m_Scheduler;
 
 /////////////////////////////////////////////////////////////////////////////
-// aspect ratio command line parameter
-CString m_csAspect;
+// number of images processed at once command line parameter
+// zero uses the default of one image per processor
+int m_nThreads;
 
 /////////////////////////////////////////////////////////////////////////////
-// aspect width command line parameter in the form of width:height
-UINT m_uiAspectWidth;
+// order the files are processed in command line parameter, empty for the
+// order they are found in, "largest" for the largest images first or 
+// "physical" for the order the files lie on the disk
+CString m_csOrder;
 
 /////////////////////////////////////////////////////////////////////////////
-// aspect height command line parameter in the form of width:height
-UINT m_uiAspectHeight;
+// predicted and actual cost of every image when the --report command 
+// line parameter is given
+CRunReport m_RunReport;
 
 /////////////////////////////////////////////////////////////////////////////
-// get the width of the image
-UINT m_uiOriginalWidth;
+// the part of the tree processed by this process when the --shard command
+// line parameter splits the tree between several processes
+CShard m_Shard;
 
 /////////////////////////////////////////////////////////////////////////////
-// get the height of the image
-UINT m_uiOriginalHeight;
+// number of child processes the images are handed to command line 
+// parameter, zero processes the images in this process
+int m_nIsolate;
 
 /////////////////////////////////////////////////////////////////////////////
-// get the horizontal resolution of the image
-float m_fHorizontalResolution;
+// tar file the corrected images are written into instead of the Corrected
+// folders command line parameter (empty writes files)
+CString m_csArchive;
 
 /////////////////////////////////////////////////////////////////////////////
-// get the vertical resolution of the image
-float m_fVerticalResolution;
+// largest an archive may grow before a new one is started command line 
+// parameter (zero is no limit)
+ULONGLONG m_ullArchiveSize;
 
 /////////////////////////////////////////////////////////////////////////////
-// calculate the new width
-UINT m_uiNewWidth;
+// the images are read out of a tar or zip archive given as the pathname
+// instead of from the folders of a tree
+bool m_bArchiveInput;
 
 /////////////////////////////////////////////////////////////////////////////
-// calculate the new height
-UINT m_uiNewHeight;
+// seconds a child process is given for an image before it is killed 
+// command line parameter
+int m_nTimeout;
 
 /////////////////////////////////////////////////////////////////////////////
-// calculate the aspect ratio given a width and height
-// a value of zero indicates a failure
-static inline float GetAspectRatio( UINT uiWidth, UINT uiHeight )
-{
-	float value = 0.0f;
-	if ( uiHeight == 0 )
-	{
-		return value;
-	}
-	value = float( uiWidth ) / float( uiHeight );
-	return value;
-}
+// this process is a child handling images for its parent
+bool m_bWorker;
 
 /////////////////////////////////////////////////////////////////////////////
-// original image aspect ratio
-// a value of zero indicates a failure
-inline float GetOriginalAspectRatio()
-{
-	return GetAspectRatio( m_uiOriginalWidth, m_uiOriginalHeight );
-}
+// the image is read from standard input and written to standard output
+// command line parameter (a pathname of a dash)
+bool m_bPipe;
 
 /////////////////////////////////////////////////////////////////////////////
-// new image aspect ratio
-// a value of zero indicates a failure
-inline float GetNewAspectRatio()
-{
-	return GetAspectRatio( m_uiNewWidth, m_uiNewHeight );
-}
+// command line starting a child process with the options of this one
+CString m_csWorkerCommand;
 
 /////////////////////////////////////////////////////////////////////////////
-// is the new image landscape mode (width larger than height)
-inline bool GetLandscapeMode()
-{
-	bool value = m_uiOriginalWidth > m_uiOriginalHeight;
-	return value;
-}
+// number of child processes killed because they hung or crashed
+atomic<ULONGLONG> m_ullWorkersLost;
+
+/////////////////////////////////////////////////////////////////////////////
+// the child process used by each worker thread when m_nIsolate is set
+thread_local CWorkerProcess m_WorkerProcess;
 
 /////////////////////////////////////////////////////////////////////////////
-// did the user request an aspect change
-inline bool GetProcessAspect()
+// a file and the key used to order the work, which is the predicted cost
+// or the place of the file on the disk
+typedef struct tagOrderedFile
 {
-	const bool value = !m_csAspect.IsEmpty();
-	return value;
-}
+	// path of the file
+	CString m_csPath;
+
+	// the key the files are sorted by
+	ULONGLONG m_ullKey;
+
+} ORDERED_FILE;
 
 /////////////////////////////////////////////////////////////////////////////
-// new image aspect ratio 
-// a value of zero indicates a failure
-inline float GetRequestedAspectRatio()
+// a page or frame of a multi-frame image after it has been trimmed
+typedef struct tagTrimmedFrame
 {
-	float value = 0.0f;
-	if ( GetProcessAspect() )
-	{
-		int nStart = 0;
-		const CString csWidth = m_csAspect.Tokenize( _T( ":" ), nStart );
-		if ( csWidth.IsEmpty() )
-		{
-			return value;
-		}
-		const CString csHeight = m_csAspect.Tokenize( _T( ":" ), nStart );
-		if ( csHeight.IsEmpty() )
-		{
-			return value;
-		}
+	// the trimmed pixels, which come from the pool
+	unique_ptr<CPixelBuffer> m_pPixels;
 
-		const bool bLandscape = GetLandscapeMode();
+	// trimmed dimensions in pixels
+	UINT m_uiWidth;
+	UINT m_uiHeight;
 
-		const UINT uiWidth = _tstol( csWidth );
-		const UINT uiHeight = _tstol( csHeight );
+	// number of bytes in each row of pixels
+	INT m_nStride;
 
-		// 3:2 remain 3:2 in landscape mode
-		if ( bLandscape )
-		{
-			m_uiAspectWidth = max( uiWidth, uiHeight );
-			m_uiAspectHeight = min( uiWidth, uiHeight );
+	// format of the pixels
+	Gdiplus::PixelFormat m_format;
 
-		} else // 3:2 becomes 2:3 in portrait mode
-		{
-			m_uiAspectWidth = min( uiWidth, uiHeight );
-			m_uiAspectHeight = max( uiWidth, uiHeight );
-		}
+	// the ColorPalette of indexed pixels (empty otherwise)
+	vector<BYTE> m_arrPalette;
 
-		// calculate the aspect ratio from the command line parameters
-		value = GetAspectRatio
-		(
-			m_uiAspectWidth,
-			m_uiAspectHeight
-		);
-	}
-	return value;
-}
+	// resolution in dots per inch
+	float m_fHorizontalResolution;
+	float m_fVerticalResolution;
+
+	// the frame encoded on its own (animations only)
+	CComPtr<IStream> m_pEncoded;
+
+} TRIMMED_FRAME;
 
 /////////////////////////////////////////////////////////////////////////////
-// the new folder under the image folder to contain the corrected images
-static inline CString GetCorrectedFolder()
-{
-	return _T( "Corrected" );
-}
+// allocate the pixel buffers from large pages command line parameter
+bool m_bLargePages;
 
 /////////////////////////////////////////////////////////////////////////////
-// the new folder under the image folder to contain the corrected images
-static inline int GetCorrectedFolderLength()
+// watch the folder tree for new files after the initial scan command line 
+// parameter
+bool m_bWatch;
+
+/////////////////////////////////////////////////////////////////////////////
+// watches the folder tree for files dropped into it when m_bWatch is set
+CWatchFolder m_WatchFolder;
+
+/////////////////////////////////////////////////////////////////////////////
+// the files handed to the workers while watching with the time each was
+// last written, so the rescan after the notifications overflowed skips 
+// them even when their output leaves nothing beside them (an archive or
+// a blank page), only used by the thread searching and watching the tree
+map<CString, ULONGLONG> m_mapHandedOver;
+
+/////////////////////////////////////////////////////////////////////////////
+// number of threads searching the folder tree command line parameter
+// zero uses the default of one thread per processor (at least 4)
+int m_nScanThreads;
+
+/////////////////////////////////////////////////////////////////////////////
+// NOTE: the values below (except the aspect ratio) are changed while an 
+// image is processed, so every worker thread has its own copy. The 
+// margins are read from the command line on the main thread and handed 
+// to the crop plan, which sets each worker's copy for every image
+/////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////////////////////
+// pixels to trim from the top command line parameter
+thread_local UINT m_uiTop;
+
+/////////////////////////////////////////////////////////////////////////////
+// pixels to trim from the bottom command line parameter
+thread_local UINT m_uiBottom;
+
+/////////////////////////////////////////////////////////////////////////////
+// pixels to trim from the left command line parameter
+thread_local UINT m_uiLeft;
+
+/////////////////////////////////////////////////////////////////////////////
+// pixels to trim from the right command line parameter
+thread_local UINT m_uiRight;
+
+/////////////////////////////////////////////////////////////////////////////
+// aspect ratio command line parameter (shared by the worker threads, 
+// which only read it)
+CString m_csAspect;
+
+/////////////////////////////////////////////////////////////////////////////
+// operations applied to the trimmed image from the --chain command line
+// parameter (shared by the worker threads, which only read it)
+CImageChain m_Chain;
+
+/////////////////////////////////////////////////////////////////////////////
+// the calibration grid drawn when there is nothing to trim, from the grid, 
+// gridcolor and gridwidth command line parameters (shared by the worker 
+// threads, which only read it)
+CGridOverlay m_Grid;
+
+/////////////////////////////////////////////////////////////////////////////
+// the settings of the blank page detection from the --blank and 
+// --blank-level command line parameters (shared by the worker threads, 
+// which test the pages with copies of it)
+CBlankPage m_BlankPage;
+
+/////////////////////////////////////////////////////////////////////////////
+// folder below the image folder blank pages are saved to from the 
+// --blank-folder command line parameter, blank pages are not saved at all
+// when it is empty
+CString m_csBlankFolder;
+
+/////////////////////////////////////////////////////////////////////////////
+// number of blank pages found
+atomic<ULONGLONG> m_ullBlankPages;
+
+/////////////////////////////////////////////////////////////////////////////
+// the settings of the deskew from the --deskew command line parameter 
+// (shared by the worker threads, which only read it)
+CDeskew m_Deskew;
+
+/////////////////////////////////////////////////////////////////////////////
+// the settings of the levels normalization from the --levels and --gamma
+// command line parameters (shared by the worker threads, which only read
+// it)
+CAutoLevels m_Levels;
+
+/////////////////////////////////////////////////////////////////////////////
+// the margins and aspect ratio read once from the command line and the 
+// crops worked out for each class of image dimensions (shared by the 
+// worker threads)
+CCropPlan m_CropPlan;
+
+/////////////////////////////////////////////////////////////////////////////
+// get the width of the image
+thread_local UINT m_uiOriginalWidth;
+
+/////////////////////////////////////////////////////////////////////////////
+// get the height of the image
+thread_local UINT m_uiOriginalHeight;
+
+/////////////////////////////////////////////////////////////////////////////
+// get the horizontal resolution of the image
+thread_local float m_fHorizontalResolution;
+
+/////////////////////////////////////////////////////////////////////////////
+// get the vertical resolution of the image
+thread_local float m_fVerticalResolution;
+
+/////////////////////////////////////////////////////////////////////////////
+// calculate the new width
+thread_local UINT m_uiNewWidth;
+
+/////////////////////////////////////////////////////////////////////////////
+// calculate the new height
+thread_local UINT m_uiNewHeight;
+
+/////////////////////////////////////////////////////////////////////////////
+// EXIF orientation of the image (1 when it is displayed as stored)
+thread_local UINT m_uiOrientation;
+
+/////////////////////////////////////////////////////////////////////////////
+// number of bytes in a row of an image (32 bits per pixel by default)
+// padded to a multiple of 64 bytes so every row starts on a cache line
+static inline INT GetStride( UINT uiWidth, UINT uiBitsPerPixel = 32 )
 {
-	const CString csFolder = GetCorrectedFolder();
-	const int value = csFolder.GetLength();
+	const UINT uiBytes = ( uiWidth * uiBitsPerPixel + 7 ) / 8;
+	const INT value = INT( ( uiBytes + 63 ) & ~63u );
 	return value;
 }
 
 /////////////////////////////////////////////////////////////////////////////
-// This function creates a file system folder whose fully qualified 
-// path is given by pszPath. If one or more of the intermediate 
-// folders do not exist, they will be created as well. 
-// returns true if the path is created or already exists
-bool CreatePath( LPCTSTR pszPath )
+// the new folder under the image folder to contain the corrected images
+static inline CString GetCorrectedFolder()
 {
-	if ( ERROR_SUCCESS == SHCreateDirectoryEx( NULL, pszPath, NULL ) )
-	{
-		return true;
-	}
-
-	return false;
-} // CreatePath
+	return _T( "Corrected" );
+}
 
 /////////////////////////////////////////////////////////////////////////////
 // initialize GDI+
@@ -0,0 +1,533 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+#include <map>
+#include <vector>
+#include <functional>
+#include <shlwapi.h>
+#pragma comment(lib, "shlwapi.lib")
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// this class watches a folder tree for image files being dropped into it
+// (for instance by a network scanner) and hands each file to a callback
+// once the file has been closed by its writer and its size has stopped
+// changing. A file that never settles (it stays empty or keeps changing)
+// is given up on after a while so it is not polled forever
+class CWatchFolder
+{
+// public definitions
+public:
+	// callback receiving the pathname of a file ready to be processed, or
+	// given up on because it never settled
+	typedef function<void( const CString& )> FILE_CALLBACK;
+
+	// callback receiving the pathname of a folder that needs to be
+	// scanned because its content was not reported by the notifications,
+	// which is the watched folder itself when the notifications overflowed
+	typedef function<void( const CString& )> FOLDER_CALLBACK;
+
+// protected definitions
+protected:
+	// a file that has been reported as changed but is not ready yet
+	typedef struct tagPendingFile
+	{
+		// size of the file the last time it was checked
+		ULONGLONG m_ullSize;
+
+		// tick count of the last change to the file
+		ULONGLONG m_ullLastChange;
+
+		// tick count of the first change to the file
+		ULONGLONG m_ullFirstChange;
+
+	} PENDING_FILE;
+
+	// map of pathnames to pending files
+	typedef map<CString, PENDING_FILE> MAP_PENDING;
+
+// protected data
+protected:
+	// the root folder being watched
+	CString m_csFolder;
+
+	// wild card pattern the data names have to match
+	CString m_csPattern;
+
+	// name of the output folders which are never watched
+	CString m_csCorrected;
+
+	// name of the folders blank pages are saved to, which are never
+	// watched (empty watches every folder)
+	CString m_csBlank;
+
+	// milliseconds a file has to be quiet before it is processed
+	DWORD m_dwSettle;
+
+	// milliseconds a file may stay unsettled before it is given up on
+	DWORD m_dwGiveUp;
+
+	// event signaled to stop watching
+	HANDLE m_hStop;
+
+	// files that have changed but are not ready to be processed
+	MAP_PENDING m_mapPending;
+
+// public properties
+public:
+	// the root folder being watched
+	inline CString GetFolder()
+	{
+		return m_csFolder;
+	}
+	// the root folder being watched
+	inline void SetFolder( CString value )
+	{
+		m_csFolder = value;
+		m_csFolder.TrimRight( _T( "\\" ) );
+	}
+	// the root folder being watched
+	__declspec( property( get = GetFolder, put = SetFolder ) )
+		CString Folder;
+
+	// wild card pattern the data names have to match
+	inline CString GetPattern()
+	{
+		return m_csPattern;
+	}
+	// wild card pattern the data names have to match
+	inline void SetPattern( CString value )
+	{
+		m_csPattern = value;
+	}
+	// wild card pattern the data names have to match
+	__declspec( property( get = GetPattern, put = SetPattern ) )
+		CString Pattern;
+
+	// name of the output folders which are never watched
+	inline CString GetCorrected()
+	{
+		return m_csCorrected;
+	}
+	// name of the output folders which are never watched
+	inline void SetCorrected( CString value )
+	{
+		m_csCorrected = value;
+	}
+	// name of the output folders which are never watched
+	__declspec( property( get = GetCorrected, put = SetCorrected ) )
+		CString Corrected;
+
+	// name of the folders blank pages are saved to, which are never
+	// watched (empty watches every folder)
+	inline CString GetBlank()
+	{
+		return m_csBlank;
+	}
+	// name of the folders blank pages are saved to
+	inline void SetBlank( CString value )
+	{
+		m_csBlank = value;
+	}
+	// name of the folders blank pages are saved to
+	__declspec( property( get = GetBlank, put = SetBlank ) )
+		CString Blank;
+
+	// milliseconds a file has to be quiet before it is processed
+	inline DWORD GetSettle()
+	{
+		return m_dwSettle;
+	}
+	// milliseconds a file has to be quiet before it is processed
+	inline void SetSettle( DWORD value )
+	{
+		m_dwSettle = value;
+	}
+	// milliseconds a file has to be quiet before it is processed
+	__declspec( property( get = GetSettle, put = SetSettle ) )
+		DWORD Settle;
+
+	// milliseconds a file may stay unsettled before it is given up on
+	inline DWORD GetGiveUp()
+	{
+		return m_dwGiveUp;
+	}
+	// milliseconds a file may stay unsettled before it is given up on
+	inline void SetGiveUp( DWORD value )
+	{
+		m_dwGiveUp = value;
+	}
+	// milliseconds a file may stay unsettled before it is given up on
+	__declspec( property( get = GetGiveUp, put = SetGiveUp ) )
+		DWORD GiveUp;
+
+// protected methods
+protected:
+	// test a path relative to the watched folder against the same rules
+	// used when crawling the tree, i.e. every folder must match the
+	// pattern and must not be a corrected or blank page folder, and the
+	// data name must match the pattern
+	bool IsIncluded( const CString& csRelative, bool bFolder )
+	{
+		const int nCorrected = m_csCorrected.GetLength();
+
+		int nStart = 0;
+		CString csToken = csRelative.Tokenize( _T( "\\" ), nStart );
+		while ( !csToken.IsEmpty() )
+		{
+			// the last token is the data name unless this is a folder
+			const bool bLast = nStart >= csRelative.GetLength();
+			if ( bFolder || !bLast )
+			{
+				// never look inside the folders we are writing to
+				if ( csToken.Right( nCorrected ) == m_csCorrected )
+				{
+					return false;
+				}
+
+				// nor inside the folders blank pages are saved to
+				if
+				(
+					!m_csBlank.IsEmpty() &&
+					0 == m_csBlank.CompareNoCase( csToken )
+				)
+				{
+					return false;
+				}
+			}
+
+			if ( !::PathMatchSpec( csToken, m_csPattern ) )
+			{
+				return false;
+			}
+
+			csToken = csRelative.Tokenize( _T( "\\" ), nStart );
+		}
+
+		return true;
+	}
+
+	// record a change to the given file so it is checked again after it
+	// has settled
+	void Touch( const CString& csPath )
+	{
+		const ULONGLONG ullNow = ::GetTickCount64();
+		const bool bNew = m_mapPending.find( csPath ) == m_mapPending.end();
+		PENDING_FILE& pending = m_mapPending[ csPath ];
+		if ( bNew )
+		{
+			pending.m_ullFirstChange = ullNow;
+		}
+
+		// an unknown size forces at least one more size comparison
+		pending.m_ullSize = ULLONG_MAX;
+		pending.m_ullLastChange = ullNow;
+	}
+
+	// walk the notification records returned by ReadDirectoryChangesW
+	void HandleNotifications
+	(
+		const BYTE* pBuffer, FOLDER_CALLBACK onFolder
+	)
+	{
+		const FILE_NOTIFY_INFORMATION* pInfo =
+			(const FILE_NOTIFY_INFORMATION*)pBuffer;
+
+		do
+		{
+			// the file name is not null terminated
+			const CString csRelative
+			(
+				pInfo->FileName,
+				int( pInfo->FileNameLength / sizeof( WCHAR ) )
+			);
+			const CString csPath = m_csFolder + _T( "\\" ) + csRelative;
+
+			switch ( pInfo->Action )
+			{
+				case FILE_ACTION_ADDED:
+				case FILE_ACTION_MODIFIED:
+				case FILE_ACTION_RENAMED_NEW_NAME:
+				{
+					const DWORD dwAttributes =
+						::GetFileAttributes( csPath );
+					if ( dwAttributes == INVALID_FILE_ATTRIBUTES )
+					{
+						break;
+					}
+
+					// a folder moved into the tree does not report the
+					// files inside of it, so let the caller scan it
+					if ( dwAttributes & FILE_ATTRIBUTE_DIRECTORY )
+					{
+						if
+						(
+							pInfo->Action != FILE_ACTION_MODIFIED &&
+							IsIncluded( csRelative, true )
+						)
+						{
+							onFolder( csPath );
+						}
+						break;
+					}
+
+					if ( IsIncluded( csRelative, false ) )
+					{
+						Touch( csPath );
+					}
+					break;
+				}
+				case FILE_ACTION_REMOVED:
+				case FILE_ACTION_RENAMED_OLD_NAME:
+				{
+					m_mapPending.erase( csPath );
+					break;
+				}
+			}
+
+			if ( pInfo->NextEntryOffset == 0 )
+			{
+				break;
+			}
+
+			pInfo = (const FILE_NOTIFY_INFORMATION*)
+				( (const BYTE*)pInfo + pInfo->NextEntryOffset );
+
+		} while ( true );
+	}
+
+	// hand every pending file that is no longer being written to onFile
+	// and every one that has not settled for too long to onGiveUp
+	void CheckPending( FILE_CALLBACK onFile, FILE_CALLBACK onGiveUp )
+	{
+		const ULONGLONG ullNow = ::GetTickCount64();
+
+		// collect the ready files first because the callback can take a
+		// while and more notifications may be queued in the meantime
+		vector<CString> arrReady;
+		vector<CString> arrGivenUp;
+
+		MAP_PENDING::iterator pos = m_mapPending.begin();
+		while ( pos != m_mapPending.end() )
+		{
+			PENDING_FILE& pending = pos->second;
+
+			// a file that stays empty or never stops changing would keep
+			// the watcher polling for good
+			if ( ullNow - pending.m_ullFirstChange >= m_dwGiveUp )
+			{
+				arrGivenUp.push_back( pos->first );
+				pos = m_mapPending.erase( pos );
+				continue;
+			}
+
+			if ( ullNow - pending.m_ullLastChange < m_dwSettle )
+			{
+				++pos;
+				continue;
+			}
+
+			// opening the file without sharing write access fails while
+			// the scanner still has the file open for writing
+			HANDLE hFile = ::CreateFile
+			(
+				pos->first, GENERIC_READ, FILE_SHARE_READ, NULL,
+				OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL
+			);
+			if ( hFile == INVALID_HANDLE_VALUE )
+			{
+				const DWORD dwError = ::GetLastError();
+				if
+				(
+					dwError == ERROR_SHARING_VIOLATION ||
+					dwError == ERROR_LOCK_VIOLATION
+				)
+				{
+					pending.m_ullLastChange = ullNow;
+					++pos;
+
+				} else // the file is gone
+				{
+					pos = m_mapPending.erase( pos );
+				}
+				continue;
+			}
+
+			LARGE_INTEGER size;
+			const BOOL bSize = ::GetFileSizeEx( hFile, &size );
+			::CloseHandle( hFile );
+
+			// some writers close and reopen the file between pages, so
+			// the size must also hold still for one settle period
+			const ULONGLONG ullSize =
+				bSize ? ULONGLONG( size.QuadPart ) : ULLONG_MAX;
+			if ( ullSize != pending.m_ullSize || ullSize == 0 )
+			{
+				pending.m_ullSize = ullSize;
+				pending.m_ullLastChange = ullNow;
+				++pos;
+				continue;
+			}
+
+			arrReady.push_back( pos->first );
+			pos = m_mapPending.erase( pos );
+		}
+
+		for ( const CString& csPath : arrReady )
+		{
+			onFile( csPath );
+		}
+		for ( const CString& csPath : arrGivenUp )
+		{
+			onGiveUp( csPath );
+		}
+	}
+
+// public methods
+public:
+	// watch the folder tree until Stop is called, passing each file that
+	// has landed to onFile, each folder needing a scan to onFolder and 
+	// each file that never settled to onGiveUp
+	// returns false if the folder could not be watched
+	bool Watch
+	( 
+		FILE_CALLBACK onFile, FOLDER_CALLBACK onFolder, 
+		FILE_CALLBACK onGiveUp 
+	)
+	{
+		HANDLE hFolder = ::CreateFile
+		(
+			m_csFolder, FILE_LIST_DIRECTORY,
+			FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			NULL, OPEN_EXISTING,
+			FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL
+		);
+		if ( hFolder == INVALID_HANDLE_VALUE )
+		{
+			return false;
+		}
+
+		OVERLAPPED overlapped = { 0 };
+		overlapped.hEvent = ::CreateEvent( NULL, TRUE, FALSE, NULL );
+
+		// network shares will not return more than 64K at a time
+		vector<BYTE> arrBuffer( 64 * 1024 );
+
+		const DWORD dwFilter =
+			FILE_NOTIFY_CHANGE_FILE_NAME |
+			FILE_NOTIFY_CHANGE_DIR_NAME |
+			FILE_NOTIFY_CHANGE_SIZE |
+			FILE_NOTIFY_CHANGE_LAST_WRITE;
+
+		bool value = true;
+		bool bReading = false;
+		do
+		{
+			if ( !bReading )
+			{
+				::ResetEvent( overlapped.hEvent );
+				if
+				(
+					!::ReadDirectoryChangesW
+					(
+						hFolder, &arrBuffer[ 0 ], (DWORD)arrBuffer.size(),
+						TRUE, dwFilter, NULL, &overlapped, NULL
+					)
+				)
+				{
+					value = false;
+					break;
+				}
+				bReading = true;
+			}
+
+			// wake up periodically while files are still being written
+			const DWORD dwTimeout =
+				m_mapPending.empty() ? INFINITE : max( m_dwSettle / 2, 50ul );
+
+			HANDLE arrHandles[] = { overlapped.hEvent, m_hStop };
+			const DWORD dwWait = ::WaitForMultipleObjects
+			(
+				_countof( arrHandles ), arrHandles, FALSE, dwTimeout
+			);
+
+			if ( dwWait == WAIT_OBJECT_0 + 1 )
+			{
+				break;
+			}
+
+			if ( dwWait == WAIT_OBJECT_0 )
+			{
+				bReading = false;
+
+				DWORD dwBytes = 0;
+				if
+				(
+					!::GetOverlappedResult
+					(
+						hFolder, &overlapped, &dwBytes, FALSE
+					)
+				)
+				{
+					value = false;
+					break;
+				}
+
+				// zero bytes means the notifications overflowed the
+				// buffer and the whole tree has to be scanned again
+				if ( dwBytes == 0 )
+				{
+					onFolder( m_csFolder );
+
+				} else
+				{
+					HandleNotifications( &arrBuffer[ 0 ], onFolder );
+				}
+			}
+
+			CheckPending( onFile, onGiveUp );
+
+		} while ( true );
+
+		// cancel the outstanding read before the buffer goes away
+		if ( bReading )
+		{
+			DWORD dwBytes = 0;
+			::CancelIo( hFolder );
+			::GetOverlappedResult( hFolder, &overlapped, &dwBytes, TRUE );
+		}
+
+		::CloseHandle( overlapped.hEvent );
+		::CloseHandle( hFolder );
+		::ResetEvent( m_hStop );
+		m_mapPending.clear();
+
+		return value;
+	}
+
+	// stop watching (safe to call from another thread)
+	void Stop()
+	{
+		::SetEvent( m_hStop );
+	}
+
+// public construction / destruction
+public:
+	// constructor
+	CWatchFolder()
+	{
+		m_csPattern = _T( "*.*" );
+		m_csCorrected = _T( "Corrected" );
+		m_dwSettle = 500;
+		m_dwGiveUp = 10 * 60 * 1000;
+		m_hStop = ::CreateEvent( NULL, TRUE, FALSE, NULL );
+	}
+	// destructor
+	virtual ~CWatchFolder()
+	{
+		::CloseHandle( m_hStop );
+	}
+};
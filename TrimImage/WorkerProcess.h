@@ -0,0 +1,362 @@
+/////////////////////////////////////////////////////////////////////////////
+// Copyright  by W. T. Block, all rights reserved
+/////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "stdafx.h"
+#include <mutex>
+
+using namespace std;
+
+/////////////////////////////////////////////////////////////////////////////
+// this class runs images through a child process so a file that hangs or
+// crashes the decoder only takes the child down with it. Paths are sent
+// to the child's standard input one per line (UTF-8), and the child
+// answers on a pipe with the lines it would have logged followed by a
+// line holding the result. A child that does not answer within the
+// timeout is killed, as is one that dies, and a new child is started for
+// the next file
+class CWorkerProcess
+{
+// public definitions
+public:
+	// how a file sent to the child turned out
+	typedef enum
+	{
+		WORKER_OK,
+		WORKER_FAILED,
+		WORKER_TIMEOUT,
+		WORKER_CRASHED,
+		WORKER_NOT_STARTED
+
+	} RESULT;
+
+	// first character of the line the child ends each answer with
+	static const char ANSWER = '\x01';
+
+// protected data
+protected:
+	// command line starting the child
+	CString m_csCommand;
+
+	// milliseconds to wait for the child to answer
+	DWORD m_dwTimeout;
+
+	// the child process
+	HANDLE m_hProcess;
+
+	// write end of the child's standard input
+	HANDLE m_hInput;
+
+	// read end of the pipe the child answers on (overlapped)
+	HANDLE m_hOutput;
+
+	// signaled when a read from the child completes
+	HANDLE m_hEvent;
+
+	// bytes read from the child that are not part of an answer yet
+	CStringA m_csReceived;
+
+	// buffer for the reads from the child
+	char m_szRead[ 4096 ];
+
+	// number of children started
+	ULONGLONG m_ullStarts;
+
+// public properties
+public:
+	// command line starting the child
+	inline CString GetCommand()
+	{
+		return m_csCommand;
+	}
+	// command line starting the child
+	inline void SetCommand( CString value )
+	{
+		m_csCommand = value;
+	}
+	// command line starting the child
+	__declspec( property( get = GetCommand, put = SetCommand ) )
+		CString Command;
+
+	// number of children started
+	inline ULONGLONG GetStarts()
+	{
+		return m_ullStarts;
+	}
+	// number of children started
+	__declspec( property( get = GetStarts ) )
+		ULONGLONG Starts;
+
+	// milliseconds to wait for the child to answer
+	inline DWORD GetTimeout()
+	{
+		return m_dwTimeout;
+	}
+	// milliseconds to wait for the child to answer
+	inline void SetTimeout( DWORD value )
+	{
+		m_dwTimeout = value;
+	}
+	// milliseconds to wait for the child to answer
+	__declspec( property( get = GetTimeout, put = SetTimeout ) )
+		DWORD Timeout;
+
+	// is a child running
+	inline bool GetIsRunning()
+	{
+		return m_hProcess != NULL;
+	}
+	// is a child running
+	__declspec( property( get = GetIsRunning ) )
+		bool IsRunning;
+
+// protected methods
+protected:
+	// start the child with its standard input and output redirected
+	bool Launch()
+	{
+		// children started by other threads at the same moment would
+		// inherit each other's pipes, which would keep a pipe open after
+		// its own child has gone
+		static mutex mutexLaunch;
+		lock_guard<mutex> lock( mutexLaunch );
+
+		static LONG lPipes = 0;
+		CString csPipe;
+		csPipe.Format
+		(
+			_T( "\\\\.\\pipe\\TrimImage-%u-%d" ), ::GetCurrentProcessId(),
+			::InterlockedIncrement( &lPipes )
+		);
+
+		m_hOutput = ::CreateNamedPipe
+		(
+			csPipe, PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED |
+			FILE_FLAG_FIRST_PIPE_INSTANCE, PIPE_TYPE_BYTE | PIPE_WAIT, 1, 0,
+			sizeof( m_szRead ), 0, NULL
+		);
+		if ( m_hOutput == INVALID_HANDLE_VALUE )
+		{
+			m_hOutput = NULL;
+			return false;
+		}
+
+		SECURITY_ATTRIBUTES sa = { sizeof( SECURITY_ATTRIBUTES ), NULL, TRUE };
+		HANDLE hChildOutput = ::CreateFile
+		(
+			csPipe, GENERIC_WRITE, 0, &sa, OPEN_EXISTING, 0, NULL
+		);
+		if ( hChildOutput == INVALID_HANDLE_VALUE )
+		{
+			Kill();
+			return false;
+		}
+
+		HANDLE hChildInput = NULL;
+		if ( !::CreatePipe( &hChildInput, &m_hInput, &sa, 0 ) )
+		{
+			::CloseHandle( hChildOutput );
+			m_hInput = NULL;
+			Kill();
+			return false;
+		}
+
+		// only the child's ends of the pipes are inherited
+		::SetHandleInformation( m_hInput, HANDLE_FLAG_INHERIT, 0 );
+
+		STARTUPINFO si = { sizeof( STARTUPINFO ) };
+		si.dwFlags = STARTF_USESTDHANDLES;
+		si.hStdInput = hChildInput;
+		si.hStdOutput = hChildOutput;
+		si.hStdError = hChildOutput;
+
+		PROCESS_INFORMATION pi = { 0 };
+		CString csCommand( m_csCommand );
+		const BOOL bOkay = ::CreateProcess
+		(
+			NULL, csCommand.GetBuffer(), NULL, NULL, TRUE,
+			CREATE_NO_WINDOW, NULL, NULL, &si, &pi
+		);
+		csCommand.ReleaseBuffer();
+
+		::CloseHandle( hChildInput );
+		::CloseHandle( hChildOutput );
+
+		if ( !bOkay )
+		{
+			Kill();
+			return false;
+		}
+
+		::CloseHandle( pi.hThread );
+		m_hProcess = pi.hProcess;
+		m_csReceived.Empty();
+		m_ullStarts++;
+		return true;
+	}
+
+	// remove the answer from the bytes received if it is complete
+	// returns true if an answer was found
+	bool GetAnswer( CString& csLog, RESULT& result )
+	{
+		int nLine = 0;
+		int nEnd = 0;
+		while ( ( nEnd = m_csReceived.Find( '\n', nLine ) ) != -1 )
+		{
+			if ( m_csReceived[ nLine ] == ANSWER )
+			{
+				const CStringA csResult =
+					m_csReceived.Mid( nLine + 1, nEnd - nLine - 1 ).Trim();
+				result = csResult == "OK" ? WORKER_OK : WORKER_FAILED;
+
+				csLog = CString( m_csReceived.Left( nLine ) );
+				csLog.Remove( _T( '\r' ) );
+				m_csReceived = m_csReceived.Mid( nEnd + 1 );
+				return true;
+			}
+			nLine = nEnd + 1;
+		}
+
+		return false;
+	}
+
+// public methods
+public:
+	// have the child process a file, starting a child if none is running
+	// and killing it if it hangs, the lines the child logged are returned
+	// in csLog
+	RESULT Process( const CString& csPath, CString& csLog )
+	{
+		csLog.Empty();
+		if ( m_hProcess == NULL && !Launch() )
+		{
+			return WORKER_NOT_STARTED;
+		}
+
+		// send the path as a line of UTF-8
+		const CStringA csLine = CStringA( CW2A( csPath, CP_UTF8 ) ) + "\n";
+		DWORD dwWritten = 0;
+		if
+		(
+			!::WriteFile
+			(
+				m_hInput, (LPCSTR)csLine, csLine.GetLength(), &dwWritten, NULL
+			)
+		)
+		{
+			Kill();
+			return WORKER_CRASHED;
+		}
+
+		const ULONGLONG ullDeadline = ::GetTickCount64() + m_dwTimeout;
+		RESULT result = WORKER_FAILED;
+		while ( !GetAnswer( csLog, result ) )
+		{
+			OVERLAPPED ov = { 0 };
+			ov.hEvent = m_hEvent;
+
+			DWORD dwRead = 0;
+			if ( !::ReadFile( m_hOutput, m_szRead, sizeof( m_szRead ), NULL, &ov ) )
+			{
+				if ( ::GetLastError() != ERROR_IO_PENDING )
+				{
+					// the child closed its end of the pipe
+					csLog = CString( m_csReceived );
+					Kill();
+					return WORKER_CRASHED;
+				}
+
+				const ULONGLONG ullNow = ::GetTickCount64();
+				const DWORD dwWait = ullNow < ullDeadline ?
+					DWORD( ullDeadline - ullNow ) : 0;
+
+				HANDLE arrWait[] = { m_hEvent, m_hProcess };
+				const DWORD dwObject = ::WaitForMultipleObjects
+				(
+					_countof( arrWait ), arrWait, FALSE, dwWait
+				);
+				if ( dwObject != WAIT_OBJECT_0 )
+				{
+					// the read must be finished with before the buffer
+					// can be used again
+					::CancelIoEx( m_hOutput, &ov );
+					::GetOverlappedResult( m_hOutput, &ov, &dwRead, TRUE );
+
+					csLog = CString( m_csReceived );
+					Kill();
+					return dwObject == WAIT_TIMEOUT ?
+						WORKER_TIMEOUT : WORKER_CRASHED;
+				}
+			}
+
+			if ( !::GetOverlappedResult( m_hOutput, &ov, &dwRead, FALSE ) )
+			{
+				csLog = CString( m_csReceived );
+				Kill();
+				return WORKER_CRASHED;
+			}
+
+			m_csReceived.Append( m_szRead, dwRead );
+		}
+
+		return result;
+	}
+
+	// kill the child and close the pipes
+	void Kill()
+	{
+		if ( m_hProcess != NULL )
+		{
+			::TerminateProcess( m_hProcess, 1 );
+			::WaitForSingleObject( m_hProcess, 5000 );
+			::CloseHandle( m_hProcess );
+			m_hProcess = NULL;
+		}
+		if ( m_hInput != NULL )
+		{
+			::CloseHandle( m_hInput );
+			m_hInput = NULL;
+		}
+		if ( m_hOutput != NULL )
+		{
+			::CloseHandle( m_hOutput );
+			m_hOutput = NULL;
+		}
+		m_csReceived.Empty();
+	}
+
+	// let the child finish and exit by closing its input, killing it if
+	// it does not exit in time
+	void Close()
+	{
+		if ( m_hInput != NULL )
+		{
+			::CloseHandle( m_hInput );
+			m_hInput = NULL;
+		}
+		if ( m_hProcess != NULL )
+		{
+			::WaitForSingleObject( m_hProcess, m_dwTimeout );
+		}
+		Kill();
+	}
+
+// public construction / destruction
+public:
+	// constructor
+	CWorkerProcess()
+	{
+		m_dwTimeout = 60000;
+		m_hProcess = NULL;
+		m_hInput = NULL;
+		m_hOutput = NULL;
+		m_hEvent = ::CreateEvent( NULL, TRUE, FALSE, NULL );
+		m_ullStarts = 0;
+	}
+	// destructor
+	virtual ~CWorkerProcess()
+	{
+		Close();
+		::CloseHandle( m_hEvent );
+	}
+};